@@ -21,6 +21,42 @@
 #define	FFX_PARALLELSORT_SORT_BIN_COUNT			(1 << FFX_PARALLELSORT_SORT_BITS_PER_PASS)
 #define FFX_PARALLELSORT_ELEMENTS_PER_THREAD	4
 #define FFX_PARALLELSORT_THREADGROUP_SIZE		128
+#define FFX_PARALLELSORT_FUSED_SCAN_MAX_THREADGROUPS	(2 * FFX_PARALLELSORT_ELEMENTS_PER_THREAD * FFX_PARALLELSORT_THREADGROUP_SIZE)
+#define FFX_PARALLELSORT_MAX_MERGE_RUNS			64	// Most sorted runs MergeRuns takes (every key binary searches each of them)
+
+// Selection state (one plane of NumSelectQueries uints each)
+#define FFX_PARALLELSORT_SELECT_STATE_PREFIX	0	// Digits of the K-th smallest key found so far (the selected key once all digits are done)
+#define FFX_PARALLELSORT_SELECT_STATE_REMAINING	1	// How many keys are still needed from the keys sharing that prefix
+#define FFX_PARALLELSORT_SELECT_STATE_NUM_LESS	2	// Compaction counter for keys below the threshold
+#define FFX_PARALLELSORT_SELECT_STATE_NUM_EQUAL	3	// Compaction counter for keys equal to the threshold
+#define FFX_PARALLELSORT_SELECT_STATE_PERCENTILE	4	// Percentile to select in [0, 1] as float bits (input, only read when NumSelectKeys is 0)
+#define FFX_PARALLELSORT_SELECT_STATE_SIZE		5
+#define FFX_PARALLELSORT_SELECT_FIRST_SHIFT		(32 - FFX_PARALLELSORT_SORT_BITS_PER_PASS)
+
+// Presort check state (one uint each)
+#define FFX_PARALLELSORT_PRESORT_STATE_INVERSIONS		0	// Out of order neighbours found by this sort's check (reset by setup)
+#define FFX_PARALLELSORT_PRESORT_STATE_LAST_INVERSIONS	1	// What the previous check found (read back for stats/debugging)
+#define FFX_PARALLELSORT_PRESORT_STATE_SIZE				2
+
+// GPU validation state (one uint each, checksums wrap around)
+#define FFX_PARALLELSORT_VALIDATE_STATE_INPUT_KEY_SUM		0	// Sum of the input key words
+#define FFX_PARALLELSORT_VALIDATE_STATE_INPUT_KEY_HASH		1	// Sum of the input key hashes
+#define FFX_PARALLELSORT_VALIDATE_STATE_INPUT_PAIR_HASH		2	// Sum of the input key/payload pair hashes
+#define FFX_PARALLELSORT_VALIDATE_STATE_OUTPUT_KEY_SUM		3	// Same for the sorted keys
+#define FFX_PARALLELSORT_VALIDATE_STATE_OUTPUT_KEY_HASH		4
+#define FFX_PARALLELSORT_VALIDATE_STATE_OUTPUT_PAIR_HASH	5
+#define FFX_PARALLELSORT_VALIDATE_STATE_INVERSIONS			6	// Out of order neighbours in the sorted keys
+#define FFX_PARALLELSORT_VALIDATE_STATE_FIRST_VIOLATION		7	// Lowest index of a key greater than the next one (0xFFFFFFFF when there is none)
+#define FFX_PARALLELSORT_VALIDATE_STATE_RESULT				8	// Start of the result record (the only part that needs reading back)
+#define FFX_PARALLELSORT_VALIDATE_RESULT_STATUS				0	// FFX_PARALLELSORT_VALIDATE_FAILED_* bits (0 for a valid sort)
+#define FFX_PARALLELSORT_VALIDATE_RESULT_INVERSIONS			1
+#define FFX_PARALLELSORT_VALIDATE_RESULT_FIRST_VIOLATION	2
+#define FFX_PARALLELSORT_VALIDATE_RESULT_COUNT				3	// How many sorts have been validated so far
+#define FFX_PARALLELSORT_VALIDATE_RESULT_SIZE				4
+#define FFX_PARALLELSORT_VALIDATE_STATE_SIZE				(FFX_PARALLELSORT_VALIDATE_STATE_RESULT + FFX_PARALLELSORT_VALIDATE_RESULT_SIZE)
+#define FFX_PARALLELSORT_VALIDATE_FAILED_ORDER				1	// Keys are not in ascending order
+#define FFX_PARALLELSORT_VALIDATE_FAILED_KEYS				2	// Sorted keys are not a permutation of the input keys
+#define FFX_PARALLELSORT_VALIDATE_FAILED_PAYLOAD			4	// Payloads didn't move along with their keys
 
 //////////////////////////////////////////////////////////////////////////
 // ParallelSort constant buffer parameters:
@@ -32,6 +68,137 @@
 //	NumThreadGroupsWithAdditionalBlocks	How many thread groups need to process additional block data
 //	NumReduceThreadgroupPerBin			How many thread groups are summed together for each reduced bin entry
 //	NumScanValues						How many values to perform scan prefix (+ add) on
+//	NumKeyWords							How many 32-bit words make up a key (only read with kRS_MultiWordKeys)
+//	NumSelectKeys						How many of the smallest keys a top-K selection keeps (only read by the select kernels)
+//	NumSelectQueries					How many selections run side by side (only read by the select kernels)
+//	NumDirtyKeys						How many keys changed since the previous sort (only read by the incremental re-sort kernels)
+//	NumMergeRuns						How many sorted runs MergeRuns merges (only read by MergeRuns)
+//	KeyStride							How many 32-bit words apart the keys are in the buffer the first pass reads (only read with kRS_StridedKeys)
+//	KeyOffset							Which 32-bit word of each record the key is (only read with kRS_StridedKeys)
+//
+// Multi-word keys (kRS_MultiWordKeys) are stored as NumKeyWords planes of NumKeys 32-bit words each, least significant
+// word first (i.e. word w of key i lives at [w * NumKeys + i]). Sort passes keep going past 32 bits, shift 32 * w + b
+// sorts bit b of word w, and every pass moves all the words of a key so LSD ordering carries over from word to word.
+//
+// Top-K selection finds the NumSelectKeys-th smallest key one digit at a time, most significant digit first. Each step runs
+// Count (with kRS_SelectPrefix, so only keys matching the digits found so far are counted) and ReduceCount, then SelectDigit
+// walks the reduced histogram to pick the next digit. SelectCompact then writes out the keys below that threshold, and as
+// many keys equal to it as are needed, so only NumSelectKeys keys go through a full sort. Single-word keys only, and when
+// several keys tie at the threshold which of them make the cut (and so which payloads come along) is not deterministic.
+//
+// The same digit refinement answers order statistic queries without sorting anything. With NumSelectKeys set to K and a
+// single query, the prefix plane ends up holding the K-th smallest key. With NumSelectKeys set to 0, each of the
+// NumSelectQueries queries instead picks the key at its own percentile (read from the percentile plane, rank
+// floor(p * (NumKeys - 1)), so 0.5 is the median). Queries are batched in the Y dimension of the Count, ReduceCount and
+// SelectDigit dispatches, each with its own slice of the scratch tables (see FFX_ParallelSort_CalculateSelectScratchResourceSize).
+// Once the last digit is done the selected keys sit next to each other at the start of the state buffer, ready to be bound
+// as an SRV or copied out without a CPU round trip.
+//
+// Indirect sorts can skip all the work for input that is already in order. CountInversions is a single read pass that
+// counts neighbouring keys that are out of order (one atomic per thread group), and SetupIndirectParams built with
+// kRS_PresortCheck turns every count/reduce/scatter dispatch into an empty one when it found none. Empty scatters leave
+// the keys and payloads where they are, so the sort has to run an even number of passes to end up back in the buffer it
+// started from and have the result in the same place either way. Key widths that take an odd number of passes need one
+// more pass over bits that are all 0 (the sort is stable, so it only moves the keys back). Data that barely changes from
+// frame to frame (e.g. particles) can stay on this path by reordering this frame's keys with last frame's sorted payload
+// indices before sorting.
+//
+// When only a few keys change between sorts, the previous sorted order can be patched instead of sorted again. The changed
+// entries are given as NumDirtyKeys positions in the previous order (unique and ascending, e.g. from an in-order compaction
+// of a dirty flag; run them through a keys-only sort first otherwise) along with their new keys. GatherDirtyPayload pulls
+// their payloads out of the previous order, the dirty keys and payloads go through a regular sort of NumDirtyKeys keys, and
+// Merge writes the untouched entries and the sorted dirty ones into a second buffer pair in a single pass. Merge is
+// partitioned merge path style: each thread group takes a block of either sequence, finds the window of the other sequence
+// its keys land in with one binary search per block boundary, and every key then only searches that (usually tiny) window
+// for its output slot. Ties keep the untouched entries first. Single-word keys only.
+//
+// Data sets too big for the GPU can be sorted out of core. The host streams chunks that fit through the regular sort (each
+// comes back as a sorted run), then produces the merged order one output window at a time. FFX_ParallelSort_SplitSortedRuns
+// finds where every run splits at a window's edges, the slices of all runs that make up the window are uploaded back to back,
+// and MergeRuns merges them in a single pass: every key adds up its rank in its own run and its lower (upper for earlier
+// runs) bound in each other run, so ties go to the earlier run and the merge is stable. Each key does NumMergeRuns binary
+// searches, so the work grows with the number of runs: a single pass is cheaper than a tree of 2-way merges for the few
+// dozen runs a chunked sort produces, and MergeRuns is limited to FFX_PARALLELSORT_MAX_MERGE_RUNS of them. Sorts with
+// more runs merge groups of at most that many runs into longer runs, and repeat until one is left. Single-word keys only.
+//
+// Sorts can be validated on the GPU without reading the keys back. Validate runs over the keys (and payloads with
+// kRS_ValueCopy) before the sort and again after it, adding up order independent checksums of the key words, the keys and
+// the key/payload pairs, and after the sort also counting out of order neighbours (including the ones across tile
+// boundaries) and keeping the lowest index of one. ValidateResult then compares the two sets of checksums, writes a small
+// result record (status bits, inversion count, first violation and a running count of validated sorts) and clears the
+// accumulators for the next sort. Copying the record into a ring of read-back buffers lets the host check it once the frame
+// that copied it has finished, without stalling. Start the state out with FFX_ParallelSort_InitValidateState.
+//
+// Payloads bigger than a uint are better off not going through every pass. With a deferred payload gather the passes
+// carry each key's 32-bit source index instead: the first Scatter is built with kRS_ValueCopy and kRS_IndexPayload (so
+// it makes up the indices rather than reading a payload buffer), the rest with kRS_ValueCopy. GatherPayload then moves
+// the payload records (RecordStride uints each) into sorted order in one pass, from a buffer that is not the one they
+// end up in. Run it with the sort's constants and NumThreadGroups thread groups (the count/scatter dispatch).
+//
+// Keys can be made up on the fly and written out in whatever form the consumer wants, without a dispatch on either side
+// of the sort. With kRS_LoadKeyHook, Count and Scatter get their keys from uint FFX_ParallelSort_LoadKey(uint Index),
+// and with kRS_StoreKeyHook, Scatter hands the sorted keys to void FFX_ParallelSort_StoreKey(uint Index, uint Key). Both
+// are declared here and defined by the includer, and only ever see indices below NumKeys. Build the first pass' Count
+// and Scatter with the load hook and the last pass' Scatter with the store hook, the passes in between keep using the sort
+// buffers. Single-word keys only.
+//
+// Keys that are a field of bigger records (e.g. the depth in a 32 byte particle) can be sorted without pulling them out
+// into a key buffer first. With kRS_StridedKeys, Count and Scatter read key i from SrcBuffer[i * KeyStride + KeyOffset]
+// (see FFX_ParallelSort_SetKeyLayout), so bind the records as SrcBuffer for the first pass' Count and Scatter. That Scatter
+// writes the keys out packed, and the other passes sort them as usual. Records have to be readable as a uint buffer (byte
+// stride and offset a multiple of 4). Single-word keys only.
+//
+// Count and Scatter only ever read the keys and payload they sort. With kRS_ReadOnlyInput they take SrcBuffer (and
+// SrcPayload) as a ByteAddressBuffer, so the source can be bound read-only (an SRV, or a readonly storage buffer) and go
+// through the read-only caches. Count then loads 4 neighbouring keys per thread in one 128-bit load, as the histogram
+// doesn't care what order keys are counted in. Scatter keeps loading a key per thread and element, as it ranks keys in
+// strided order and has to keep equal keys in that order for the sort to be stable. Not with kRS_LoadKeyHook.
+//
+// Keys narrower than 32 bits only need a pass per 4 bits they have, so run the passes with ShiftBit from 0 up to the key
+// width (e.g. 4 passes for 16-bit keys, 6 for 24-bit ones). Bits above the key width have to be 0. On top of that, 16-bit
+// keys can be stored as 16-bit values: with kRS_16BitKeys, Count, Scatter and Validate take the key buffers as
+// RWStructuredBuffer<uint16_t> (bound separately from the uint ones), halving the key traffic of every pass. This needs 16-bit types in the shader (shader
+// model 6.2 and -enable-16bit-types, 16-bit storage buffer access on Vulkan). 24-bit keys can't be packed the same way,
+// as Scatter would have to write 3 byte keys from different threads into the same dwords, so they stay in uint buffers.
+// Payloads stay 32-bit. Single-word keys read from the key buffers only (not with kRS_StridedKeys or kRS_ReadOnlyInput).
+//
+// When all that's wanted from the payload is where each key came from (e.g. binning by a small tile key), the key and its
+// source index fit in a single uint as long as the key is narrow enough (see FFX_ParallelSort_CanPackKeyIndex). PackKeyIndex
+// puts each key above its IndexBits bit index, the passes then run keys only (no kRS_ValueCopy) with ShiftBit going from
+// IndexBits up to IndexBits plus the key width, and UnpackKeyIndex splits the sorted words back up into the keys and the
+// sorted order's source indices. The indices start out ascending and the sort is stable, so their bits never need a pass,
+// and every pass moves a single uint per key, without the payload's trip through LDS. Single-word keys only.
+//
+// The thread group reduce and scan-prefix find out how many waves make up a thread group at run time, and the scan-prefix
+// prefixes the wave totals in LDS behind a second barrier. Built with kRS_WaveSize set to 32 or 64, every kernel assumes
+// that wave size instead: the 4 (or 2) wave totals become a constant, unrolled handful of LDS reads, and the scan-prefix
+// (run twice per element by every Scatter) gets by with a single barrier. Thread groups stay 128 threads, as the block
+// layout, the scratch sizes and the dispatch math all build on that. Only run these on hardware that is guaranteed to run
+// them at that wave size, in full waves: where the wave size can vary, pin it (e.g. [WaveSize(N)] on shader model 6.6, or
+// a required subgroup size plus full subgroups with VK_EXT_subgroup_size_control), otherwise use the unspecialized kernels.
+//
+// Scatter ranks and writes a block a row (thread group size keys) at a time, so every row pays for its own local sort and
+// only writes short runs per bin. With kRS_TileScatter it ranks all the block's keys together instead: the rows are moved
+// to a blocked layout in LDS (each thread holding neighbouring keys), both 2-bit splits run over the whole tile with a
+// single scan each, and the last split leaves the sorted tile in rows again, so each bin's keys go out in one run of
+// neighbouring writes. That takes about a quarter of the barriers, for 2KB more LDS.
+//
+// Count gives every thread its own column of LDS counters (8KB) and bumps them with LDS atomics. With kRS_RegisterCount
+// each thread counts its keys in registers instead, as 16 8-bit counters packed into 4 uints, and the counters are summed
+// up across each wave with wave ops (even and odd bytes as separate 16-bit fields, so the sums can't carry) into a small
+// per wave histogram. They get flushed every 63 blocks, before any of them can overflow. That leaves no LDS atomics and
+// 512 bytes of LDS. Needs waves of at least 16 lanes (as the rest of the sort already does).
+//
+// Scatter's local sort runs 2-bit splits through LDS, each with a thread group scan-prefix and a key exchange, for every
+// row. With kRS_MatchScatter it skips the local sort: each lane finds the lanes of its wave holding the same digit, and its
+// rank among them is its place among the wave's keys of that digit. The first lane of each digit stores the wave's count
+// in LDS, and after a single barrier each key adds in the counts of the waves before its own and goes straight out to its
+// sorted position (with its payload, which never leaves the thread). Two barriers per row. The match is WaveMatch and
+// WaveMultiPrefixCountBits with kRS_WaveMatch (shader model 6.5), or one ballot per digit bit otherwise (wherever WaveMatch
+// isn't available). Not with kRS_TileScatter.
+//
+// With kRS_ValueCopy, Scatter's local sort moves each key and its value through LDS together as a uint2, so a payload
+// sort takes as many barriers as a keys-only one (for 1KB more LDS, 4KB with kRS_TileScatter).
 //////////////////////////////////////////////////////////////////////////
 
 #ifdef FFX_CPP
@@ -43,6 +210,13 @@
 		uint32_t NumThreadGroupsWithAdditionalBlocks;
 		uint32_t NumReduceThreadgroupPerBin;
 		uint32_t NumScanValues;
+		uint32_t NumKeyWords;
+		uint32_t NumSelectKeys;
+		uint32_t NumSelectQueries;
+		uint32_t NumDirtyKeys;
+		uint32_t NumMergeRuns;
+		uint32_t KeyStride;
+		uint32_t KeyOffset;
 	};
 
 	void FFX_ParallelSort_CalculateScratchResourceSize(uint32_t MaxNumKeys, uint32_t& ScratchBufferSize, uint32_t& ReduceScratchBufferSize)
@@ -55,9 +229,16 @@
 		ReduceScratchBufferSize = FFX_PARALLELSORT_SORT_BIN_COUNT * NumReducedBlocks * sizeof(uint32_t);
 	}
 
-	void FFX_ParallelSort_SetConstantAndDispatchData(uint32_t NumKeys, uint32_t MaxThreadGroups, FFX_ParallelSortCB& ConstantBuffer, uint32_t& NumThreadGroupsToRun, uint32_t& NumReducedThreadGroupsToRun)
+	void FFX_ParallelSort_SetConstantAndDispatchData(uint32_t NumKeys, uint32_t MaxThreadGroups, FFX_ParallelSortCB& ConstantBuffer, uint32_t& NumThreadGroupsToRun, uint32_t& NumReducedThreadGroupsToRun, uint32_t NumKeyWords = 1)
 	{
 		ConstantBuffer.NumKeys = NumKeys;
+		ConstantBuffer.NumKeyWords = NumKeyWords;
+		ConstantBuffer.NumSelectKeys = 0;
+		ConstantBuffer.NumSelectQueries = 1;
+		ConstantBuffer.NumDirtyKeys = 0;
+		ConstantBuffer.NumMergeRuns = 0;
+		ConstantBuffer.KeyStride = 1;
+		ConstantBuffer.KeyOffset = 0;
 
 		uint32_t BlockSize = FFX_PARALLELSORT_ELEMENTS_PER_THREAD * FFX_PARALLELSORT_THREADGROUP_SIZE;
 		uint32_t NumBlocks = (NumKeys + BlockSize - 1) / BlockSize;
@@ -83,6 +264,192 @@
 		ConstantBuffer.NumScanValues = NumReducedThreadGroupsToRun;	// The number of reduce thread groups becomes our scan count (as each thread group writes out 1 value that needs scan prefix)
 	}
 
+	// Has the first pass (built with kRS_StridedKeys) read the keys out of records KeyStrideInBytes apart, KeyOffsetInBytes into each
+	void FFX_ParallelSort_SetKeyLayout(FFX_ParallelSortCB& ConstantBuffer, uint32_t KeyStrideInBytes, uint32_t KeyOffsetInBytes)
+	{
+		ConstantBuffer.KeyStride = KeyStrideInBytes / sizeof(uint32_t);
+		ConstantBuffer.KeyOffset = KeyOffsetInBytes / sizeof(uint32_t);
+	}
+
+	// A single thread group can only scan BlockSize values. When the reduced table is bigger than that, it gets scanned through
+	// a second level: each block of the reduced table is reduced to one partial sum, the partial sums are scanned, and then each
+	// block is scanned with its partial sum added in. NumScanValues never exceeds 16 * ceil(2^23 / BlockSize) = 2^18 for 32-bit
+	// key counts, so one extra level is always enough to get back down to a single block.
+	uint32_t FFX_ParallelSort_NumScanBlocks(uint32_t NumScanValues)
+	{
+		uint32_t BlockSize = FFX_PARALLELSORT_ELEMENTS_PER_THREAD * FFX_PARALLELSORT_THREADGROUP_SIZE;
+		return (NumScanValues + BlockSize - 1) / BlockSize;
+	}
+
+	// Whether sorting NumKeys keys needs the second scan level (for indirect execution, pass the largest key count that can be sorted)
+	bool FFX_ParallelSort_RequiresScanHierarchy(uint32_t NumKeys, uint32_t MaxThreadGroups)
+	{
+		FFX_ParallelSortCB ConstantBuffer;
+		uint32_t NumThreadGroupsToRun, NumReducedThreadGroupsToRun;
+		FFX_ParallelSort_SetConstantAndDispatchData(NumKeys, MaxThreadGroups, ConstantBuffer, NumThreadGroupsToRun, NumReducedThreadGroupsToRun);
+		return FFX_ParallelSort_NumScanBlocks(ConstantBuffer.NumScanValues) > 1;
+	}
+
+	// Whether the reduce, scan and scan add of a pass can be done by a single ReduceScanAdd thread group instead. It walks the whole
+	// sum table one block at a time, so it is only worth it while the table is a few blocks long (up to 2 reduce thread groups per bin).
+	// Pass the thread group count the passes run with (for indirect execution, the max thread group count, which it never exceeds).
+	bool FFX_ParallelSort_UseFusedScan(uint32_t NumThreadGroups)
+	{
+		return NumThreadGroups <= FFX_PARALLELSORT_FUSED_SCAN_MAX_THREADGROUPS;
+	}
+
+	// How many bits the source indices of NumKeys keys take in a packed key+index sort (for indirect execution, pass the largest key count)
+	uint32_t FFX_ParallelSort_PackedIndexBits(uint32_t NumKeys)
+	{
+		uint32_t IndexBits = 0;
+		while (NumKeys > 1 && (NumKeys - 1) >> IndexBits)
+			IndexBits++;
+		return IndexBits;
+	}
+
+	// Whether KeyBits bit keys and the source indices of NumKeys keys fit in a uint together
+	bool FFX_ParallelSort_CanPackKeyIndex(uint32_t KeyBits, uint32_t NumKeys)
+	{
+		return KeyBits + FFX_ParallelSort_PackedIndexBits(NumKeys) <= 32;
+	}
+
+	// Size of the buffer holding the second scan level (one partial sum per block of the reduced table)
+	void FFX_ParallelSort_CalculateScanBlockResourceSize(uint32_t MaxNumKeys, uint32_t& ScanBlockBufferSize)
+	{
+		uint32_t ScratchBufferSize, ReduceScratchBufferSize;
+		FFX_ParallelSort_CalculateScratchResourceSize(MaxNumKeys, ScratchBufferSize, ReduceScratchBufferSize);
+		ScanBlockBufferSize = FFX_ParallelSort_NumScanBlocks(ReduceScratchBufferSize / sizeof(uint32_t)) * sizeof(uint32_t);
+	}
+
+	// Sizes of the scratch buffers for NumSelectQueries selections over up to MaxNumKeys keys (every query gets its own sum
+	// and reduce table). The sort's own scratch buffers are big enough for a single query.
+	void FFX_ParallelSort_CalculateSelectScratchResourceSize(uint32_t MaxNumKeys, uint32_t MaxThreadGroups, uint32_t NumSelectQueries, uint32_t& ScratchBufferSize, uint32_t& ReduceScratchBufferSize)
+	{
+		FFX_ParallelSortCB ConstantBuffer;
+		uint32_t NumThreadGroupsToRun, NumReducedThreadGroupsToRun;
+		FFX_ParallelSort_SetConstantAndDispatchData(MaxNumKeys, MaxThreadGroups, ConstantBuffer, NumThreadGroupsToRun, NumReducedThreadGroupsToRun);
+
+		ScratchBufferSize = FFX_PARALLELSORT_SORT_BIN_COUNT * NumThreadGroupsToRun * NumSelectQueries * sizeof(uint32_t);
+		ReduceScratchBufferSize = NumReducedThreadGroupsToRun * NumSelectQueries * sizeof(uint32_t);
+	}
+
+	// Constants and dispatch sizes for merging NumDirtyKeys sorted dirty keys into the previous order of NumKeys keys. GatherDirtyPayload
+	// runs NumGatherThreadGroupsToRun thread groups, Merge runs NumMergeThreadGroupsToRun (previous order blocks first, then dirty blocks).
+	void FFX_ParallelSort_SetMergeConstantAndDispatchData(uint32_t NumKeys, uint32_t NumDirtyKeys, FFX_ParallelSortCB& ConstantBuffer, uint32_t& NumGatherThreadGroupsToRun, uint32_t& NumMergeThreadGroupsToRun)
+	{
+		uint32_t BlockSize = FFX_PARALLELSORT_ELEMENTS_PER_THREAD * FFX_PARALLELSORT_THREADGROUP_SIZE;
+
+		ConstantBuffer = {};
+		ConstantBuffer.NumKeys = NumKeys;
+		ConstantBuffer.NumKeyWords = 1;
+		ConstantBuffer.NumSelectQueries = 1;
+		ConstantBuffer.NumDirtyKeys = NumDirtyKeys;
+		ConstantBuffer.NumThreadGroups = (NumKeys + BlockSize - 1) / BlockSize;
+
+		NumGatherThreadGroupsToRun = (NumDirtyKeys + FFX_PARALLELSORT_THREADGROUP_SIZE - 1) / FFX_PARALLELSORT_THREADGROUP_SIZE;
+		NumMergeThreadGroupsToRun = ConstantBuffer.NumThreadGroups + (NumDirtyKeys + BlockSize - 1) / BlockSize;
+	}
+
+	// Constants and dispatch size for merging NumMergeRuns sorted runs (NumKeys keys in all, stored back to back) with MergeRuns.
+	// Returns false (and leaves the outputs alone) when NumMergeRuns is 0 or more than FFX_PARALLELSORT_MAX_MERGE_RUNS
+	bool FFX_ParallelSort_SetMergeRunsConstantAndDispatchData(uint32_t NumKeys, uint32_t NumMergeRuns, FFX_ParallelSortCB& ConstantBuffer, uint32_t& NumThreadGroupsToRun)
+	{
+		if (!NumMergeRuns || NumMergeRuns > FFX_PARALLELSORT_MAX_MERGE_RUNS)
+			return false;
+
+		uint32_t BlockSize = FFX_PARALLELSORT_ELEMENTS_PER_THREAD * FFX_PARALLELSORT_THREADGROUP_SIZE;
+
+		ConstantBuffer = {};
+		ConstantBuffer.NumKeys = NumKeys;
+		ConstantBuffer.NumKeyWords = 1;
+		ConstantBuffer.NumSelectQueries = 1;
+		ConstantBuffer.NumMergeRuns = NumMergeRuns;
+
+		NumThreadGroupsToRun = (NumKeys + BlockSize - 1) / BlockSize;
+		return true;
+	}
+
+	// Number of keys in [0, Length) of a sorted run that are below (LowerBound) or not above (UpperBound) Value
+	uint32_t FFX_ParallelSort_RunLowerBound(const uint32_t* pRun, uint32_t Length, uint32_t Value)
+	{
+		uint32_t First = 0;
+		while (First < Length)
+		{
+			uint32_t Middle = First + (Length - First) / 2;
+			if (pRun[Middle] < Value)
+				First = Middle + 1;
+			else
+				Length = Middle;
+		}
+		return First;
+	}
+
+	uint32_t FFX_ParallelSort_RunUpperBound(const uint32_t* pRun, uint32_t Length, uint32_t Value)
+	{
+		uint32_t First = 0;
+		while (First < Length)
+		{
+			uint32_t Middle = First + (Length - First) / 2;
+			if (pRun[Middle] <= Value)
+				First = Middle + 1;
+			else
+				Length = Middle;
+		}
+		return First;
+	}
+
+	// Splits NumRuns sorted runs so that the first OutputOffset keys of their merged order are [0, pSplits[r]) of every run r.
+	// Keys equal to the one the split lands on go to the earlier runs first, matching MergeRuns.
+	void FFX_ParallelSort_SplitSortedRuns(const uint32_t* const* ppRuns, const uint32_t* pRunLengths, uint32_t NumRuns, uint64_t OutputOffset, uint32_t* pSplits)
+	{
+		// Find the smallest key that has more than OutputOffset keys at or below it (the key the split lands on)
+		uint64_t Low = 0, High = 0x100000000ull;
+		while (Low < High)
+		{
+			uint64_t Middle = (Low + High) / 2;
+			uint64_t NumAtOrBelow = 0;
+			for (uint32_t Run = 0; Run < NumRuns; Run++)
+				NumAtOrBelow += FFX_ParallelSort_RunUpperBound(ppRuns[Run], pRunLengths[Run], (uint32_t)Middle);
+
+			if (NumAtOrBelow > OutputOffset)
+				High = Middle;
+			else
+				Low = Middle + 1;
+		}
+
+		// Past the end of the merged order
+		if (Low > 0xFFFFFFFFull)
+		{
+			for (uint32_t Run = 0; Run < NumRuns; Run++)
+				pSplits[Run] = pRunLengths[Run];
+			return;
+		}
+
+		// Every run gives up its keys below the split key, what is left comes out of the keys equal to it in run order
+		uint32_t SplitKey = (uint32_t)Low;
+		uint64_t NumRemaining = OutputOffset;
+		for (uint32_t Run = 0; Run < NumRuns; Run++)
+		{
+			pSplits[Run] = FFX_ParallelSort_RunLowerBound(ppRuns[Run], pRunLengths[Run], SplitKey);
+			NumRemaining -= pSplits[Run];
+		}
+		for (uint32_t Run = 0; Run < NumRuns && NumRemaining; Run++)
+		{
+			uint64_t NumEqual = FFX_ParallelSort_RunUpperBound(ppRuns[Run], pRunLengths[Run], SplitKey) - pSplits[Run];
+			uint64_t NumTaken = NumEqual < NumRemaining ? NumEqual : NumRemaining;
+			pSplits[Run] += (uint32_t)NumTaken;
+			NumRemaining -= NumTaken;
+		}
+	}
+
+	// Initial contents of the GPU validation state buffer (FFX_PARALLELSORT_VALIDATE_STATE_SIZE entries)
+	void FFX_ParallelSort_InitValidateState(uint32_t* pValidateState)
+	{
+		for (uint32_t i = 0; i < FFX_PARALLELSORT_VALIDATE_STATE_SIZE; i++)
+			pValidateState[i] = 0;
+		pValidateState[FFX_PARALLELSORT_VALIDATE_STATE_FIRST_VIOLATION] = 0xFFFFFFFF;
+	}
+
 	// We are using some optimizations to hide buffer load latency, so make sure anyone changing this define is made aware of that fact.
 	static_assert(FFX_PARALLELSORT_ELEMENTS_PER_THREAD == 4, "FFX_ParallelSort Shaders currently explicitly rely on FFX_PARALLELSORT_ELEMENTS_PER_THREAD being set to 4 in order to optimize buffer loads. Please adjust the optimization to factor in the new define value.");
 #elif defined(FFX_HLSL)
@@ -95,14 +462,172 @@
 		uint NumThreadGroupsWithAdditionalBlocks;
 		uint NumReduceThreadgroupPerBin;
 		uint NumScanValues;
+		uint NumKeyWords;
+		uint NumSelectKeys;
+		uint NumSelectQueries;
+		uint NumDirtyKeys;
+		uint NumMergeRuns;
+		uint KeyStride;
+		uint KeyOffset;
 	};
 
+	// Picks the plane holding the word this pass' digit is in and makes ShiftBit relative to that word
+	uint FFX_ParallelSort_KeyPlaneOffset(FFX_ParallelSortCB CBuffer, inout uint ShiftBit)
+	{
+#ifdef kRS_MultiWordKeys
+		uint KeyWord = ShiftBit / 32;
+		ShiftBit %= 32;
+		return KeyWord * CBuffer.NumKeys;
+#else
+		return 0;
+#endif // kRS_MultiWordKeys
+	}
+
+#if defined(kRS_MultiWordKeys) && (defined(kRS_LoadKeyHook) || defined(kRS_StoreKeyHook))
+#error Key hooks only support single-word keys
+#endif
+#if defined(kRS_StridedKeys) && (defined(kRS_MultiWordKeys) || defined(kRS_LoadKeyHook))
+#error Strided keys only support single-word keys loaded from SrcBuffer
+#endif
+#if defined(kRS_ReadOnlyInput) && defined(kRS_LoadKeyHook)
+#error Read-only input is for keys loaded from SrcBuffer
+#endif
+#if defined(kRS_16BitKeys) && (defined(kRS_MultiWordKeys) || defined(kRS_StridedKeys) || defined(kRS_ReadOnlyInput))
+#error 16-bit keys only support single-word keys read from a packed key buffer
+#endif
+#if defined(kRS_TileScatter) && defined(kRS_MatchScatter)
+#error Scatter ranks either a whole tile or a row of wave matches at a time
+#endif
+#if defined(kRS_WaveSize) && kRS_WaveSize != 32 && kRS_WaveSize != 64
+#error Kernels can only be specialized for 32 or 64 lane waves
+#endif
+
+	// What Count and Scatter read the keys and payload out of
+#ifdef kRS_ReadOnlyInput
+	#define FFX_PARALLELSORT_INPUT_BUFFER	ByteAddressBuffer
+#else
+	#define FFX_PARALLELSORT_INPUT_BUFFER	RWStructuredBuffer<uint>
+#endif // kRS_ReadOnlyInput
+
+	uint FFX_ParallelSort_LoadInput(FFX_PARALLELSORT_INPUT_BUFFER InputBuffer, uint Index)
+	{
+#ifdef kRS_ReadOnlyInput
+		return InputBuffer.Load(Index * 4);
+#else
+		return InputBuffer[Index];
+#endif // kRS_ReadOnlyInput
+	}
+
+	// What Count and Scatter read and write the keys through (the payload always goes through uints)
+#ifdef kRS_16BitKeys
+	#define FFX_PARALLELSORT_KEY_TYPE			uint16_t
+	#define FFX_PARALLELSORT_KEY_INPUT_BUFFER	RWStructuredBuffer<uint16_t>
+
+	uint FFX_ParallelSort_LoadInput(RWStructuredBuffer<uint16_t> InputBuffer, uint Index)
+	{
+		return InputBuffer[Index];
+	}
+#else
+	#define FFX_PARALLELSORT_KEY_TYPE			uint
+	#define FFX_PARALLELSORT_KEY_INPUT_BUFFER	FFX_PARALLELSORT_INPUT_BUFFER
+#endif // kRS_16BitKeys
+
+	// Key hooks (defined by the includer)
+#ifdef kRS_LoadKeyHook
+	uint FFX_ParallelSort_LoadKey(uint Index);
+#endif // kRS_LoadKeyHook
+#ifdef kRS_StoreKeyHook
+	void FFX_ParallelSort_StoreKey(uint Index, uint Key);
+#endif // kRS_StoreKeyHook
+
+	// Where Count and Scatter get their keys from (the includer's load hook, a field of the source records, or the source buffer)
+	uint FFX_ParallelSort_LoadSourceKey(FFX_ParallelSortCB CBuffer, FFX_PARALLELSORT_KEY_INPUT_BUFFER SrcBuffer, uint KeyIndex)
+	{
+#ifdef kRS_LoadKeyHook
+		uint Key = 0;
+		if (KeyIndex < CBuffer.NumKeys)
+			Key = FFX_ParallelSort_LoadKey(KeyIndex);
+		return Key;
+#elif defined(kRS_StridedKeys)
+		return FFX_ParallelSort_LoadInput(SrcBuffer, KeyIndex * CBuffer.KeyStride + CBuffer.KeyOffset);
+#else
+		return FFX_ParallelSort_LoadInput(SrcBuffer, KeyIndex);
+#endif // kRS_LoadKeyHook
+	}
+
+	// Lanes per wave and waves per thread group (constants for kernels built for a known wave size, looked up at run time otherwise).
+	// Everything that splits a thread group into waves goes through these, so all of a kernel's waves agree on where they start
+#ifdef kRS_WaveSize
+	#define FFX_PARALLELSORT_WAVE_SIZE	kRS_WaveSize
+#else
+	#define FFX_PARALLELSORT_WAVE_SIZE	WaveGetLaneCount()
+#endif // kRS_WaveSize
+	#define FFX_PARALLELSORT_NUM_WAVES	(FFX_PARALLELSORT_THREADGROUP_SIZE / FFX_PARALLELSORT_WAVE_SIZE)
+
+#ifdef kRS_RegisterCount
+	// 8-bit counters can count up to 255 keys, so they get flushed every this many blocks
+	#define FFX_PARALLELSORT_REGISTER_COUNT_BLOCKS	(255 / FFX_PARALLELSORT_ELEMENTS_PER_THREAD)
+
+	// Digit counts of each wave (waves have at least 16 lanes, so a thread group has at most 8 of them)
+	groupshared uint gs_FFX_PARALLELSORT_WaveHistogram[FFX_PARALLELSORT_SORT_BIN_COUNT * (FFX_PARALLELSORT_THREADGROUP_SIZE / 16)];
+
+	// Adds a thread's packed digit counts (digit d in byte d % 4 of Counts[d / 4]) up across its wave, into the wave's histogram
+	void FFX_ParallelSort_FlushRegisterCounts(uint localID, uint4 Counts)
+	{
+		uint waveID = localID / FFX_PARALLELSORT_WAVE_SIZE;
+
+		[unroll]
+		for (uint i = 0; i < 4; i++)
+		{
+			// Sum the even and odd bytes as 16-bit fields, so no digit's sum can carry into the next one
+			uint evenSums = WaveActiveSum(Counts[i] & 0x00ff00ff);
+			uint oddSums = WaveActiveSum((Counts[i] >> 8) & 0x00ff00ff);
+			if (WaveIsFirstLane())
+			{
+				uint BinOffset = waveID * FFX_PARALLELSORT_SORT_BIN_COUNT + i * 4;
+				gs_FFX_PARALLELSORT_WaveHistogram[BinOffset] += evenSums & 0xffff;
+				gs_FFX_PARALLELSORT_WaveHistogram[BinOffset + 1] += oddSums & 0xffff;
+				gs_FFX_PARALLELSORT_WaveHistogram[BinOffset + 2] += evenSums >> 16;
+				gs_FFX_PARALLELSORT_WaveHistogram[BinOffset + 3] += oddSums >> 16;
+			}
+		}
+	}
+#else
 	groupshared uint gs_FFX_PARALLELSORT_Histogram[FFX_PARALLELSORT_THREADGROUP_SIZE * FFX_PARALLELSORT_SORT_BIN_COUNT];
-	void FFX_ParallelSort_Count_uint(uint localID, uint groupID, FFX_ParallelSortCB CBuffer, uint ShiftBit, RWStructuredBuffer<uint> SrcBuffer, RWStructuredBuffer<uint> SumTable)
+#endif // kRS_RegisterCount
+
+	// Top-K selection only counts keys that share the threshold digits picked so far (everything is a candidate for the first digit)
+	bool FFX_ParallelSort_SelectIsCandidate(uint Key, uint SelectPrefix, uint ShiftBit)
 	{
+		return ShiftBit >= FFX_PARALLELSORT_SELECT_FIRST_SHIFT || !((Key ^ SelectPrefix) >> (ShiftBit + FFX_PARALLELSORT_SORT_BITS_PER_PASS));
+	}
+
+	uint FFX_ParallelSort_SelectStateIndex(FFX_ParallelSortCB CBuffer, uint Field, uint SelectQuery)
+	{
+		return Field * CBuffer.NumSelectQueries + SelectQuery;
+	}
+
+	void FFX_ParallelSort_Count_uint(uint localID, uint groupID, FFX_ParallelSortCB CBuffer, uint ShiftBit, FFX_PARALLELSORT_KEY_INPUT_BUFFER SrcBuffer, RWStructuredBuffer<uint> SumTable
+#ifdef kRS_SelectPrefix
+									 ,RWStructuredBuffer<uint> SelectState, uint SelectQuery
+#endif // kRS_SelectPrefix
+	)
+	{
+		uint KeyPlaneOffset = FFX_ParallelSort_KeyPlaneOffset(CBuffer, ShiftBit);
+		uint SumTableOffset = 0;
+#ifdef kRS_SelectPrefix
+		uint SelectPrefix = SelectState[FFX_ParallelSort_SelectStateIndex(CBuffer, FFX_PARALLELSORT_SELECT_STATE_PREFIX, SelectQuery)];
+		SumTableOffset = SelectQuery * FFX_PARALLELSORT_SORT_BIN_COUNT * CBuffer.NumThreadGroups;
+#endif // kRS_SelectPrefix
+
 		// Start by clearing our local counts in LDS
+#ifdef kRS_RegisterCount
+		if (localID < FFX_PARALLELSORT_SORT_BIN_COUNT * (FFX_PARALLELSORT_THREADGROUP_SIZE / 16))
+			gs_FFX_PARALLELSORT_WaveHistogram[localID] = 0;
+#else
 		for (int i = 0; i < FFX_PARALLELSORT_SORT_BIN_COUNT; i++)
 			gs_FFX_PARALLELSORT_Histogram[(i * FFX_PARALLELSORT_THREADGROUP_SIZE) + localID] = 0;
+#endif // kRS_RegisterCount
 
 		// Wait for everyone to catch up
 		GroupMemoryBarrierWithGroupSync();
@@ -124,6 +649,20 @@
 		// Get the block start index for this thread
 		uint BlockIndex = ThreadgroupBlockStart + localID;
 
+#if defined(kRS_ReadOnlyInput) && !defined(kRS_StridedKeys)
+		// Each thread counts 4 neighbouring keys of the block (read with one 128-bit load)
+		BlockIndex = ThreadgroupBlockStart + localID * FFX_PARALLELSORT_ELEMENTS_PER_THREAD;
+		uint KeyStep = 1;
+#else
+		uint KeyStep = FFX_PARALLELSORT_THREADGROUP_SIZE;
+#endif // kRS_ReadOnlyInput && !kRS_StridedKeys
+
+#ifdef kRS_RegisterCount
+		// Every thread counts its keys in 16 8-bit counters, packed into 4 uints
+		uint4 Counts = 0;
+		uint FlushBlockCount = min(FFX_PARALLELSORT_REGISTER_COUNT_BLOCKS, NumBlocksToProcess);
+#endif // kRS_RegisterCount
+
 		// Count value occurrence
 		for (uint BlockCount = 0; BlockCount < NumBlocksToProcess; BlockCount++, BlockIndex += BlockSize)
 		{
@@ -131,20 +670,45 @@
 
 			// Pre-load the key values in order to hide some of the read latency
 			uint srcKeys[FFX_PARALLELSORT_ELEMENTS_PER_THREAD];
-			srcKeys[0] = SrcBuffer[DataIndex];
-			srcKeys[1] = SrcBuffer[DataIndex + FFX_PARALLELSORT_THREADGROUP_SIZE];
-			srcKeys[2] = SrcBuffer[DataIndex + (FFX_PARALLELSORT_THREADGROUP_SIZE * 2)];
-			srcKeys[3] = SrcBuffer[DataIndex + (FFX_PARALLELSORT_THREADGROUP_SIZE * 3)];
+#if defined(kRS_ReadOnlyInput) && !defined(kRS_StridedKeys)
+			uint4 srcKeys4 = SrcBuffer.Load4((KeyPlaneOffset + DataIndex) * 4);
+			srcKeys[0] = srcKeys4.x;
+			srcKeys[1] = srcKeys4.y;
+			srcKeys[2] = srcKeys4.z;
+			srcKeys[3] = srcKeys4.w;
+#else
+			srcKeys[0] = FFX_ParallelSort_LoadSourceKey(CBuffer, SrcBuffer, KeyPlaneOffset + DataIndex);
+			srcKeys[1] = FFX_ParallelSort_LoadSourceKey(CBuffer, SrcBuffer, KeyPlaneOffset + DataIndex + FFX_PARALLELSORT_THREADGROUP_SIZE);
+			srcKeys[2] = FFX_ParallelSort_LoadSourceKey(CBuffer, SrcBuffer, KeyPlaneOffset + DataIndex + (FFX_PARALLELSORT_THREADGROUP_SIZE * 2));
+			srcKeys[3] = FFX_ParallelSort_LoadSourceKey(CBuffer, SrcBuffer, KeyPlaneOffset + DataIndex + (FFX_PARALLELSORT_THREADGROUP_SIZE * 3));
+#endif // kRS_ReadOnlyInput && !kRS_StridedKeys
 
 			for (uint i = 0; i < FFX_PARALLELSORT_ELEMENTS_PER_THREAD; i++)
 			{
 				if (DataIndex < CBuffer.NumKeys)
 				{
 					uint localKey = (srcKeys[i] >> ShiftBit) & 0xf;
+#ifdef kRS_SelectPrefix
+					if (FFX_ParallelSort_SelectIsCandidate(srcKeys[i], SelectPrefix, ShiftBit))
+#endif // kRS_SelectPrefix
+#ifdef kRS_RegisterCount
+					Counts += uint4(uint4(0, 1, 2, 3) == (localKey >> 2)) << ((localKey & 3) * 8);
+#else
 					InterlockedAdd(gs_FFX_PARALLELSORT_Histogram[(localKey * FFX_PARALLELSORT_THREADGROUP_SIZE) + localID], 1);
-					DataIndex += FFX_PARALLELSORT_THREADGROUP_SIZE;
+#endif // kRS_RegisterCount
+					DataIndex += KeyStep;
 				}
 			}
+
+#ifdef kRS_RegisterCount
+			// Flush the counters before they can overflow (all threads of the group do the same number of blocks, so whole waves flush together)
+			if (BlockCount + 1 == FlushBlockCount)
+			{
+				FFX_ParallelSort_FlushRegisterCounts(localID, Counts);
+				Counts = 0;
+				FlushBlockCount = min(FlushBlockCount + FFX_PARALLELSORT_REGISTER_COUNT_BLOCKS, NumBlocksToProcess);
+			}
+#endif // kRS_RegisterCount
 		}
 
 		// Even though our LDS layout guarantees no collisions, our thread group size is greater than a wave
@@ -154,11 +718,16 @@
 		if (localID < FFX_PARALLELSORT_SORT_BIN_COUNT)
 		{
 			uint sum = 0;
+#ifdef kRS_RegisterCount
+			for (uint waveID = 0; waveID < FFX_PARALLELSORT_NUM_WAVES; waveID++)
+				sum += gs_FFX_PARALLELSORT_WaveHistogram[waveID * FFX_PARALLELSORT_SORT_BIN_COUNT + localID];
+#else
 			for (int i = 0; i < FFX_PARALLELSORT_THREADGROUP_SIZE; i++)
 			{
 				sum += gs_FFX_PARALLELSORT_Histogram[localID * FFX_PARALLELSORT_THREADGROUP_SIZE + i];
 			}
-			SumTable[localID * CBuffer.NumThreadGroups + groupID] = sum;
+#endif // kRS_RegisterCount
+			SumTable[SumTableOffset + localID * CBuffer.NumThreadGroups + groupID] = sum;
 		}
 	}
 
@@ -168,6 +737,21 @@
 		// Do wave local reduce
 		uint waveReduced = WaveActiveSum(localSum);
 
+#ifdef kRS_WaveSize
+		// First lane in a wave writes out wave reduction to LDS
+		uint waveID = localID / kRS_WaveSize;
+		if (WaveIsFirstLane())
+			gs_FFX_PARALLELSORT_LDSSums[waveID] = waveReduced;
+
+		// Wait for everyone to catch up
+		GroupMemoryBarrierWithGroupSync();
+
+		// Every thread adds up the (2 or 4) wave reductions itself, so they all get the group's sum
+		waveReduced = 0;
+		[unroll]
+		for (uint i = 0; i < FFX_PARALLELSORT_NUM_WAVES; i++)
+			waveReduced += gs_FFX_PARALLELSORT_LDSSums[i];
+#else
 		// First lane in a wave writes out wave reduction to LDS (this accounts for num waves per group greater than HW wave size)
 		// Note that some hardware with very small HW wave sizes (i.e. <= 8) may exhibit issues with this algorithm, and have not been tested.
 		uint waveID = localID / WaveGetLaneCount();
@@ -180,6 +764,7 @@
 		// First wave worth of threads sum up wave reductions
 		if (!waveID)
 			waveReduced = WaveActiveSum( (localID < FFX_PARALLELSORT_THREADGROUP_SIZE / WaveGetLaneCount()) ? gs_FFX_PARALLELSORT_LDSSums[localID] : 0);
+#endif // kRS_WaveSize
 
 		// Returned the reduced sum
 		return waveReduced;
@@ -190,6 +775,20 @@
 		// Do wave local scan-prefix
 		uint wavePrefixed = WavePrefixSum(localSum);
 
+#ifdef kRS_WaveSize
+		// Last element in a wave writes out partial sum to LDS
+		uint waveID = localID / kRS_WaveSize;
+		if (WaveGetLaneIndex() == kRS_WaveSize - 1)
+			gs_FFX_PARALLELSORT_LDSSums[waveID] = wavePrefixed + localSum;
+
+		// Wait for everyone to catch up
+		GroupMemoryBarrierWithGroupSync();
+
+		// Add the partial sums of the waves before this one (at most 3), instead of prefixing them in LDS behind a second barrier
+		[unroll]
+		for (uint i = 0; i < FFX_PARALLELSORT_NUM_WAVES - 1; i++)
+			wavePrefixed += (i < waveID) ? gs_FFX_PARALLELSORT_LDSSums[i] : 0;
+#else
 		// Since we are dealing with thread group sizes greater than HW wave size, we need to account for what wave we are in.
 		uint waveID = localID / WaveGetLaneCount();
 		uint laneID = WaveGetLaneIndex();
@@ -210,15 +809,28 @@
 
 		// Add the partial sums back to each wave prefix
 		wavePrefixed += gs_FFX_PARALLELSORT_LDSSums[waveID];
+#endif // kRS_WaveSize
 
 		return wavePrefixed;
 	}
 
-	void FFX_ParallelSort_ReduceCount(uint localID, uint groupID, FFX_ParallelSortCB CBuffer, RWStructuredBuffer<uint> SumTable, RWStructuredBuffer<uint> ReduceTable)
+	void FFX_ParallelSort_ReduceCount(uint localID, uint groupID, FFX_ParallelSortCB CBuffer, RWStructuredBuffer<uint> SumTable, RWStructuredBuffer<uint> ReduceTable
+#ifdef kRS_SelectPrefix
+									  ,uint SelectQuery
+#endif // kRS_SelectPrefix
+	)
 	{
+		// Batched selections each reduce their own slice of the tables
+		uint SumTableOffset = 0;
+		uint ReduceTableOffset = 0;
+#ifdef kRS_SelectPrefix
+		SumTableOffset = SelectQuery * FFX_PARALLELSORT_SORT_BIN_COUNT * CBuffer.NumThreadGroups;
+		ReduceTableOffset = SelectQuery * CBuffer.NumScanValues;
+#endif // kRS_SelectPrefix
+
 		// Figure out what bin data we are reducing
 		uint BinID = groupID / CBuffer.NumReduceThreadgroupPerBin;
-		uint BinOffset = BinID * CBuffer.NumThreadGroups;
+		uint BinOffset = SumTableOffset + BinID * CBuffer.NumThreadGroups;
 
 		// Get the base index for this thread group
 		uint BaseIndex = (groupID % CBuffer.NumReduceThreadgroupPerBin) * FFX_PARALLELSORT_ELEMENTS_PER_THREAD * FFX_PARALLELSORT_THREADGROUP_SIZE;
@@ -236,12 +848,40 @@
 
 		// First thread of the group writes out the reduced sum for the bin
 		if (!localID)
-			ReduceTable[groupID] = threadgroupSum;
+			ReduceTable[ReduceTableOffset + groupID] = threadgroupSum;
 
 		// What this will look like in the reduced table is:
 		//	[ [bin0 ... bin0] [bin1 ... bin1] ... ]
 	}
 
+	uint FFX_ParallelSort_NumScanBlocks(uint NumScanValues)
+	{
+		uint BlockSize = FFX_PARALLELSORT_ELEMENTS_PER_THREAD * FFX_PARALLELSORT_THREADGROUP_SIZE;
+		return (NumScanValues + BlockSize - 1) / BlockSize;
+	}
+
+	// Reduces each block of scan values down to a single partial sum (first step of a scan that doesn't fit in one thread group)
+	void FFX_ParallelSort_ReduceScanBlocks(uint localID, uint groupID, uint NumScanValues, RWStructuredBuffer<uint> ScanSrc, RWStructuredBuffer<uint> ScanDst)
+	{
+		// Get the base index for this thread group
+		uint BaseIndex = groupID * FFX_PARALLELSORT_ELEMENTS_PER_THREAD * FFX_PARALLELSORT_THREADGROUP_SIZE;
+
+		// Calculate partial sums for entries this thread reads in
+		uint threadgroupSum = 0;
+		for (uint i = 0; i < FFX_PARALLELSORT_ELEMENTS_PER_THREAD; ++i)
+		{
+			uint DataIndex = BaseIndex + (i * FFX_PARALLELSORT_THREADGROUP_SIZE) + localID;
+			threadgroupSum += (DataIndex < NumScanValues) ? ScanSrc[DataIndex] : 0;
+		}
+
+		// Reduce across the entirety of the thread group
+		threadgroupSum = FFX_ParallelSort_ThreadgroupReduce(threadgroupSum, localID);
+
+		// First thread of the group writes out the partial sum for the block
+		if (!localID)
+			ScanDst[groupID] = threadgroupSum;
+	}
+
 	// This is to transform uncoalesced loads into coalesced loads and 
 	// then scattered loads from LDS
 	groupshared int gs_FFX_PARALLELSORT_LDS[FFX_PARALLELSORT_ELEMENTS_PER_THREAD][FFX_PARALLELSORT_THREADGROUP_SIZE];
@@ -303,22 +943,266 @@
 		}
 	}
 
+	// The scatter offsets are the exclusive prefix sum of the whole sum table (bins one after another), so one thread group can
+	// build them in place by scanning the table a block at a time and carrying the running total over from block to block.
+	// This does the work of CountReduce, Scan and ScanAdd in a single dispatch (see FFX_ParallelSort_UseFusedScan).
+	groupshared uint gs_FFX_PARALLELSORT_ScanCarry;
+	void FFX_ParallelSort_ReduceScanAdd(uint localID, FFX_ParallelSortCB CBuffer, RWStructuredBuffer<uint> SumTable)
+	{
+		uint BlockSize = FFX_PARALLELSORT_ELEMENTS_PER_THREAD * FFX_PARALLELSORT_THREADGROUP_SIZE;
+		uint NumValues = FFX_PARALLELSORT_SORT_BIN_COUNT * CBuffer.NumThreadGroups;
+
+		uint Carry = 0;
+		for (uint BaseIndex = 0; BaseIndex < NumValues; BaseIndex += BlockSize)
+		{
+			uint i;
+			// Perform coalesced loads into LDS
+			for (i = 0; i < FFX_PARALLELSORT_ELEMENTS_PER_THREAD; i++)
+			{
+				uint DataIndex = BaseIndex + (i * FFX_PARALLELSORT_THREADGROUP_SIZE) + localID;
+
+				uint col = ((i * FFX_PARALLELSORT_THREADGROUP_SIZE) + localID) / FFX_PARALLELSORT_ELEMENTS_PER_THREAD;
+				uint row = ((i * FFX_PARALLELSORT_THREADGROUP_SIZE) + localID) % FFX_PARALLELSORT_ELEMENTS_PER_THREAD;
+				gs_FFX_PARALLELSORT_LDS[row][col] = (DataIndex < NumValues) ? SumTable[DataIndex] : 0;
+			}
+
+			// Wait for everyone to catch up
+			GroupMemoryBarrierWithGroupSync();
+
+			uint threadgroupSum = 0;
+			// Calculate the local scan-prefix for current thread
+			for (i = 0; i < FFX_PARALLELSORT_ELEMENTS_PER_THREAD; i++)
+			{
+				uint tmp = gs_FFX_PARALLELSORT_LDS[i][localID];
+				gs_FFX_PARALLELSORT_LDS[i][localID] = threadgroupSum;
+				threadgroupSum += tmp;
+			}
+
+			uint threadPrefix = FFX_ParallelSort_BlockScanPrefix(threadgroupSum, localID);
+
+			// Last thread's inclusive prefix is the block's total, which carries over to the next block
+			if (localID == FFX_PARALLELSORT_THREADGROUP_SIZE - 1)
+				gs_FFX_PARALLELSORT_ScanCarry = threadPrefix + threadgroupSum;
+
+			// Add the block scanned-prefixes and everything before the block back in
+			for (i = 0; i < FFX_PARALLELSORT_ELEMENTS_PER_THREAD; i++)
+				gs_FFX_PARALLELSORT_LDS[i][localID] += threadPrefix + Carry;
+
+			// Wait for everyone to catch up
+			GroupMemoryBarrierWithGroupSync();
+
+			// Perform coalesced writes back to the sum table
+			for (i = 0; i < FFX_PARALLELSORT_ELEMENTS_PER_THREAD; i++)
+			{
+				uint DataIndex = BaseIndex + (i * FFX_PARALLELSORT_THREADGROUP_SIZE) + localID;
+
+				uint col = ((i * FFX_PARALLELSORT_THREADGROUP_SIZE) + localID) / FFX_PARALLELSORT_ELEMENTS_PER_THREAD;
+				uint row = ((i * FFX_PARALLELSORT_THREADGROUP_SIZE) + localID) % FFX_PARALLELSORT_ELEMENTS_PER_THREAD;
+
+				if (DataIndex < NumValues)
+					SumTable[DataIndex] = gs_FFX_PARALLELSORT_LDS[row][col];
+			}
+			Carry += gs_FFX_PARALLELSORT_ScanCarry;
+
+			// LDS and the carry get reused by the next block
+			GroupMemoryBarrierWithGroupSync();
+		}
+	}
+
 	// Offset cache to avoid loading the offsets all the time
 	groupshared uint gs_FFX_PARALLELSORT_BinOffsetCache[FFX_PARALLELSORT_THREADGROUP_SIZE];
 	// Local histogram for offset calculations
 	groupshared uint gs_FFX_PARALLELSORT_LocalHistogram[FFX_PARALLELSORT_SORT_BIN_COUNT];
 	// Scratch area for algorithm
 	groupshared uint gs_FFX_PARALLELSORT_LDSScratch[FFX_PARALLELSORT_THREADGROUP_SIZE];
-	void FFX_ParallelSort_Scatter_uint(uint localID, uint groupID, FFX_ParallelSortCB CBuffer, uint ShiftBit, RWStructuredBuffer<uint> SrcBuffer, RWStructuredBuffer<uint> DstBuffer, RWStructuredBuffer<uint> SumTable
 #ifdef kRS_ValueCopy
-										,RWStructuredBuffer<uint> SrcPayload, RWStructuredBuffer<uint> DstPayload
+	// Keys and values move through the local sort together (one exchange instead of two)
+	groupshared uint2 gs_FFX_PARALLELSORT_LDSKeyValues[FFX_PARALLELSORT_THREADGROUP_SIZE];
+#endif // kRS_ValueCopy
+
+	// Writes a ranked key (and its payload) out to its place in the sorted order
+	void FFX_ParallelSort_StoreScatteredKey(FFX_ParallelSortCB CBuffer, uint KeyPlaneOffset, uint totalOffset, uint localKey, FFX_PARALLELSORT_KEY_INPUT_BUFFER SrcBuffer, RWStructuredBuffer<FFX_PARALLELSORT_KEY_TYPE> DstBuffer
+#ifdef kRS_MultiWordKeys
+											,uint localIndex
+#endif // kRS_MultiWordKeys
+#ifdef kRS_ValueCopy
+											,uint localValue, RWStructuredBuffer<uint> DstPayload
+#endif // kRS_ValueCopy
+	)
+	{
+#ifdef kRS_MultiWordKeys
+		// Move every word of the key (we already hold the one this pass sorted on)
+		for (uint KeyWord = 0; KeyWord < CBuffer.NumKeyWords; KeyWord++)
+		{
+			uint WordOffset = KeyWord * CBuffer.NumKeys;
+			DstBuffer[WordOffset + totalOffset] = (WordOffset == KeyPlaneOffset) ? localKey : FFX_ParallelSort_LoadInput(SrcBuffer, WordOffset + localIndex);
+		}
+#elif defined(kRS_StoreKeyHook)
+		FFX_ParallelSort_StoreKey(totalOffset, localKey);
+#else
+		DstBuffer[totalOffset] = (FFX_PARALLELSORT_KEY_TYPE)localKey;
+#endif // kRS_MultiWordKeys
+
+#ifdef kRS_ValueCopy
+		DstPayload[totalOffset] = localValue;
+#endif // kRS_ValueCopy
+	}
+
+#ifdef kRS_TileScatter
+	// Full tile ranking (kRS_TileScatter) moves keys around the whole block through LDS
+	groupshared uint gs_FFX_PARALLELSORT_TileLDS[FFX_PARALLELSORT_ELEMENTS_PER_THREAD * FFX_PARALLELSORT_THREADGROUP_SIZE];
+
+	// Moves a thread's values to their slots in the tile and picks its own slots back up (a row at a time when Strided, neighbouring slots otherwise)
+	void FFX_ParallelSort_TileExchange(uint localID, uint Slots[FFX_PARALLELSORT_ELEMENTS_PER_THREAD], bool Strided, inout uint Values[FFX_PARALLELSORT_ELEMENTS_PER_THREAD])
+	{
+		uint i;
+		for (i = 0; i < FFX_PARALLELSORT_ELEMENTS_PER_THREAD; i++)
+			gs_FFX_PARALLELSORT_TileLDS[Slots[i]] = Values[i];
+
+		// Wait for everyone to catch up
+		GroupMemoryBarrierWithGroupSync();
+
+		for (i = 0; i < FFX_PARALLELSORT_ELEMENTS_PER_THREAD; i++)
+			Values[i] = gs_FFX_PARALLELSORT_TileLDS[Strided ? i * FFX_PARALLELSORT_THREADGROUP_SIZE + localID : localID * FFX_PARALLELSORT_ELEMENTS_PER_THREAD + i];
+
+		// Wait for everyone to catch up (the tile gets reused by the next exchange)
+		GroupMemoryBarrierWithGroupSync();
+	}
+
+#ifdef kRS_ValueCopy
+	groupshared uint2 gs_FFX_PARALLELSORT_TileKeyValues[FFX_PARALLELSORT_ELEMENTS_PER_THREAD * FFX_PARALLELSORT_THREADGROUP_SIZE];
+
+	// Same for keys and their values together, in a single exchange
+	void FFX_ParallelSort_TileExchangeKeyValues(uint localID, uint Slots[FFX_PARALLELSORT_ELEMENTS_PER_THREAD], bool Strided, inout uint Keys[FFX_PARALLELSORT_ELEMENTS_PER_THREAD], inout uint Values[FFX_PARALLELSORT_ELEMENTS_PER_THREAD])
+	{
+		uint i;
+		for (i = 0; i < FFX_PARALLELSORT_ELEMENTS_PER_THREAD; i++)
+			gs_FFX_PARALLELSORT_TileKeyValues[Slots[i]] = uint2(Keys[i], Values[i]);
+
+		// Wait for everyone to catch up
+		GroupMemoryBarrierWithGroupSync();
+
+		for (i = 0; i < FFX_PARALLELSORT_ELEMENTS_PER_THREAD; i++)
+		{
+			uint2 KeyValue = gs_FFX_PARALLELSORT_TileKeyValues[Strided ? i * FFX_PARALLELSORT_THREADGROUP_SIZE + localID : localID * FFX_PARALLELSORT_ELEMENTS_PER_THREAD + i];
+			Keys[i] = KeyValue.x;
+			Values[i] = KeyValue.y;
+		}
+
+		// Wait for everyone to catch up (the tile gets reused by the next exchange)
+		GroupMemoryBarrierWithGroupSync();
+	}
+#endif // kRS_ValueCopy
+
+	// Where a thread's (neighbouring) keys go for a stable 2-bit split of the whole tile. A tile can hold up to 512 keys of
+	// a bin, so bins 0-2 are counted in 10-bit fields and bin 3's count is whatever is left of the key's position
+	void FFX_ParallelSort_TileSplitSlots(uint localID, uint Keys[FFX_PARALLELSORT_ELEMENTS_PER_THREAD], uint ShiftBit, uint bitShift, out uint Slots[FFX_PARALLELSORT_ELEMENTS_PER_THREAD])
+	{
+		uint bitKeys[FFX_PARALLELSORT_ELEMENTS_PER_THREAD];
+		uint keyCounts[FFX_PARALLELSORT_ELEMENTS_PER_THREAD];
+		uint threadCounts = 0;
+		uint i;
+		for (i = 0; i < FFX_PARALLELSORT_ELEMENTS_PER_THREAD; i++)
+		{
+			bitKeys[i] = (((Keys[i] >> ShiftBit) & 0xf) >> bitShift) & 0x3;
+			keyCounts[i] = threadCounts;
+			threadCounts += (bitKeys[i] < 3) ? 1u << (bitKeys[i] * 10) : 0;
+		}
+
+		// Sum up the counts of the threads before this one
+		uint threadPrefix = FFX_ParallelSort_BlockScanPrefix(threadCounts, localID);
+
+		// Last thread stores the counts for the whole tile
+		if (localID == (FFX_PARALLELSORT_THREADGROUP_SIZE - 1))
+			gs_FFX_PARALLELSORT_LDSScratch[0] = threadPrefix + threadCounts;
+
+		// Wait for everyone to catch up
+		GroupMemoryBarrierWithGroupSync();
+
+		uint tileCounts = gs_FFX_PARALLELSORT_LDSScratch[0];
+		uint binStart1 = tileCounts & 0x3ff;
+		uint binStart2 = binStart1 + ((tileCounts >> 10) & 0x3ff);
+		uint binStart3 = binStart2 + (tileCounts >> 20);
+
+		for (i = 0; i < FFX_PARALLELSORT_ELEMENTS_PER_THREAD; i++)
+		{
+			uint counts = threadPrefix + keyCounts[i];
+			uint count0 = counts & 0x3ff;
+			uint count1 = (counts >> 10) & 0x3ff;
+			uint count2 = counts >> 20;
+			uint count3 = localID * FFX_PARALLELSORT_ELEMENTS_PER_THREAD + i - count0 - count1 - count2;
+
+			Slots[i] = (bitKeys[i] == 0) ? count0 : (bitKeys[i] == 1) ? binStart1 + count1 : (bitKeys[i] == 2) ? binStart2 + count2 : binStart3 + count3;
+		}
+	}
+#endif // kRS_TileScatter
+
+#ifdef kRS_MatchScatter
+	// Digit counts of each wave for match ranking (kRS_MatchScatter). Waves have at least 16 lanes, so a thread group has at
+	// most 8 of them, and there are two sets so a row can clear its counts while the next one fills the other set in
+	#define FFX_PARALLELSORT_MATCH_COUNTS_SIZE	(FFX_PARALLELSORT_SORT_BIN_COUNT * (FFX_PARALLELSORT_THREADGROUP_SIZE / 16))
+	groupshared uint gs_FFX_PARALLELSORT_MatchCounts[2 * FFX_PARALLELSORT_MATCH_COUNTS_SIZE];
+
+	// The lanes of the wave holding the same digit as this one
+	uint4 FFX_ParallelSort_MatchDigit(uint Digit)
+	{
+#ifdef kRS_WaveMatch
+		return WaveMatch(Digit);
+#else
+		// One ballot per digit bit, keeping the lanes that agree with this one on every bit
+		uint4 Match = WaveActiveBallot(true);
+		[unroll]
+		for (uint Bit = 0; Bit < FFX_PARALLELSORT_SORT_BITS_PER_PASS; Bit++)
+		{
+			bool BitSet = (Digit >> Bit) & 1;
+			Match &= WaveActiveBallot(BitSet) ^ (BitSet ? 0 : 0xffffffff);
+		}
+		return Match;
+#endif // kRS_WaveMatch
+	}
+
+	// How many of the matching lanes come before this one
+	uint FFX_ParallelSort_MatchRank(uint4 Match)
+	{
+#ifdef kRS_WaveMatch
+		return WaveMultiPrefixCountBits(true, Match);
+#else
+		uint LaneID = WaveGetLaneIndex();
+		uint Rank = 0;
+		[unroll]
+		for (uint i = 0; i < 4; i++)
+		{
+			uint LaneBase = i * 32;
+			uint LowerLanes = (LaneID >= LaneBase + 32) ? 0xffffffff : (LaneID > LaneBase) ? (1u << (LaneID - LaneBase)) - 1 : 0;
+			Rank += countbits(Match[i] & LowerLanes);
+		}
+		return Rank;
+#endif // kRS_WaveMatch
+	}
+#endif // kRS_MatchScatter
+
+	void FFX_ParallelSort_Scatter_uint(uint localID, uint groupID, FFX_ParallelSortCB CBuffer, uint ShiftBit, FFX_PARALLELSORT_KEY_INPUT_BUFFER SrcBuffer, RWStructuredBuffer<FFX_PARALLELSORT_KEY_TYPE> DstBuffer, RWStructuredBuffer<uint> SumTable
+#ifdef kRS_ValueCopy
+										,FFX_PARALLELSORT_INPUT_BUFFER SrcPayload, RWStructuredBuffer<uint> DstPayload
 #endif // kRS_ValueCopy
 	)
 	{
+		uint KeyPlaneOffset = FFX_ParallelSort_KeyPlaneOffset(CBuffer, ShiftBit);
+
 		// Load the sort bin threadgroup offsets into LDS for faster referencing
 		if (localID < FFX_PARALLELSORT_SORT_BIN_COUNT)
 			gs_FFX_PARALLELSORT_BinOffsetCache[localID] = SumTable[localID * CBuffer.NumThreadGroups + groupID];
 
+#ifdef kRS_MatchScatter
+		// Start out with cleared wave counts
+		for (uint CountIndex = localID; CountIndex < 2 * FFX_PARALLELSORT_MATCH_COUNTS_SIZE; CountIndex += FFX_PARALLELSORT_THREADGROUP_SIZE)
+			gs_FFX_PARALLELSORT_MatchCounts[CountIndex] = 0;
+
+		uint waveID = localID / FFX_PARALLELSORT_WAVE_SIZE;
+		uint NumWaves = FFX_PARALLELSORT_NUM_WAVES;
+		uint MatchCountsOffset = 0;
+#endif // kRS_MatchScatter
+
 		// Wait for everyone to catch up
 		GroupMemoryBarrierWithGroupSync();
 
@@ -347,19 +1231,168 @@
 			
 			// Pre-load the key values in order to hide some of the read latency
 			uint srcKeys[FFX_PARALLELSORT_ELEMENTS_PER_THREAD];
-			srcKeys[0] = SrcBuffer[DataIndex];
-			srcKeys[1] = SrcBuffer[DataIndex + FFX_PARALLELSORT_THREADGROUP_SIZE];
-			srcKeys[2] = SrcBuffer[DataIndex + (FFX_PARALLELSORT_THREADGROUP_SIZE * 2)];
-			srcKeys[3] = SrcBuffer[DataIndex + (FFX_PARALLELSORT_THREADGROUP_SIZE * 3)];
+			srcKeys[0] = FFX_ParallelSort_LoadSourceKey(CBuffer, SrcBuffer, KeyPlaneOffset + DataIndex);
+			srcKeys[1] = FFX_ParallelSort_LoadSourceKey(CBuffer, SrcBuffer, KeyPlaneOffset + DataIndex + FFX_PARALLELSORT_THREADGROUP_SIZE);
+			srcKeys[2] = FFX_ParallelSort_LoadSourceKey(CBuffer, SrcBuffer, KeyPlaneOffset + DataIndex + (FFX_PARALLELSORT_THREADGROUP_SIZE * 2));
+			srcKeys[3] = FFX_ParallelSort_LoadSourceKey(CBuffer, SrcBuffer, KeyPlaneOffset + DataIndex + (FFX_PARALLELSORT_THREADGROUP_SIZE * 3));
 
 #ifdef kRS_ValueCopy
 			uint srcValues[FFX_PARALLELSORT_ELEMENTS_PER_THREAD];
-			srcValues[0] = SrcPayload[DataIndex];
-			srcValues[1] = SrcPayload[DataIndex + FFX_PARALLELSORT_THREADGROUP_SIZE];
-			srcValues[2] = SrcPayload[DataIndex + (FFX_PARALLELSORT_THREADGROUP_SIZE * 2)];
-			srcValues[3] = SrcPayload[DataIndex + (FFX_PARALLELSORT_THREADGROUP_SIZE * 3)];
+#ifdef kRS_IndexPayload
+			// First pass of a deferred payload gather, the payload is where the key started out
+			srcValues[0] = DataIndex;
+			srcValues[1] = DataIndex + FFX_PARALLELSORT_THREADGROUP_SIZE;
+			srcValues[2] = DataIndex + (FFX_PARALLELSORT_THREADGROUP_SIZE * 2);
+			srcValues[3] = DataIndex + (FFX_PARALLELSORT_THREADGROUP_SIZE * 3);
+#else
+			srcValues[0] = FFX_ParallelSort_LoadInput(SrcPayload, DataIndex);
+			srcValues[1] = FFX_ParallelSort_LoadInput(SrcPayload, DataIndex + FFX_PARALLELSORT_THREADGROUP_SIZE);
+			srcValues[2] = FFX_ParallelSort_LoadInput(SrcPayload, DataIndex + (FFX_PARALLELSORT_THREADGROUP_SIZE * 2));
+			srcValues[3] = FFX_ParallelSort_LoadInput(SrcPayload, DataIndex + (FFX_PARALLELSORT_THREADGROUP_SIZE * 3));
+#endif // kRS_IndexPayload
+#endif // kRS_ValueCopy
+
+#ifdef kRS_TileScatter
+			// Rank the whole block at once. The keys were loaded a row at a time, so first move them over to a blocked layout,
+			// where every thread holds neighbouring keys of the block
+			uint i;
+			uint tileSlots[FFX_PARALLELSORT_ELEMENTS_PER_THREAD];
+			uint tileKeys[FFX_PARALLELSORT_ELEMENTS_PER_THREAD];
+#ifdef kRS_MultiWordKeys
+			uint tileIndices[FFX_PARALLELSORT_ELEMENTS_PER_THREAD];
+#endif // kRS_MultiWordKeys
+			for (i = 0; i < FFX_PARALLELSORT_ELEMENTS_PER_THREAD; i++)
+			{
+				tileSlots[i] = i * FFX_PARALLELSORT_THREADGROUP_SIZE + localID;
+				tileKeys[i] = (DataIndex + i * FFX_PARALLELSORT_THREADGROUP_SIZE < CBuffer.NumKeys) ? srcKeys[i] : 0xffffffff;
+#ifdef kRS_MultiWordKeys
+				// Source indices start out blocked already
+				tileIndices[i] = DataIndex - localID + localID * FFX_PARALLELSORT_ELEMENTS_PER_THREAD + i;
+#endif // kRS_MultiWordKeys
+			}
+
+			// Clear the local histogram
+			if (localID < FFX_PARALLELSORT_SORT_BIN_COUNT)
+				gs_FFX_PARALLELSORT_LocalHistogram[localID] = 0;
+
+#ifdef kRS_ValueCopy
+			FFX_ParallelSort_TileExchangeKeyValues(localID, tileSlots, false, tileKeys, srcValues);
+#else
+			FFX_ParallelSort_TileExchange(localID, tileSlots, false, tileKeys);
+#endif // kRS_ValueCopy
+
+			// Count the tile's digits
+			for (i = 0; i < FFX_PARALLELSORT_ELEMENTS_PER_THREAD; i++)
+				InterlockedAdd(gs_FFX_PARALLELSORT_LocalHistogram[(tileKeys[i] >> ShiftBit) & 0xf], 1);
+
+			// Sort the tile in LDS (the last split leaves the keys in rows again, so the writes below are coalesced)
+			for (uint bitShift = 0; bitShift < FFX_PARALLELSORT_SORT_BITS_PER_PASS; bitShift += 2)
+			{
+				bool LastSplit = (bitShift + 2 >= FFX_PARALLELSORT_SORT_BITS_PER_PASS);
+				FFX_ParallelSort_TileSplitSlots(localID, tileKeys, ShiftBit, bitShift, tileSlots);
+
+#ifdef kRS_ValueCopy
+				FFX_ParallelSort_TileExchangeKeyValues(localID, tileSlots, LastSplit, tileKeys, srcValues);
+#else
+				FFX_ParallelSort_TileExchange(localID, tileSlots, LastSplit, tileKeys);
+#endif // kRS_ValueCopy
+#ifdef kRS_MultiWordKeys
+				FFX_ParallelSort_TileExchange(localID, tileSlots, LastSplit, tileIndices);
+#endif // kRS_MultiWordKeys
+			}
+
+			// Prefix histogram (where each digit's keys start in the tile) and broadcast it via LDS
+			uint histogramPrefixSum = WavePrefixSum(localID < FFX_PARALLELSORT_SORT_BIN_COUNT ? gs_FFX_PARALLELSORT_LocalHistogram[localID] : 0);
+			if (localID < FFX_PARALLELSORT_SORT_BIN_COUNT)
+				gs_FFX_PARALLELSORT_LDSScratch[localID] = histogramPrefixSum;
+
+			// Wait for everyone to catch up
+			GroupMemoryBarrierWithGroupSync();
+
+			// Every digit's keys sit next to each other now, so each row writes out runs of neighbouring keys
+			for (i = 0; i < FFX_PARALLELSORT_ELEMENTS_PER_THREAD; i++)
+			{
+				uint keyIndex = (tileKeys[i] >> ShiftBit) & 0xf;
+				uint totalOffset = gs_FFX_PARALLELSORT_BinOffsetCache[keyIndex] + i * FFX_PARALLELSORT_THREADGROUP_SIZE + localID - gs_FFX_PARALLELSORT_LDSScratch[keyIndex];
+
+				if (totalOffset < CBuffer.NumKeys)
+				{
+					FFX_ParallelSort_StoreScatteredKey(CBuffer, KeyPlaneOffset, totalOffset, tileKeys[i], SrcBuffer, DstBuffer
+#ifdef kRS_MultiWordKeys
+													   ,tileIndices[i]
+#endif // kRS_MultiWordKeys
+#ifdef kRS_ValueCopy
+													   ,srcValues[i], DstPayload
+#endif // kRS_ValueCopy
+					);
+				}
+			}
+
+			// Wait for everyone to catch up
+			GroupMemoryBarrierWithGroupSync();
+
+			// Update the cached histogram for the next block
+			if (localID < FFX_PARALLELSORT_SORT_BIN_COUNT)
+				gs_FFX_PARALLELSORT_BinOffsetCache[localID] += gs_FFX_PARALLELSORT_LocalHistogram[localID];
+#elif defined(kRS_MatchScatter)
+			for (uint i = 0; i < FFX_PARALLELSORT_ELEMENTS_PER_THREAD; i++)
+			{
+				uint localKey = (DataIndex < CBuffer.NumKeys ? srcKeys[i] : 0xffffffff);
+				uint keyIndex = (localKey >> ShiftBit) & 0xf;
+
+				// Rank the key among the wave's keys of the same digit (lanes are in key order, so this keeps the sort stable)
+				uint4 digitLanes = FFX_ParallelSort_MatchDigit(keyIndex);
+				uint waveRank = FFX_ParallelSort_MatchRank(digitLanes);
+
+				// First lane of each digit stores how many of the wave's keys have it
+				if (!waveRank)
+					gs_FFX_PARALLELSORT_MatchCounts[MatchCountsOffset + waveID * FFX_PARALLELSORT_SORT_BIN_COUNT + keyIndex] = countbits(digitLanes.x) + countbits(digitLanes.y) + countbits(digitLanes.z) + countbits(digitLanes.w);
+
+				// Wait for everyone to catch up
+				GroupMemoryBarrierWithGroupSync();
+
+				// Add in the keys of the same digit in the waves before this one
+				uint localOffset = waveRank;
+				for (uint PrevWaveID = 0; PrevWaveID < waveID; PrevWaveID++)
+					localOffset += gs_FFX_PARALLELSORT_MatchCounts[MatchCountsOffset + PrevWaveID * FFX_PARALLELSORT_SORT_BIN_COUNT + keyIndex];
+
+				// And total up the row's digits for the next row's offsets
+				uint rowCount = 0;
+				if (localID < FFX_PARALLELSORT_SORT_BIN_COUNT)
+				{
+					for (uint WaveIndex = 0; WaveIndex < NumWaves; WaveIndex++)
+						rowCount += gs_FFX_PARALLELSORT_MatchCounts[MatchCountsOffset + WaveIndex * FFX_PARALLELSORT_SORT_BIN_COUNT + localID];
+				}
+
+				// Write to destination
+				uint totalOffset = gs_FFX_PARALLELSORT_BinOffsetCache[keyIndex] + localOffset;
+				if (totalOffset < CBuffer.NumKeys)
+				{
+					FFX_ParallelSort_StoreScatteredKey(CBuffer, KeyPlaneOffset, totalOffset, localKey, SrcBuffer, DstBuffer
+#ifdef kRS_MultiWordKeys
+													   ,DataIndex
+#endif // kRS_MultiWordKeys
+#ifdef kRS_ValueCopy
+													   ,srcValues[i], DstPayload
 #endif // kRS_ValueCopy
+					);
+				}
+
+				// Wait for everyone to catch up
+				GroupMemoryBarrierWithGroupSync();
+
+				// Update the cached histogram for the next row, and clear this row's counts (the next row uses the other set)
+				if (localID < FFX_PARALLELSORT_SORT_BIN_COUNT)
+				{
+					gs_FFX_PARALLELSORT_BinOffsetCache[localID] += rowCount;
+					for (uint WaveIndex = 0; WaveIndex < NumWaves; WaveIndex++)
+						gs_FFX_PARALLELSORT_MatchCounts[MatchCountsOffset + WaveIndex * FFX_PARALLELSORT_SORT_BIN_COUNT + localID] = 0;
+				}
+				MatchCountsOffset ^= FFX_PARALLELSORT_MATCH_COUNTS_SIZE;
 
+				DataIndex += FFX_PARALLELSORT_THREADGROUP_SIZE;	// Increase the data offset by thread group size
+			}
+#else
 			for (int i = 0; i < FFX_PARALLELSORT_ELEMENTS_PER_THREAD; i++)
 			{
 				// Clear the local histogram
@@ -370,6 +1403,9 @@
 #ifdef kRS_ValueCopy
 				uint localValue = (DataIndex < CBuffer.NumKeys ? srcValues[i] : 0);
 #endif // kRS_ValueCopy
+#ifdef kRS_MultiWordKeys
+				uint localIndex = DataIndex;
+#endif // kRS_MultiWordKeys
 
 				// Sort the keys locally in LDS
 				for (uint bitShift = 0; bitShift < FFX_PARALLELSORT_SORT_BITS_PER_PASS; bitShift += 2)
@@ -404,23 +1440,32 @@
 					// Calculate target offset
 					uint keyOffset = (localSum >> (bitKey * 8)) & 0xff;
 
+#ifdef kRS_ValueCopy
+					// Re-arrange the keys and values together (store, sync, load)
+					gs_FFX_PARALLELSORT_LDSKeyValues[keyOffset] = uint2(localKey, localValue);
+					GroupMemoryBarrierWithGroupSync();
+					uint2 localKeyValue = gs_FFX_PARALLELSORT_LDSKeyValues[localID];
+					localKey = localKeyValue.x;
+					localValue = localKeyValue.y;
+#else
 					// Re-arrange the keys (store, sync, load)
 					gs_FFX_PARALLELSORT_LDSSums[keyOffset] = localKey;
 					GroupMemoryBarrierWithGroupSync();
 					localKey = gs_FFX_PARALLELSORT_LDSSums[localID];
+#endif // kRS_ValueCopy
 
 					// Wait for everyone to catch up
 					GroupMemoryBarrierWithGroupSync();
 
-#ifdef kRS_ValueCopy
-					// Re-arrange the values if we have them (store, sync, load)
-					gs_FFX_PARALLELSORT_LDSSums[keyOffset] = localValue;
+#ifdef kRS_MultiWordKeys
+					// Re-arrange the source indices so the rest of the key's words can be fetched once we know where it goes (store, sync, load)
+					gs_FFX_PARALLELSORT_LDSSums[keyOffset] = localIndex;
 					GroupMemoryBarrierWithGroupSync();
-					localValue = gs_FFX_PARALLELSORT_LDSSums[localID];
+					localIndex = gs_FFX_PARALLELSORT_LDSSums[localID];
 
 					// Wait for everyone to catch up
 					GroupMemoryBarrierWithGroupSync();
-#endif // kRS_ValueCopy
+#endif // kRS_MultiWordKeys
 				}
 
 				// Need to recalculate the keyIndex on this thread now that values have been copied around the thread group
@@ -453,11 +1498,14 @@
 
 				if (totalOffset < CBuffer.NumKeys)
 				{
-					DstBuffer[totalOffset] = localKey;
-
+					FFX_ParallelSort_StoreScatteredKey(CBuffer, KeyPlaneOffset, totalOffset, localKey, SrcBuffer, DstBuffer
+#ifdef kRS_MultiWordKeys
+													   ,localIndex
+#endif // kRS_MultiWordKeys
 #ifdef kRS_ValueCopy
-					DstPayload[totalOffset] = localValue;
+													   ,localValue, DstPayload
 #endif // kRS_ValueCopy
+					);
 				}
 
 				// Wait for everyone to catch up
@@ -469,12 +1517,424 @@
 
 				DataIndex += FFX_PARALLELSORT_THREADGROUP_SIZE;	// Increase the data offset by thread group size
 			}
+#endif // kRS_TileScatter / kRS_MatchScatter
+		}
+	}
+
+	// Deferred payload gather. One thread per payload uint (so records of any size stay coalesced), looping over the whole set.
+	void FFX_ParallelSort_GatherPayload(uint localID, uint groupID, FFX_ParallelSortCB CBuffer, uint RecordStride, RWStructuredBuffer<uint> SrcIndices, RWStructuredBuffer<uint> SrcPayload, RWStructuredBuffer<uint> DstPayload)
+	{
+		uint NumValues = CBuffer.NumKeys * RecordStride;
+		for (uint ValueIndex = groupID * FFX_PARALLELSORT_THREADGROUP_SIZE + localID; ValueIndex < NumValues; ValueIndex += CBuffer.NumThreadGroups * FFX_PARALLELSORT_THREADGROUP_SIZE)
+		{
+			uint KeyIndex = ValueIndex / RecordStride;
+			uint RecordWord = ValueIndex - KeyIndex * RecordStride;
+			DstPayload[ValueIndex] = SrcPayload[SrcIndices[KeyIndex] * RecordStride + RecordWord];
+		}
+	}
+
+	// Packed key+index sorts. Each key goes above its IndexBits bit source index, one thread per key, looping over the whole set.
+	void FFX_ParallelSort_PackKeyIndex(uint localID, uint groupID, FFX_ParallelSortCB CBuffer, uint IndexBits, RWStructuredBuffer<uint> SrcKeys, RWStructuredBuffer<uint> DstPacked)
+	{
+		for (uint KeyIndex = groupID * FFX_PARALLELSORT_THREADGROUP_SIZE + localID; KeyIndex < CBuffer.NumKeys; KeyIndex += CBuffer.NumThreadGroups * FFX_PARALLELSORT_THREADGROUP_SIZE)
+			DstPacked[KeyIndex] = (SrcKeys[KeyIndex] << IndexBits) | KeyIndex;
+	}
+
+	// And back into the sorted keys and the source index of each of them
+	void FFX_ParallelSort_UnpackKeyIndex(uint localID, uint groupID, FFX_ParallelSortCB CBuffer, uint IndexBits, RWStructuredBuffer<uint> SrcPacked, RWStructuredBuffer<uint> DstKeys, RWStructuredBuffer<uint> DstIndices)
+	{
+		uint IndexMask = (1u << IndexBits) - 1;
+		for (uint KeyIndex = groupID * FFX_PARALLELSORT_THREADGROUP_SIZE + localID; KeyIndex < CBuffer.NumKeys; KeyIndex += CBuffer.NumThreadGroups * FFX_PARALLELSORT_THREADGROUP_SIZE)
+		{
+			uint Packed = SrcPacked[KeyIndex];
+			DstKeys[KeyIndex] = Packed >> IndexBits;
+			DstIndices[KeyIndex] = Packed & IndexMask;
+		}
+	}
+
+	groupshared uint gs_FFX_PARALLELSORT_SelectBinCounts[FFX_PARALLELSORT_SORT_BIN_COUNT];
+	void FFX_ParallelSort_SelectDigit(uint localID, uint SelectQuery, FFX_ParallelSortCB CBuffer, uint ShiftBit, RWStructuredBuffer<uint> ReduceTable, RWStructuredBuffer<uint> SelectState)
+	{
+		// Total up the candidates in each bin (reduced table is laid out [ [bin0 ... bin0] [bin1 ... bin1] ... ])
+		uint ReduceTableOffset = SelectQuery * CBuffer.NumScanValues;
+		for (uint BinID = 0; BinID < FFX_PARALLELSORT_SORT_BIN_COUNT; BinID++)
+		{
+			uint binSum = 0;
+			for (uint i = localID; i < CBuffer.NumReduceThreadgroupPerBin; i += FFX_PARALLELSORT_THREADGROUP_SIZE)
+				binSum += ReduceTable[ReduceTableOffset + BinID * CBuffer.NumReduceThreadgroupPerBin + i];
+
+			binSum = FFX_ParallelSort_ThreadgroupReduce(binSum, localID);
+			if (!localID)
+				gs_FFX_PARALLELSORT_SelectBinCounts[BinID] = binSum;
+
+			// Wait for everyone to catch up (reduce re-uses LDS)
+			GroupMemoryBarrierWithGroupSync();
+		}
+
+		if (!localID)
+		{
+			uint PrefixIndex = FFX_ParallelSort_SelectStateIndex(CBuffer, FFX_PARALLELSORT_SELECT_STATE_PREFIX, SelectQuery);
+			uint RemainingIndex = FFX_ParallelSort_SelectStateIndex(CBuffer, FFX_PARALLELSORT_SELECT_STATE_REMAINING, SelectQuery);
+
+			// The first (most significant) digit starts off with every key as a candidate, looking for either the
+			// NumSelectKeys-th smallest key or the one at the query's percentile
+			bool FirstDigit = ShiftBit >= FFX_PARALLELSORT_SELECT_FIRST_SHIFT;
+			uint Prefix = FirstDigit ? 0 : SelectState[PrefixIndex];
+			uint Remaining;
+			if (FirstDigit)
+			{
+				float Percentile = saturate(asfloat(SelectState[FFX_ParallelSort_SelectStateIndex(CBuffer, FFX_PARALLELSORT_SELECT_STATE_PERCENTILE, SelectQuery)]));
+				Remaining = CBuffer.NumSelectKeys ? CBuffer.NumSelectKeys : min(uint(Percentile * (CBuffer.NumKeys - 1)), CBuffer.NumKeys - 1) + 1;
+			}
+			else
+				Remaining = SelectState[RemainingIndex];
+
+			// Skip whole bins until the one holding the key we are looking for
+			uint Digit = 0;
+			for (; Digit < FFX_PARALLELSORT_SORT_BIN_COUNT - 1 && gs_FFX_PARALLELSORT_SelectBinCounts[Digit] < Remaining; Digit++)
+				Remaining -= gs_FFX_PARALLELSORT_SelectBinCounts[Digit];
+
+			SelectState[PrefixIndex] = Prefix | (Digit << ShiftBit);
+			SelectState[RemainingIndex] = Remaining;
+			SelectState[FFX_ParallelSort_SelectStateIndex(CBuffer, FFX_PARALLELSORT_SELECT_STATE_NUM_LESS, SelectQuery)] = 0;
+			SelectState[FFX_ParallelSort_SelectStateIndex(CBuffer, FFX_PARALLELSORT_SELECT_STATE_NUM_EQUAL, SelectQuery)] = 0;
 		}
 	}
 
-	void FFX_ParallelSort_SetupIndirectParams(uint NumKeys, uint MaxThreadGroups, RWStructuredBuffer<FFX_ParallelSortCB> CBuffer, RWStructuredBuffer<uint> CountScatterArgs, RWStructuredBuffer<uint> ReduceScanArgs)
+	// Reserves output slots for all the lanes that want one with a single atomic per wave
+	uint FFX_ParallelSort_SelectAppend(bool Append, RWStructuredBuffer<uint> SelectState, uint CounterIndex)
+	{
+		uint waveCount = WaveActiveCountBits(Append);
+		uint waveOffset = 0;
+		if (WaveIsFirstLane() && waveCount)
+			InterlockedAdd(SelectState[CounterIndex], waveCount, waveOffset);
+
+		return WaveReadLaneFirst(waveOffset) + WavePrefixCountBits(Append);
+	}
+
+	void FFX_ParallelSort_SelectCompact(uint localID, uint groupID, FFX_ParallelSortCB CBuffer, RWStructuredBuffer<uint> SrcBuffer, RWStructuredBuffer<uint> DstBuffer, RWStructuredBuffer<uint> SelectState
+#ifdef kRS_ValueCopy
+										,RWStructuredBuffer<uint> SrcPayload, RWStructuredBuffer<uint> DstPayload
+#endif // kRS_ValueCopy
+	)
+	{
+		// Everything below the threshold makes it, and the remaining slots go to keys equal to it (top-K is always query 0)
+		uint Threshold = SelectState[FFX_ParallelSort_SelectStateIndex(CBuffer, FFX_PARALLELSORT_SELECT_STATE_PREFIX, 0)];
+		uint NumEqualKeys = SelectState[FFX_ParallelSort_SelectStateIndex(CBuffer, FFX_PARALLELSORT_SELECT_STATE_REMAINING, 0)];
+		uint NumLessKeys = CBuffer.NumSelectKeys - NumEqualKeys;
+
+		// Same block distribution as count/scatter
+		int BlockSize = FFX_PARALLELSORT_ELEMENTS_PER_THREAD * FFX_PARALLELSORT_THREADGROUP_SIZE;
+		uint ThreadgroupBlockStart = (BlockSize * CBuffer.NumBlocksPerThreadGroup * groupID);
+		uint NumBlocksToProcess = CBuffer.NumBlocksPerThreadGroup;
+
+		if (groupID >= CBuffer.NumThreadGroups - CBuffer.NumThreadGroupsWithAdditionalBlocks)
+		{
+			ThreadgroupBlockStart += (groupID - (CBuffer.NumThreadGroups - CBuffer.NumThreadGroupsWithAdditionalBlocks)) * BlockSize;
+			NumBlocksToProcess++;
+		}
+
+		uint BlockIndex = ThreadgroupBlockStart + localID;
+		for (uint BlockCount = 0; BlockCount < NumBlocksToProcess; BlockCount++, BlockIndex += BlockSize)
+		{
+			uint DataIndex = BlockIndex;
+
+			// Pre-load the key values in order to hide some of the read latency
+			uint srcKeys[FFX_PARALLELSORT_ELEMENTS_PER_THREAD];
+			srcKeys[0] = SrcBuffer[DataIndex];
+			srcKeys[1] = SrcBuffer[DataIndex + FFX_PARALLELSORT_THREADGROUP_SIZE];
+			srcKeys[2] = SrcBuffer[DataIndex + (FFX_PARALLELSORT_THREADGROUP_SIZE * 2)];
+			srcKeys[3] = SrcBuffer[DataIndex + (FFX_PARALLELSORT_THREADGROUP_SIZE * 3)];
+
+			for (uint i = 0; i < FFX_PARALLELSORT_ELEMENTS_PER_THREAD; i++, DataIndex += FFX_PARALLELSORT_THREADGROUP_SIZE)
+			{
+				bool bValid = DataIndex < CBuffer.NumKeys;
+				bool bLess = bValid && srcKeys[i] < Threshold;
+				bool bEqual = bValid && srcKeys[i] == Threshold;
+
+				// Keep the whole wave together for the appends
+				uint lessOffset = FFX_ParallelSort_SelectAppend(bLess, SelectState, FFX_ParallelSort_SelectStateIndex(CBuffer, FFX_PARALLELSORT_SELECT_STATE_NUM_LESS, 0));
+				uint equalOffset = FFX_ParallelSort_SelectAppend(bEqual, SelectState, FFX_ParallelSort_SelectStateIndex(CBuffer, FFX_PARALLELSORT_SELECT_STATE_NUM_EQUAL, 0));
+
+				uint dstOffset = bLess ? lessOffset : NumLessKeys + equalOffset;
+				if (bLess || (bEqual && equalOffset < NumEqualKeys))
+				{
+					DstBuffer[dstOffset] = srcKeys[i];
+#ifdef kRS_ValueCopy
+					DstPayload[dstOffset] = SrcPayload[DataIndex];
+#endif // kRS_ValueCopy
+				}
+			}
+		}
+	}
+
+	// First index in [First, Last) holding a value that isn't below Value (Last if there is none)
+	uint FFX_ParallelSort_LowerBound(RWStructuredBuffer<uint> Buffer, uint Value, uint First, uint Last)
+	{
+		while (First < Last)
+		{
+			uint Middle = (First + Last) / 2;
+			if (Buffer[Middle] < Value)
+				First = Middle + 1;
+			else
+				Last = Middle;
+		}
+		return First;
+	}
+
+	// First index in [First, Last) holding a value above Value (Last if there is none)
+	uint FFX_ParallelSort_UpperBound(RWStructuredBuffer<uint> Buffer, uint Value, uint First, uint Last)
+	{
+		while (First < Last)
+		{
+			uint Middle = (First + Last) / 2;
+			if (Buffer[Middle] <= Value)
+				First = Middle + 1;
+			else
+				Last = Middle;
+		}
+		return First;
+	}
+
+	void FFX_ParallelSort_GatherDirtyPayload(uint localID, uint groupID, FFX_ParallelSortCB CBuffer, RWStructuredBuffer<uint> DirtyIndices, RWStructuredBuffer<uint> SrcPayload, RWStructuredBuffer<uint> DirtyPayload)
+	{
+		uint DirtyIndex = groupID * FFX_PARALLELSORT_THREADGROUP_SIZE + localID;
+		if (DirtyIndex < CBuffer.NumDirtyKeys)
+			DirtyPayload[DirtyIndex] = SrcPayload[DirtyIndices[DirtyIndex]];
+	}
+
+	// Merge windows: [0, 1] range of the other sequence the block's keys land in, [2, 3] range of dirty indices that can be below them
+	groupshared uint gs_FFX_PARALLELSORT_MergeWindow[4];
+	void FFX_ParallelSort_Merge(uint localID, uint groupID, FFX_ParallelSortCB CBuffer, RWStructuredBuffer<uint> SrcBuffer, RWStructuredBuffer<uint> DstBuffer, RWStructuredBuffer<uint> DirtyKeys, RWStructuredBuffer<uint> DirtyIndices
+#ifdef kRS_ValueCopy
+								,RWStructuredBuffer<uint> SrcPayload, RWStructuredBuffer<uint> DstPayload, RWStructuredBuffer<uint> DirtyPayload
+#endif // kRS_ValueCopy
+	)
+	{
+		// The first NumThreadGroups thread groups each take a block of the previous order, the rest a block of the sorted dirty keys
+		uint BlockSize = FFX_PARALLELSORT_ELEMENTS_PER_THREAD * FFX_PARALLELSORT_THREADGROUP_SIZE;
+		bool bDirtyBlock = groupID >= CBuffer.NumThreadGroups;
+		uint BlockStart = (bDirtyBlock ? groupID - CBuffer.NumThreadGroups : groupID) * BlockSize;
+		uint BlockEnd = min(BlockStart + BlockSize, bDirtyBlock ? CBuffer.NumDirtyKeys : CBuffer.NumKeys);
+
+		// Partition: the first and last key of the block bound the window every other key of the block lands in
+		if (localID < 2)
+		{
+			uint BoundIndex = localID ? BlockEnd - 1 : BlockStart;
+			if (bDirtyBlock)
+			{
+				uint NumOlder = FFX_ParallelSort_UpperBound(SrcBuffer, DirtyKeys[BoundIndex], 0, CBuffer.NumKeys);
+				gs_FFX_PARALLELSORT_MergeWindow[localID] = NumOlder;
+				gs_FFX_PARALLELSORT_MergeWindow[2 + localID] = FFX_ParallelSort_LowerBound(DirtyIndices, NumOlder, 0, CBuffer.NumDirtyKeys);
+			}
+			else
+			{
+				gs_FFX_PARALLELSORT_MergeWindow[localID] = FFX_ParallelSort_LowerBound(DirtyKeys, SrcBuffer[BoundIndex], 0, CBuffer.NumDirtyKeys);
+				gs_FFX_PARALLELSORT_MergeWindow[2 + localID] = FFX_ParallelSort_LowerBound(DirtyIndices, BoundIndex, 0, CBuffer.NumDirtyKeys);
+			}
+		}
+
+		// Wait for the windows
+		GroupMemoryBarrierWithGroupSync();
+
+		uint DataIndex = BlockStart + localID;
+		for (uint i = 0; i < FFX_PARALLELSORT_ELEMENTS_PER_THREAD && DataIndex < BlockEnd; i++, DataIndex += FFX_PARALLELSORT_THREADGROUP_SIZE)
+		{
+			if (bDirtyBlock)
+			{
+				// Goes after every previous key that isn't bigger (minus the changed ones, they don't get written)
+				uint Key = DirtyKeys[DataIndex];
+				uint NumOlder = FFX_ParallelSort_UpperBound(SrcBuffer, Key, gs_FFX_PARALLELSORT_MergeWindow[0], gs_FFX_PARALLELSORT_MergeWindow[1]);
+				uint NumRemoved = FFX_ParallelSort_LowerBound(DirtyIndices, NumOlder, gs_FFX_PARALLELSORT_MergeWindow[2], gs_FFX_PARALLELSORT_MergeWindow[3]);
+				uint DstIndex = DataIndex + NumOlder - NumRemoved;
+
+				DstBuffer[DstIndex] = Key;
+#ifdef kRS_ValueCopy
+				DstPayload[DstIndex] = DirtyPayload[DataIndex];
+#endif // kRS_ValueCopy
+			}
+			else
+			{
+				// Changed entries are skipped, their sorted dirty copy takes their place
+				uint NumRemoved = FFX_ParallelSort_LowerBound(DirtyIndices, DataIndex, gs_FFX_PARALLELSORT_MergeWindow[2], gs_FFX_PARALLELSORT_MergeWindow[3]);
+				if (NumRemoved < CBuffer.NumDirtyKeys && DirtyIndices[NumRemoved] == DataIndex)
+					continue;
+
+				// Goes after every dirty key that is smaller
+				uint Key = SrcBuffer[DataIndex];
+				uint NumDirtyBefore = FFX_ParallelSort_LowerBound(DirtyKeys, Key, gs_FFX_PARALLELSORT_MergeWindow[0], gs_FFX_PARALLELSORT_MergeWindow[1]);
+				uint DstIndex = DataIndex - NumRemoved + NumDirtyBefore;
+
+				DstBuffer[DstIndex] = Key;
+#ifdef kRS_ValueCopy
+				DstPayload[DstIndex] = SrcPayload[DataIndex];
+#endif // kRS_ValueCopy
+			}
+		}
+	}
+
+	// Out-of-core merge of NumMergeRuns sorted runs stored back to back in SrcBuffer (run r is [RunOffsets[r], RunOffsets[r + 1]))
+	void FFX_ParallelSort_MergeRuns(uint localID, uint groupID, FFX_ParallelSortCB CBuffer, RWStructuredBuffer<uint> SrcBuffer, RWStructuredBuffer<uint> DstBuffer, RWStructuredBuffer<uint> RunOffsets
+#ifdef kRS_ValueCopy
+									,RWStructuredBuffer<uint> SrcPayload, RWStructuredBuffer<uint> DstPayload
+#endif // kRS_ValueCopy
+	)
+	{
+		uint BlockSize = FFX_PARALLELSORT_ELEMENTS_PER_THREAD * FFX_PARALLELSORT_THREADGROUP_SIZE;
+		uint DataIndex = groupID * BlockSize + localID;
+		for (uint i = 0; i < FFX_PARALLELSORT_ELEMENTS_PER_THREAD && DataIndex < CBuffer.NumKeys; i++, DataIndex += FFX_PARALLELSORT_THREADGROUP_SIZE)
+		{
+			// Last run starting at or before the key (empty runs start where the next one does, so they never match)
+			uint Run = FFX_ParallelSort_UpperBound(RunOffsets, DataIndex, 0, CBuffer.NumMergeRuns + 1) - 1;
+			uint Key = SrcBuffer[DataIndex];
+
+			// Rank in its own run, plus the keys of every other run that go first (ties go to the earlier run)
+			uint DstIndex = DataIndex - RunOffsets[Run];
+			for (uint OtherRun = 0; OtherRun < CBuffer.NumMergeRuns; OtherRun++)
+			{
+				uint RunStart = RunOffsets[OtherRun];
+				uint RunEnd = RunOffsets[OtherRun + 1];
+				if (OtherRun < Run)
+					DstIndex += FFX_ParallelSort_UpperBound(SrcBuffer, Key, RunStart, RunEnd) - RunStart;
+				else if (OtherRun > Run)
+					DstIndex += FFX_ParallelSort_LowerBound(SrcBuffer, Key, RunStart, RunEnd) - RunStart;
+			}
+
+			DstBuffer[DstIndex] = Key;
+#ifdef kRS_ValueCopy
+			DstPayload[DstIndex] = SrcPayload[DataIndex];
+#endif // kRS_ValueCopy
+		}
+	}
+
+	// Multi-word keys compare from the most significant word down
+	bool FFX_ParallelSort_KeyGreater(uint NumKeys, uint NumKeyWords, RWStructuredBuffer<uint> SrcBuffer, uint IndexA, uint IndexB)
+	{
+		for (int KeyWord = int(NumKeyWords) - 1; KeyWord >= 0; KeyWord--)
+		{
+			uint KeyA = SrcBuffer[KeyWord * NumKeys + IndexA];
+			uint KeyB = SrcBuffer[KeyWord * NumKeys + IndexB];
+			if (KeyA != KeyB)
+				return KeyA > KeyB;
+		}
+		return false;
+	}
+
+	void FFX_ParallelSort_CountInversions(uint localID, uint groupID, uint NumThreadGroups, uint NumKeys, uint NumKeyWords, RWStructuredBuffer<uint> SrcBuffer, RWStructuredBuffer<uint> PresortState)
+	{
+		// Every thread group walks its share of the neighbouring pairs (grid stride, so any number of thread groups works)
+		uint NumInversions = 0;
+		for (uint DataIndex = groupID * FFX_PARALLELSORT_THREADGROUP_SIZE + localID; DataIndex + 1 < NumKeys; DataIndex += NumThreadGroups * FFX_PARALLELSORT_THREADGROUP_SIZE)
+			NumInversions += FFX_ParallelSort_KeyGreater(NumKeys, NumKeyWords, SrcBuffer, DataIndex, DataIndex + 1) ? 1 : 0;
+
+		// One atomic per thread group
+		NumInversions = FFX_ParallelSort_ThreadgroupReduce(NumInversions, localID);
+		if (!localID && NumInversions)
+			InterlockedAdd(PresortState[FFX_PARALLELSORT_PRESORT_STATE_INVERSIONS], NumInversions);
+	}
+
+	// Bit mixer for the validation checksums. It isn't order independent itself (key words get chained through it), the checksums
+	// are, as they add up one hash per key or key/payload pair
+	uint FFX_ParallelSort_ValidateHash(uint Value)
+	{
+		Value ^= Value >> 16;
+		Value *= 0x7FEB352D;
+		Value ^= Value >> 15;
+		Value *= 0x846CA68B;
+		Value ^= Value >> 16;
+		return Value;
+	}
+
+	void FFX_ParallelSort_Validate(uint localID, uint groupID, uint NumThreadGroups, uint NumKeys, uint NumKeyWords, RWStructuredBuffer<FFX_PARALLELSORT_KEY_TYPE> SrcBuffer, RWStructuredBuffer<uint> ValidateState, bool bSorted
+#ifdef kRS_ValueCopy
+								   ,RWStructuredBuffer<uint> SrcPayload
+#endif // kRS_ValueCopy
+	)
+	{
+		// Grid stride like CountInversions, checking each key against the next one when looking at the sorted keys
+		uint KeySum = 0, KeyHash = 0, PairHash = 0, NumInversions = 0, FirstViolation = 0xFFFFFFFF;
+		for (uint DataIndex = groupID * FFX_PARALLELSORT_THREADGROUP_SIZE + localID; DataIndex < NumKeys; DataIndex += NumThreadGroups * FFX_PARALLELSORT_THREADGROUP_SIZE)
+		{
+			uint Hash = 0;
+			for (uint KeyWord = 0; KeyWord < NumKeyWords; KeyWord++)
+			{
+				uint Key = SrcBuffer[KeyWord * NumKeys + DataIndex];
+				KeySum += Key;
+				Hash = FFX_ParallelSort_ValidateHash(Hash ^ Key);
+			}
+			KeyHash += Hash;
+#ifdef kRS_ValueCopy
+			PairHash += FFX_ParallelSort_ValidateHash(Hash ^ FFX_ParallelSort_ValidateHash(SrcPayload[DataIndex]));
+#endif // kRS_ValueCopy
+
+#ifdef kRS_16BitKeys
+			bool bInversion = bSorted && DataIndex + 1 < NumKeys && SrcBuffer[DataIndex] > SrcBuffer[DataIndex + 1];
+#else
+			bool bInversion = bSorted && DataIndex + 1 < NumKeys && FFX_ParallelSort_KeyGreater(NumKeys, NumKeyWords, SrcBuffer, DataIndex, DataIndex + 1);
+#endif // kRS_16BitKeys
+			if (bInversion)
+			{
+				NumInversions++;
+				FirstViolation = min(FirstViolation, DataIndex);
+			}
+		}
+
+		// One set of atomics per wave
+		uint StateOffset = bSorted ? FFX_PARALLELSORT_VALIDATE_STATE_OUTPUT_KEY_SUM : FFX_PARALLELSORT_VALIDATE_STATE_INPUT_KEY_SUM;
+		KeySum = WaveActiveSum(KeySum);
+		KeyHash = WaveActiveSum(KeyHash);
+		PairHash = WaveActiveSum(PairHash);
+		NumInversions = WaveActiveSum(NumInversions);
+		FirstViolation = WaveActiveMin(FirstViolation);
+		if (WaveIsFirstLane())
+		{
+			InterlockedAdd(ValidateState[StateOffset], KeySum);
+			InterlockedAdd(ValidateState[StateOffset + 1], KeyHash);
+			InterlockedAdd(ValidateState[StateOffset + 2], PairHash);
+			if (NumInversions)
+			{
+				InterlockedAdd(ValidateState[FFX_PARALLELSORT_VALIDATE_STATE_INVERSIONS], NumInversions);
+				InterlockedMin(ValidateState[FFX_PARALLELSORT_VALIDATE_STATE_FIRST_VIOLATION], FirstViolation);
+			}
+		}
+	}
+
+	void FFX_ParallelSort_ValidateResult(RWStructuredBuffer<uint> ValidateState)
+	{
+		uint Status = 0;
+		if (ValidateState[FFX_PARALLELSORT_VALIDATE_STATE_INVERSIONS])
+			Status |= FFX_PARALLELSORT_VALIDATE_FAILED_ORDER;
+		if (ValidateState[FFX_PARALLELSORT_VALIDATE_STATE_INPUT_KEY_SUM] != ValidateState[FFX_PARALLELSORT_VALIDATE_STATE_OUTPUT_KEY_SUM] ||
+			ValidateState[FFX_PARALLELSORT_VALIDATE_STATE_INPUT_KEY_HASH] != ValidateState[FFX_PARALLELSORT_VALIDATE_STATE_OUTPUT_KEY_HASH])
+			Status |= FFX_PARALLELSORT_VALIDATE_FAILED_KEYS;
+		if (ValidateState[FFX_PARALLELSORT_VALIDATE_STATE_INPUT_PAIR_HASH] != ValidateState[FFX_PARALLELSORT_VALIDATE_STATE_OUTPUT_PAIR_HASH])
+			Status |= FFX_PARALLELSORT_VALIDATE_FAILED_PAYLOAD;
+
+		ValidateState[FFX_PARALLELSORT_VALIDATE_STATE_RESULT + FFX_PARALLELSORT_VALIDATE_RESULT_STATUS] = Status;
+		ValidateState[FFX_PARALLELSORT_VALIDATE_STATE_RESULT + FFX_PARALLELSORT_VALIDATE_RESULT_INVERSIONS] = ValidateState[FFX_PARALLELSORT_VALIDATE_STATE_INVERSIONS];
+		ValidateState[FFX_PARALLELSORT_VALIDATE_STATE_RESULT + FFX_PARALLELSORT_VALIDATE_RESULT_FIRST_VIOLATION] = ValidateState[FFX_PARALLELSORT_VALIDATE_STATE_FIRST_VIOLATION];
+		ValidateState[FFX_PARALLELSORT_VALIDATE_STATE_RESULT + FFX_PARALLELSORT_VALIDATE_RESULT_COUNT] += 1;
+
+		// Start over for the next sort
+		for (uint i = 0; i < FFX_PARALLELSORT_VALIDATE_STATE_FIRST_VIOLATION; i++)
+			ValidateState[i] = 0;
+		ValidateState[FFX_PARALLELSORT_VALIDATE_STATE_FIRST_VIOLATION] = 0xFFFFFFFF;
+	}
+
+	void FFX_ParallelSort_SetupIndirectParams(uint NumKeys, uint MaxThreadGroups, uint NumKeyWords, uint KeyStride, uint KeyOffset, RWStructuredBuffer<FFX_ParallelSortCB> CBuffer, RWStructuredBuffer<uint> CountScatterArgs, RWStructuredBuffer<uint> ReduceScanArgs
+#ifdef kRS_PresortCheck
+											  ,RWStructuredBuffer<uint> PresortState
+#endif // kRS_PresortCheck
+	)
 	{
 		CBuffer[0].NumKeys = NumKeys;
+		CBuffer[0].NumKeyWords = NumKeyWords;
+		CBuffer[0].NumSelectKeys = 0;
+		CBuffer[0].NumSelectQueries = 1;
+		CBuffer[0].NumDirtyKeys = 0;
+		CBuffer[0].NumMergeRuns = 0;
+		CBuffer[0].KeyStride = KeyStride;
+		CBuffer[0].KeyOffset = KeyOffset;
 
 		uint BlockSize = FFX_PARALLELSORT_ELEMENTS_PER_THREAD * FFX_PARALLELSORT_THREADGROUP_SIZE;
 		uint NumBlocks = (NumKeys + BlockSize - 1) / BlockSize;
@@ -507,6 +1967,25 @@
 		ReduceScanArgs[0] = NumReducedThreadGroupsToRun;
 		ReduceScanArgs[1] = 1;
 		ReduceScanArgs[2] = 1;
+
+		// Second set of args is for the scan hierarchy (only used when the reduced table can be bigger than a single scan block)
+		ReduceScanArgs[3] = FFX_ParallelSort_NumScanBlocks(NumReducedThreadGroupsToRun);
+		ReduceScanArgs[4] = 1;
+		ReduceScanArgs[5] = 1;
+		// (the fused ReduceScanAdd also goes by these: with at most 2 reduce thread groups per bin, they always come to 1 group)
+
+#ifdef kRS_PresortCheck
+		// Keys that are already in order don't need any of the passes (and the check starts over for the next sort)
+		uint NumInversions = PresortState[FFX_PARALLELSORT_PRESORT_STATE_INVERSIONS];
+		if (!NumInversions)
+		{
+			CountScatterArgs[0] = 0;
+			ReduceScanArgs[0] = 0;
+			ReduceScanArgs[3] = 0;
+		}
+		PresortState[FFX_PARALLELSORT_PRESORT_STATE_LAST_INVERSIONS] = NumInversions;
+		PresortState[FFX_PARALLELSORT_PRESORT_STATE_INVERSIONS] = 0;
+#endif // kRS_PresortCheck
 	}
 
 #endif // __cplusplus
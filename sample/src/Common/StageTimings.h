@@ -0,0 +1,157 @@
+// StageTimings.h
+// 
+// Copyright(c) 2021 Advanced Micro Devices, Inc.All rights reserved.
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Rolling per-stage GPU timings of the sort, shared by the DX12 and VK samples.
+// Stage stamps are named "FPS <Stage> <Shift>" and each one holds the time since the previous stamp.
+class StageTimings
+{
+public:
+    struct Timing
+    {
+        std::string Label;
+        float       P50;    // Rolling median (microseconds)
+        float       P99;    // Rolling 99th percentile (microseconds)
+    };
+
+    // GPUTimestamps holds 128 queries per frame, leave a few for the renderer's own stamps
+    static const uint32_t MaxTimeStampsPerSort = 120;
+    static const uint32_t HistorySize = 128;
+
+    // Call before recording a sort, and before each stage stamp (returns false once the query budget is used up)
+    void BeginSort() { m_NumTimeStamps = 0; m_bTruncated = false; }
+    bool ReserveTimeStamp()
+    {
+        if (m_NumTimeStamps >= MaxTimeStampsPerSort)
+        {
+            m_bTruncated = true;
+            return false;
+        }
+        ++m_NumTimeStamps;
+        return true;
+    }
+    bool IsTruncated() const { return m_bTruncated; }
+
+    void Clear()
+    {
+        m_StageHistory.clear();
+        m_PassHistory.clear();
+    }
+
+    // Pull the stage stamps out of the frame's timings and fold them into the rolling history.
+    // sortLabel is the stamp the renderer closes the sort with, it only covers the time after the last stage
+    // so the stage times get added back into it (and into our "Total") to keep it the time of the whole sort
+    template<typename TimeStampType>
+    void Update(std::vector<TimeStampType>& timeStamps, const char* sortLabel)
+    {
+        std::vector<std::pair<std::string, float>> stageTotals;
+        float stageSum = 0.f;
+        for (TimeStampType& timeStamp : timeStamps)
+        {
+            if (timeStamp.m_label == sortLabel)
+            {
+                if (stageTotals.empty())
+                    continue;
+
+                for (const std::pair<std::string, float>& total : stageTotals)
+                    AddSample(m_StageHistory, total.first, total.second);
+                stageTotals.clear();
+
+                AddSample(m_StageHistory, "Tail", timeStamp.m_microseconds);
+                timeStamp.m_microseconds += stageSum;
+                AddSample(m_StageHistory, "Total", timeStamp.m_microseconds);
+                stageSum = 0.f;
+                continue;
+            }
+
+            if (timeStamp.m_label.compare(0, 4, "FPS ") != 0)
+                continue;
+
+            AddSample(m_PassHistory, timeStamp.m_label, timeStamp.m_microseconds);
+            stageSum += timeStamp.m_microseconds;
+
+            // Strip the prefix and shift to get the stage, then sum up all passes of that stage
+            std::string stage = timeStamp.m_label.substr(4, timeStamp.m_label.rfind(' ') - 4);
+            auto it = std::find_if(stageTotals.begin(), stageTotals.end(), [&stage](const std::pair<std::string, float>& total) { return total.first == stage; });
+            if (it == stageTotals.end())
+                stageTotals.push_back(std::make_pair(stage, timeStamp.m_microseconds));
+            else
+                it->second += timeStamp.m_microseconds;
+        }
+
+        for (const std::pair<std::string, float>& total : stageTotals)
+            AddSample(m_StageHistory, total.first, total.second);
+    }
+
+    // Get rolling p50/p99 for each stage (or for each stage of every pass)
+    void Get(std::vector<Timing>& timings, bool perPass) const
+    {
+        timings.clear();
+
+        const std::vector<History>& history = perPass ? m_PassHistory : m_StageHistory;
+        for (const History& entry : history)
+        {
+            std::vector<float> samples(entry.Samples);
+            std::sort(samples.begin(), samples.end());
+
+            Timing timing;
+            timing.Label = entry.Label;
+            timing.P50 = samples[(samples.size() - 1) / 2];
+            timing.P99 = samples[(samples.size() - 1) * 99 / 100];
+            timings.push_back(timing);
+        }
+    }
+
+private:
+    struct History
+    {
+        std::string         Label;
+        std::vector<float>  Samples;
+        uint32_t            NextSample = 0;
+    };
+
+    // Add a sample to the rolling history kept for a label
+    static void AddSample(std::vector<History>& history, const std::string& label, float microseconds)
+    {
+        auto it = std::find_if(history.begin(), history.end(), [&label](const History& entry) { return entry.Label == label; });
+        if (it == history.end())
+        {
+            History entry;
+            entry.Label = label;
+            history.push_back(entry);
+            it = history.end() - 1;
+        }
+
+        if (it->Samples.size() < HistorySize)
+            it->Samples.push_back(microseconds);
+        else
+            it->Samples[it->NextSample] = microseconds;
+        it->NextSample = (it->NextSample + 1) % HistorySize;
+    }
+
+    std::vector<History>    m_StageHistory;     // Per stage, summed over all passes of a sort
+    std::vector<History>    m_PassHistory;      // Per stage and shift
+    uint32_t                m_NumTimeStamps = 0;
+    bool                    m_bTruncated = false;
+};
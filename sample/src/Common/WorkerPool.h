@@ -0,0 +1,96 @@
+// WorkerPool.h
+// 
+// Copyright(c) 2021 Advanced Micro Devices, Inc.All rights reserved.
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Small fixed-size pool of worker threads, shared by the DX12 and VK samples to build pipeline permutations.
+// Threads are started on the first Submit() (at most one per hardware thread), and tasks run in the order they were submitted.
+class WorkerPool
+{
+public:
+    WorkerPool() = default;
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+    ~WorkerPool() { Stop(); }
+
+    // Queue a task, the returned future hands back its result (or rethrows what it threw)
+    template<typename Task>
+    auto Submit(Task&& task) -> std::shared_future<decltype(task())>
+    {
+        typedef decltype(task()) Result;
+        std::shared_ptr<std::packaged_task<Result()>> pTask = std::make_shared<std::packaged_task<Result()>>(std::forward<Task>(task));
+        std::shared_future<Result> Future = pTask->get_future().share();
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Tasks.push_back([pTask]() { (*pTask)(); });
+            if (m_Threads.size() < std::max(1u, std::thread::hardware_concurrency()))
+                m_Threads.emplace_back(&WorkerPool::Run, this);
+        }
+        m_Condition.notify_one();
+        return Future;
+    }
+
+    // Finish the queued tasks and join the threads (the pool can be used again afterwards)
+    void Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_bStopping = true;
+        }
+        m_Condition.notify_all();
+        for (std::thread& Thread : m_Threads)
+            Thread.join();
+        m_Threads.clear();
+        m_bStopping = false;
+    }
+
+private:
+    void Run()
+    {
+        for (;;)
+        {
+            std::function<void()> Task;
+            {
+                std::unique_lock<std::mutex> lock(m_Mutex);
+                m_Condition.wait(lock, [this]() { return m_bStopping || !m_Tasks.empty(); });
+                if (m_Tasks.empty())
+                    return;
+                Task = std::move(m_Tasks.front());
+                m_Tasks.pop_front();
+            }
+            Task();
+        }
+    }
+
+    std::vector<std::thread>            m_Threads;
+    std::deque<std::function<void()>>   m_Tasks;
+    std::mutex                          m_Mutex;
+    std::condition_variable             m_Condition;
+    bool                                m_bStopping = false;
+};
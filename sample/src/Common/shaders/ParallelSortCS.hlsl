@@ -29,6 +29,9 @@
 {
 	uint NumKeysIndex;
 	uint MaxThreadGroups;
+	uint NumKeyWords;
+	uint KeyStride;
+	uint KeyOffset;
 };
 
 struct RootConstantData {
@@ -43,9 +46,18 @@ struct RootConstantData {
 
 [[vk::binding(0, 2)]] RWStructuredBuffer<uint>	SrcBuffer		: register(u0, space0);					// The unsorted keys or scan data
 [[vk::binding(2, 2)]] RWStructuredBuffer<uint>	SrcPayload		: register(u0, space1);					// The payload data
+#ifdef kRS_ReadOnlyInput
+[[vk::binding(0, 2)]] ByteAddressBuffer			SrcBufferRO		: register(t0, space0);					// Read-only view of the unsorted keys (Count and Scatter)
+[[vk::binding(2, 2)]] ByteAddressBuffer			SrcPayloadRO	: register(t0, space1);					// Read-only view of the payload data (Scatter)
+#endif // kRS_ReadOnlyInput
+#ifdef kRS_16BitKeys
+[[vk::binding(4, 2)]] RWStructuredBuffer<uint16_t>	SrcKeys16	: register(u0, space20);				// The unsorted keys, stored as 16-bit values (Count, Scatter and Validate)
+[[vk::binding(5, 2)]] RWStructuredBuffer<uint16_t>	DstKeys16	: register(u0, space21);				// The sorted keys, stored as 16-bit values (Scatter)
+#endif // kRS_16BitKeys
 				 
 [[vk::binding(0, 4)]] RWStructuredBuffer<uint>	SumTable		: register(u0, space2);					// The sum table we will write sums to
 [[vk::binding(1, 4)]] RWStructuredBuffer<uint>	ReduceTable		: register(u0, space3);					// The reduced sum table we will write sums to
+[[vk::binding(2, 4)]] RWStructuredBuffer<uint>	SelectState		: register(u0, space13);				// Selection state (thresholds, compaction counters and percentile queries)
 				 
 [[vk::binding(1, 2)]] RWStructuredBuffer<uint>	DstBuffer		: register(u0, space4);					// The sorted keys or prefixed data
 [[vk::binding(3, 2)]] RWStructuredBuffer<uint>	DstPayload		: register(u0, space5);					// the sorted payload data
@@ -58,25 +70,73 @@ struct RootConstantData {
 [[vk::binding(1, 5)]] RWStructuredBuffer<FFX_ParallelSortCB>	CBufferUAV	: register(u0, space10);	// UAV for constant buffer parameters for indirect execution
 [[vk::binding(2, 5)]] RWStructuredBuffer<uint>	CountScatterArgs: register(u0, space11);				// Count and Scatter Args for indirect execution
 [[vk::binding(3, 5)]] RWStructuredBuffer<uint>	ReduceScanArgs	: register(u0, space12);				// Reduce and Scan Args for indirect execution
+[[vk::binding(4, 5)]] RWStructuredBuffer<uint>	PresortState	: register(u0, space14);				// Inversion counts for skipping sorts of ordered keys
+[[vk::binding(5, 5)]] RWStructuredBuffer<uint>	ValidateState	: register(u0, space19);				// Checksums and the result record of GPU validation
+
+[[vk::binding(0, 6)]] RWStructuredBuffer<uint>	DirtyKeys		: register(u0, space15);				// New keys of the entries that changed (incremental re-sort)
+[[vk::binding(1, 6)]] RWStructuredBuffer<uint>	DirtyPayload	: register(u0, space16);				// Payloads of the entries that changed (incremental re-sort)
+[[vk::binding(2, 6)]] RWStructuredBuffer<uint>	DirtyIndices	: register(u0, space17);				// Positions of the entries that changed in the previous order (incremental re-sort)
+
+[[vk::binding(0, 7)]] RWStructuredBuffer<uint>	RunOffsets		: register(u0, space18);				// Where each sorted run starts, plus the total key count (out-of-core merge)
+
+// Kernels specialized for a wave size (kRS_WaveSize) get it pinned when the device could run them at another one (shader model 6.6)
+#ifdef kRS_PinWaveSize
+	#define FPS_WAVE_SIZE	[WaveSize(kRS_WaveSize)]
+#else
+	#define FPS_WAVE_SIZE
+#endif // kRS_PinWaveSize
+
+// Key hooks (the sample's keys already sit in the sort buffers, so these just read and write them where the sort would. An
+// integration would make its keys up here instead, e.g. view depth from a particle's position, and write them out as needed)
+#ifdef kRS_LoadKeyHook
+uint FFX_ParallelSort_LoadKey(uint Index)
+{
+	return SrcBuffer[Index];
+}
+#endif // kRS_LoadKeyHook
+
+#ifdef kRS_StoreKeyHook
+void FFX_ParallelSort_StoreKey(uint Index, uint Key)
+{
+	DstBuffer[Index] = Key;
+}
+#endif // kRS_StoreKeyHook
 
 
 // FPS Count
+FPS_WAVE_SIZE
 [numthreads(FFX_PARALLELSORT_THREADGROUP_SIZE, 1, 1)]
-void FPS_Count(uint localID : SV_GroupThreadID, uint groupID : SV_GroupID)
+void FPS_Count(uint localID : SV_GroupThreadID, uint3 groupID : SV_GroupID)
 {
-	// Call the uint version of the count part of the algorithm
-	FFX_ParallelSort_Count_uint(localID, groupID, CBuffer, rootConstData.CShiftBit, SrcBuffer, SumTable);
+	// Call the uint version of the count part of the algorithm (selections are batched one query per Y group)
+#ifdef kRS_ReadOnlyInput
+	FFX_ParallelSort_Count_uint(localID, groupID.x, CBuffer, rootConstData.CShiftBit, SrcBufferRO, SumTable
+#elif defined(kRS_16BitKeys)
+	FFX_ParallelSort_Count_uint(localID, groupID.x, CBuffer, rootConstData.CShiftBit, SrcKeys16, SumTable
+#else
+	FFX_ParallelSort_Count_uint(localID, groupID.x, CBuffer, rootConstData.CShiftBit, SrcBuffer, SumTable
+#endif // kRS_ReadOnlyInput
+#ifdef kRS_SelectPrefix
+								,SelectState, groupID.y
+#endif // kRS_SelectPrefix
+	);
 }
 
 // FPS Reduce
+FPS_WAVE_SIZE
 [numthreads(FFX_PARALLELSORT_THREADGROUP_SIZE, 1, 1)]
-void FPS_CountReduce(uint localID : SV_GroupThreadID, uint groupID : SV_GroupID)
+void FPS_CountReduce(uint localID : SV_GroupThreadID, uint3 groupID : SV_GroupID)
 {
 	// Call the reduce part of the algorithm
-	FFX_ParallelSort_ReduceCount(localID, groupID, CBuffer,  SumTable, ReduceTable);
+	FFX_ParallelSort_ReduceCount(localID, groupID.x, CBuffer,  SumTable, ReduceTable
+#ifdef kRS_SelectPrefix
+								 ,groupID.y
+#endif // kRS_SelectPrefix
+	);
 }
 
 // FPS Scan
+FPS_WAVE_SIZE
 [numthreads(FFX_PARALLELSORT_THREADGROUP_SIZE, 1, 1)]
 void FPS_Scan(uint localID : SV_GroupThreadID, uint groupID : SV_GroupID)
 {
@@ -86,6 +146,7 @@ void FPS_Scan(uint localID : SV_GroupThreadID, uint groupID : SV_GroupID)
 }
 
 // FPS ScanAdd
+FPS_WAVE_SIZE
 [numthreads(FFX_PARALLELSORT_THREADGROUP_SIZE, 1, 1)]
 void FPS_ScanAdd(uint localID : SV_GroupThreadID, uint groupID : SV_GroupID)
 {
@@ -103,19 +164,221 @@ void FPS_ScanAdd(uint localID : SV_GroupThreadID, uint groupID : SV_GroupID)
 								CBuffer, ScanSrc, ScanDst, ScanScratch);
 }
 
+// FPS ReduceScanAdd (does FPS_CountReduce -> FPS_Scan -> FPS_ScanAdd in one thread group when there are few thread groups)
+FPS_WAVE_SIZE
+[numthreads(FFX_PARALLELSORT_THREADGROUP_SIZE, 1, 1)]
+void FPS_ReduceScanAdd(uint localID : SV_GroupThreadID)
+{
+	FFX_ParallelSort_ReduceScanAdd(localID, CBuffer, SumTable);
+}
+
+// FPS ScanBlockReduce (reduced tables too big for FPS_Scan are scanned via FPS_ScanBlockReduce -> FPS_ScanBlockSums -> FPS_ScanBlockAdd)
+FPS_WAVE_SIZE
+[numthreads(FFX_PARALLELSORT_THREADGROUP_SIZE, 1, 1)]
+void FPS_ScanBlockReduce(uint localID : SV_GroupThreadID, uint groupID : SV_GroupID)
+{
+	FFX_ParallelSort_ReduceScanBlocks(localID, groupID, CBuffer.NumScanValues, ScanSrc, ScanDst);
+}
+
+// FPS ScanBlockSums
+FPS_WAVE_SIZE
+[numthreads(FFX_PARALLELSORT_THREADGROUP_SIZE, 1, 1)]
+void FPS_ScanBlockSums(uint localID : SV_GroupThreadID, uint groupID : SV_GroupID)
+{
+	FFX_ParallelSort_ScanPrefix(FFX_ParallelSort_NumScanBlocks(CBuffer.NumScanValues), localID, groupID, 0, 0, false,
+								CBuffer, ScanSrc, ScanDst, ScanScratch);
+}
+
+// FPS ScanBlockAdd
+FPS_WAVE_SIZE
+[numthreads(FFX_PARALLELSORT_THREADGROUP_SIZE, 1, 1)]
+void FPS_ScanBlockAdd(uint localID : SV_GroupThreadID, uint groupID : SV_GroupID)
+{
+	uint BaseIndex = FFX_PARALLELSORT_ELEMENTS_PER_THREAD * FFX_PARALLELSORT_THREADGROUP_SIZE * groupID;
+	FFX_ParallelSort_ScanPrefix(CBuffer.NumScanValues, localID, groupID, 0, BaseIndex, true,
+								CBuffer, ScanSrc, ScanDst, ScanScratch);
+}
+
 // FPS Scatter
+FPS_WAVE_SIZE
 [numthreads(FFX_PARALLELSORT_THREADGROUP_SIZE, 1, 1)]
 void FPS_Scatter(uint localID : SV_GroupThreadID, uint groupID : SV_GroupID)
 {
+#ifdef kRS_ReadOnlyInput
+	FFX_ParallelSort_Scatter_uint(localID, groupID, CBuffer, rootConstData.CShiftBit, SrcBufferRO, DstBuffer, SumTable
+#ifdef kRS_ValueCopy
+								  ,SrcPayloadRO, DstPayload
+#endif // kRS_ValueCopy
+	);
+#elif defined(kRS_16BitKeys)
+	FFX_ParallelSort_Scatter_uint(localID, groupID, CBuffer, rootConstData.CShiftBit, SrcKeys16, DstKeys16, SumTable
+#ifdef kRS_ValueCopy
+								  ,SrcPayload, DstPayload
+#endif // kRS_ValueCopy
+	);
+#else
 	FFX_ParallelSort_Scatter_uint(localID, groupID, CBuffer, rootConstData.CShiftBit, SrcBuffer, DstBuffer, SumTable
 #ifdef kRS_ValueCopy
 								  ,SrcPayload, DstPayload
 #endif // kRS_ValueCopy
 	);
+#endif // kRS_ReadOnlyInput
+}
+
+// FPS GatherPayload (deferred payload gather: SrcBuffer holds the sorted source indices, the root constant is the record stride)
+[numthreads(FFX_PARALLELSORT_THREADGROUP_SIZE, 1, 1)]
+void FPS_GatherPayload(uint localID : SV_GroupThreadID, uint groupID : SV_GroupID)
+{
+	FFX_ParallelSort_GatherPayload(localID, groupID, CBuffer, rootConstData.CShiftBit, SrcBuffer, SrcPayload, DstPayload);
+}
+
+// FPS PackKeyIndex (packed key+index sort: put the source indices below the keys, the root constant is the index width)
+[numthreads(FFX_PARALLELSORT_THREADGROUP_SIZE, 1, 1)]
+void FPS_PackKeyIndex(uint localID : SV_GroupThreadID, uint groupID : SV_GroupID)
+{
+	FFX_ParallelSort_PackKeyIndex(localID, groupID, CBuffer, rootConstData.CShiftBit, SrcBuffer, DstBuffer);
+}
+
+// FPS UnpackKeyIndex (split the sorted words into the keys and the source indices, which go out as the payload)
+[numthreads(FFX_PARALLELSORT_THREADGROUP_SIZE, 1, 1)]
+void FPS_UnpackKeyIndex(uint localID : SV_GroupThreadID, uint groupID : SV_GroupID)
+{
+	FFX_ParallelSort_UnpackKeyIndex(localID, groupID, CBuffer, rootConstData.CShiftBit, SrcBuffer, DstBuffer, DstPayload);
+}
+
+// FPS SelectDigit (pick the next digit of each query's key from the reduced histogram, one thread group per query)
+FPS_WAVE_SIZE
+[numthreads(FFX_PARALLELSORT_THREADGROUP_SIZE, 1, 1)]
+void FPS_SelectDigit(uint localID : SV_GroupThreadID, uint groupID : SV_GroupID)
+{
+	FFX_ParallelSort_SelectDigit(localID, groupID, CBuffer, rootConstData.CShiftBit, ReduceTable, SelectState);
+}
+
+// FPS SelectCompact (top-K: gather the keys that made the cut)
+[numthreads(FFX_PARALLELSORT_THREADGROUP_SIZE, 1, 1)]
+void FPS_SelectCompact(uint localID : SV_GroupThreadID, uint groupID : SV_GroupID)
+{
+	FFX_ParallelSort_SelectCompact(localID, groupID, CBuffer, SrcBuffer, DstBuffer, SelectState
+#ifdef kRS_ValueCopy
+								   ,SrcPayload, DstPayload
+#endif // kRS_ValueCopy
+	);
+}
+
+// FPS GenerateDirtyKeys (sample only: change NumDirtyKeys entries of last frame's order, the root constant seeds it)
+uint FPS_Hash(uint Value)
+{
+	Value = (Value ^ 61) ^ (Value >> 16);
+	Value *= 9;
+	Value = Value ^ (Value >> 4);
+	Value *= 0x27d4eb2d;
+	return Value ^ (Value >> 15);
+}
+
+[numthreads(FFX_PARALLELSORT_THREADGROUP_SIZE, 1, 1)]
+void FPS_GenerateDirtyKeys(uint localID : SV_GroupThreadID, uint groupID : SV_GroupID)
+{
+	uint DirtyIndex = groupID * FFX_PARALLELSORT_THREADGROUP_SIZE + localID;
+	if (DirtyIndex >= CBuffer.NumDirtyKeys)
+		return;
+
+	// One position per stride keeps them unique and in order
+	uint Stride = CBuffer.NumKeys / CBuffer.NumDirtyKeys;
+	uint Hash = FPS_Hash(DirtyIndex ^ FPS_Hash(rootConstData.CShiftBit));
+	DirtyIndices[DirtyIndex] = DirtyIndex * Stride + Hash % Stride;
+	DirtyKeys[DirtyIndex] = FPS_Hash(Hash);
+}
+
+// FPS WriteKeyRecords (sample only: spread the keys out into records, the key at KeyOffset and filler around it)
+[numthreads(FFX_PARALLELSORT_THREADGROUP_SIZE, 1, 1)]
+void FPS_WriteKeyRecords(uint localID : SV_GroupThreadID, uint groupID : SV_GroupID)
+{
+	for (uint KeyIndex = groupID * FFX_PARALLELSORT_THREADGROUP_SIZE + localID; KeyIndex < CBuffer.NumKeys; KeyIndex += CBuffer.NumThreadGroups * FFX_PARALLELSORT_THREADGROUP_SIZE)
+	{
+		uint RecordStart = KeyIndex * CBuffer.KeyStride;
+		for (uint RecordWord = 0; RecordWord < CBuffer.KeyStride; RecordWord++)
+			DstBuffer[RecordStart + RecordWord] = (RecordWord == CBuffer.KeyOffset) ? SrcBuffer[KeyIndex] : FPS_Hash(RecordStart + RecordWord);
+	}
+}
+
+// FPS GatherDirtyPayload (incremental re-sort: pull the changed entries' payloads out of the previous order)
+[numthreads(FFX_PARALLELSORT_THREADGROUP_SIZE, 1, 1)]
+void FPS_GatherDirtyPayload(uint localID : SV_GroupThreadID, uint groupID : SV_GroupID)
+{
+	FFX_ParallelSort_GatherDirtyPayload(localID, groupID, CBuffer, DirtyIndices, SrcPayload, DirtyPayload);
+}
+
+// FPS Merge (incremental re-sort: merge the sorted dirty keys into the previous order)
+[numthreads(FFX_PARALLELSORT_THREADGROUP_SIZE, 1, 1)]
+void FPS_Merge(uint localID : SV_GroupThreadID, uint groupID : SV_GroupID)
+{
+	FFX_ParallelSort_Merge(localID, groupID, CBuffer, SrcBuffer, DstBuffer, DirtyKeys, DirtyIndices
+#ifdef kRS_ValueCopy
+						   ,SrcPayload, DstPayload, DirtyPayload
+#endif // kRS_ValueCopy
+	);
+}
+
+// FPS MergeRuns (out-of-core sort: merge the sorted runs that make up an output window)
+[numthreads(FFX_PARALLELSORT_THREADGROUP_SIZE, 1, 1)]
+void FPS_MergeRuns(uint localID : SV_GroupThreadID, uint groupID : SV_GroupID)
+{
+	FFX_ParallelSort_MergeRuns(localID, groupID, CBuffer, SrcBuffer, DstBuffer, RunOffsets
+#ifdef kRS_ValueCopy
+							   ,SrcPayload, DstPayload
+#endif // kRS_ValueCopy
+	);
+}
+
+// FPS CountInversions (presort check: count neighbouring keys that are out of order, MaxThreadGroups thread groups)
+FPS_WAVE_SIZE
+[numthreads(FFX_PARALLELSORT_THREADGROUP_SIZE, 1, 1)]
+void FPS_CountInversions(uint localID : SV_GroupThreadID, uint groupID : SV_GroupID)
+{
+	FFX_ParallelSort_CountInversions(localID, groupID, MaxThreadGroups, NumKeysBuffer[NumKeysIndex], NumKeyWords, SrcBuffer, PresortState);
+}
+
+// FPS ValidateInput/ValidateOutput (GPU validation: checksums before the sort, checksums and order after it, MaxThreadGroups thread groups)
+[numthreads(FFX_PARALLELSORT_THREADGROUP_SIZE, 1, 1)]
+void FPS_ValidateInput(uint localID : SV_GroupThreadID, uint groupID : SV_GroupID)
+{
+#ifdef kRS_16BitKeys
+	FFX_ParallelSort_Validate(localID, groupID, MaxThreadGroups, NumKeysBuffer[NumKeysIndex], NumKeyWords, SrcKeys16, ValidateState, false
+#else
+	FFX_ParallelSort_Validate(localID, groupID, MaxThreadGroups, NumKeysBuffer[NumKeysIndex], NumKeyWords, SrcBuffer, ValidateState, false
+#endif // kRS_16BitKeys
+#ifdef kRS_ValueCopy
+							  ,SrcPayload
+#endif // kRS_ValueCopy
+	);
+}
+
+[numthreads(FFX_PARALLELSORT_THREADGROUP_SIZE, 1, 1)]
+void FPS_ValidateOutput(uint localID : SV_GroupThreadID, uint groupID : SV_GroupID)
+{
+#ifdef kRS_16BitKeys
+	FFX_ParallelSort_Validate(localID, groupID, MaxThreadGroups, NumKeysBuffer[NumKeysIndex], NumKeyWords, SrcKeys16, ValidateState, true
+#else
+	FFX_ParallelSort_Validate(localID, groupID, MaxThreadGroups, NumKeysBuffer[NumKeysIndex], NumKeyWords, SrcBuffer, ValidateState, true
+#endif // kRS_16BitKeys
+#ifdef kRS_ValueCopy
+							  ,SrcPayload
+#endif // kRS_ValueCopy
+	);
+}
+
+[numthreads(1, 1, 1)]
+void FPS_ValidateResult(uint localID : SV_GroupThreadID)
+{
+	FFX_ParallelSort_ValidateResult(ValidateState);
 }
 
 [numthreads(1, 1, 1)]
 void FPS_SetupIndirectParameters(uint localID : SV_GroupThreadID)
 {
-	FFX_ParallelSort_SetupIndirectParams(NumKeysBuffer[NumKeysIndex], MaxThreadGroups, CBufferUAV, CountScatterArgs, ReduceScanArgs);
+	FFX_ParallelSort_SetupIndirectParams(NumKeysBuffer[NumKeysIndex], MaxThreadGroups, NumKeyWords, KeyStride, KeyOffset, CBufferUAV, CountScatterArgs, ReduceScanArgs
+#ifdef kRS_PresortCheck
+										 ,PresortState
+#endif // kRS_PresortCheck
+	);
 }
@@ -20,11 +20,16 @@
 #include "stdafx.h"
 #include "../../../FFX-ParallelSort/FFX_ParallelSort.h"
 
+#include <algorithm>
+#include <chrono>
+#include <emmintrin.h>
 #include <numeric>
 #include <random>
+#include <thread>
 #include <vector>
 
-static const uint32_t NumKeys[] = { 1920 * 1080, 2560 * 1440, 3840 * 2160 };
+static const uint32_t MaxDispatchThreadGroups = 65535; // Most thread groups a dispatch can have along X (what every device supports)
+static const int MaxDirtyKeyPercent = 10;   // Most keys the incremental re-sort can change per frame (what the dirty buffers are sized for)
 
 //////////////////////////////////////////////////////////////////////////
     
@@ -40,79 +45,519 @@ void FFXParallelSort::OverridePayload()
 {
     PayloadOverride = true;
 }
+bool FFXParallelSort::DeferredPayloadOverride = false;
+void FFXParallelSort::OverrideDeferredPayload()
+{
+    DeferredPayloadOverride = true;
+}
+bool FFXParallelSort::KeyHooksOverride = false;
+void FFXParallelSort::OverrideKeyHooks()
+{
+    KeyHooksOverride = true;
+}
+uint32_t FFXParallelSort::KeyRecordStrideOverride = 0;
+uint32_t FFXParallelSort::KeyRecordOffsetOverride = 0;
+void FFXParallelSort::OverrideKeyRecords(uint32_t StrideInBytes, uint32_t OffsetInBytes)
+{
+    // Records are read as uints, so the key has to be a whole uint of a record made of whole uints
+    KeyRecordStrideOverride = std::max(StrideInBytes & ~3u, (uint32_t)sizeof(uint32_t));
+    KeyRecordOffsetOverride = std::min(OffsetInBytes & ~3u, KeyRecordStrideOverride - (uint32_t)sizeof(uint32_t));
+}
+bool FFXParallelSort::ReadOnlyInputOverride = false;
+void FFXParallelSort::OverrideReadOnlyInput()
+{
+    ReadOnlyInputOverride = true;
+}
+bool FFXParallelSort::PackedKeyIndexOverride = false;
+void FFXParallelSort::OverridePackedKeyIndex()
+{
+    PackedKeyIndexOverride = true;
+}
+int FFXParallelSort::WaveSizeOverride = -1;
+void FFXParallelSort::OverrideWaveSize(uint32_t WaveSize)
+{
+    WaveSizeOverride = (int)WaveSize;
+}
+bool FFXParallelSort::TileScatterOverride = false;
+void FFXParallelSort::OverrideTileScatter()
+{
+    TileScatterOverride = true;
+}
+bool FFXParallelSort::RegisterCountOverride = false;
+void FFXParallelSort::OverrideRegisterCount()
+{
+    RegisterCountOverride = true;
+}
+bool FFXParallelSort::MatchScatterOverride = false;
+void FFXParallelSort::OverrideMatchScatter()
+{
+    MatchScatterOverride = true;
+}
+uint32_t FFXParallelSort::KeyBitsOverride = 0;
+void FFXParallelSort::OverrideKeyBits(uint32_t KeyBits)
+{
+    // Keys are sorted a digit at a time, so the width goes up to the next whole digit
+    KeyBitsOverride = std::min(std::max((KeyBits + FFX_PARALLELSORT_SORT_BITS_PER_PASS - 1) & ~(FFX_PARALLELSORT_SORT_BITS_PER_PASS - 1), (uint32_t)FFX_PARALLELSORT_SORT_BITS_PER_PASS), 32u);
+}
+bool FFXParallelSort::AsyncPipelineOverride = false;
+void FFXParallelSort::OverrideAsyncPipelineCreation()
+{
+    AsyncPipelineOverride = true;
+}
+bool FFXParallelSort::StageTimingsOverride = false;
+void FFXParallelSort::OverrideStageTimings()
+{
+    StageTimingsOverride = true;
+}
+int FFXParallelSort::KeyDistributionOverride = FFXParallelSort::KeyDistribution_Permutation;
+void FFXParallelSort::OverrideKeyDistribution(int Distribution)
+{
+    KeyDistributionOverride = Distribution;
+}
+uint32_t FFXParallelSort::KeySeedOverride = 0x5eed;
+void FFXParallelSort::OverrideKeySeed(uint32_t Seed)
+{
+    KeySeedOverride = Seed;
+}
+uint32_t FFXParallelSort::NumKeysOverride = 0;
+void FFXParallelSort::OverrideNumKeys(uint32_t NumKeys)
+{
+    NumKeysOverride = NumKeys;
+}
+uint32_t FFXParallelSort::MaxThreadGroupsOverride = 0;
+void FFXParallelSort::OverrideMaxThreadGroups(uint32_t MaxThreadGroups)
+{
+    MaxThreadGroupsOverride = MaxThreadGroups;
+}
+uint32_t FFXParallelSort::KeyWordsOverride = 0;
+void FFXParallelSort::OverrideKeyWords(uint32_t NumKeyWords)
+{
+    KeyWordsOverride = NumKeyWords;
+}
+uint32_t FFXParallelSort::TopKOverride = 0;
+void FFXParallelSort::OverrideTopK(uint32_t NumSelectKeys)
+{
+    TopKOverride = NumSelectKeys;
+}
+std::vector<float> FFXParallelSort::PercentilesOverride;
+void FFXParallelSort::OverridePercentiles(const std::vector<float>& Percentiles)
+{
+    PercentilesOverride = Percentiles;
+}
+bool FFXParallelSort::PresortCheckOverride = false;
+void FFXParallelSort::OverridePresortCheck()
+{
+    PresortCheckOverride = true;
+}
+bool FFXParallelSort::TemporalCoherenceOverride = false;
+void FFXParallelSort::OverrideTemporalCoherence()
+{
+    TemporalCoherenceOverride = true;
+}
+uint32_t FFXParallelSort::IncrementalSortOverride = 0;
+void FFXParallelSort::OverrideIncrementalSort(uint32_t DirtyKeyPercent)
+{
+    IncrementalSortOverride = DirtyKeyPercent;
+}
+uint32_t FFXParallelSort::OutOfCoreOverride = 0;
+void FFXParallelSort::OverrideOutOfCore(uint32_t NumKeys)
+{
+    OutOfCoreOverride = NumKeys;
+}
+bool FFXParallelSort::GPUValidationOverride = false;
+void FFXParallelSort::OverrideGPUValidation()
+{
+    GPUValidationOverride = true;
+}
+//////////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////////
+// Key data generation
+
+static const char* KeyDistributionNames[] = { "permutation", "uniform", "sorted", "reverse", "nearlysorted", "fewunique", "zipf", "constanthighbits" };
+static_assert(_countof(KeyDistributionNames) == FFXParallelSort::KeyDistribution_Count, "Missing key distribution name");
+
+const char* FFXParallelSort::GetKeyDistributionName(int Distribution)
+{
+    return KeyDistributionNames[Distribution];
+}
+
+int FFXParallelSort::GetKeyDistributionFromName(const std::string& Name)
+{
+    for (int i = 0; i < KeyDistribution_Count; ++i)
+    {
+        if (!Name.compare(KeyDistributionNames[i]))
+            return i;
+    }
+    return -1;
+}
+
+// Used to tag benchmark results with the data that was sorted
+std::string FFXParallelSort::GetKeyDataSuffix()
+{
+    std::string Suffix = std::string("_") + KeyDistributionNames[KeyDistributionOverride] + "_seed" + std::to_string(KeySeedOverride);
+    if (NumKeysOverride)
+        Suffix += "_keys" + std::to_string(NumKeysOverride);
+    if (KeyWordsOverride > 1)
+        Suffix += "_words" + std::to_string(KeyWordsOverride);
+    if (TopKOverride)
+        Suffix += "_topk" + std::to_string(TopKOverride);
+    if (!PercentilesOverride.empty())
+        Suffix += "_percentiles" + std::to_string(PercentilesOverride.size());
+    if (PresortCheckOverride)
+        Suffix += "_presort";
+    if (TemporalCoherenceOverride)
+        Suffix += "_temporal";
+    if (IncrementalSortOverride)
+        Suffix += "_incremental" + std::to_string(IncrementalSortOverride);
+    if (OutOfCoreOverride)
+        Suffix += "_outofcore" + std::to_string(OutOfCoreOverride);
+    if (GPUValidationOverride)
+        Suffix += "_gpuvalidate";
+    if (DeferredPayloadOverride)
+        Suffix += "_deferredpayload";
+    if (KeyHooksOverride)
+        Suffix += "_keyhooks";
+    if (KeyRecordStrideOverride)
+        Suffix += "_keyrecords" + std::to_string(KeyRecordStrideOverride) + "_" + std::to_string(KeyRecordOffsetOverride);
+    if (ReadOnlyInputOverride)
+        Suffix += "_readonly";
+    if (KeyBitsOverride && KeyBitsOverride < 32)
+        Suffix += "_keybits" + std::to_string(KeyBitsOverride);
+    if (PackedKeyIndexOverride)
+        Suffix += "_packedkeyindex";
+    if (WaveSizeOverride >= 0)
+        Suffix += "_wave" + std::to_string(WaveSizeOverride);
+    if (TileScatterOverride)
+        Suffix += "_tilescatter";
+    if (RegisterCountOverride)
+        Suffix += "_registercount";
+    if (MatchScatterOverride)
+        Suffix += "_matchscatter";
+    return Suffix;
+}
+
+// Whether the generated keys are a permutation of 0..N-1
+static bool KeysArePermutation(int Distribution)
+{
+    return Distribution == FFXParallelSort::KeyDistribution_Permutation || Distribution == FFXParallelSort::KeyDistribution_Sorted ||
+           Distribution == FFXParallelSort::KeyDistribution_ReverseSorted || Distribution == FFXParallelSort::KeyDistribution_NearlySorted;
+}
+
+// Fill the key buffer following the requested distribution (everything is driven by the seed)
+static void GenerateKeys(std::vector<uint32_t>& Keys, int Distribution, uint32_t Seed)
+{
+    std::mt19937 Generator(Seed);
+    switch (Distribution)
+    {
+    case FFXParallelSort::KeyDistribution_Permutation:
+        std::iota(Keys.begin(), Keys.end(), 0);
+        std::shuffle(Keys.begin(), Keys.end(), Generator);
+        break;
+
+    case FFXParallelSort::KeyDistribution_Uniform:
+        for (uint32_t& Key : Keys)
+            Key = Generator();
+        break;
+
+    case FFXParallelSort::KeyDistribution_Sorted:
+        std::iota(Keys.begin(), Keys.end(), 0);
+        break;
+
+    case FFXParallelSort::KeyDistribution_ReverseSorted:
+        std::iota(Keys.rbegin(), Keys.rend(), 0);
+        break;
+
+    case FFXParallelSort::KeyDistribution_NearlySorted:
+    {
+        std::iota(Keys.begin(), Keys.end(), 0);
+        std::uniform_int_distribution<size_t> Index(0, Keys.size() - 1);
+        for (size_t i = 0; i < Keys.size() / 100; ++i)
+        {
+            // Draw the indices in a fixed order (argument evaluation order is unspecified), so a seed gives the same keys everywhere
+            size_t First = Index(Generator);
+            size_t Second = Index(Generator);
+            std::swap(Keys[First], Keys[Second]);
+        }
+        break;
+    }
+
+    case FFXParallelSort::KeyDistribution_FewUnique:
+    {
+        uint32_t Values[16];
+        for (uint32_t& Value : Values)
+            Value = Generator();
+        for (uint32_t& Key : Keys)
+            Key = Values[Generator() % _countof(Values)];
+        break;
+    }
+
+    case FFXParallelSort::KeyDistribution_Zipf:
+    {
+        // Build the CDF for ranks 1..NumValues and give each rank a random 32-bit value so all digits get exercised
+        const size_t NumValues = 64 * 1024;
+        std::vector<double> CDF(NumValues);
+        std::vector<uint32_t> Values(NumValues);
+        double Sum = 0.0;
+        for (size_t i = 0; i < NumValues; ++i)
+        {
+            Sum += 1.0 / double(i + 1);
+            CDF[i] = Sum;
+            Values[i] = Generator();
+        }
+
+        std::uniform_real_distribution<double> Draw(0.0, Sum);
+        for (uint32_t& Key : Keys)
+        {
+            size_t Rank = std::upper_bound(CDF.begin(), CDF.end(), Draw(Generator)) - CDF.begin();
+            Key = Values[std::min(Rank, NumValues - 1)];
+        }
+        break;
+    }
+
+    case FFXParallelSort::KeyDistribution_ConstantHighBits:
+        for (uint32_t& Key : Keys)
+            Key = 0x3F800000 | (Generator() & 0x007FFFFF);
+        break;
+
+    default:
+        assert(false && "Unknown key distribution");
+        break;
+    }
+}
+
+// Shift a key set down until its biggest key fits in KeyBits bits (keeps the order of the keys, and leaves key sets that already fit alone)
+static void NarrowKeys(std::vector<uint32_t>& Keys, uint32_t KeyBits)
+{
+    uint32_t MaxKey = Keys.empty() ? 0 : *std::max_element(Keys.begin(), Keys.end());
+    uint32_t Shift = 0;
+    while (KeyBits < 32 && (MaxKey >> Shift) >> KeyBits)
+        ++Shift;
+    for (uint32_t& Key : Keys)
+        Key >>= Shift;
+}
 //////////////////////////////////////////////////////////////////////////
 
+// Copy data into a buffer through the upload heap. Big buffers are copied in chunks, flushing the upload heap whenever it fills up.
+void FFXParallelSort::UploadBufferData(ID3D12Resource* pBuffer, const uint32_t* pData, uint32_t NumValues)
+{
+    const uint32_t MaxValuesPerCopy = 4 * 1024 * 1024;
+    for (uint32_t Offset = 0; Offset < NumValues; )
+    {
+        uint32_t NumValuesToCopy = std::min(NumValues - Offset, MaxValuesPerCopy);
+        uint8_t* pDataBuffer = m_pUploadHeap->Suballocate(NumValuesToCopy * sizeof(uint32_t), sizeof(uint32_t));
+        if (!pDataBuffer)
+        {
+            m_pUploadHeap->FlushAndFinish();
+            pDataBuffer = m_pUploadHeap->Suballocate(NumValuesToCopy * sizeof(uint32_t), sizeof(uint32_t));
+        }
+
+        memcpy(pDataBuffer, pData + Offset, sizeof(uint32_t) * NumValuesToCopy);
+        m_pUploadHeap->GetCommandList()->CopyBufferRegion(pBuffer, sizeof(uint32_t) * Offset, m_pUploadHeap->GetResource(), pDataBuffer - m_pUploadHeap->BasePtr(), sizeof(uint32_t) * NumValuesToCopy);
+        Offset += NumValuesToCopy;
+    }
+}
+
+// Raw SRV of a sort buffer, for count and scatter to read it through with read-only input
+void FFXParallelSort::CreateReadOnlyView(Texture& Buffer, uint32_t Index, CBV_SRV_UAV* pSRV)
+{
+    D3D12_SHADER_RESOURCE_VIEW_DESC SRVDesc = {};
+    SRVDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+    SRVDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
+    SRVDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+    SRVDesc.Buffer.FirstElement = 0;
+    SRVDesc.Buffer.NumElements = (UINT)(Buffer.GetResource()->GetDesc().Width / sizeof(uint32_t));
+    SRVDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_RAW;
+    m_pDevice->GetDevice()->CreateShaderResourceView(Buffer.GetResource(), &SRVDesc, pSRV->GetCPU(Index));
+}
+
+// Allocate the scratch and indirect buffers one sort needs while it runs (called with m_SortContextMutex held)
+FFXParallelSort::SortContext* FFXParallelSort::CreateSortContext()
+{
+    std::unique_ptr<SortContext> Context(new SortContext);
+    m_pResourceViewHeaps->AllocCBV_SRV_UAVDescriptor(1, &Context->ScratchUAV);
+    m_pResourceViewHeaps->AllocCBV_SRV_UAVDescriptor(1, &Context->ReducedScratchUAV);
+    m_pResourceViewHeaps->AllocCBV_SRV_UAVDescriptor(1, &Context->ScanBlockUAV);
+    m_pResourceViewHeaps->AllocCBV_SRV_UAVDescriptor(1, &Context->IndirectConstantBufferUAV);
+    m_pResourceViewHeaps->AllocCBV_SRV_UAVDescriptor(1, &Context->IndirectCountScatterArgsUAV);
+    m_pResourceViewHeaps->AllocCBV_SRV_UAVDescriptor(1, &Context->IndirectReduceScanArgsUAV);
+
+    CD3DX12_RESOURCE_DESC ResourceDesc = CD3DX12_RESOURCE_DESC::Buffer(m_ScratchBufferSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+    Context->ScratchBuffer.InitBuffer(m_pDevice, "Scratch", &ResourceDesc, sizeof(uint32_t), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    Context->ScratchBuffer.CreateBufferUAV(0, nullptr, &Context->ScratchUAV);
+
+    ResourceDesc = CD3DX12_RESOURCE_DESC::Buffer(m_ReducedScratchBufferSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+    Context->ReducedScratchBuffer.InitBuffer(m_pDevice, "ReducedScratch", &ResourceDesc, sizeof(uint32_t), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    Context->ReducedScratchBuffer.CreateBufferUAV(0, nullptr, &Context->ReducedScratchUAV);
+
+    ResourceDesc = CD3DX12_RESOURCE_DESC::Buffer(m_ScanBlockBufferSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+    Context->ScanBlockBuffer.InitBuffer(m_pDevice, "ScanBlockScratch", &ResourceDesc, sizeof(uint32_t), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    Context->ScanBlockBuffer.CreateBufferUAV(0, nullptr, &Context->ScanBlockUAV);
+
+    // Buffers for indirect execution of the algorithm
+    ResourceDesc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(FFX_ParallelSortCB), D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+    Context->IndirectConstantBuffer.InitBuffer(m_pDevice, "IndirectConstantBuffer", &ResourceDesc, sizeof(FFX_ParallelSortCB), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    Context->IndirectConstantBuffer.CreateBufferUAV(0, nullptr, &Context->IndirectConstantBufferUAV);
+
+    ResourceDesc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(uint32_t) * 3, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+    Context->IndirectCountScatterArgs.InitBuffer(m_pDevice, "IndirectCount_Scatter_DispatchArgs", &ResourceDesc, sizeof(uint32_t), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    Context->IndirectCountScatterArgs.CreateBufferUAV(0, nullptr, &Context->IndirectCountScatterArgsUAV);
+    ResourceDesc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(uint32_t) * 6, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);    // Reduce/scan args followed by scan block args
+    Context->IndirectReduceScanArgs.InitBuffer(m_pDevice, "IndirectReduceScanArgs", &ResourceDesc, sizeof(uint32_t), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    Context->IndirectReduceScanArgs.CreateBufferUAV(0, nullptr, &Context->IndirectReduceScanArgsUAV);
+
+    m_SortContexts.push_back(std::move(Context));
+    return m_SortContexts.back().get();
+}
+
+void FFXParallelSort::DestroySortContext(SortContext& Context)
+{
+    Context.ScratchBuffer.OnDestroy();
+    Context.ReducedScratchBuffer.OnDestroy();
+    Context.ScanBlockBuffer.OnDestroy();
+    Context.IndirectConstantBuffer.OnDestroy();
+    Context.IndirectCountScatterArgs.OnDestroy();
+    Context.IndirectReduceScanArgs.OnDestroy();
+}
+
+FFXParallelSort::SortContext* FFXParallelSort::AcquireSortContext()
+{
+    std::lock_guard<std::mutex> lock(m_SortContextMutex);
+    for (std::unique_ptr<SortContext>& Context : m_SortContexts)
+    {
+        if (!Context->bInUse)
+        {
+            Context->bInUse = true;
+            return Context.get();
+        }
+    }
+
+    SortContext* pContext = CreateSortContext();
+    pContext->bInUse = true;
+    return pContext;
+}
+
+void FFXParallelSort::ReleaseSortContext(SortContext* pContext)
+{
+    std::lock_guard<std::mutex> lock(m_SortContextMutex);
+    assert(pContext->bInUse && pContext != m_pDefaultSortContext);
+    pContext->bInUse = false;
+}
+
+void FFXParallelSort::SetSortContextBuffers(SortContext* pContext, uint32_t NumKeys, const RdxDX12ResourceInfo KeyInfo[2], const RdxDX12ResourceInfo* pPayloadInfo/*=nullptr*/)
+{
+    assert(pContext->bInUse && pContext != m_pDefaultSortContext);
+    pContext->NumKeys = NumKeys;
+    for (int i = 0; i < 2; ++i)
+    {
+        pContext->KeyInfo[i] = KeyInfo[i];
+        pContext->PayloadInfo[i] = pPayloadInfo ? pPayloadInfo[i] : RdxDX12ResourceInfo{};
+    }
+}
+
+// Constant buffer ring allocations (the ring is shared by all contexts)
+D3D12_GPU_VIRTUAL_ADDRESS FFXParallelSort::AllocConstantBuffer(uint32_t Size, void* pData)
+{
+    std::lock_guard<std::mutex> lock(m_ConstantBufferMutex);
+    return m_pConstantBufferRing->AllocConstantBuffer(Size, pData);
+}
+
 // Create all of the sort data for the sample
 void FFXParallelSort::CreateKeyPayloadBuffers()
 {
-    std::vector<uint32_t> KeyData1080(NumKeys[0]);
-    std::vector<uint32_t> KeyData2K(NumKeys[1]);
-    std::vector<uint32_t> KeyData4K(NumKeys[2]);
-                
-    // Populate the buffers with linear access index
-    std::iota(KeyData1080.begin(), KeyData1080.end(), 0);
-    std::iota(KeyData2K.begin(), KeyData2K.end(), 0);
-    std::iota(KeyData4K.begin(), KeyData4K.end(), 0);
-
-    // Shuffle the data
-    std::shuffle(KeyData1080.begin(), KeyData1080.end(), std::mt19937{ std::random_device{}() });
-    std::shuffle(KeyData2K.begin(), KeyData2K.end(), std::mt19937{ std::random_device{}() });
-    std::shuffle(KeyData4K.begin(), KeyData4K.end(), std::mt19937{ std::random_device{}() });
-        
-    // 1080p
-    CD3DX12_RESOURCE_DESC ResourceDesc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(uint32_t) * NumKeys[0], D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
-    m_SrcKeyBuffers[0].InitBuffer(m_pDevice, "SrcKeys1080", &ResourceDesc, sizeof(uint32_t), D3D12_RESOURCE_STATE_COPY_DEST);
-    // 2K
-    ResourceDesc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(uint32_t) * NumKeys[1], D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
-    m_SrcKeyBuffers[1].InitBuffer(m_pDevice, "SrcKeys2K", &ResourceDesc, sizeof(uint32_t), D3D12_RESOURCE_STATE_COPY_DEST);
-    // 4K
-    ResourceDesc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(uint32_t) * NumKeys[2], D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
-    m_SrcKeyBuffers[2].InitBuffer(m_pDevice, "SrcKeys4K", &ResourceDesc, sizeof(uint32_t), D3D12_RESOURCE_STATE_COPY_DEST);
-    m_SrcPayloadBuffers.InitBuffer(m_pDevice, "SrcPayloadBuffer", &ResourceDesc, sizeof(uint32_t), D3D12_RESOURCE_STATE_COPY_DEST);
-        
+    static const char* SrcKeyBufferNames[] = { "SrcKeys1080", "SrcKeys2K", "SrcKeys4K", "SrcKeysCustom" };
+    static const char* SrcKey16BufferNames[] = { "SrcKeys16Bit1080", "SrcKeys16Bit2K", "SrcKeys16Bit4K", "SrcKeys16BitCustom" };
+
     // The DstKey and DstPayload buffers will be used as src/dst when sorting. A copy of the 
     // source key/payload will be copied into them before hand so we can keep our original values
-    ResourceDesc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(uint32_t) * NumKeys[2], D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+    CD3DX12_RESOURCE_DESC ResourceDesc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(uint32_t) * m_MaxNumKeys * m_NumKeyWords, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
     m_DstKeyBuffers[0].InitBuffer(m_pDevice, "DstKeyBuf0", &ResourceDesc, sizeof(uint32_t), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
     m_DstKeyBuffers[1].InitBuffer(m_pDevice, "DstKeyBuf1", &ResourceDesc, sizeof(uint32_t), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    ResourceDesc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(uint32_t) * m_MaxNumKeys, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+    m_SrcPayloadBuffers.InitBuffer(m_pDevice, "SrcPayloadBuffer", &ResourceDesc, sizeof(uint32_t), D3D12_RESOURCE_STATE_COPY_DEST);
     m_DstPayloadBuffers[0].InitBuffer(m_pDevice, "DstPayloadBuf0", &ResourceDesc, sizeof(uint32_t), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
     m_DstPayloadBuffers[1].InitBuffer(m_pDevice, "DstPayloadBuf1", &ResourceDesc, sizeof(uint32_t), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    if (m_b16BitKeyStorage)
+    {
+        ResourceDesc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(uint32_t) * ((m_MaxNumKeys + 1) / 2), D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+        m_DstKey16Buffers[0].InitBuffer(m_pDevice, "DstKey16BitBuf0", &ResourceDesc, sizeof(uint16_t), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+        m_DstKey16Buffers[1].InitBuffer(m_pDevice, "DstKey16BitBuf1", &ResourceDesc, sizeof(uint16_t), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    }
+
+    // Populate the buffers with the requested key distribution (one key set at a time so we only ever hold one on the CPU)
+    Trace(std::string("FFXParallelSort: generating ") + KeyDistributionNames[KeyDistributionOverride] + " keys with seed " + std::to_string(KeySeedOverride));
+    bool bPayloadUploaded = false;
+    std::vector<uint32_t> KeyData, KeyPlane;
+    for (uint32_t i = 0; i < m_NumKeySets; ++i)
+    {
+        // Multi-word keys get one plane per word, each following the distribution with its own seed
+        KeyData.resize(m_NumKeys[i] * m_NumKeyWords);
+        KeyPlane.resize(m_NumKeys[i]);
+        for (uint32_t Word = 0; Word < m_NumKeyWords; ++Word)
+        {
+            GenerateKeys(KeyPlane, KeyDistributionOverride, KeySeedOverride + Word);
+            NarrowKeys(KeyPlane, m_KeyBits);
+            std::copy(KeyPlane.begin(), KeyPlane.end(), KeyData.begin() + m_NumKeys[i] * Word);
+        }
 
-    // Copy data in
+        ResourceDesc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(uint32_t) * m_NumKeys[i] * m_NumKeyWords, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+        m_SrcKeyBuffers[i].InitBuffer(m_pDevice, SrcKeyBufferNames[i], &ResourceDesc, sizeof(uint32_t), D3D12_RESOURCE_STATE_COPY_DEST);
+        UploadBufferData(m_SrcKeyBuffers[i].GetResource(), KeyData.data(), m_NumKeys[i] * m_NumKeyWords);
 
-    // 1080
-    uint8_t* pKeyDataBuffer = m_pUploadHeap->Suballocate(NumKeys[0] * sizeof(uint32_t), sizeof(uint32_t));
-    memcpy(pKeyDataBuffer, KeyData1080.data() , sizeof(uint32_t) * NumKeys[0]);
-    m_pUploadHeap->GetCommandList()->CopyBufferRegion(m_SrcKeyBuffers[0].GetResource(), 0, m_pUploadHeap->GetResource(), pKeyDataBuffer - m_pUploadHeap->BasePtr(), sizeof(uint32_t) * NumKeys[0]);
-        
-    // 2K
-    pKeyDataBuffer = m_pUploadHeap->Suballocate(NumKeys[1] * sizeof(uint32_t), sizeof(uint32_t));
-    memcpy(pKeyDataBuffer, KeyData2K.data(), sizeof(uint32_t) * NumKeys[1]);
-    m_pUploadHeap->GetCommandList()->CopyBufferRegion(m_SrcKeyBuffers[1].GetResource(), 0, m_pUploadHeap->GetResource(), pKeyDataBuffer - m_pUploadHeap->BasePtr(), sizeof(uint32_t) * NumKeys[1]);
-        
-    // 4K
-    pKeyDataBuffer = m_pUploadHeap->Suballocate(NumKeys[2] * sizeof(uint32_t), sizeof(uint32_t));
-    memcpy(pKeyDataBuffer, KeyData4K.data(), sizeof(uint32_t) * NumKeys[2]);
-    m_pUploadHeap->GetCommandList()->CopyBufferRegion(m_SrcKeyBuffers[2].GetResource(), 0, m_pUploadHeap->GetResource(), pKeyDataBuffer - m_pUploadHeap->BasePtr(), sizeof(uint32_t) * NumKeys[2]);
-    uint8_t* pPayloadDataBuffer = m_pUploadHeap->Suballocate(NumKeys[2] * sizeof(uint32_t), sizeof(uint32_t));
-    memcpy(pPayloadDataBuffer, KeyData4K.data(), sizeof(uint32_t) * NumKeys[2]);    // Copy the 4k source data for payload (it doesn't matter what the payload is as we really only want it to measure cost of copying/sorting)
-    m_pUploadHeap->GetCommandList()->CopyBufferRegion(m_SrcPayloadBuffers.GetResource(), 0, m_pUploadHeap->GetResource(), pPayloadDataBuffer - m_pUploadHeap->BasePtr(), sizeof(uint32_t) * NumKeys[2]);
-        
+        // Keys of up to 16 bits also get a copy stored as 16-bit values (two to a uint, padded out to whole uints)
+        if (m_b16BitKeyStorage)
+        {
+            KeyPlane.assign((m_NumKeys[i] + 1) / 2, 0);
+            for (uint32_t Key = 0; Key < m_NumKeys[i]; ++Key)
+                KeyPlane[Key / 2] |= KeyData[Key] << (16 * (Key % 2));
+
+            ResourceDesc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(uint32_t) * KeyPlane.size(), D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+            m_SrcKey16Buffers[i].InitBuffer(m_pDevice, SrcKey16BufferNames[i], &ResourceDesc, sizeof(uint16_t), D3D12_RESOURCE_STATE_COPY_DEST);
+            UploadBufferData(m_SrcKey16Buffers[i].GetResource(), KeyPlane.data(), (uint32_t)KeyPlane.size());
+        }
+
+        // Copy the biggest key set for payload (it doesn't matter what the payload is as we really only want it to measure cost of copying/sorting)
+        if (m_NumKeys[i] == m_MaxNumKeys && !bPayloadUploaded)
+        {
+            UploadBufferData(m_SrcPayloadBuffers.GetResource(), KeyData.data(), m_NumKeys[i]);
+            bPayloadUploaded = true;
+        }
+
+        // Work out what the percentile queries should find in this key set, the same rank the GPU picks (keys get reordered, so this goes last)
+        m_ExpectedPercentileKeys[i].clear();
+        if (m_NumKeyWords == 1)
+        {
+            for (float Percentile : m_SelectPercentiles)
+            {
+                uint32_t Rank = std::min((uint32_t)(std::min(std::max(Percentile, 0.f), 1.f) * (float)(m_NumKeys[i] - 1)), m_NumKeys[i] - 1);
+                std::nth_element(KeyData.begin(), KeyData.begin() + Rank, KeyData.end());
+                m_ExpectedPercentileKeys[i].push_back(KeyData[Rank]);
+            }
+        }
+    }
 
     // Once we are done copying the data, put in barriers to transition the source resources to 
     // copy source (which is what they will stay for the duration of app runtime)
-    CD3DX12_RESOURCE_BARRIER Barriers[6] = { CD3DX12_RESOURCE_BARRIER::Transition(m_SrcKeyBuffers[2].GetResource(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COPY_SOURCE),
-                                                CD3DX12_RESOURCE_BARRIER::Transition(m_SrcPayloadBuffers.GetResource(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COPY_SOURCE),
-                                                CD3DX12_RESOURCE_BARRIER::Transition(m_SrcKeyBuffers[1].GetResource(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COPY_SOURCE), 
-                                                CD3DX12_RESOURCE_BARRIER::Transition(m_SrcKeyBuffers[0].GetResource(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COPY_SOURCE), 
-                                                 
-                                                // Copy the data into the dst[0] buffers for use on first frame
-                                                CD3DX12_RESOURCE_BARRIER::Transition(m_DstKeyBuffers[0].GetResource(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_DEST),
-                                                CD3DX12_RESOURCE_BARRIER::Transition(m_DstPayloadBuffers[0].GetResource(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_DEST) };
-    m_pUploadHeap->GetCommandList()->ResourceBarrier(6, Barriers);
+    CD3DX12_RESOURCE_BARRIER Barriers[_countof(m_SrcKeyBuffers) + 3];
+    uint32_t NumBarriers = 0;
+    for (uint32_t i = 0; i < m_NumKeySets; ++i)
+        Barriers[NumBarriers++] = CD3DX12_RESOURCE_BARRIER::Transition(m_SrcKeyBuffers[i].GetResource(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COPY_SOURCE);
+    Barriers[NumBarriers++] = CD3DX12_RESOURCE_BARRIER::Transition(m_SrcPayloadBuffers.GetResource(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COPY_SOURCE);
+    if (m_b16BitKeyStorage)
+    {
+        CD3DX12_RESOURCE_BARRIER Key16Barriers[_countof(m_SrcKey16Buffers)];
+        for (uint32_t i = 0; i < m_NumKeySets; ++i)
+            Key16Barriers[i] = CD3DX12_RESOURCE_BARRIER::Transition(m_SrcKey16Buffers[i].GetResource(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COPY_SOURCE);
+        m_pUploadHeap->GetCommandList()->ResourceBarrier(m_NumKeySets, Key16Barriers);
+    }
+
+    // Copy the data into the dst[0] buffers for use on first frame
+    Barriers[NumBarriers++] = CD3DX12_RESOURCE_BARRIER::Transition(m_DstKeyBuffers[0].GetResource(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_DEST);
+    Barriers[NumBarriers++] = CD3DX12_RESOURCE_BARRIER::Transition(m_DstPayloadBuffers[0].GetResource(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_DEST);
+    m_pUploadHeap->GetCommandList()->ResourceBarrier(NumBarriers, Barriers);
 
-    m_pUploadHeap->GetCommandList()->CopyBufferRegion(m_DstKeyBuffers[0].GetResource(), 0, m_SrcKeyBuffers[m_UIResolutionSize].GetResource(), 0, sizeof(uint32_t) * NumKeys[m_UIResolutionSize]);
-    m_pUploadHeap->GetCommandList()->CopyBufferRegion(m_DstPayloadBuffers[0].GetResource(), 0, m_SrcPayloadBuffers.GetResource(), 0, sizeof(uint32_t) * NumKeys[m_UIResolutionSize]);
+    m_pUploadHeap->GetCommandList()->CopyBufferRegion(m_DstKeyBuffers[0].GetResource(), 0, m_SrcKeyBuffers[m_UIResolutionSize].GetResource(), 0, sizeof(uint32_t) * m_NumKeys[m_UIResolutionSize] * m_NumKeyWords);
+    m_pUploadHeap->GetCommandList()->CopyBufferRegion(m_DstPayloadBuffers[0].GetResource(), 0, m_SrcPayloadBuffers.GetResource(), 0, sizeof(uint32_t) * m_NumKeys[m_UIResolutionSize]);
 
     // Put the dst buffers back to UAVs for sort usage
     Barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(m_DstKeyBuffers[0].GetResource(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
@@ -120,35 +565,137 @@ void FFXParallelSort::CreateKeyPayloadBuffers()
     m_pUploadHeap->GetCommandList()->ResourceBarrier(2, Barriers);
 
     // Create UAVs
-    m_SrcKeyBuffers[2].CreateBufferUAV(2, nullptr, &m_SrcKeyUAVTable);
-    m_SrcKeyBuffers[1].CreateBufferUAV(1, nullptr, &m_SrcKeyUAVTable);
-    m_SrcKeyBuffers[0].CreateBufferUAV(0, nullptr, &m_SrcKeyUAVTable);
+    for (uint32_t i = 0; i < m_NumKeySets; ++i)
+        m_SrcKeyBuffers[i].CreateBufferUAV(i, nullptr, &m_SrcKeyUAVTable);
     m_SrcPayloadBuffers.CreateBufferUAV(0, nullptr, &m_SrcPayloadUAV);
     m_DstKeyBuffers[0].CreateBufferUAV(0, nullptr, &m_DstKeyUAVTable);
     m_DstKeyBuffers[1].CreateBufferUAV(1, nullptr, &m_DstKeyUAVTable);
     m_DstPayloadBuffers[0].CreateBufferUAV(0, nullptr, &m_DstPayloadUAVTable);
     m_DstPayloadBuffers[1].CreateBufferUAV(1, nullptr, &m_DstPayloadUAVTable);
+    if (m_b16BitKeyStorage)
+    {
+        m_DstKey16Buffers[0].CreateBufferUAV(0, nullptr, &m_DstKey16UAVTable);
+        m_DstKey16Buffers[1].CreateBufferUAV(1, nullptr, &m_DstKey16UAVTable);
+    }
+
+    // Create the raw SRVs read-only input reads the sort buffers through
+    CreateReadOnlyView(m_DstKeyBuffers[0], 0, &m_DstKeySRVTable);
+    CreateReadOnlyView(m_DstKeyBuffers[1], 1, &m_DstKeySRVTable);
+    CreateReadOnlyView(m_DstPayloadBuffers[0], 0, &m_DstPayloadSRVTable);
+    CreateReadOnlyView(m_DstPayloadBuffers[1], 1, &m_DstPayloadSRVTable);
 }
 
 // Compile specified radix sort shader and create pipeline
-void FFXParallelSort::CompileRadixPipeline(const char* shaderFile, const DefineList* defines, const char* entryPoint, ID3D12PipelineState*& pPipeline)
+// Compilation is queued on the compile pool (one worker per hardware thread), so permutations build concurrently without a thread
+// each. Calling get() on the returned pipeline blocks until that specific permutation is ready.
+FFXParallelSort::FPSPipeline FFXParallelSort::CompileRadixPipeline(const char* shaderFile, const DefineList* defines, const char* entryPoint)
 {
-    std::string CompileFlags("-T cs_6_0");
+    // Take copies of everything as the task will outlive the caller's arguments
+    std::string ShaderFile(shaderFile);
+    std::string EntryPoint(entryPoint);
+    DefineList Defines;
+    if (defines)
+        Defines = *defines;
+
+    // Every permutation is built for the wave size and scatter ranking and digit counting picked at creation
+    if (m_WaveSize)
+    {
+        Defines["kRS_WaveSize"] = std::to_string(m_WaveSize);
+        if (m_bPinWaveSize)
+            Defines["kRS_PinWaveSize"] = std::to_string(1);
+    }
+    if (m_bTileScatter)
+        Defines["kRS_TileScatter"] = std::to_string(1);
+    if (m_bRegisterCount)
+        Defines["kRS_RegisterCount"] = std::to_string(1);
+    if (m_bMatchScatter)
+        Defines["kRS_MatchScatter"] = std::to_string(1);
+    if (m_bMatchScatter && m_bWaveMatch)
+        Defines["kRS_WaveMatch"] = std::to_string(1);
+
+    return m_CompilePool.Submit([this, ShaderFile, EntryPoint, Defines]()
+    {
+        // Pinning the wave size needs shader model 6.6, WaveMatch 6.5, 16-bit key storage needs native 16-bit types
+        std::string CompileFlags(Defines.count("kRS_PinWaveSize") ? "-T cs_6_6" : Defines.count("kRS_WaveMatch") ? "-T cs_6_5" : Defines.count("kRS_16BitKeys") ? "-T cs_6_2" : "-T cs_6_0");
+        if (Defines.count("kRS_16BitKeys"))
+            CompileFlags += " -enable-16bit-types";
 #ifdef _DEBUG
-    CompileFlags += " -Zi -Od";
+        CompileFlags += " -Zi -Od";
 #endif // _DEBUG
 
-    D3D12_SHADER_BYTECODE shaderByteCode = {};
-    CompileShaderFromFile(shaderFile, defines, entryPoint, CompileFlags.c_str(), &shaderByteCode);
+        D3D12_SHADER_BYTECODE shaderByteCode = {};
+        CompileShaderFromFile(ShaderFile.c_str(), &Defines, EntryPoint.c_str(), CompileFlags.c_str(), &shaderByteCode);
+
+        D3D12_COMPUTE_PIPELINE_STATE_DESC descPso = {};
+        descPso.CS = shaderByteCode;
+        descPso.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
+        descPso.pRootSignature = m_pFPSRootSignature;
+        descPso.NodeMask = 0;
 
-    D3D12_COMPUTE_PIPELINE_STATE_DESC descPso = {};
-    descPso.CS = shaderByteCode;
-    descPso.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
-    descPso.pRootSignature = m_pFPSRootSignature;
-    descPso.NodeMask = 0;
+        ID3D12PipelineState* pPipeline = nullptr;
+        ThrowIfFailed(m_pDevice->GetDevice()->CreateComputePipelineState(&descPso, IID_PPV_ARGS(&pPipeline)));
+        SetName(pPipeline, EntryPoint.c_str());
+        return pPipeline;
+    });
+}
 
-    ThrowIfFailed(m_pDevice->GetDevice()->CreateComputePipelineState(&descPso, IID_PPV_ARGS(&pPipeline)));
-    SetName(pPipeline, entryPoint);
+// Block until every radix sort pipeline has finished building
+void FFXParallelSort::WaitForPipelines()
+{
+    m_FPSIndirectSetupParametersPipeline.wait();
+    m_FPSIndirectSetupPresortPipeline.wait();
+    m_FPSCountInversionsPipeline.wait();
+    m_FPSValidateInputPipeline.wait();
+    m_FPSValidateInputPayloadPipeline.wait();
+    m_FPSValidateOutputPipeline.wait();
+    m_FPSValidateOutputPayloadPipeline.wait();
+    m_FPSValidateResultPipeline.wait();
+    m_FPSCountPipeline.wait();
+    m_FPSCountReducePipeline.wait();
+    m_FPSScanPipeline.wait();
+    m_FPSScanAddPipeline.wait();
+    m_FPSReduceScanAddPipeline.wait();
+    m_FPSScanBlockReducePipeline.wait();
+    m_FPSScanBlockSumsPipeline.wait();
+    m_FPSScanBlockAddPipeline.wait();
+    m_FPSScatterPipeline.wait();
+    m_FPSScatterPayloadPipeline.wait();
+    m_FPSScatterIndexPipeline.wait();
+    m_FPSGatherPayloadPipeline.wait();
+    m_FPSPackKeyIndexPipeline.wait();
+    m_FPSUnpackKeyIndexPipeline.wait();
+    m_FPSCountLoadKeyPipeline.wait();
+    m_FPSScatterLoadKeyPipeline.wait();
+    m_FPSScatterLoadKeyPayloadPipeline.wait();
+    m_FPSScatterStoreKeyPipeline.wait();
+    m_FPSScatterStoreKeyPayloadPipeline.wait();
+    m_FPSWriteKeyRecordsPipeline.wait();
+    m_FPSCountKeyRecordsPipeline.wait();
+    m_FPSScatterKeyRecordsPipeline.wait();
+    m_FPSScatterKeyRecordsPayloadPipeline.wait();
+    m_FPSCountReadOnlyPipeline.wait();
+    m_FPSScatterReadOnlyPipeline.wait();
+    m_FPSScatterReadOnlyPayloadPipeline.wait();
+    if (m_b16BitKeyStorage)
+    {
+        m_FPSCount16BitPipeline.wait();
+        m_FPSScatter16BitPipeline.wait();
+        m_FPSScatter16BitPayloadPipeline.wait();
+        m_FPSValidateInput16BitPipeline.wait();
+        m_FPSValidateInput16BitPayloadPipeline.wait();
+        m_FPSValidateOutput16BitPipeline.wait();
+        m_FPSValidateOutput16BitPayloadPipeline.wait();
+    }
+    m_FPSSelectCountPipeline.wait();
+    m_FPSSelectReducePipeline.wait();
+    m_FPSSelectDigitPipeline.wait();
+    m_FPSSelectCompactPipeline.wait();
+    m_FPSSelectCompactPayloadPipeline.wait();
+    m_FPSGenerateDirtyKeysPipeline.wait();
+    m_FPSGatherDirtyPayloadPipeline.wait();
+    m_FPSMergePipeline.wait();
+    m_FPSMergePayloadPipeline.wait();
+    m_FPSMergeRunsPipeline.wait();
 }
 
 // Parallel Sort initialization
@@ -161,37 +708,203 @@ void FFXParallelSort::OnCreate(Device* pDevice, ResourceViewHeaps* pResourceView
     m_MaxNumThreadgroups = 800;
 
     // Overrides for testing
-    if (KeySetOverride >= 0)
+    if (MaxThreadGroupsOverride)
+        m_MaxNumThreadgroups = std::min(MaxThreadGroupsOverride, MaxDispatchThreadGroups);
+    if (KeyWordsOverride)
+        m_NumKeyWords = KeyWordsOverride;
+    if (KeyBitsOverride && m_NumKeyWords == 1)
+        m_KeyBits = KeyBitsOverride;
+    if (NumKeysOverride)
+    {
+        m_NumKeys[CustomKeySet] = NumKeysOverride;
+        m_NumKeySets = CustomKeySet + 1;
+        m_UIResolutionSize = CustomKeySet;
+    }
+    m_MaxNumKeys = *std::max_element(m_NumKeys, m_NumKeys + m_NumKeySets);
+    if (KeySetOverride >= 0 && KeySetOverride < (int)m_NumKeySets)
         m_UIResolutionSize = KeySetOverride;
     if (PayloadOverride)
-        m_UISortPayload = true; 
+        m_UISortPayload = true;
+    if (DeferredPayloadOverride)
+    {
+        m_UISortPayload = true;
+        m_UIDeferredPayload = true;
+    }
+    if (KeyHooksOverride)
+        m_UIKeyHooks = true;
+    if (KeyRecordStrideOverride)
+    {
+        // The records of the biggest key set have to fit in a single buffer (at most 2GB)
+        uint64_t KeyRecordBufferSize = (uint64_t)KeyRecordStrideOverride * m_MaxNumKeys;
+        if (KeyRecordBufferSize <= (uint64_t)D3D12_REQ_RESOURCE_SIZE_IN_MEGABYTES_EXPRESSION_C_TERM * 1024 * 1024)
+            m_UIKeyRecords = true;
+        else
+        {
+            Trace("FFXParallelSort: key records of " + std::to_string(KeyRecordStrideOverride) + " bytes don't fit in a buffer for " + std::to_string(m_MaxNumKeys) + " keys, not sorting key records");
+            KeyRecordStrideOverride = 0;
+        }
+    }
+    if (ReadOnlyInputOverride)
+        m_UIReadOnlyInput = true;
+    if (PackedKeyIndexOverride)
+        m_UIPackedKeyIndex = true;
+    if (TileScatterOverride)
+        m_bTileScatter = true;
+    if (RegisterCountOverride)
+        m_bRegisterCount = true;
+    if (MatchScatterOverride && !m_bTileScatter)
+        m_bMatchScatter = true;
+    if (StageTimingsOverride)
+        m_UIStageTimings = true; 
+    if (TopKOverride)
+    {
+        m_UISelectTopK = true;
+        m_UISelectNumKeys = (int)TopKOverride;
+    }
+    if (PresortCheckOverride)
+        m_UIPresortCheck = true;
+    if (TemporalCoherenceOverride)
+        m_UITemporalCoherence = true;
+    if (GPUValidationOverride)
+        m_UIGPUValidation = true;
+    if (IncrementalSortOverride)
+    {
+        m_UIIncrementalSort = true;
+        m_UIDirtyKeyPercent = std::min((int)IncrementalSortOverride, MaxDirtyKeyPercent);
+    }
+    m_SelectPercentiles = { 0.01f, 0.25f, 0.5f, 0.75f, 0.99f };
+    if (!PercentilesOverride.empty())
+    {
+        m_SelectPercentiles = PercentilesOverride;
+        m_UISelectPercentiles = true;
+    }
+
+    // Keys of up to 16 bits can be sorted as 16-bit values when the device has native 16-bit shader ops (shader model 6.2)
+    if (m_KeyBits <= 16)
+    {
+        D3D12_FEATURE_DATA_SHADER_MODEL ShaderModel = { D3D_SHADER_MODEL_6_2 };
+        D3D12_FEATURE_DATA_D3D12_OPTIONS4 Options4 = {};
+        m_b16BitKeyStorage = SUCCEEDED(m_pDevice->GetDevice()->CheckFeatureSupport(D3D12_FEATURE_SHADER_MODEL, &ShaderModel, sizeof(ShaderModel))) &&
+                             ShaderModel.HighestShaderModel >= D3D_SHADER_MODEL_6_2 &&
+                             SUCCEEDED(m_pDevice->GetDevice()->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS4, &Options4, sizeof(Options4))) &&
+                             Options4.Native16BitShaderOpsSupported;
+        m_UI16BitKeys = m_b16BitKeyStorage;
+    }
+
+    // Match ranking can use WaveMatch where the device has shader model 6.5 (and falls back to ballots otherwise)
+    if (m_bMatchScatter)
+    {
+        D3D12_FEATURE_DATA_SHADER_MODEL ShaderModel = { D3D_SHADER_MODEL_6_5 };
+        m_bWaveMatch = SUCCEEDED(m_pDevice->GetDevice()->CheckFeatureSupport(D3D12_FEATURE_SHADER_MODEL, &ShaderModel, sizeof(ShaderModel))) &&
+                       ShaderModel.HighestShaderModel >= D3D_SHADER_MODEL_6_5;
+    }
+
+    // Specialize the sort kernels for the device's wave size when they are sure to run at it: either the device only has one, or
+    // shader model 6.6 lets the kernels pin it. Where there is a choice go with the widest, as it leaves the fewest wave totals to combine
+    D3D12_FEATURE_DATA_D3D12_OPTIONS1 Options1 = {};
+    if (SUCCEEDED(m_pDevice->GetDevice()->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS1, &Options1, sizeof(Options1))) && Options1.WaveOps)
+    {
+        uint32_t WaveSize = WaveSizeOverride >= 0 ? (uint32_t)WaveSizeOverride : Options1.WaveLaneCountMax;
+        bool bFixedWaveSize = Options1.WaveLaneCountMin == Options1.WaveLaneCountMax;
+        D3D12_FEATURE_DATA_SHADER_MODEL ShaderModel = { D3D_SHADER_MODEL_6_6 };
+        bool bCanPinWaveSize = SUCCEEDED(m_pDevice->GetDevice()->CheckFeatureSupport(D3D12_FEATURE_SHADER_MODEL, &ShaderModel, sizeof(ShaderModel))) &&
+                               ShaderModel.HighestShaderModel >= D3D_SHADER_MODEL_6_6;
+        if ((WaveSize == 32 || WaveSize == 64) && WaveSize >= Options1.WaveLaneCountMin && WaveSize <= Options1.WaveLaneCountMax && (bFixedWaveSize || bCanPinWaveSize))
+        {
+            m_WaveSize = WaveSize;
+            m_bPinWaveSize = !bFixedWaveSize;
+        }
+    }
 
     // Allocate UAVs to use for data
-    m_pResourceViewHeaps->AllocCBV_SRV_UAVDescriptor(3, &m_SrcKeyUAVTable);
+    m_pResourceViewHeaps->AllocCBV_SRV_UAVDescriptor(m_NumKeySets, &m_SrcKeyUAVTable);
     m_pResourceViewHeaps->AllocCBV_SRV_UAVDescriptor(1, &m_SrcPayloadUAV);
     m_pResourceViewHeaps->AllocCBV_SRV_UAVDescriptor(2, &m_DstKeyUAVTable);
+    m_pResourceViewHeaps->AllocCBV_SRV_UAVDescriptor(2, &m_DstKey16UAVTable);
     m_pResourceViewHeaps->AllocCBV_SRV_UAVDescriptor(2, &m_DstPayloadUAVTable);
-    m_pResourceViewHeaps->AllocCBV_SRV_UAVDescriptor(1, &m_FPSScratchUAV);
-    m_pResourceViewHeaps->AllocCBV_SRV_UAVDescriptor(1, &m_FPSReducedScratchUAV);
+    m_pResourceViewHeaps->AllocCBV_SRV_UAVDescriptor(2, &m_DirtyKeyUAVTable);
+    m_pResourceViewHeaps->AllocCBV_SRV_UAVDescriptor(2, &m_DirtyPayloadUAVTable);
+    m_pResourceViewHeaps->AllocCBV_SRV_UAVDescriptor(1, &m_DirtyIndexUAV);
+    m_pResourceViewHeaps->AllocCBV_SRV_UAVDescriptor(1, &m_PayloadIndexUAV);
+    m_pResourceViewHeaps->AllocCBV_SRV_UAVDescriptor(2, &m_DstKeySRVTable);
+    m_pResourceViewHeaps->AllocCBV_SRV_UAVDescriptor(2, &m_DstPayloadSRVTable);
+    m_pResourceViewHeaps->AllocCBV_SRV_UAVDescriptor(2, &m_DirtyKeySRVTable);
+    m_pResourceViewHeaps->AllocCBV_SRV_UAVDescriptor(2, &m_DirtyPayloadSRVTable);
+    m_pResourceViewHeaps->AllocCBV_SRV_UAVDescriptor(1, &m_PayloadIndexSRV);
+    m_pResourceViewHeaps->AllocCBV_SRV_UAVDescriptor(1, &m_KeyRecordUAV);
+    m_pResourceViewHeaps->AllocCBV_SRV_UAVDescriptor(1, &m_RunOffsetUAV);
+    m_pResourceViewHeaps->AllocCBV_SRV_UAVDescriptor(1, &m_FPSSelectStateUAV);
     m_pResourceViewHeaps->AllocCBV_SRV_UAVDescriptor(1, &m_IndirectKeyCountsUAV);
-    m_pResourceViewHeaps->AllocCBV_SRV_UAVDescriptor(1, &m_IndirectConstantBufferUAV);
-    m_pResourceViewHeaps->AllocCBV_SRV_UAVDescriptor(1, &m_IndirectCountScatterArgsUAV);
-    m_pResourceViewHeaps->AllocCBV_SRV_UAVDescriptor(1, &m_IndirectReduceScanArgsUAV);
+    m_pResourceViewHeaps->AllocCBV_SRV_UAVDescriptor(1, &m_PresortStateUAV);
+    m_pResourceViewHeaps->AllocCBV_SRV_UAVDescriptor(1, &m_ValidateStateUAV);
     m_pResourceViewHeaps->AllocCBV_SRV_UAVDescriptor(3, &m_ValidateTextureSRV);
 
-    // Create resources to test with. Sorts will be done for 1080p, 2K, and 4K resolution data sets
+    // Create resources to test with. Sorts will be done for 1080p, 2K, and 4K resolution data sets (and the custom key count if there is one)
     CreateKeyPayloadBuffers();
 
     // We are just going to fudge the indirect execution parameters for each resolution
-    CD3DX12_RESOURCE_DESC ResourceDesc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(uint32_t) * 3, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+    CD3DX12_RESOURCE_DESC ResourceDesc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(m_NumKeys), D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
     m_IndirectKeyCounts.InitBuffer(m_pDevice, "IndirectKeyCounts", &ResourceDesc, sizeof(uint32_t), D3D12_RESOURCE_STATE_COPY_DEST);
     m_IndirectKeyCounts.CreateBufferUAV(0, nullptr, &m_IndirectKeyCountsUAV);
-    uint8_t* pNumKeysBuffer = m_pUploadHeap->Suballocate(sizeof(uint32_t) * 3, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
-    memcpy(pNumKeysBuffer, NumKeys, sizeof(uint32_t) * 3);
-    m_pUploadHeap->GetCommandList()->CopyBufferRegion(m_IndirectKeyCounts.GetResource(), 0, m_pUploadHeap->GetResource(), pNumKeysBuffer - m_pUploadHeap->BasePtr(), sizeof(uint32_t) * 3);
+    UploadBufferData(m_IndirectKeyCounts.GetResource(), m_NumKeys, _countof(m_NumKeys));
     CD3DX12_RESOURCE_BARRIER Barrier = CD3DX12_RESOURCE_BARRIER::Transition(m_IndirectKeyCounts.GetResource(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
     m_pUploadHeap->GetCommandList()->ResourceBarrier(1, &Barrier);
 
+    // Selection state is a plane per field with one entry per query, the percentile plane is filled in once up front
+    uint32_t NumSelectQueries = (uint32_t)m_SelectPercentiles.size();
+    std::vector<uint32_t> SelectState(FFX_PARALLELSORT_SELECT_STATE_SIZE * NumSelectQueries, 0);
+    for (uint32_t i = 0; i < NumSelectQueries; ++i)
+        memcpy(&SelectState[FFX_PARALLELSORT_SELECT_STATE_PERCENTILE * NumSelectQueries + i], &m_SelectPercentiles[i], sizeof(float));
+
+    ResourceDesc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(uint32_t) * SelectState.size(), D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+    m_FPSSelectStateBuffer.InitBuffer(m_pDevice, "SelectState", &ResourceDesc, sizeof(uint32_t), D3D12_RESOURCE_STATE_COPY_DEST);
+    m_FPSSelectStateBuffer.CreateBufferUAV(0, nullptr, &m_FPSSelectStateUAV);
+    UploadBufferData(m_FPSSelectStateBuffer.GetResource(), SelectState.data(), (uint32_t)SelectState.size());
+    Barrier = CD3DX12_RESOURCE_BARRIER::Transition(m_FPSSelectStateBuffer.GetResource(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    m_pUploadHeap->GetCommandList()->ResourceBarrier(1, &Barrier);
+
+    // The presort check accumulates into its inversion counter, so it needs to start out cleared
+    uint32_t PresortState[FFX_PARALLELSORT_PRESORT_STATE_SIZE] = { 0 };
+    ResourceDesc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(PresortState), D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+    m_PresortStateBuffer.InitBuffer(m_pDevice, "PresortState", &ResourceDesc, sizeof(uint32_t), D3D12_RESOURCE_STATE_COPY_DEST);
+    m_PresortStateBuffer.CreateBufferUAV(0, nullptr, &m_PresortStateUAV);
+    UploadBufferData(m_PresortStateBuffer.GetResource(), PresortState, _countof(PresortState));
+    Barrier = CD3DX12_RESOURCE_BARRIER::Transition(m_PresortStateBuffer.GetResource(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    m_pUploadHeap->GetCommandList()->ResourceBarrier(1, &Barrier);
+
+    // What each check found gets copied into a ring of read-back slots too (so the GUI can show whether sorts get skipped)
+    CD3DX12_HEAP_PROPERTIES presortReadBackHeapProperties(D3D12_HEAP_TYPE_READBACK);
+    ResourceDesc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(uint32_t) * ReadBackLatency, D3D12_RESOURCE_FLAG_NONE);
+    ThrowIfFailed(m_pDevice->GetDevice()->CreateCommittedResource(&presortReadBackHeapProperties, D3D12_HEAP_FLAG_NONE, &ResourceDesc, D3D12_RESOURCE_STATE_COPY_DEST,
+                                                                  nullptr, IID_PPV_ARGS(&m_pPresortReadBackBuffer)));
+    m_pPresortReadBackBuffer->SetName(L"Presort Read-back Buffer");
+    ThrowIfFailed(m_pPresortReadBackBuffer->Map(0, nullptr, (void**)&m_pPresortInversions));
+
+    // The keys the percentile queries find get copied into a ring of read-back slots (so they can be shown and checked against the CPU)
+    ResourceDesc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(uint32_t) * ReadBackLatency * std::max(NumSelectQueries, 1u), D3D12_RESOURCE_FLAG_NONE);
+    ThrowIfFailed(m_pDevice->GetDevice()->CreateCommittedResource(&presortReadBackHeapProperties, D3D12_HEAP_FLAG_NONE, &ResourceDesc, D3D12_RESOURCE_STATE_COPY_DEST,
+                                                                  nullptr, IID_PPV_ARGS(&m_pPercentileReadBackBuffer)));
+    m_pPercentileReadBackBuffer->SetName(L"Percentile Read-back Buffer");
+    ThrowIfFailed(m_pPercentileReadBackBuffer->Map(0, nullptr, (void**)&m_pPercentileResults));
+
+    // GPU validation accumulates checksums, so it needs to start out cleared too
+    uint32_t ValidateState[FFX_PARALLELSORT_VALIDATE_STATE_SIZE];
+    FFX_ParallelSort_InitValidateState(ValidateState);
+    ResourceDesc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(ValidateState), D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+    m_ValidateStateBuffer.InitBuffer(m_pDevice, "ValidateState", &ResourceDesc, sizeof(uint32_t), D3D12_RESOURCE_STATE_COPY_DEST);
+    m_ValidateStateBuffer.CreateBufferUAV(0, nullptr, &m_ValidateStateUAV);
+    UploadBufferData(m_ValidateStateBuffer.GetResource(), ValidateState, _countof(ValidateState));
+    Barrier = CD3DX12_RESOURCE_BARRIER::Transition(m_ValidateStateBuffer.GetResource(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    m_pUploadHeap->GetCommandList()->ResourceBarrier(1, &Barrier);
+
+    // Result records get copied into a ring of read-back slots and looked at once the slot comes around again
+    CD3DX12_HEAP_PROPERTIES readBackHeapProperties(D3D12_HEAP_TYPE_READBACK);
+    ResourceDesc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(uint32_t) * FFX_PARALLELSORT_VALIDATE_RESULT_SIZE * GPUValidationSlots, D3D12_RESOURCE_FLAG_NONE);
+    ThrowIfFailed(m_pDevice->GetDevice()->CreateCommittedResource(&readBackHeapProperties, D3D12_HEAP_FLAG_NONE, &ResourceDesc, D3D12_RESOURCE_STATE_COPY_DEST,
+                                                                  nullptr, IID_PPV_ARGS(&m_pValidateReadBackBuffer)));
+    m_pValidateReadBackBuffer->SetName(L"GPU Validation Read-back Buffer");
+    ThrowIfFailed(m_pValidateReadBackBuffer->Map(0, nullptr, (void**)&m_pValidateResults));
+
     // Create resources for sort validation (image that goes from shuffled to sorted)
     m_Validate1080pTexture.InitFromFile(m_pDevice, m_pUploadHeap, "Validate1080p.png", false, 1.f, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS );
     m_Validate1080pTexture.CreateSRV(0, &m_ValidateTextureSRV, 0);
@@ -203,34 +916,58 @@ void FFXParallelSort::OnCreate(Device* pDevice, ResourceViewHeaps* pResourceView
     // Finish up
     m_pUploadHeap->FlushAndFinish();
 
-    // Allocate the scratch buffers needed for radix sort
-    uint32_t scratchBufferSize;
-    uint32_t reducedScratchBufferSize;
-    FFX_ParallelSort_CalculateScratchResourceSize(NumKeys[2], scratchBufferSize, reducedScratchBufferSize);
-        
-    ResourceDesc = CD3DX12_RESOURCE_DESC::Buffer(scratchBufferSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
-    m_FPSScratchBuffer.InitBuffer(m_pDevice, "Scratch", &ResourceDesc, sizeof(uint32_t), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-    m_FPSScratchBuffer.CreateBufferUAV(0, nullptr, &m_FPSScratchUAV);
-
-    ResourceDesc = CD3DX12_RESOURCE_DESC::Buffer(reducedScratchBufferSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
-    m_FPSReducedScratchBuffer.InitBuffer(m_pDevice, "ReducedScratch", &ResourceDesc, sizeof(uint32_t), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-    m_FPSReducedScratchBuffer.CreateBufferUAV(0, nullptr, &m_FPSReducedScratchUAV);
-
-    // Allocate the buffers for indirect execution of the algorithm
-    ResourceDesc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(FFX_ParallelSortCB), D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
-    m_IndirectConstantBuffer.InitBuffer(m_pDevice, "IndirectConstantBuffer", &ResourceDesc, sizeof(FFX_ParallelSortCB), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-    m_IndirectConstantBuffer.CreateBufferUAV(0, nullptr, &m_IndirectConstantBufferUAV);
-
-    ResourceDesc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(uint32_t) * 3, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
-    m_IndirectCountScatterArgs.InitBuffer(m_pDevice, "IndirectCount_Scatter_DispatchArgs", &ResourceDesc, sizeof(uint32_t), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-    m_IndirectCountScatterArgs.CreateBufferUAV(0, nullptr, &m_IndirectCountScatterArgsUAV);
-    m_IndirectReduceScanArgs.InitBuffer(m_pDevice, "IndirectReduceScanArgs", &ResourceDesc, sizeof(uint32_t), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-    m_IndirectReduceScanArgs.CreateBufferUAV(0, nullptr, &m_IndirectReduceScanArgsUAV);
+    // Size the scratch buffers needed for radix sort (big enough for the batched percentile queries too), every sort context gets its own
+    uint32_t selectScratchBufferSize;
+    uint32_t selectReducedScratchBufferSize;
+    FFX_ParallelSort_CalculateScratchResourceSize(m_MaxNumKeys, m_ScratchBufferSize, m_ReducedScratchBufferSize);
+    FFX_ParallelSort_CalculateSelectScratchResourceSize(m_MaxNumKeys, m_MaxNumThreadgroups, NumSelectQueries, selectScratchBufferSize, selectReducedScratchBufferSize);
+    m_ScratchBufferSize = std::max(m_ScratchBufferSize, selectScratchBufferSize);
+    m_ReducedScratchBufferSize = std::max(m_ReducedScratchBufferSize, selectReducedScratchBufferSize);
+    FFX_ParallelSort_CalculateScanBlockResourceSize(m_MaxNumKeys, m_ScanBlockBufferSize);
+
+    // Allocate the buffers the incremental re-sort sorts the changed keys in (ping-pong, like the sort buffers)
+    uint32_t MaxNumDirtyKeys = std::max(m_MaxNumKeys / 100 * MaxDirtyKeyPercent, 1u);
+    ResourceDesc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(uint32_t) * MaxNumDirtyKeys, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+    m_DirtyKeyBuffers[0].InitBuffer(m_pDevice, "DirtyKeyBuf0", &ResourceDesc, sizeof(uint32_t), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    m_DirtyKeyBuffers[1].InitBuffer(m_pDevice, "DirtyKeyBuf1", &ResourceDesc, sizeof(uint32_t), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    m_DirtyPayloadBuffers[0].InitBuffer(m_pDevice, "DirtyPayloadBuf0", &ResourceDesc, sizeof(uint32_t), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    m_DirtyPayloadBuffers[1].InitBuffer(m_pDevice, "DirtyPayloadBuf1", &ResourceDesc, sizeof(uint32_t), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    m_DirtyIndexBuffer.InitBuffer(m_pDevice, "DirtyIndices", &ResourceDesc, sizeof(uint32_t), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    m_DirtyKeyBuffers[0].CreateBufferUAV(0, nullptr, &m_DirtyKeyUAVTable);
+    m_DirtyKeyBuffers[1].CreateBufferUAV(1, nullptr, &m_DirtyKeyUAVTable);
+    m_DirtyPayloadBuffers[0].CreateBufferUAV(0, nullptr, &m_DirtyPayloadUAVTable);
+    m_DirtyPayloadBuffers[1].CreateBufferUAV(1, nullptr, &m_DirtyPayloadUAVTable);
+    m_DirtyIndexBuffer.CreateBufferUAV(0, nullptr, &m_DirtyIndexUAV);
+    CreateReadOnlyView(m_DirtyKeyBuffers[0], 0, &m_DirtyKeySRVTable);
+    CreateReadOnlyView(m_DirtyKeyBuffers[1], 1, &m_DirtyKeySRVTable);
+    CreateReadOnlyView(m_DirtyPayloadBuffers[0], 0, &m_DirtyPayloadSRVTable);
+    CreateReadOnlyView(m_DirtyPayloadBuffers[1], 1, &m_DirtyPayloadSRVTable);
+
+    // Allocate the buffer deferred payload gathers carry source indices in (the temp payload buffer is the other half of the ping-pong)
+    ResourceDesc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(uint32_t) * m_MaxNumKeys, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+    m_PayloadIndexBuffer.InitBuffer(m_pDevice, "PayloadIndices", &ResourceDesc, sizeof(uint32_t), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    m_PayloadIndexBuffer.CreateBufferUAV(0, nullptr, &m_PayloadIndexUAV);
+    CreateReadOnlyView(m_PayloadIndexBuffer, 0, &m_PayloadIndexSRV);
+
+    // Allocate the key records (only sized for the biggest key set when sorting key records)
+    uint64_t KeyRecordBufferSize = KeyRecordStrideOverride ? (uint64_t)KeyRecordStrideOverride * m_MaxNumKeys : sizeof(uint32_t);
+    ResourceDesc = CD3DX12_RESOURCE_DESC::Buffer(KeyRecordBufferSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+    m_KeyRecordBuffer.InitBuffer(m_pDevice, "KeyRecords", &ResourceDesc, sizeof(uint32_t), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    m_KeyRecordBuffer.CreateBufferUAV(0, nullptr, &m_KeyRecordUAV);
+
+    // Allocate the run offsets for out-of-core merges (one sorted run per chunk of keys that fits in the sort buffers, plus the end)
+    uint32_t MaxNumRuns = std::max((OutOfCoreOverride + m_MaxNumKeys - 1) / m_MaxNumKeys, 1u);
+    ResourceDesc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(uint32_t) * (MaxNumRuns + 1), D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+    m_RunOffsetBuffer.InitBuffer(m_pDevice, "RunOffsets", &ResourceDesc, sizeof(uint32_t), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    m_RunOffsetBuffer.CreateBufferUAV(0, nullptr, &m_RunOffsetUAV);
+
+    // Create the default sort context (scratch and indirect buffers for sorts that aren't handed a context of their own)
+    m_pDefaultSortContext = AcquireSortContext();
 
     // Create root signature for Radix sort passes
     {
-        D3D12_DESCRIPTOR_RANGE descRange[15];
-        D3D12_ROOT_PARAMETER rootParams[16];
+        D3D12_DESCRIPTOR_RANGE descRange[26];
+        D3D12_ROOT_PARAMETER rootParams[27];
 
         // Constant buffer table (always have 1)
         descRange[0] = { D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND };
@@ -310,8 +1047,52 @@ void FFXParallelSort::OnCreate(Device* pDevice, ResourceViewHeaps* pResourceView
         rootParams[15].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE; rootParams[15].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
         rootParams[15].DescriptorTable = { 1, &descRange[14] };
 
+        // SelectState (top-K only)
+        descRange[15] = { D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0, 13, D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND };
+        rootParams[16].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE; rootParams[16].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
+        rootParams[16].DescriptorTable = { 1, &descRange[15] };
+
+        // PresortState (indirect presort check only)
+        descRange[16] = { D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0, 14, D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND };
+        rootParams[17].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE; rootParams[17].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
+        rootParams[17].DescriptorTable = { 1, &descRange[16] };
+
+        // DirtyKeys, DirtyPayload and DirtyIndices (incremental re-sort only)
+        for (uint32_t i = 0; i < 3; ++i)
+        {
+            descRange[17 + i] = { D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0, 15 + i, D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND };
+            rootParams[18 + i].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE; rootParams[18 + i].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
+            rootParams[18 + i].DescriptorTable = { 1, &descRange[17 + i] };
+        }
+
+        // RunOffsets (out-of-core merge only)
+        descRange[20] = { D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0, 18, D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND };
+        rootParams[21].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE; rootParams[21].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
+        rootParams[21].DescriptorTable = { 1, &descRange[20] };
+
+        // ValidateState (GPU validation only)
+        descRange[21] = { D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0, 19, D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND };
+        rootParams[22].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE; rootParams[22].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
+        rootParams[22].DescriptorTable = { 1, &descRange[21] };
+
+        // Read-only SrcBuffer and SrcPayload (raw SRVs, read-only input only)
+        for (uint32_t i = 0; i < 2; ++i)
+        {
+            descRange[22 + i] = { D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0, i, D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND };
+            rootParams[23 + i].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE; rootParams[23 + i].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
+            rootParams[23 + i].DescriptorTable = { 1, &descRange[22 + i] };
+        }
+
+        // SrcKeys16 and DstKeys16 (16-bit key storage only)
+        for (uint32_t i = 0; i < 2; ++i)
+        {
+            descRange[24 + i] = { D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0, 20 + i, D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND };
+            rootParams[25 + i].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE; rootParams[25 + i].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
+            rootParams[25 + i].DescriptorTable = { 1, &descRange[24 + i] };
+        }
+
         D3D12_ROOT_SIGNATURE_DESC rootSigDesc = {};
-        rootSigDesc.NumParameters = 16;
+        rootSigDesc.NumParameters = 27;
         rootSigDesc.pParameters = rootParams;
         rootSigDesc.NumStaticSamplers = 0;
         rootSigDesc.pStaticSamplers = nullptr;
@@ -376,26 +1157,130 @@ void FFXParallelSort::OnCreate(Device* pDevice, ResourceViewHeaps* pResourceView
     //////////////////////////////////////////////////////////////////////////
     // Create pipelines for radix sort
     {
-        // Create all of the necessary pipelines for Sort and Scan
+        // Create all of the necessary pipelines for Sort and Scan (these all build in parallel)
         
         // SetupIndirectParams (indirect only)
-        CompileRadixPipeline("ParallelSortCS.hlsl", nullptr, "FPS_SetupIndirectParameters", m_pFPSIndirectSetupParametersPipeline);
+        m_FPSIndirectSetupParametersPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", nullptr, "FPS_SetupIndirectParameters");
+
+        // Presort check (inversion count, and setup that skips the sort when there were none)
+        DefineList presortDefines;
+        presortDefines["kRS_PresortCheck"] = std::to_string(1);
+        m_FPSIndirectSetupPresortPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &presortDefines, "FPS_SetupIndirectParameters");
+        m_FPSCountInversionsPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", nullptr, "FPS_CountInversions");
+
+        // GPU validation (checksums of the keys going in, checksums and order of the keys coming out, and the result record)
+        DefineList validatePayloadDefines;
+        validatePayloadDefines["kRS_ValueCopy"] = std::to_string(1);
+        m_FPSValidateInputPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", nullptr, "FPS_ValidateInput");
+        m_FPSValidateInputPayloadPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &validatePayloadDefines, "FPS_ValidateInput");
+        m_FPSValidateOutputPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", nullptr, "FPS_ValidateOutput");
+        m_FPSValidateOutputPayloadPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &validatePayloadDefines, "FPS_ValidateOutput");
+        m_FPSValidateResultPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", nullptr, "FPS_ValidateResult");
+
+        // Multi-word keys need the count and scatter passes to walk the key's word planes
+        DefineList keyDefines;
+        if (m_NumKeyWords > 1)
+            keyDefines["kRS_MultiWordKeys"] = std::to_string(1);
 
         // Radix count (sum table generation)
-        CompileRadixPipeline("ParallelSortCS.hlsl", nullptr, "FPS_Count", m_pFPSCountPipeline);
+        m_FPSCountPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &keyDefines, "FPS_Count");
         // Radix count reduce (sum table reduction for offset prescan)
-        CompileRadixPipeline("ParallelSortCS.hlsl", nullptr, "FPS_CountReduce", m_pFPSCountReducePipeline);
+        m_FPSCountReducePipeline = CompileRadixPipeline("ParallelSortCS.hlsl", nullptr, "FPS_CountReduce");
         // Radix scan (prefix scan)
-        CompileRadixPipeline("ParallelSortCS.hlsl", nullptr, "FPS_Scan", m_pFPSScanPipeline);
+        m_FPSScanPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", nullptr, "FPS_Scan");
         // Radix scan add (prefix scan + reduced prefix scan addition)
-        CompileRadixPipeline("ParallelSortCS.hlsl", nullptr, "FPS_ScanAdd", m_pFPSScanAddPipeline);
+        m_FPSScanAddPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", nullptr, "FPS_ScanAdd");
+        // Radix reduce + scan + scan add in a single thread group (for small thread group counts)
+        m_FPSReduceScanAddPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", nullptr, "FPS_ReduceScanAdd");
+        // Radix scan for reduced tables that don't fit in one thread group (block reduce, block sum scan, block scan + add)
+        m_FPSScanBlockReducePipeline = CompileRadixPipeline("ParallelSortCS.hlsl", nullptr, "FPS_ScanBlockReduce");
+        m_FPSScanBlockSumsPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", nullptr, "FPS_ScanBlockSums");
+        m_FPSScanBlockAddPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", nullptr, "FPS_ScanBlockAdd");
         // Radix scatter (key redistribution)
-        CompileRadixPipeline("ParallelSortCS.hlsl", nullptr, "FPS_Scatter", m_pFPSScatterPipeline);
+        m_FPSScatterPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &keyDefines, "FPS_Scatter");
         
         // Radix scatter with payload (key and payload redistribution)
-        DefineList defines;
+        DefineList defines = keyDefines;
         defines["kRS_ValueCopy"] = std::to_string(1);
-        CompileRadixPipeline("ParallelSortCS.hlsl", &defines, "FPS_Scatter", m_pFPSScatterPayloadPipeline);
+        m_FPSScatterPayloadPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &defines, "FPS_Scatter");
+
+        // Deferred payload gather (first scatter makes up the source indices, the payload moves once at the end)
+        DefineList indexDefines = defines;
+        indexDefines["kRS_IndexPayload"] = std::to_string(1);
+        m_FPSScatterIndexPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &indexDefines, "FPS_Scatter");
+        m_FPSGatherPayloadPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", nullptr, "FPS_GatherPayload");
+
+        // Packed key+index sorts (the passes in between are keys only)
+        m_FPSPackKeyIndexPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", nullptr, "FPS_PackKeyIndex");
+        m_FPSUnpackKeyIndexPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", nullptr, "FPS_UnpackKeyIndex");
+
+        // Key hooks (first pass' count and scatter load the keys through a hook, last pass' scatter stores them through one)
+        DefineList loadKeyDefines;
+        loadKeyDefines["kRS_LoadKeyHook"] = std::to_string(1);
+        m_FPSCountLoadKeyPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &loadKeyDefines, "FPS_Count");
+        m_FPSScatterLoadKeyPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &loadKeyDefines, "FPS_Scatter");
+        loadKeyDefines["kRS_ValueCopy"] = std::to_string(1);
+        m_FPSScatterLoadKeyPayloadPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &loadKeyDefines, "FPS_Scatter");
+        DefineList storeKeyDefines;
+        storeKeyDefines["kRS_StoreKeyHook"] = std::to_string(1);
+        m_FPSScatterStoreKeyPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &storeKeyDefines, "FPS_Scatter");
+        storeKeyDefines["kRS_ValueCopy"] = std::to_string(1);
+        m_FPSScatterStoreKeyPayloadPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &storeKeyDefines, "FPS_Scatter");
+
+        // Key records (first pass' count and scatter read the keys out of the records)
+        m_FPSWriteKeyRecordsPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", nullptr, "FPS_WriteKeyRecords");
+        DefineList keyRecordDefines;
+        keyRecordDefines["kRS_StridedKeys"] = std::to_string(1);
+        m_FPSCountKeyRecordsPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &keyRecordDefines, "FPS_Count");
+        m_FPSScatterKeyRecordsPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &keyRecordDefines, "FPS_Scatter");
+        keyRecordDefines["kRS_ValueCopy"] = std::to_string(1);
+        m_FPSScatterKeyRecordsPayloadPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &keyRecordDefines, "FPS_Scatter");
+
+        // Read-only input (count and scatter read the keys and payload through read-only views, count with 128-bit loads)
+        DefineList readOnlyDefines = keyDefines;
+        readOnlyDefines["kRS_ReadOnlyInput"] = std::to_string(1);
+        m_FPSCountReadOnlyPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &readOnlyDefines, "FPS_Count");
+        m_FPSScatterReadOnlyPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &readOnlyDefines, "FPS_Scatter");
+        readOnlyDefines["kRS_ValueCopy"] = std::to_string(1);
+        m_FPSScatterReadOnlyPayloadPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &readOnlyDefines, "FPS_Scatter");
+
+        // 16-bit key storage (count and scatter read and write the keys as 16-bit values, only built when the device can run them)
+        if (m_b16BitKeyStorage)
+        {
+            DefineList key16Defines;
+            key16Defines["kRS_16BitKeys"] = std::to_string(1);
+            m_FPSCount16BitPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &key16Defines, "FPS_Count");
+            m_FPSScatter16BitPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &key16Defines, "FPS_Scatter");
+            key16Defines["kRS_ValueCopy"] = std::to_string(1);
+            m_FPSScatter16BitPayloadPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &key16Defines, "FPS_Scatter");
+            m_FPSValidateInput16BitPayloadPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &key16Defines, "FPS_ValidateInput");
+            m_FPSValidateOutput16BitPayloadPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &key16Defines, "FPS_ValidateOutput");
+            key16Defines.erase("kRS_ValueCopy");
+            m_FPSValidateInput16BitPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &key16Defines, "FPS_ValidateInput");
+            m_FPSValidateOutput16BitPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &key16Defines, "FPS_ValidateOutput");
+        }
+
+        // Selection (prefix filtered count, per query reduce, threshold digit select, compaction with and without payload)
+        DefineList selectDefines;
+        selectDefines["kRS_SelectPrefix"] = std::to_string(1);
+        m_FPSSelectCountPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &selectDefines, "FPS_Count");
+        m_FPSSelectReducePipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &selectDefines, "FPS_CountReduce");
+        m_FPSSelectDigitPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", nullptr, "FPS_SelectDigit");
+        m_FPSSelectCompactPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", nullptr, "FPS_SelectCompact");
+        selectDefines.clear();
+        selectDefines["kRS_ValueCopy"] = std::to_string(1);
+        m_FPSSelectCompactPayloadPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &selectDefines, "FPS_SelectCompact");
+
+        // Incremental re-sort (sample's changed key generation, dirty payload gather, merge with and without payload)
+        m_FPSGenerateDirtyKeysPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", nullptr, "FPS_GenerateDirtyKeys");
+        m_FPSGatherDirtyPayloadPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", nullptr, "FPS_GatherDirtyPayload");
+        m_FPSMergePipeline = CompileRadixPipeline("ParallelSortCS.hlsl", nullptr, "FPS_Merge");
+        DefineList mergeDefines;
+        mergeDefines["kRS_ValueCopy"] = std::to_string(1);
+        m_FPSMergePayloadPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &mergeDefines, "FPS_Merge");
+
+        // Out-of-core merge of sorted runs (keys only)
+        m_FPSMergeRunsPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", nullptr, "FPS_MergeRuns");
     }
 
     //////////////////////////////////////////////////////////////////////////
@@ -436,6 +1321,15 @@ void FFXParallelSort::OnCreate(Device* pDevice, ResourceViewHeaps* pResourceView
         ThrowIfFailed(m_pDevice->GetDevice()->CreateGraphicsPipelineState(&descPso, IID_PPV_ARGS(&m_pRenderResultVerificationPipeline)));
         SetName(m_pRenderResultVerificationPipeline, "RenderFPSResults_Pipeline");
     }
+
+    // Unless asked not to, wait for the sort pipelines here. In async mode the first Sort() will only 
+    // wait on the permutations it actually binds.
+    if (!AsyncPipelineOverride)
+        WaitForPipelines();
+
+    // Out-of-core sorts run once up front (they stream everything through the upload heap)
+    if (OutOfCoreOverride)
+        SortOutOfCore(OutOfCoreOverride);
 }
 
 // Parallel Sort termination
@@ -450,61 +1344,437 @@ void FFXParallelSort::OnDestroy()
 
     // Release radix sort indirect resources
     m_IndirectKeyCounts.OnDestroy();
-    m_IndirectConstantBuffer.OnDestroy();
-    m_IndirectCountScatterArgs.OnDestroy();
-    m_IndirectReduceScanArgs.OnDestroy();
+    m_PresortStateBuffer.OnDestroy();
+    m_pPresortReadBackBuffer->Unmap(0, nullptr);
+    m_pPresortReadBackBuffer->Release();
+    m_pPercentileReadBackBuffer->Unmap(0, nullptr);
+    m_pPercentileReadBackBuffer->Release();
+    m_ValidateStateBuffer.OnDestroy();
+    m_pValidateReadBackBuffer->Unmap(0, nullptr);
+    m_pValidateReadBackBuffer->Release();
     m_pFPSCommandSignature->Release();
-    m_pFPSIndirectSetupParametersPipeline->Release();
+
+    // Pipelines may still be building if we never sorted, get() waits for them
+    m_FPSIndirectSetupParametersPipeline.get()->Release();
+    m_FPSIndirectSetupPresortPipeline.get()->Release();
+    m_FPSCountInversionsPipeline.get()->Release();
+    m_FPSValidateInputPipeline.get()->Release();
+    m_FPSValidateInputPayloadPipeline.get()->Release();
+    m_FPSValidateOutputPipeline.get()->Release();
+    m_FPSValidateOutputPayloadPipeline.get()->Release();
+    m_FPSValidateResultPipeline.get()->Release();
 
     // Release radix sort algorithm resources
-    m_FPSScratchBuffer.OnDestroy();
-    m_FPSReducedScratchBuffer.OnDestroy();
+    for (std::unique_ptr<SortContext>& Context : m_SortContexts)
+        DestroySortContext(*Context);
+    m_SortContexts.clear();
+    m_pDefaultSortContext = nullptr;
+    m_FPSSelectStateBuffer.OnDestroy();
+    m_FPSCountPipeline.get()->Release();
+    m_FPSCountReducePipeline.get()->Release();
+    m_FPSScanPipeline.get()->Release();
+    m_FPSScanAddPipeline.get()->Release();
+    m_FPSReduceScanAddPipeline.get()->Release();
+    m_FPSScanBlockReducePipeline.get()->Release();
+    m_FPSScanBlockSumsPipeline.get()->Release();
+    m_FPSScanBlockAddPipeline.get()->Release();
+    m_FPSScatterPipeline.get()->Release();
+    m_FPSScatterPayloadPipeline.get()->Release();
+    m_FPSScatterIndexPipeline.get()->Release();
+    m_FPSGatherPayloadPipeline.get()->Release();
+    m_FPSPackKeyIndexPipeline.get()->Release();
+    m_FPSUnpackKeyIndexPipeline.get()->Release();
+    m_FPSCountLoadKeyPipeline.get()->Release();
+    m_FPSScatterLoadKeyPipeline.get()->Release();
+    m_FPSScatterLoadKeyPayloadPipeline.get()->Release();
+    m_FPSScatterStoreKeyPipeline.get()->Release();
+    m_FPSScatterStoreKeyPayloadPipeline.get()->Release();
+    m_FPSWriteKeyRecordsPipeline.get()->Release();
+    m_FPSCountKeyRecordsPipeline.get()->Release();
+    m_FPSScatterKeyRecordsPipeline.get()->Release();
+    m_FPSScatterKeyRecordsPayloadPipeline.get()->Release();
+    m_FPSCountReadOnlyPipeline.get()->Release();
+    m_FPSScatterReadOnlyPipeline.get()->Release();
+    m_FPSScatterReadOnlyPayloadPipeline.get()->Release();
+    if (m_b16BitKeyStorage)
+    {
+        m_FPSCount16BitPipeline.get()->Release();
+        m_FPSScatter16BitPipeline.get()->Release();
+        m_FPSScatter16BitPayloadPipeline.get()->Release();
+        m_FPSValidateInput16BitPipeline.get()->Release();
+        m_FPSValidateInput16BitPayloadPipeline.get()->Release();
+        m_FPSValidateOutput16BitPipeline.get()->Release();
+        m_FPSValidateOutput16BitPayloadPipeline.get()->Release();
+    }
+    m_FPSSelectCountPipeline.get()->Release();
+    m_FPSSelectReducePipeline.get()->Release();
+    m_FPSSelectDigitPipeline.get()->Release();
+    m_FPSSelectCompactPipeline.get()->Release();
+    m_FPSSelectCompactPayloadPipeline.get()->Release();
+    m_FPSGenerateDirtyKeysPipeline.get()->Release();
+    m_FPSGatherDirtyPayloadPipeline.get()->Release();
+    m_FPSMergePipeline.get()->Release();
+    m_FPSMergePayloadPipeline.get()->Release();
+    m_FPSMergeRunsPipeline.get()->Release();
+    m_CompilePool.Stop();
     m_pFPSRootSignature->Release();
-    m_pFPSCountPipeline->Release();
-    m_pFPSCountReducePipeline->Release();
-    m_pFPSScanPipeline->Release();
-    m_pFPSScanAddPipeline->Release();
-    m_pFPSScatterPipeline->Release();
-    m_pFPSScatterPayloadPipeline->Release();
 
     // Release all of our resources
-    m_SrcKeyBuffers[0].OnDestroy();
-    m_SrcKeyBuffers[1].OnDestroy();
-    m_SrcKeyBuffers[2].OnDestroy();
+    for (uint32_t i = 0; i < m_NumKeySets; ++i)
+        m_SrcKeyBuffers[i].OnDestroy();
+    if (m_b16BitKeyStorage)
+    {
+        for (uint32_t i = 0; i < m_NumKeySets; ++i)
+            m_SrcKey16Buffers[i].OnDestroy();
+        m_DstKey16Buffers[0].OnDestroy();
+        m_DstKey16Buffers[1].OnDestroy();
+    }
     m_SrcPayloadBuffers.OnDestroy();
     m_DstKeyBuffers[0].OnDestroy();
     m_DstKeyBuffers[1].OnDestroy();
     m_DstPayloadBuffers[0].OnDestroy();
     m_DstPayloadBuffers[1].OnDestroy();
+    m_DirtyKeyBuffers[0].OnDestroy();
+    m_DirtyKeyBuffers[1].OnDestroy();
+    m_DirtyPayloadBuffers[0].OnDestroy();
+    m_DirtyPayloadBuffers[1].OnDestroy();
+    m_DirtyIndexBuffer.OnDestroy();
+    m_PayloadIndexBuffer.OnDestroy();
+    m_KeyRecordBuffer.OnDestroy();
+    m_RunOffsetBuffer.OnDestroy();
 }
 
-// This allows us to validate that the sorted data is actually in ascending order. Only used when doing algorithm changes.
+// This allows us to validate that the sorted data is actually in ascending order, and (for full sorts) that it is a stable
+// permutation of the keys and payloads that went in. Only used when doing algorithm changes.
 #ifdef DEVELOPERMODE
-void FFXParallelSort::CreateValidationResources(ID3D12GraphicsCommandList* pCommandList, RdxDX12ResourceInfo* pKeyDstInfo)
+// Host-side validation of read-back sort results. Keys are stored as word planes (word w of key i at w * NumKeys + i), and all the
+// checks split the keys into contiguous chunks that each get a thread.
+struct HostSortValidation
 {
-    // Create the read-back resource
-    CD3DX12_HEAP_PROPERTIES readBackHeapProperties(D3D12_HEAP_TYPE_READBACK);
-    CD3DX12_RESOURCE_DESC bufferDesc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(uint32_t) * NumKeys[m_UIResolutionSize], D3D12_RESOURCE_FLAG_NONE);
-    ThrowIfFailed(m_pDevice->GetDevice()->CreateCommittedResource(&readBackHeapProperties, D3D12_HEAP_FLAG_NONE, &bufferDesc, D3D12_RESOURCE_STATE_COPY_DEST,
-                                                    nullptr, IID_PPV_ARGS(&m_ReadBackBufferResource)));
-    m_ReadBackBufferResource->SetName(L"Validation Read-back Buffer");
+    uint64_t Inversions = 0;                // Entries larger than the next one
+    uint64_t FirstInversion = UINT64_MAX;
+    bool bPermutation = true;               // Sorted key/payload pairs are the ones that went in
+    bool bStable = true;                    // Equal keys kept the order their payloads went in with
+};
 
-    // And the fence for us to wait on
-    ThrowIfFailed(m_pDevice->GetDevice()->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_ReadBackFence)));
-    m_ReadBackFence->SetName(L"Validation Read-back Fence");
-                
-    // Transition, copy, and transition back
-    pCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(pKeyDstInfo->pResource, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE));
-    pCommandList->CopyBufferRegion(m_ReadBackBufferResource, 0, pKeyDstInfo->pResource, 0, sizeof(uint32_t) * NumKeys[m_UIResolutionSize]);
-    pCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(pKeyDstInfo->pResource, D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
+// Chunks smaller than this aren't worth a thread
+static const uint32_t HostValidationMinChunk = 1 << 16;
+
+template <typename ChunkFn>
+static void ParallelForChunks(uint32_t Count, uint32_t NumChunks, ChunkFn Fn)
+{
+    std::vector<std::thread> Threads;
+    for (uint32_t Chunk = 1; Chunk < NumChunks; ++Chunk)
+        Threads.emplace_back(Fn, Chunk, (uint32_t)((uint64_t)Count * Chunk / NumChunks), (uint32_t)((uint64_t)Count * (Chunk + 1) / NumChunks));
+    Fn(0, 0, (uint32_t)((uint64_t)Count / NumChunks));
+    for (std::thread& Thread : Threads)
+        Thread.join();
 }
 
-void FFXParallelSort::WaitForValidationResults()
+static inline uint64_t HostValidationMix(uint64_t Value)
 {
-    if (!m_ReadBackFence && !m_ReadBackBufferResource)
-        return;
+    Value ^= Value >> 33;
+    Value *= 0xff51afd7ed558ccdull;
+    Value ^= Value >> 33;
+    Value *= 0xc4ceb9fe1a85ec53ull;
+    return Value ^ (Value >> 33);
+}
 
-    // Insert the fence to wait on and create the event to trigger when it's been processed
+// Identifies a key for the permutation and stability checks (exact for keys of up to two words)
+static inline uint64_t HostValidationKey(const uint32_t* pKeys, uint32_t NumKeys, uint32_t NumKeyWords, uint32_t Index)
+{
+    uint64_t Key = pKeys[Index];
+    if (NumKeyWords > 1)
+        Key |= (uint64_t)pKeys[NumKeys + Index] << 32;
+    for (uint32_t Word = 2; Word < NumKeyWords; ++Word)
+        Key = HostValidationMix(Key) ^ pKeys[Word * NumKeys + Index];
+    return Key;
+}
+
+// Same compare as the sort (most significant key word first)
+static inline int HostValidationCompare(const uint32_t* pKeys, uint32_t NumKeys, uint32_t NumKeyWords, uint32_t IndexA, uint32_t IndexB)
+{
+    for (uint32_t Word = NumKeyWords; Word-- > 0;)
+    {
+        uint32_t A = pKeys[Word * NumKeys + IndexA], B = pKeys[Word * NumKeys + IndexB];
+        if (A != B)
+            return A < B ? -1 : 1;
+    }
+    return 0;
+}
+
+// Counts the entries in [Begin, End) that are larger than the next one. Single word keys compare 4 pairs at a time.
+static void CountHostInversions(const uint32_t* pKeys, uint32_t NumKeys, uint32_t NumKeyWords, uint32_t Begin, uint32_t End, uint64_t& Inversions, uint64_t& FirstInversion)
+{
+    End = std::min(End, NumKeys - 1);
+    uint32_t i = Begin;
+    if (NumKeyWords == 1)
+    {
+        // SSE2 only has signed compares, so flip the sign bits first
+        const __m128i SignBits = _mm_set1_epi32(0x80000000);
+        for (; i + 4 <= End; i += 4)
+        {
+            __m128i Keys = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(pKeys + i)), SignBits);
+            __m128i NextKeys = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(pKeys + i + 1)), SignBits);
+            uint32_t Mask = (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(Keys, NextKeys)));
+            if (!Mask)
+                continue;
+
+            if (FirstInversion == UINT64_MAX)
+            {
+                uint32_t Lane = 0;
+                while (!(Mask & (1 << Lane)))
+                    ++Lane;
+                FirstInversion = i + Lane;
+            }
+            Inversions += (Mask & 1) + ((Mask >> 1) & 1) + ((Mask >> 2) & 1) + (Mask >> 3);
+        }
+    }
+
+    for (; i < End; ++i)
+    {
+        if (HostValidationCompare(pKeys, NumKeys, NumKeyWords, i, i + 1) > 0)
+        {
+            if (FirstInversion == UINT64_MAX)
+                FirstInversion = i;
+            ++Inversions;
+        }
+    }
+}
+
+// Checksums of key/payload pairs, with and without each key's rank among the keys equal to it (the pairs going in and coming
+// out have to match for a permutation, and the ranked ones too for a stable sort)
+struct HostValidationChecksum
+{
+    uint64_t PairSum = 0, PairXor = 0;
+    uint64_t RankedSum = 0, RankedXor = 0;
+
+    void Add(uint64_t PairHash, uint32_t Rank)
+    {
+        PairSum += PairHash;
+        PairXor ^= PairHash;
+        uint64_t RankedHash = HostValidationMix(PairHash + (uint64_t)(Rank + 1) * 0x9e3779b97f4a7c15ull);
+        RankedSum += RankedHash;
+        RankedXor ^= RankedHash;
+    }
+
+    void Add(const HostValidationChecksum& Other)
+    {
+        PairSum += Other.PairSum;
+        PairXor ^= Other.PairXor;
+        RankedSum += Other.RankedSum;
+        RankedXor ^= Other.RankedXor;
+    }
+};
+
+static inline uint64_t HostValidationPairHash(uint64_t Key, const uint32_t* pPayload, uint32_t Index)
+{
+    uint64_t Hash = HostValidationMix(Key);
+    if (pPayload)
+        Hash = HostValidationMix(Hash ^ ((uint64_t)pPayload[Index] * 0x9e3779b97f4a7c15ull));
+    return Hash;
+}
+
+// Open-addressed set of the keys that show up more than once (the only ones whose rank among equal keys isn't 0)
+struct HostValidationKeySet
+{
+    std::vector<uint64_t> Keys;
+    std::vector<uint8_t> Used;
+
+    void Init(const std::vector<uint64_t>& SetKeys)
+    {
+        size_t Size = 16;
+        while (Size < 2 * SetKeys.size())
+            Size *= 2;
+        Keys.assign(Size, 0);
+        Used.assign(Size, 0);
+        for (uint64_t Key : SetKeys)
+        {
+            size_t Slot = Find(Key);
+            Keys[Slot] = Key;
+            Used[Slot] = 1;
+        }
+    }
+
+    // Slot holding the key, or the empty slot it would go in
+    size_t Find(uint64_t Key) const
+    {
+        size_t Mask = Keys.size() - 1;
+        size_t Slot = HostValidationMix(Key) & Mask;
+        while (Used[Slot] && Keys[Slot] != Key)
+            Slot = (Slot + 1) & Mask;
+        return Slot;
+    }
+};
+
+// Checksums of the sorted keys. Equal keys are next to each other here, so a key's rank is its distance from the start of its run
+// (which for the first key of a chunk is found with a binary search). Also collects the keys that show up more than once.
+static HostValidationChecksum ChecksumHostOutput(const uint32_t* pKeys, const uint32_t* pPayload, uint32_t NumKeys, uint32_t NumKeyWords, uint32_t NumChunks, HostValidationKeySet& Duplicates)
+{
+    std::vector<HostValidationChecksum> Checksums(NumChunks);
+    std::vector<std::vector<uint64_t>> ChunkDuplicates(NumChunks);
+    ParallelForChunks(NumKeys, NumChunks, [&](uint32_t Chunk, uint32_t Begin, uint32_t End)
+    {
+        if (Begin == End)
+            return;
+
+        uint32_t RunBegin = 0, RunEnd = Begin;
+        while (RunBegin < RunEnd)
+        {
+            uint32_t Middle = RunBegin + (RunEnd - RunBegin) / 2;
+            if (HostValidationCompare(pKeys, NumKeys, NumKeyWords, Middle, Begin) < 0)
+                RunBegin = Middle + 1;
+            else
+                RunEnd = Middle;
+        }
+
+        uint32_t Rank = Begin - RunBegin;
+        for (uint32_t i = Begin; i < End; ++i)
+        {
+            if (i > Begin && HostValidationCompare(pKeys, NumKeys, NumKeyWords, i - 1, i))
+                Rank = 0;
+            uint64_t Key = HostValidationKey(pKeys, NumKeys, NumKeyWords, i);
+            if (Rank == 1 || (Rank && i == Begin))
+                ChunkDuplicates[Chunk].push_back(Key);
+            Checksums[Chunk].Add(HostValidationPairHash(Key, pPayload, i), Rank++);
+        }
+    });
+
+    std::vector<uint64_t> DuplicateKeys;
+    for (const std::vector<uint64_t>& Keys : ChunkDuplicates)
+        DuplicateKeys.insert(DuplicateKeys.end(), Keys.begin(), Keys.end());
+    Duplicates.Init(DuplicateKeys);
+
+    HostValidationChecksum Checksum;
+    for (const HostValidationChecksum& ChunkChecksum : Checksums)
+        Checksum.Add(ChunkChecksum);
+    return Checksum;
+}
+
+// Checksums of the keys going in. Here a key's rank is how many equal keys came before it, which needs a count per duplicated key,
+// so every thread owns some of the duplicated keys and walks the whole input counting just those (keys that only show up once have rank 0).
+static HostValidationChecksum ChecksumHostInput(const uint32_t* pKeys, const uint32_t* pPayload, uint32_t NumKeys, uint32_t NumKeyWords, uint32_t NumChunks, const HostValidationKeySet& Duplicates)
+{
+    const uint8_t NoOwner = 0xff;
+    std::vector<uint8_t> Owners(NumKeys);
+    std::vector<HostValidationChecksum> Checksums(NumChunks);
+    ParallelForChunks(NumKeys, NumChunks, [&](uint32_t Chunk, uint32_t Begin, uint32_t End)
+    {
+        for (uint32_t i = Begin; i < End; ++i)
+        {
+            uint64_t Key = HostValidationKey(pKeys, NumKeys, NumKeyWords, i);
+            size_t Slot = Duplicates.Find(Key);
+            Owners[i] = Duplicates.Used[Slot] ? (uint8_t)(Slot % NumChunks) : NoOwner;
+            if (!Duplicates.Used[Slot])
+                Checksums[Chunk].Add(HostValidationPairHash(Key, pPayload, i), 0);
+        }
+    });
+
+    // Every duplicated key's count is only touched by the thread that owns it
+    std::vector<uint32_t> Counts(Duplicates.Keys.size(), 0);
+    std::vector<HostValidationChecksum> RankedChecksums(NumChunks);
+    ParallelForChunks(NumChunks, NumChunks, [&](uint32_t Owner, uint32_t, uint32_t)
+    {
+        for (uint32_t i = 0; i < NumKeys; ++i)
+        {
+            if (Owners[i] != Owner)
+                continue;
+            uint64_t Key = HostValidationKey(pKeys, NumKeys, NumKeyWords, i);
+            RankedChecksums[Owner].Add(HostValidationPairHash(Key, pPayload, i), Counts[Duplicates.Find(Key)]++);
+        }
+    });
+
+    HostValidationChecksum Checksum;
+    for (uint32_t Chunk = 0; Chunk < NumChunks; ++Chunk)
+    {
+        Checksum.Add(Checksums[Chunk]);
+        Checksum.Add(RankedChecksums[Chunk]);
+    }
+    return Checksum;
+}
+
+// Checks the sorted keys are in order, and when the keys going in are given that the sorted key/payload pairs are a stable permutation of them
+static HostSortValidation ValidateHostSortResults(const uint32_t* pSortedKeys, const uint32_t* pSortedPayload, const uint32_t* pInputKeys, const uint32_t* pInputPayload,
+                                                  uint32_t NumKeys, uint32_t NumKeyWords)
+{
+    HostSortValidation Result;
+    if (NumKeys < 2)
+        return Result;
+
+    uint32_t NumChunks = std::max(std::min(std::thread::hardware_concurrency(), NumKeys / HostValidationMinChunk), 1u);
+    NumChunks = std::min(NumChunks, 255u);      // Owners are bytes (with 0xff for keys no thread owns)
+
+    std::vector<uint64_t> Inversions(NumChunks, 0), FirstInversions(NumChunks, UINT64_MAX);
+    ParallelForChunks(NumKeys, NumChunks, [&](uint32_t Chunk, uint32_t Begin, uint32_t End)
+    {
+        CountHostInversions(pSortedKeys, NumKeys, NumKeyWords, Begin, End, Inversions[Chunk], FirstInversions[Chunk]);
+    });
+    for (uint32_t Chunk = 0; Chunk < NumChunks; ++Chunk)
+    {
+        Result.Inversions += Inversions[Chunk];
+        Result.FirstInversion = std::min(Result.FirstInversion, FirstInversions[Chunk]);
+    }
+
+    if (!pInputKeys)
+        return Result;
+
+    HostValidationKeySet Duplicates;
+    HostValidationChecksum OutputChecksum = ChecksumHostOutput(pSortedKeys, pSortedPayload, NumKeys, NumKeyWords, NumChunks, Duplicates);
+    HostValidationChecksum InputChecksum = ChecksumHostInput(pInputKeys, pInputPayload, NumKeys, NumKeyWords, NumChunks, Duplicates);
+    Result.bPermutation = InputChecksum.PairSum == OutputChecksum.PairSum && InputChecksum.PairXor == OutputChecksum.PairXor;
+    Result.bStable = InputChecksum.RankedSum == OutputChecksum.RankedSum && InputChecksum.RankedXor == OutputChecksum.RankedXor;
+    return Result;
+}
+
+// Read back of the keys (and payloads) a sort ends with, and for full sorts the ones it started with too (inputs come first)
+void FFXParallelSort::CreateValidationResources(uint32_t NumValidationKeys, bool bHasInput, bool bHasPayload, bool b16BitKeys)
+{
+    m_NumValidationKeys = NumValidationKeys;
+    m_bValidationHasInput = bHasInput;
+    m_bValidationHasPayload = bHasInput && bHasPayload;
+    m_bValidation16BitKeys = b16BitKeys;
+    uint64_t RegionSize = sizeof(uint32_t) * m_NumValidationKeys * (m_NumKeyWords + (m_bValidationHasPayload ? 1 : 0));
+
+    // Create the read-back resource
+    CD3DX12_HEAP_PROPERTIES readBackHeapProperties(D3D12_HEAP_TYPE_READBACK);
+    CD3DX12_RESOURCE_DESC bufferDesc = CD3DX12_RESOURCE_DESC::Buffer(RegionSize * (m_bValidationHasInput ? 2 : 1), D3D12_RESOURCE_FLAG_NONE);
+    ThrowIfFailed(m_pDevice->GetDevice()->CreateCommittedResource(&readBackHeapProperties, D3D12_HEAP_FLAG_NONE, &bufferDesc, D3D12_RESOURCE_STATE_COPY_DEST,
+                                                    nullptr, IID_PPV_ARGS(&m_ReadBackBufferResource)));
+    m_ReadBackBufferResource->SetName(L"Validation Read-back Buffer");
+
+    // And the fence for us to wait on
+    ThrowIfFailed(m_pDevice->GetDevice()->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_ReadBackFence)));
+    m_ReadBackFence->SetName(L"Validation Read-back Fence");
+}
+
+// Copies the keys (and payloads) going into or coming out of the sort into their part of the read-back buffer (16-bit keys only
+// fill the first half of theirs, they get widened once they are read back)
+void FFXParallelSort::CopyValidationData(ID3D12GraphicsCommandList* pCommandList, const RdxDX12ResourceInfo& KeyInfo, const RdxDX12ResourceInfo& PayloadInfo, bool bSorted)
+{
+    uint64_t KeySize = sizeof(uint32_t) * m_NumValidationKeys * m_NumKeyWords;
+    uint64_t PayloadSize = m_bValidationHasPayload ? sizeof(uint32_t) * m_NumValidationKeys : 0;
+    uint64_t Offset = (bSorted && m_bValidationHasInput) ? KeySize + PayloadSize : 0;
+    uint64_t KeyCopySize = m_bValidation16BitKeys ? sizeof(uint32_t) * ((m_NumValidationKeys + 1) / 2) : KeySize;
+
+    // Transition, copy, and transition back
+    CD3DX12_RESOURCE_BARRIER Barriers[2] = { CD3DX12_RESOURCE_BARRIER::Transition(KeyInfo.pResource, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE),
+                                             CD3DX12_RESOURCE_BARRIER::Transition(PayloadInfo.pResource, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE) };
+    UINT NumBarriers = PayloadSize ? 2 : 1;
+    pCommandList->ResourceBarrier(NumBarriers, Barriers);
+    pCommandList->CopyBufferRegion(m_ReadBackBufferResource, Offset, KeyInfo.pResource, 0, KeyCopySize);
+    if (PayloadSize)
+        pCommandList->CopyBufferRegion(m_ReadBackBufferResource, Offset + KeySize, PayloadInfo.pResource, 0, PayloadSize);
+    Barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(KeyInfo.pResource, D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    Barriers[1] = CD3DX12_RESOURCE_BARRIER::Transition(PayloadInfo.pResource, D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    pCommandList->ResourceBarrier(NumBarriers, Barriers);
+}
+
+void FFXParallelSort::WaitForValidationResults()
+{
+    if (!m_ReadBackFence && !m_ReadBackBufferResource)
+        return;
+
+    // Insert the fence to wait on and create the event to trigger when it's been processed
     ThrowIfFailed(m_pDevice->GetGraphicsQueue()->Signal(m_ReadBackFence, 1));
     m_ReadBackFenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
     m_ReadBackFence->SetEventOnCompletion(1, m_ReadBackFenceEvent);
@@ -516,34 +1786,68 @@ void FFXParallelSort::WaitForValidationResults()
     // Validate data ...
     Trace("Validating Data");
 
+    uint32_t keysToValidate = m_NumValidationKeys;
+    uint32_t RegionSize = keysToValidate * (m_NumKeyWords + (m_bValidationHasPayload ? 1 : 0));
+
     D3D12_RANGE range;
     range.Begin = 0;
-    range.End = sizeof(uint32_t) * NumKeys[m_UIResolutionSize];
+    range.End = sizeof(uint32_t) * RegionSize * (m_bValidationHasInput ? 2 : 1);
     void* pData;
     m_ReadBackBufferResource->Map(0, &range, &pData);
 
-    uint32_t* SortedData = (uint32_t*)pData;
-        
-    // Do the validation
-    uint32_t keysToValidate = NumKeys[m_UIResolutionSize];
-    bool dataValid = true;
+    const uint32_t* InputData = m_bValidationHasInput ? (const uint32_t*)pData : nullptr;
+    const uint32_t* SortedData = (const uint32_t*)pData + (m_bValidationHasInput ? RegionSize : 0);
+    const uint32_t* InputPayload = m_bValidationHasPayload ? InputData + keysToValidate * m_NumKeyWords : nullptr;
+    const uint32_t* SortedPayload = m_bValidationHasPayload ? SortedData + keysToValidate * m_NumKeyWords : nullptr;
 
-    for (uint32_t i = 0; i < keysToValidate - 1; i++)
+    // 16-bit keys were read back two to a uint, widen them so they can be checked like any other keys
+    std::vector<uint32_t> InputKeys16, SortedKeys16;
+    if (m_bValidation16BitKeys)
     {
-        if (SortedData[i] > SortedData[i + 1])
+        auto WidenKeys = [keysToValidate](const uint32_t* pPacked, std::vector<uint32_t>& Keys)
         {
-            std::string message = "Sort invalidated. Entry ";
-            message += std::to_string(i);
-            message += " is larger next entry.\n";
-            Trace(message);
-            dataValid = false;
+            Keys.resize(keysToValidate);
+            for (uint32_t i = 0; i < keysToValidate; ++i)
+                Keys[i] = (pPacked[i / 2] >> (16 * (i % 2))) & 0xFFFF;
+        };
+        if (InputData)
+        {
+            WidenKeys(InputData, InputKeys16);
+            InputData = InputKeys16.data();
         }
+        WidenKeys(SortedData, SortedKeys16);
+        SortedData = SortedKeys16.data();
     }
 
+    // Do the validation
+    auto ValidationStart = std::chrono::high_resolution_clock::now();
+    HostSortValidation Result = ValidateHostSortResults(SortedData, SortedPayload, InputData, InputPayload, keysToValidate, m_NumKeyWords);
+    double ValidationMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - ValidationStart).count();
+
     m_ReadBackBufferResource->Unmap(0, nullptr);
 
+    bool dataValid = true;
+    if (Result.Inversions)
+    {
+        std::string message = "Sort invalidated. " + std::to_string(Result.Inversions) + " entries are larger than the next entry (first at entry " +
+                              std::to_string(Result.FirstInversion) + ").\n";
+        Trace(message);
+        dataValid = false;
+    }
+    if (!Result.bPermutation)
+    {
+        Trace(m_bValidationHasPayload ? "Sort invalidated. Sorted key/payload pairs are not a permutation of the input.\n" : "Sort invalidated. Sorted keys are not a permutation of the input.\n");
+        dataValid = false;
+    }
+    else if (!Result.bStable)
+    {
+        Trace("Sort invalidated. Equal keys did not keep the order of their payloads.\n");
+        dataValid = false;
+    }
+
     if (dataValid)
         Trace("Data Valid");
+    Trace("Validated " + std::to_string(keysToValidate) + " keys in " + std::to_string(ValidationMs) + " ms");
 
     // We are done with the fence and the read-back buffer
     m_ReadBackBufferResource->Release();
@@ -556,30 +1860,92 @@ void FFXParallelSort::WaitForValidationResults()
 // Because we are sorting the data every frame, need to reset to unsorted version of data before running sort
 void FFXParallelSort::CopySourceDataForFrame(ID3D12GraphicsCommandList* pCommandList)
 {
+    // A new frame, so pick up the GPU validation results that have landed since the last one
+    ++m_FrameCount;
+    ReadGPUValidationResults();
+
     // Copy the contents the source buffer to the dstBuffer[0] each frame in order to not 
     // lose our original data
 
+    // With temporal coherence (or incremental re-sorts) we keep sorting last frame's result instead (only resetting when the key set changes)
+    bool bKeepKeys = KeepsSortedKeys();
+    if (bKeepKeys && m_TemporalKeySet == m_UIResolutionSize)
+        return;
+    m_TemporalKeySet = bKeepKeys ? m_UIResolutionSize : -1;
+    m_bSortedKeysInPlace = false;
+
     // Copy the data into the dst[0] buffers for use on first frame
     CD3DX12_RESOURCE_BARRIER Barriers[2] = { CD3DX12_RESOURCE_BARRIER::Transition(m_DstKeyBuffers[0].GetResource(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_DEST),
                                                 CD3DX12_RESOURCE_BARRIER::Transition(m_DstPayloadBuffers[0].GetResource(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_DEST) };
     pCommandList->ResourceBarrier(2, Barriers);
 
-    pCommandList->CopyBufferRegion(m_DstKeyBuffers[0].GetResource(), 0, m_SrcKeyBuffers[m_UIResolutionSize].GetResource(), 0, sizeof(uint32_t) * NumKeys[m_UIResolutionSize]);
-    pCommandList->CopyBufferRegion(m_DstPayloadBuffers[0].GetResource(), 0, m_SrcPayloadBuffers.GetResource(), 0, sizeof(uint32_t) * NumKeys[m_UIResolutionSize]);
+    pCommandList->CopyBufferRegion(m_DstKeyBuffers[0].GetResource(), 0, m_SrcKeyBuffers[m_UIResolutionSize].GetResource(), 0, sizeof(uint32_t) * m_NumKeys[m_UIResolutionSize] * m_NumKeyWords);
+    pCommandList->CopyBufferRegion(m_DstPayloadBuffers[0].GetResource(), 0, m_SrcPayloadBuffers.GetResource(), 0, sizeof(uint32_t) * m_NumKeys[m_UIResolutionSize]);
 
     // Put the dst buffers back to UAVs for sort usage
     Barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(m_DstKeyBuffers[0].GetResource(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
     Barriers[1] = CD3DX12_RESOURCE_BARRIER::Transition(m_DstPayloadBuffers[0].GetResource(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
     pCommandList->ResourceBarrier(2, Barriers);
+
+    // And the 16-bit copy of the keys when sorting with 16-bit key storage
+    if (m_b16BitKeyStorage && m_UI16BitKeys)
+    {
+        Barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(m_DstKey16Buffers[0].GetResource(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_DEST);
+        pCommandList->ResourceBarrier(1, Barriers);
+        pCommandList->CopyBufferRegion(m_DstKey16Buffers[0].GetResource(), 0, m_SrcKey16Buffers[m_UIResolutionSize].GetResource(), 0, sizeof(uint32_t) * ((m_NumKeys[m_UIResolutionSize] + 1) / 2));
+        Barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(m_DstKey16Buffers[0].GetResource(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+        pCommandList->ResourceBarrier(1, Barriers);
+    }
 }
 
 // Perform Parallel Sort (radix-based sort)
-void FFXParallelSort::Sort(ID3D12GraphicsCommandList* pCommandList, bool isBenchmarking, float benchmarkTime)
+void FFXParallelSort::Sort(ID3D12GraphicsCommandList* pCommandList, bool isBenchmarking, float benchmarkTime, GPUTimestamps* pGPUTimer/*=nullptr*/, SortContext* pContext/*=nullptr*/)
 {
-    bool bIndirectDispatch = m_UIIndirectSort;
+    SortContext& Context = pContext ? *pContext : *m_pDefaultSortContext;
+
+    // Sorts on an acquired context are plain direct sorts of the context's keys, and so are out-of-core chunks of the chunk's keys.
+    // None of the other modes apply to them, and context sorts don't look at or update any of the sample's state, so they can be
+    // recorded on other threads.
+    bool bContextSort = &Context != m_pDefaultSortContext;
+    if (bContextSort && !Context.NumKeys)
+        return;
+    assert(!bContextSort || Context.NumKeys <= m_MaxNumKeys);
+    uint32_t NumPlainSortKeys = bContextSort ? Context.NumKeys : m_OutOfCoreChunkKeys;
+    bool bIndirectDispatch = !NumPlainSortKeys && m_UIIndirectSort;
+    GPUTimestamps* pStageTimer = !bContextSort && m_UIStageTimings ? pGPUTimer : nullptr;
+    if (!bContextSort)
+        m_StageTimings.BeginSort();
+
+    // Selection needs to know how many keys it is selecting from, so it always runs with direct dispatches
+    uint32_t NumSelectKeys = NumPlainSortKeys ? 0 : GetNumSelectKeys();
+    uint32_t NumSelectQueries = NumPlainSortKeys ? 0 : GetNumSelectQueries();
+    if (NumSelectKeys || NumSelectQueries)
+        bIndirectDispatch = false;
+
+    // Incremental re-sorts only sort the keys that changed (so they need to know how many), once there is a sorted order to merge them into
+    uint32_t NumDirtyKeys = !NumPlainSortKeys && m_bSortedKeysInPlace ? GetNumDirtyKeys() : 0;
+    if (NumDirtyKeys)
+        bIndirectDispatch = false;
+
+    // The presort check decides whether to sort on the GPU, so it always runs with indirect dispatches
+    bool bPresortCheck = !NumPlainSortKeys && m_UIPresortCheck && !NumSelectKeys && !NumSelectQueries && !NumDirtyKeys;
+    if (bPresortCheck)
+        bIndirectDispatch = true;
+
+    // GPU validation checks full sorts (the other modes don't leave a sorted permutation of the input keys behind)
+    bool bGPUValidate = !NumPlainSortKeys && m_UIGPUValidation && !NumSelectKeys && !NumSelectQueries && !NumDirtyKeys;
+
+    // Key records have the first pass read the keys straight out of the records (full sorts of single-word keys that start over
+    // from the source keys every frame, so the records always hold the keys being sorted)
+    bool bKeyRecords = !NumPlainSortKeys && m_UIKeyRecords && m_NumKeyWords == 1 && !bPresortCheck && !NumSelectKeys && !NumSelectQueries && !NumDirtyKeys &&
+                       !m_UITemporalCoherence && !m_UIIncrementalSort;
 
     std::string markerText = "FFXParallelSort";
     if (bIndirectDispatch) markerText += " Indirect";
+    if (bPresortCheck) markerText += " Presort";
+    if (NumSelectKeys) markerText += " TopK";
+    if (NumSelectQueries) markerText += " Percentiles";
+    if (NumDirtyKeys) markerText += " Incremental";
     UserMarker marker(pCommandList, markerText.c_str());
 
     FFX_ParallelSortCB  constantBufferData = { 0 };
@@ -591,13 +1957,19 @@ void FFXParallelSort::Sort(ID3D12GraphicsCommandList* pCommandList, bool isBench
     // Bind the root signature
     pCommandList->SetComputeRootSignature(m_pFPSRootSignature);
 
+    // Spread the keys out into records when the key set changes
+    if (bKeyRecords && m_KeyRecordSet != m_UIResolutionSize)
+        WriteKeyRecords(pCommandList, pStageTimer);
+
     // Fill in the constant buffer data structure (this will be done by a shader in the indirect version)
     uint32_t NumThreadgroupsToRun;
     uint32_t NumReducedThreadgroupsToRun;
+    uint32_t NumberOfKeys = NumPlainSortKeys ? NumPlainSortKeys : (NumSelectKeys ? NumSelectKeys : (NumDirtyKeys ? NumDirtyKeys : m_NumKeys[m_UIResolutionSize]));
     if (!bIndirectDispatch)
     {
-        uint32_t NumberOfKeys = NumKeys[m_UIResolutionSize];
-        FFX_ParallelSort_SetConstantAndDispatchData(NumberOfKeys, m_MaxNumThreadgroups, constantBufferData, NumThreadgroupsToRun, NumReducedThreadgroupsToRun);
+        FFX_ParallelSort_SetConstantAndDispatchData(NumberOfKeys, m_MaxNumThreadgroups, constantBufferData, NumThreadgroupsToRun, NumReducedThreadgroupsToRun, m_NumKeyWords);
+        if (bKeyRecords)
+            FFX_ParallelSort_SetKeyLayout(constantBufferData, KeyRecordStrideOverride, KeyRecordOffsetOverride);
     }
     else
     {
@@ -605,76 +1977,239 @@ void FFXParallelSort::Sort(ID3D12GraphicsCommandList* pCommandList, bool isBench
         {
             uint32_t NumKeysIndex;
             uint32_t MaxThreadGroups;
+            uint32_t NumKeyWords;
+            uint32_t KeyStride;
+            uint32_t KeyOffset;
         };
         SetupIndirectCB IndirectSetupCB;
         IndirectSetupCB.NumKeysIndex = m_UIResolutionSize;
         IndirectSetupCB.MaxThreadGroups = m_MaxNumThreadgroups;
+        IndirectSetupCB.NumKeyWords = m_NumKeyWords;
+        IndirectSetupCB.KeyStride = bKeyRecords ? KeyRecordStrideOverride / sizeof(uint32_t) : 1;
+        IndirectSetupCB.KeyOffset = bKeyRecords ? KeyRecordOffsetOverride / sizeof(uint32_t) : 0;
             
         // Copy the data into the constant buffer
-        D3D12_GPU_VIRTUAL_ADDRESS constantBuffer = m_pConstantBufferRing->AllocConstantBuffer(sizeof(SetupIndirectCB), &IndirectSetupCB);
+        D3D12_GPU_VIRTUAL_ADDRESS constantBuffer = AllocConstantBuffer(sizeof(SetupIndirectCB), &IndirectSetupCB);
         pCommandList->SetComputeRootConstantBufferView(1, constantBuffer);  // SetupIndirect Constant buffer
 
         // Bind other buffer
         pCommandList->SetComputeRootDescriptorTable(12, m_IndirectKeyCountsUAV.GetGPU());           // Key counts
-        pCommandList->SetComputeRootDescriptorTable(13, m_IndirectConstantBufferUAV.GetGPU());      // Indirect Sort Constant Buffer
-        pCommandList->SetComputeRootDescriptorTable(14, m_IndirectCountScatterArgsUAV.GetGPU());    // Indirect Sort Count/Scatter Args
-        pCommandList->SetComputeRootDescriptorTable(15, m_IndirectReduceScanArgsUAV.GetGPU());      // Indirect Sort Reduce/Scan Args
+        pCommandList->SetComputeRootDescriptorTable(13, Context.IndirectConstantBufferUAV.GetGPU());      // Indirect Sort Constant Buffer
+        pCommandList->SetComputeRootDescriptorTable(14, Context.IndirectCountScatterArgsUAV.GetGPU());    // Indirect Sort Count/Scatter Args
+        pCommandList->SetComputeRootDescriptorTable(15, Context.IndirectReduceScanArgsUAV.GetGPU());      // Indirect Sort Reduce/Scan Args
+
+        // Count the keys that are out of order so setup can skip the sort when there are none
+        if (bPresortCheck)
+        {
+            pCommandList->SetComputeRootDescriptorTable(3, m_DstKeyUAVTable.GetGPU(0));           // SrcBuffer
+            pCommandList->SetComputeRootDescriptorTable(17, m_PresortStateUAV.GetGPU());          // Presort state
+            pCommandList->SetPipelineState(m_FPSCountInversionsPipeline.get());
+            pCommandList->Dispatch(m_MaxNumThreadgroups, 1, 1);
+
+            CD3DX12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::UAV(m_PresortStateBuffer.GetResource());
+            pCommandList->ResourceBarrier(1, &barrier);
+            StageTimeStamp(pCommandList, pStageTimer, "CountInversions", 0);
+        }
             
         // Dispatch
-        pCommandList->SetPipelineState(m_pFPSIndirectSetupParametersPipeline);
+        pCommandList->SetPipelineState(bPresortCheck ? m_FPSIndirectSetupPresortPipeline.get() : m_FPSIndirectSetupParametersPipeline.get());
         pCommandList->Dispatch(1, 1, 1);
 
         // When done, transition the args buffers to INDIRECT_ARGUMENT, and the constant buffer UAV to Constant buffer
         CD3DX12_RESOURCE_BARRIER barriers[5];
-        barriers[0] = CD3DX12_RESOURCE_BARRIER::UAV(m_IndirectCountScatterArgs.GetResource());
-        barriers[1] = CD3DX12_RESOURCE_BARRIER::UAV(m_IndirectReduceScanArgs.GetResource());
-        barriers[2] = CD3DX12_RESOURCE_BARRIER::Transition(m_IndirectConstantBuffer.GetResource(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
-        barriers[3] = CD3DX12_RESOURCE_BARRIER::Transition(m_IndirectCountScatterArgs.GetResource(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT);
-        barriers[4] = CD3DX12_RESOURCE_BARRIER::Transition(m_IndirectReduceScanArgs.GetResource(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT);
+        barriers[0] = CD3DX12_RESOURCE_BARRIER::UAV(Context.IndirectCountScatterArgs.GetResource());
+        barriers[1] = CD3DX12_RESOURCE_BARRIER::UAV(Context.IndirectReduceScanArgs.GetResource());
+        barriers[2] = CD3DX12_RESOURCE_BARRIER::Transition(Context.IndirectConstantBuffer.GetResource(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
+        barriers[3] = CD3DX12_RESOURCE_BARRIER::Transition(Context.IndirectCountScatterArgs.GetResource(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT);
+        barriers[4] = CD3DX12_RESOURCE_BARRIER::Transition(Context.IndirectReduceScanArgs.GetResource(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT);
         pCommandList->ResourceBarrier(5, barriers);
+        StageTimeStamp(pCommandList, pStageTimer, "SetupIndirect", 0);
+
+        if (bPresortCheck)
+            ReadBackPresortInversions(pCommandList);
     }
 
+    // Reduced tables that don't fit in a single scan block go through the scan hierarchy. The key count isn't known on the 
+    // CPU with indirect execution, so there we go by the biggest key count that could be sorted.
+    bool bScanHierarchy = FFX_ParallelSort_RequiresScanHierarchy(bIndirectDispatch ? m_MaxNumKeys : NumberOfKeys, m_MaxNumThreadgroups);
+    uint32_t NumScanBlocks = FFX_ParallelSort_NumScanBlocks(constantBufferData.NumScanValues);
+
+    // Few enough thread groups for one thread group to do the reduce, scan and scan add on its own
+    bool bFusedScan = FFX_ParallelSort_UseFusedScan(bIndirectDispatch ? m_MaxNumThreadgroups : NumThreadgroupsToRun);
+
     // Setup resource/UAV pairs to use during sort
-    RdxDX12ResourceInfo KeySrcInfo = { m_DstKeyBuffers[0].GetResource(), m_DstKeyUAVTable.GetGPU(0) };
-    RdxDX12ResourceInfo PayloadSrcInfo = { m_DstPayloadBuffers[0].GetResource(), m_DstPayloadUAVTable.GetGPU(0) };
-    RdxDX12ResourceInfo KeyTmpInfo = { m_DstKeyBuffers[1].GetResource(), m_DstKeyUAVTable.GetGPU(1) };
-    RdxDX12ResourceInfo PayloadTmpInfo = { m_DstPayloadBuffers[1].GetResource(), m_DstPayloadUAVTable.GetGPU(1) };
-    RdxDX12ResourceInfo ScratchBufferInfo = { m_FPSScratchBuffer.GetResource(), m_FPSScratchUAV.GetGPU() };
-    RdxDX12ResourceInfo ReducedScratchBufferInfo = { m_FPSReducedScratchBuffer.GetResource(), m_FPSReducedScratchUAV.GetGPU() };
+    RdxDX12ResourceInfo KeySrcInfo = { m_DstKeyBuffers[0].GetResource(), m_DstKeyUAVTable.GetGPU(0), m_DstKeySRVTable.GetGPU(0) };
+    RdxDX12ResourceInfo PayloadSrcInfo = { m_DstPayloadBuffers[0].GetResource(), m_DstPayloadUAVTable.GetGPU(0), m_DstPayloadSRVTable.GetGPU(0) };
+    RdxDX12ResourceInfo KeyTmpInfo = { m_DstKeyBuffers[1].GetResource(), m_DstKeyUAVTable.GetGPU(1), m_DstKeySRVTable.GetGPU(1) };
+    RdxDX12ResourceInfo PayloadTmpInfo = { m_DstPayloadBuffers[1].GetResource(), m_DstPayloadUAVTable.GetGPU(1), m_DstPayloadSRVTable.GetGPU(1) };
+    RdxDX12ResourceInfo ScratchBufferInfo = { Context.ScratchBuffer.GetResource(), Context.ScratchUAV.GetGPU() };
+    RdxDX12ResourceInfo ReducedScratchBufferInfo = { Context.ReducedScratchBuffer.GetResource(), Context.ReducedScratchUAV.GetGPU() };
+    RdxDX12ResourceInfo ScanBlockBufferInfo = { Context.ScanBlockBuffer.GetResource(), Context.ScanBlockUAV.GetGPU() };
+    RdxDX12ResourceInfo DirtyKeyInfo[2] = { { m_DirtyKeyBuffers[0].GetResource(), m_DirtyKeyUAVTable.GetGPU(0), m_DirtyKeySRVTable.GetGPU(0) },
+                                            { m_DirtyKeyBuffers[1].GetResource(), m_DirtyKeyUAVTable.GetGPU(1), m_DirtyKeySRVTable.GetGPU(1) } };
+    RdxDX12ResourceInfo DirtyPayloadInfo[2] = { { m_DirtyPayloadBuffers[0].GetResource(), m_DirtyPayloadUAVTable.GetGPU(0), m_DirtyPayloadSRVTable.GetGPU(0) },
+                                                { m_DirtyPayloadBuffers[1].GetResource(), m_DirtyPayloadUAVTable.GetGPU(1), m_DirtyPayloadSRVTable.GetGPU(1) } };
+    if (bContextSort)
+    {
+        KeySrcInfo = Context.KeyInfo[0];
+        KeyTmpInfo = Context.KeyInfo[1];
+        PayloadSrcInfo = Context.PayloadInfo[0];
+        PayloadTmpInfo = Context.PayloadInfo[1];
+    }
 
     // Buffers to ping-pong between when writing out sorted values
     const RdxDX12ResourceInfo* ReadBufferInfo(&KeySrcInfo), * WriteBufferInfo(&KeyTmpInfo);
     const RdxDX12ResourceInfo* ReadPayloadBufferInfo(&PayloadSrcInfo), * WritePayloadBufferInfo(&PayloadTmpInfo);
-    bool bHasPayload = m_UISortPayload;
+    bool bHasPayload = bContextSort ? Context.PayloadInfo[0].pResource != nullptr : (m_UISortPayload && !m_OutOfCoreChunkKeys);
+
+    // Deferred payload gathers carry source indices through the passes instead of the payload, then move the payload once at the end.
+    // Skipped sorts wouldn't write any indices to gather with, and the other modes move payloads around themselves.
+    bool bDeferredPayload = bHasPayload && !bContextSort && m_UIDeferredPayload && !bPresortCheck && !NumSelectKeys && !NumSelectQueries && !NumDirtyKeys && !bKeyRecords;
+    RdxDX12ResourceInfo PayloadIndexInfo = { m_PayloadIndexBuffer.GetResource(), m_PayloadIndexUAV.GetGPU(), m_PayloadIndexSRV.GetGPU() };
+
+    // Key hooks load the keys in the first pass and store them in the last one (full sorts of single-word keys, and not with
+    // a deferred payload gather, its first scatter makes up indices instead, or key records, those load the keys themselves)
+    bool bKeyHooks = !NumPlainSortKeys && m_UIKeyHooks && m_NumKeyWords == 1 && !bPresortCheck && !NumSelectKeys && !NumSelectQueries && !NumDirtyKeys && !bDeferredPayload &&
+                     !bKeyRecords;
+
+    // Read-only input has count and scatter read the sort buffers through read-only views (not for the passes that read keys from
+    // elsewhere, or the first pass of a deferred payload gather, its scatter doesn't read a payload)
+    bool bReadOnlyInput = !bContextSort && m_UIReadOnlyInput && !bKeyRecords && !bKeyHooks;
+
+    // Packed key+index sorts carry the source indices in the low bits of the keys, and hand them out in place of the payload (plain
+    // full sorts of keys narrow enough to leave room for the indices of every key that could be sorted)
+    uint32_t PackedIndexBits = FFX_ParallelSort_PackedIndexBits(bIndirectDispatch ? m_MaxNumKeys : NumberOfKeys);
+    bool bPackedKeyIndex = !NumPlainSortKeys && m_UIPackedKeyIndex && m_NumKeyWords == 1 && FFX_ParallelSort_CanPackKeyIndex(m_KeyBits, bIndirectDispatch ? m_MaxNumKeys : NumberOfKeys) &&
+                           !bPresortCheck && !NumSelectKeys && !NumSelectQueries && !NumDirtyKeys && !m_UITemporalCoherence &&
+                           !m_UIIncrementalSort && !bGPUValidate && !bKeyRecords && !bDeferredPayload && !bKeyHooks;
+#ifdef DEVELOPERMODE
+    bPackedKeyIndex = bPackedKeyIndex && !m_UIValidateSortResults;
+#endif // DEVELOPERMODE
+    if (bPackedKeyIndex)
+        bHasPayload = false;
+
+    // 16-bit key storage sorts the 16-bit copy of the keys (plain full sorts, validated or not, the other modes read and write the keys
+    // as uints, so they sort the same narrow keys in the 32-bit buffers, with the same number of passes)
+    bool b16BitKeys = !NumPlainSortKeys && m_b16BitKeyStorage && m_UI16BitKeys && !bPresortCheck && !NumSelectKeys && !NumSelectQueries && !NumDirtyKeys &&
+                      !m_UITemporalCoherence && !m_UIIncrementalSort && !bKeyRecords && !bDeferredPayload && !bKeyHooks && !bReadOnlyInput && !bPackedKeyIndex;
+    if (b16BitKeys)
+    {
+        KeySrcInfo = { m_DstKey16Buffers[0].GetResource(), m_DstKey16UAVTable.GetGPU(0) };
+        KeyTmpInfo = { m_DstKey16Buffers[1].GetResource(), m_DstKey16UAVTable.GetGPU(1) };
+    }
+
+    // Checksums of the keys going in
+    if (bGPUValidate)
+        ValidateSort(pCommandList, pStageTimer, KeySrcInfo, PayloadSrcInfo, bHasPayload, b16BitKeys, false);
+
+#ifdef DEVELOPERMODE
+    // Full sorts also read back the keys going in, so the results can be checked for being a stable permutation of them
+    bool bValidateInput = !NumPlainSortKeys && m_UIValidateSortResults && !isBenchmarking && !NumSelectKeys && !NumSelectQueries && !NumDirtyKeys;
+    if (bValidateInput)
+    {
+        CreateValidationResources(NumberOfKeys, true, bHasPayload, b16BitKeys);
+        CopyValidationData(pCommandList, KeySrcInfo, PayloadSrcInfo, false);
+    }
+#endif // DEVELOPERMODE
+
+    // Percentile queries only refine digits, nothing gets sorted (the selected keys get copied back from the select state buffer)
+    if (NumSelectQueries)
+    {
+        SelectPercentiles(pCommandList, pStageTimer, Context, KeySrcInfo);
+        ReadBackPercentiles(pCommandList);
+        return;
+    }
+
+    // With top-K selection only the selected keys get sorted (they are compacted into the temp buffers)
+    if (NumSelectKeys)
+    {
+        SelectTopK(pCommandList, pStageTimer, Context, NumSelectKeys, KeySrcInfo, KeyTmpInfo, PayloadSrcInfo, PayloadTmpInfo);
+        std::swap(ReadBufferInfo, WriteBufferInfo);
+        std::swap(ReadPayloadBufferInfo, WritePayloadBufferInfo);
+    }
+
+    // With incremental re-sorts only the changed keys get sorted (they are pulled out into the dirty buffers)
+    if (NumDirtyKeys)
+    {
+        GatherDirtyKeys(pCommandList, pStageTimer, NumDirtyKeys, PayloadSrcInfo);
+        ReadBufferInfo = &DirtyKeyInfo[0];
+        WriteBufferInfo = &DirtyKeyInfo[1];
+        ReadPayloadBufferInfo = &DirtyPayloadInfo[0];
+        WritePayloadBufferInfo = &DirtyPayloadInfo[1];
+    }
+
+    // Source indices ping-pong between the index buffer and the temp payload buffer (ending up in the index buffer)
+    if (bDeferredPayload)
+        ReadPayloadBufferInfo = &PayloadIndexInfo;
+
+    // Packed key+index sorts start out with the packed words in the temp buffer, and only sort the key bits above the indices
+    uint32_t FirstShift = 0;
+    if (bPackedKeyIndex)
+    {
+        PackKeyIndex(pCommandList, pStageTimer, Context, bIndirectDispatch, NumThreadgroupsToRun, constantBufferData, PackedIndexBits, *ReadBufferInfo, *WriteBufferInfo);
+        std::swap(ReadBufferInfo, WriteBufferInfo);
+        std::swap(ReadPayloadBufferInfo, WritePayloadBufferInfo);
+        FirstShift = PackedIndexBits;
+    }
 
     // Setup barriers for the run
-    CD3DX12_RESOURCE_BARRIER barriers[3];
+    CD3DX12_RESOURCE_BARRIER barriers[4];
         
-    // Perform Radix Sort (currently only support 32-bit key/payload sorting
-    for (uint32_t Shift = 0; Shift < 32u; Shift += FFX_PARALLELSORT_SORT_BITS_PER_PASS)
+    // Perform Radix Sort (32 bits per key word or the narrower key width, payload is always 32-bit). An odd number of passes leaves
+    // the keys in the temp buffers, so the modes that pick them up from the sort buffers (kept keys, the merge of the changed keys,
+    // context sorts and out-of-core chunks, presort checks that can skip the whole sort) run one more pass over bits that are all 0,
+    // which only moves the keys back (the sort is stable)
+    uint32_t NumKeyBits = FirstShift + (m_NumKeyWords > 1 ? 32u * m_NumKeyWords : m_KeyBits);
+    if ((NumPlainSortKeys || KeepsSortedKeys() || NumDirtyKeys || bPresortCheck) && (NumKeyBits - FirstShift) / FFX_PARALLELSORT_SORT_BITS_PER_PASS % 2)
+        NumKeyBits += FFX_PARALLELSORT_SORT_BITS_PER_PASS;
+    for (uint32_t Shift = FirstShift; Shift < NumKeyBits; Shift += FFX_PARALLELSORT_SORT_BITS_PER_PASS)
     {
         // Update the bit shift
         pCommandList->SetComputeRoot32BitConstant(2, Shift, 0);
 
+        // Read-only passes read their sources through the raw SRVs (in a shader resource state until the pass is done)
+        bool bReadOnlyPass = bReadOnlyInput && !(bDeferredPayload && !Shift);
+        if (bReadOnlyPass)
+        {
+            int numBarriers = 0;
+            barriers[numBarriers++] = CD3DX12_RESOURCE_BARRIER::Transition(ReadBufferInfo->pResource, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+            if (bHasPayload)
+                barriers[numBarriers++] = CD3DX12_RESOURCE_BARRIER::Transition(ReadPayloadBufferInfo->pResource, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+            pCommandList->ResourceBarrier(numBarriers, barriers);
+
+            pCommandList->SetComputeRootDescriptorTable(23, ReadBufferInfo->readOnlyGPUHandle);                 // SrcBuffer (read-only)
+            if (bHasPayload)
+                pCommandList->SetComputeRootDescriptorTable(24, ReadPayloadBufferInfo->readOnlyGPUHandle);      // SrcPayload (read-only)
+        }
+
         // Copy the data into the constant buffer
         D3D12_GPU_VIRTUAL_ADDRESS constantBuffer;
         if (bIndirectDispatch)
-            constantBuffer = m_IndirectConstantBuffer.GetResource()->GetGPUVirtualAddress();
+            constantBuffer = Context.IndirectConstantBuffer.GetResource()->GetGPUVirtualAddress();
         else
-            constantBuffer = m_pConstantBufferRing->AllocConstantBuffer(sizeof(FFX_ParallelSortCB), &constantBufferData);
+            constantBuffer = AllocConstantBuffer(sizeof(FFX_ParallelSortCB), &constantBufferData);
 
         // Bind to root signature
         pCommandList->SetComputeRootConstantBufferView(0, constantBuffer);                      // Constant buffer
-        pCommandList->SetComputeRootDescriptorTable(3, ReadBufferInfo->resourceGPUHandle);      // SrcBuffer 
+        pCommandList->SetComputeRootDescriptorTable(3, (bKeyRecords && !Shift) ? m_KeyRecordUAV.GetGPU() : ReadBufferInfo->resourceGPUHandle);     // SrcBuffer (the records in the first pass of a key record sort)
+        if (b16BitKeys)
+            pCommandList->SetComputeRootDescriptorTable(25, ReadBufferInfo->resourceGPUHandle);    // SrcKeys16
         pCommandList->SetComputeRootDescriptorTable(5, ScratchBufferInfo.resourceGPUHandle);    // Scratch buffer
 
         // Sort Count
         {
-            pCommandList->SetPipelineState(m_pFPSCountPipeline);
+            if (bKeyRecords && !Shift)
+                pCommandList->SetPipelineState(m_FPSCountKeyRecordsPipeline.get());
+            else if (bReadOnlyPass)
+                pCommandList->SetPipelineState(m_FPSCountReadOnlyPipeline.get());
+            else if (b16BitKeys)
+                pCommandList->SetPipelineState(m_FPSCount16BitPipeline.get());
+            else
+                pCommandList->SetPipelineState((bKeyHooks && !Shift) ? m_FPSCountLoadKeyPipeline.get() : m_FPSCountPipeline.get());
 
             if (bIndirectDispatch)
             {
-                pCommandList->ExecuteIndirect(m_pFPSCommandSignature, 1, m_IndirectCountScatterArgs.GetResource(), 0, nullptr, 0);
+                pCommandList->ExecuteIndirect(m_pFPSCommandSignature, 1, Context.IndirectCountScatterArgs.GetResource(), 0, nullptr, 0);
             }
             else
             {
@@ -685,63 +2220,134 @@ void FFXParallelSort::Sort(ID3D12GraphicsCommandList* pCommandList, bool isBench
         // UAV barrier on the sum table
         barriers[0] = CD3DX12_RESOURCE_BARRIER::UAV(ScratchBufferInfo.pResource);
         pCommandList->ResourceBarrier(1, barriers);
+        StageTimeStamp(pCommandList, pStageTimer, "Count", Shift);
 
-        pCommandList->SetComputeRootDescriptorTable(6, ReducedScratchBufferInfo.resourceGPUHandle); // Scratch reduce buffer
-
-        // Sort Reduce
+        if (bFusedScan)
         {
-            pCommandList->SetPipelineState(m_pFPSCountReducePipeline);
-
+            // Sort ReduceScanAdd (the scan block args are a single thread group here, and skipped along with the rest by the presort check)
+            pCommandList->SetPipelineState(m_FPSReduceScanAddPipeline.get());
             if (bIndirectDispatch)
             {
-                pCommandList->ExecuteIndirect(m_pFPSCommandSignature, 1, m_IndirectReduceScanArgs.GetResource(), 0, nullptr, 0);
+                pCommandList->ExecuteIndirect(m_pFPSCommandSignature, 1, Context.IndirectReduceScanArgs.GetResource(), sizeof(D3D12_DISPATCH_ARGUMENTS), nullptr, 0);
             }
             else
             {
-                pCommandList->Dispatch(NumReducedThreadgroupsToRun, 1, 1);
+                pCommandList->Dispatch(1, 1, 1);
             }
 
-            // UAV barrier on the reduced sum table
-            barriers[0] = CD3DX12_RESOURCE_BARRIER::UAV(ReducedScratchBufferInfo.pResource);
+            // UAV barrier on the sum table
+            barriers[0] = CD3DX12_RESOURCE_BARRIER::UAV(ScratchBufferInfo.pResource);
             pCommandList->ResourceBarrier(1, barriers);
+            StageTimeStamp(pCommandList, pStageTimer, "ReduceScanAdd", Shift);
         }
-
-        // Sort Scan
+        else
         {
-            // First do scan prefix of reduced values
-            pCommandList->SetComputeRootDescriptorTable(9, ReducedScratchBufferInfo.resourceGPUHandle);
-            pCommandList->SetComputeRootDescriptorTable(10, ReducedScratchBufferInfo.resourceGPUHandle);
+            pCommandList->SetComputeRootDescriptorTable(6, ReducedScratchBufferInfo.resourceGPUHandle); // Scratch reduce buffer
 
-            pCommandList->SetPipelineState(m_pFPSScanPipeline);
-            if (!bIndirectDispatch)
+            // Sort Reduce
             {
-                assert(NumReducedThreadgroupsToRun < FFX_PARALLELSORT_ELEMENTS_PER_THREAD * FFX_PARALLELSORT_THREADGROUP_SIZE && "Need to account for bigger reduced histogram scan");
+                pCommandList->SetPipelineState(m_FPSCountReducePipeline.get());
+
+                if (bIndirectDispatch)
+                {
+                    pCommandList->ExecuteIndirect(m_pFPSCommandSignature, 1, Context.IndirectReduceScanArgs.GetResource(), 0, nullptr, 0);
+                }
+                else
+                {
+                    pCommandList->Dispatch(NumReducedThreadgroupsToRun, 1, 1);
+                }
+
+                // UAV barrier on the reduced sum table
+                barriers[0] = CD3DX12_RESOURCE_BARRIER::UAV(ReducedScratchBufferInfo.pResource);
+                pCommandList->ResourceBarrier(1, barriers);
+                StageTimeStamp(pCommandList, pStageTimer, "CountReduce", Shift);
             }
-            pCommandList->Dispatch(1, 1, 1);
-
-            // UAV barrier on the reduced sum table
-            barriers[0] = CD3DX12_RESOURCE_BARRIER::UAV(ReducedScratchBufferInfo.pResource);
-            pCommandList->ResourceBarrier(1, barriers);
 
-            // Next do scan prefix on the histogram with partial sums that we just did
-            pCommandList->SetComputeRootDescriptorTable(9, ScratchBufferInfo.resourceGPUHandle);
-            pCommandList->SetComputeRootDescriptorTable(10, ScratchBufferInfo.resourceGPUHandle);
-            pCommandList->SetComputeRootDescriptorTable(11, ReducedScratchBufferInfo.resourceGPUHandle);
-
-            pCommandList->SetPipelineState(m_pFPSScanAddPipeline);
-            if (bIndirectDispatch)
+            // Sort Scan
             {
-                pCommandList->ExecuteIndirect(m_pFPSCommandSignature, 1, m_IndirectReduceScanArgs.GetResource(), 0, nullptr, 0);
+                if (!bScanHierarchy)
+                {
+                    // First do scan prefix of reduced values
+                    pCommandList->SetComputeRootDescriptorTable(9, ReducedScratchBufferInfo.resourceGPUHandle);
+                    pCommandList->SetComputeRootDescriptorTable(10, ReducedScratchBufferInfo.resourceGPUHandle);
+
+                    pCommandList->SetPipelineState(m_FPSScanPipeline.get());
+                    pCommandList->Dispatch(1, 1, 1);
+                }
+                else
+                {
+                    // Reduce each block of reduced values to a partial sum
+                    pCommandList->SetComputeRootDescriptorTable(9, ReducedScratchBufferInfo.resourceGPUHandle);
+                    pCommandList->SetComputeRootDescriptorTable(10, ScanBlockBufferInfo.resourceGPUHandle);
+
+                    pCommandList->SetPipelineState(m_FPSScanBlockReducePipeline.get());
+                    if (bIndirectDispatch)
+                    {
+                        pCommandList->ExecuteIndirect(m_pFPSCommandSignature, 1, Context.IndirectReduceScanArgs.GetResource(), sizeof(D3D12_DISPATCH_ARGUMENTS), nullptr, 0);
+                    }
+                    else
+                    {
+                        pCommandList->Dispatch(NumScanBlocks, 1, 1);
+                    }
+
+                    // UAV barrier on the partial sums
+                    barriers[0] = CD3DX12_RESOURCE_BARRIER::UAV(ScanBlockBufferInfo.pResource);
+                    pCommandList->ResourceBarrier(1, barriers);
+                    StageTimeStamp(pCommandList, pStageTimer, "ScanBlockReduce", Shift);
+
+                    // Scan prefix the partial sums
+                    pCommandList->SetComputeRootDescriptorTable(9, ScanBlockBufferInfo.resourceGPUHandle);
+                    pCommandList->SetComputeRootDescriptorTable(10, ScanBlockBufferInfo.resourceGPUHandle);
+
+                    pCommandList->SetPipelineState(m_FPSScanBlockSumsPipeline.get());
+                    pCommandList->Dispatch(1, 1, 1);
+
+                    // UAV barrier on the partial sums
+                    barriers[0] = CD3DX12_RESOURCE_BARRIER::UAV(ScanBlockBufferInfo.pResource);
+                    pCommandList->ResourceBarrier(1, barriers);
+
+                    // Scan prefix each block of reduced values and add in the block's partial sum
+                    pCommandList->SetComputeRootDescriptorTable(9, ReducedScratchBufferInfo.resourceGPUHandle);
+                    pCommandList->SetComputeRootDescriptorTable(10, ReducedScratchBufferInfo.resourceGPUHandle);
+                    pCommandList->SetComputeRootDescriptorTable(11, ScanBlockBufferInfo.resourceGPUHandle);
+
+                    pCommandList->SetPipelineState(m_FPSScanBlockAddPipeline.get());
+                    if (bIndirectDispatch)
+                    {
+                        pCommandList->ExecuteIndirect(m_pFPSCommandSignature, 1, Context.IndirectReduceScanArgs.GetResource(), sizeof(D3D12_DISPATCH_ARGUMENTS), nullptr, 0);
+                    }
+                    else
+                    {
+                        pCommandList->Dispatch(NumScanBlocks, 1, 1);
+                    }
+                }
+
+                // UAV barrier on the reduced sum table
+                barriers[0] = CD3DX12_RESOURCE_BARRIER::UAV(ReducedScratchBufferInfo.pResource);
+                pCommandList->ResourceBarrier(1, barriers);
+                StageTimeStamp(pCommandList, pStageTimer, "Scan", Shift);
+
+                // Next do scan prefix on the histogram with partial sums that we just did
+                pCommandList->SetComputeRootDescriptorTable(9, ScratchBufferInfo.resourceGPUHandle);
+                pCommandList->SetComputeRootDescriptorTable(10, ScratchBufferInfo.resourceGPUHandle);
+                pCommandList->SetComputeRootDescriptorTable(11, ReducedScratchBufferInfo.resourceGPUHandle);
+
+                pCommandList->SetPipelineState(m_FPSScanAddPipeline.get());
+                if (bIndirectDispatch)
+                {
+                    pCommandList->ExecuteIndirect(m_pFPSCommandSignature, 1, Context.IndirectReduceScanArgs.GetResource(), 0, nullptr, 0);
+                }
+                else
+                {
+                    pCommandList->Dispatch(NumReducedThreadgroupsToRun, 1, 1);
+                }
             }
-            else
-            {
-                pCommandList->Dispatch(NumReducedThreadgroupsToRun, 1, 1);
-            }
-        }
 
-        // UAV barrier on the sum table
-        barriers[0] = CD3DX12_RESOURCE_BARRIER::UAV(ScratchBufferInfo.pResource);
-        pCommandList->ResourceBarrier(1, barriers);
+            // UAV barrier on the sum table
+            barriers[0] = CD3DX12_RESOURCE_BARRIER::UAV(ScratchBufferInfo.pResource);
+            pCommandList->ResourceBarrier(1, barriers);
+            StageTimeStamp(pCommandList, pStageTimer, "ScanAdd", Shift);
+        }
 
         if (bHasPayload)
         {
@@ -750,14 +2356,29 @@ void FFXParallelSort::Sort(ID3D12GraphicsCommandList* pCommandList, bool isBench
         }
 
         pCommandList->SetComputeRootDescriptorTable(7, WriteBufferInfo->resourceGPUHandle);         // DstBuffer 
+        if (b16BitKeys)
+            pCommandList->SetComputeRootDescriptorTable(26, WriteBufferInfo->resourceGPUHandle);    // DstKeys16
 
         // Sort Scatter
         {
-            pCommandList->SetPipelineState(bHasPayload ? m_pFPSScatterPayloadPipeline : m_pFPSScatterPipeline);
+            if (bDeferredPayload && !Shift)
+                pCommandList->SetPipelineState(m_FPSScatterIndexPipeline.get());
+            else if (bKeyRecords && !Shift)
+                pCommandList->SetPipelineState(bHasPayload ? m_FPSScatterKeyRecordsPayloadPipeline.get() : m_FPSScatterKeyRecordsPipeline.get());
+            else if (bKeyHooks && !Shift)
+                pCommandList->SetPipelineState(bHasPayload ? m_FPSScatterLoadKeyPayloadPipeline.get() : m_FPSScatterLoadKeyPipeline.get());
+            else if (bKeyHooks && Shift + FFX_PARALLELSORT_SORT_BITS_PER_PASS == NumKeyBits)
+                pCommandList->SetPipelineState(bHasPayload ? m_FPSScatterStoreKeyPayloadPipeline.get() : m_FPSScatterStoreKeyPipeline.get());
+            else if (bReadOnlyPass)
+                pCommandList->SetPipelineState(bHasPayload ? m_FPSScatterReadOnlyPayloadPipeline.get() : m_FPSScatterReadOnlyPipeline.get());
+            else if (b16BitKeys)
+                pCommandList->SetPipelineState(bHasPayload ? m_FPSScatter16BitPayloadPipeline.get() : m_FPSScatter16BitPipeline.get());
+            else
+                pCommandList->SetPipelineState(bHasPayload ? m_FPSScatterPayloadPipeline.get() : m_FPSScatterPipeline.get());
 
             if (bIndirectDispatch)
             {
-                pCommandList->ExecuteIndirect(m_pFPSCommandSignature, 1, m_IndirectCountScatterArgs.GetResource(), 0, nullptr, 0);
+                pCommandList->ExecuteIndirect(m_pFPSCommandSignature, 1, Context.IndirectCountScatterArgs.GetResource(), 0, nullptr, 0);
             }
             else
             {
@@ -765,69 +2386,895 @@ void FFXParallelSort::Sort(ID3D12GraphicsCommandList* pCommandList, bool isBench
             }
         }
             
-        // Finish doing everything and barrier for the next pass
+        // Finish doing everything and barrier for the next pass (read-only sources go back to UAVs, they get written next)
         int numBarriers = 0;
         barriers[numBarriers++] = CD3DX12_RESOURCE_BARRIER::UAV(WriteBufferInfo->pResource);
         if (bHasPayload)
             barriers[numBarriers++] = CD3DX12_RESOURCE_BARRIER::UAV(WritePayloadBufferInfo->pResource);
+        if (bReadOnlyPass)
+        {
+            barriers[numBarriers++] = CD3DX12_RESOURCE_BARRIER::Transition(ReadBufferInfo->pResource, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+            if (bHasPayload)
+                barriers[numBarriers++] = CD3DX12_RESOURCE_BARRIER::Transition(ReadPayloadBufferInfo->pResource, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+        }
         pCommandList->ResourceBarrier(numBarriers, barriers);
+        StageTimeStamp(pCommandList, pStageTimer, "Scatter", Shift);
 
         // Swap read/write sources
         std::swap(ReadBufferInfo, WriteBufferInfo);
-        if (bHasPayload)
+        if (bHasPayload || bPackedKeyIndex)
             std::swap(ReadPayloadBufferInfo, WritePayloadBufferInfo);
     }
 
+    // Split the sorted words back up into the keys and their source indices (into the buffer pair the next pass would have written)
+    if (bPackedKeyIndex)
+    {
+        UnpackKeyIndex(pCommandList, pStageTimer, Context, bIndirectDispatch, NumThreadgroupsToRun, PackedIndexBits, *ReadBufferInfo, *WriteBufferInfo, *WritePayloadBufferInfo);
+        std::swap(ReadBufferInfo, WriteBufferInfo);
+        std::swap(ReadPayloadBufferInfo, WritePayloadBufferInfo);
+    }
+
+    // Move the payload into sorted order (with the sort's constants and dispatch, so before the indirect buffers go back to UAVs)
+    if (bDeferredPayload)
+    {
+        GatherPayload(pCommandList, pStageTimer, Context, bIndirectDispatch, NumThreadgroupsToRun, *ReadPayloadBufferInfo, PayloadSrcInfo, PayloadTmpInfo);
+        ReadPayloadBufferInfo = &PayloadTmpInfo;
+        WritePayloadBufferInfo = &PayloadSrcInfo;
+    }
+
     // When we are all done, transition indirect buffers back to UAV for the next frame (if doing indirect dispatch)
     if (bIndirectDispatch)
     {
-        barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(m_IndirectCountScatterArgs.GetResource(), D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-        barriers[1] = CD3DX12_RESOURCE_BARRIER::Transition(m_IndirectReduceScanArgs.GetResource(), D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-        barriers[2] = CD3DX12_RESOURCE_BARRIER::Transition(m_IndirectConstantBuffer.GetResource(), D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+        barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(Context.IndirectCountScatterArgs.GetResource(), D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+        barriers[1] = CD3DX12_RESOURCE_BARRIER::Transition(Context.IndirectReduceScanArgs.GetResource(), D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+        barriers[2] = CD3DX12_RESOURCE_BARRIER::Transition(Context.IndirectConstantBuffer.GetResource(), D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
         pCommandList->ResourceBarrier(3, barriers);
     }
 
+    // Merge the sorted changed keys into last frame's order (which puts the result back where a full sort leaves it)
+    if (NumDirtyKeys)
+    {
+        MergeDirtyKeys(pCommandList, pStageTimer, NumDirtyKeys, KeySrcInfo, KeyTmpInfo, PayloadSrcInfo, PayloadTmpInfo);
+        ReadBufferInfo = &KeySrcInfo;
+        NumberOfKeys = m_NumKeys[m_UIResolutionSize];
+    }
+    if (bContextSort)
+        return;
+    if (!NumSelectKeys)
+        m_bSortedKeysInPlace = true;
+
+    // Checksums and order of the keys coming out
+    if (bGPUValidate)
+        ValidateSort(pCommandList, pStageTimer, *ReadBufferInfo, *ReadPayloadBufferInfo, bHasPayload, b16BitKeys, true);
+
     // Do we need to validate the results? If so, create a read back buffer to use for this frame
 #ifdef DEVELOPERMODE
     if (m_UIValidateSortResults && !isBenchmarking)
     {
-        CreateValidationResources(pCommandList, &KeySrcInfo);
+        if (!bValidateInput)
+            CreateValidationResources(NumberOfKeys, false, false, b16BitKeys);
+        CopyValidationData(pCommandList, *ReadBufferInfo, *ReadPayloadBufferInfo, true);
         // Only do this for 1 frame
         m_UIValidateSortResults = false;
     }
 #endif // DEVELOPERMODE
 }
 
+// How many keys top-K selection keeps this frame (0 when all keys get sorted)
+uint32_t FFXParallelSort::GetNumSelectKeys() const
+{
+    if (!m_UISelectTopK || m_NumKeyWords > 1 || m_OutOfCoreChunkKeys || GetNumSelectQueries())
+        return 0;
+
+    uint32_t NumSelectKeys = (uint32_t)std::max(m_UISelectNumKeys, 1);
+    return NumSelectKeys < m_NumKeys[m_UIResolutionSize] ? NumSelectKeys : 0;
+}
+
+// Whether each frame sorts last frame's result instead of a fresh copy of the source keys (temporal coherence and incremental
+// re-sorts). Not with top-K selection, as its passes ping-pong through the kept key buffers and only leave the selected keys sorted
+bool FFXParallelSort::KeepsSortedKeys() const
+{
+    return (m_UITemporalCoherence || m_UIIncrementalSort) && !GetNumSelectKeys();
+}
+
+// How many percentile queries run this frame (0 when sorting)
+uint32_t FFXParallelSort::GetNumSelectQueries() const
+{
+    if (!m_UISelectPercentiles || m_NumKeyWords > 1 || m_OutOfCoreChunkKeys)
+        return 0;
+
+    return (uint32_t)m_SelectPercentiles.size();
+}
+
+// Copies out how many out of order neighbours the presort check found (what decided whether setup skipped the sort), and picks
+// up what the slot's previous check found once its copy has landed (the frame that copied it is ReadBackLatency frames old)
+void FFXParallelSort::ReadBackPresortInversions(ID3D12GraphicsCommandList* pCommandList)
+{
+    uint32_t Slot = m_NumPresortChecks++ % ReadBackLatency;
+    if (m_NumPresortChecks > ReadBackLatency && m_FrameCount - m_PresortCheckFrame[Slot] >= ReadBackLatency)
+        m_LastPresortInversions = m_pPresortInversions[Slot];
+    m_PresortCheckFrame[Slot] = m_FrameCount;
+
+    CD3DX12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::Transition(m_PresortStateBuffer.GetResource(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
+    pCommandList->ResourceBarrier(1, &barrier);
+    pCommandList->CopyBufferRegion(m_pPresortReadBackBuffer, sizeof(uint32_t) * Slot, m_PresortStateBuffer.GetResource(), sizeof(uint32_t) * FFX_PARALLELSORT_PRESORT_STATE_LAST_INVERSIONS, sizeof(uint32_t));
+    barrier = CD3DX12_RESOURCE_BARRIER::Transition(m_PresortStateBuffer.GetResource(), D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    pCommandList->ResourceBarrier(1, &barrier);
+}
+
+// Copies out the keys the percentile queries found (the prefix plane at the start of the select state), and picks up
+// what the slot's previous selection found once its copy has landed (the frame that copied it is ReadBackLatency frames old)
+void FFXParallelSort::ReadBackPercentiles(ID3D12GraphicsCommandList* pCommandList)
+{
+    uint32_t NumSelectQueries = GetNumSelectQueries();
+    uint32_t Slot = m_NumPercentileReadBacks++ % ReadBackLatency;
+    if (m_NumPercentileReadBacks > ReadBackLatency && m_FrameCount - m_PercentileReadBackFrame[Slot] >= ReadBackLatency)
+    {
+        m_PercentileKeys.assign(m_pPercentileResults + NumSelectQueries * Slot, m_pPercentileResults + NumSelectQueries * (Slot + 1));
+        m_PercentileKeySet = m_PercentileReadBackKeySet[Slot];
+    }
+    m_PercentileReadBackFrame[Slot] = m_FrameCount;
+    m_PercentileReadBackKeySet[Slot] = m_UIIncrementalSort ? -1 : m_UIResolutionSize;
+
+    CD3DX12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::Transition(m_FPSSelectStateBuffer.GetResource(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
+    pCommandList->ResourceBarrier(1, &barrier);
+    pCommandList->CopyBufferRegion(m_pPercentileReadBackBuffer, sizeof(uint32_t) * NumSelectQueries * Slot, m_FPSSelectStateBuffer.GetResource(),
+                                   sizeof(uint32_t) * FFX_PARALLELSORT_SELECT_STATE_PREFIX * NumSelectQueries, sizeof(uint32_t) * NumSelectQueries);
+    barrier = CD3DX12_RESOURCE_BARRIER::Transition(m_FPSSelectStateBuffer.GetResource(), D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    pCommandList->ResourceBarrier(1, &barrier);
+}
+
+// Radix select. Finds each query's key one digit at a time (most significant first) using the count/reduce histograms
+// of the keys still in the running. All the queries go through each step together, one Y group per query.
+void FFXParallelSort::SelectDigits(ID3D12GraphicsCommandList* pCommandList, GPUTimestamps* pStageTimer, SortContext& Context, const FFX_ParallelSortCB& ConstantBufferData, uint32_t NumThreadgroupsToRun, uint32_t NumReducedThreadgroupsToRun,
+                                   const RdxDX12ResourceInfo& KeySrcInfo)
+{
+    D3D12_GPU_VIRTUAL_ADDRESS constantBuffer = AllocConstantBuffer(sizeof(FFX_ParallelSortCB), (void*)&ConstantBufferData);
+    pCommandList->SetComputeRootConstantBufferView(0, constantBuffer);                  // Constant buffer
+    pCommandList->SetComputeRootDescriptorTable(3, KeySrcInfo.resourceGPUHandle);       // SrcBuffer
+    pCommandList->SetComputeRootDescriptorTable(5, Context.ScratchUAV.GetGPU());           // Scratch buffer
+    pCommandList->SetComputeRootDescriptorTable(6, Context.ReducedScratchUAV.GetGPU());    // Scratch reduce buffer
+    pCommandList->SetComputeRootDescriptorTable(16, m_FPSSelectStateUAV.GetGPU());      // Select state
+
+    uint32_t NumSelectQueries = ConstantBufferData.NumSelectQueries;
+    CD3DX12_RESOURCE_BARRIER barrier;
+    for (int32_t Shift = FFX_PARALLELSORT_SELECT_FIRST_SHIFT; Shift >= 0; Shift -= FFX_PARALLELSORT_SORT_BITS_PER_PASS)
+    {
+        // Update the bit shift
+        pCommandList->SetComputeRoot32BitConstant(2, (UINT)Shift, 0);
+
+        // Count the digit over the keys that still share each query's prefix
+        pCommandList->SetPipelineState(m_FPSSelectCountPipeline.get());
+        pCommandList->Dispatch(NumThreadgroupsToRun, NumSelectQueries, 1);
+
+        barrier = CD3DX12_RESOURCE_BARRIER::UAV(Context.ScratchBuffer.GetResource());
+        pCommandList->ResourceBarrier(1, &barrier);
+        StageTimeStamp(pCommandList, pStageTimer, "SelectCount", Shift);
+
+        pCommandList->SetPipelineState(m_FPSSelectReducePipeline.get());
+        pCommandList->Dispatch(NumReducedThreadgroupsToRun, NumSelectQueries, 1);
+
+        barrier = CD3DX12_RESOURCE_BARRIER::UAV(Context.ReducedScratchBuffer.GetResource());
+        pCommandList->ResourceBarrier(1, &barrier);
+        StageTimeStamp(pCommandList, pStageTimer, "SelectReduce", Shift);
+
+        // Pick the bin each query's key falls in
+        pCommandList->SetPipelineState(m_FPSSelectDigitPipeline.get());
+        pCommandList->Dispatch(NumSelectQueries, 1, 1);
+
+        barrier = CD3DX12_RESOURCE_BARRIER::UAV(m_FPSSelectStateBuffer.GetResource());
+        pCommandList->ResourceBarrier(1, &barrier);
+        StageTimeStamp(pCommandList, pStageTimer, "SelectDigit", Shift);
+    }
+}
+
+// Percentile queries. Leaves the key at each of m_SelectPercentiles at the start of the select state buffer, in query order.
+void FFXParallelSort::SelectPercentiles(ID3D12GraphicsCommandList* pCommandList, GPUTimestamps* pStageTimer, SortContext& Context, const RdxDX12ResourceInfo& KeySrcInfo)
+{
+    FFX_ParallelSortCB constantBufferData = { 0 };
+    uint32_t NumThreadgroupsToRun;
+    uint32_t NumReducedThreadgroupsToRun;
+    FFX_ParallelSort_SetConstantAndDispatchData(m_NumKeys[m_UIResolutionSize], m_MaxNumThreadgroups, constantBufferData, NumThreadgroupsToRun, NumReducedThreadgroupsToRun);
+    constantBufferData.NumSelectQueries = GetNumSelectQueries();
+
+    SelectDigits(pCommandList, pStageTimer, Context, constantBufferData, NumThreadgroupsToRun, NumReducedThreadgroupsToRun, KeySrcInfo);
+}
+
+// Top-K selection. Finds the NumSelectKeys-th smallest key with a single select query, then compacts every key up to it
+// into the dst buffers.
+void FFXParallelSort::SelectTopK(ID3D12GraphicsCommandList* pCommandList, GPUTimestamps* pStageTimer, SortContext& Context, uint32_t NumSelectKeys, const RdxDX12ResourceInfo& KeySrcInfo, const RdxDX12ResourceInfo& KeyDstInfo,
+                                 const RdxDX12ResourceInfo& PayloadSrcInfo, const RdxDX12ResourceInfo& PayloadDstInfo)
+{
+    UserMarker marker(pCommandList, "FFXParallelSort Select");
+
+    // Selection runs over all of the keys
+    FFX_ParallelSortCB constantBufferData = { 0 };
+    uint32_t NumThreadgroupsToRun;
+    uint32_t NumReducedThreadgroupsToRun;
+    FFX_ParallelSort_SetConstantAndDispatchData(m_NumKeys[m_UIResolutionSize], m_MaxNumThreadgroups, constantBufferData, NumThreadgroupsToRun, NumReducedThreadgroupsToRun);
+    constantBufferData.NumSelectKeys = NumSelectKeys;
+
+    SelectDigits(pCommandList, pStageTimer, Context, constantBufferData, NumThreadgroupsToRun, NumReducedThreadgroupsToRun, KeySrcInfo);
+
+    // Compact the keys (and payloads) that made the cut
+    bool bHasPayload = m_UISortPayload;
+    pCommandList->SetComputeRootDescriptorTable(7, KeyDstInfo.resourceGPUHandle);              // DstBuffer
+    if (bHasPayload)
+    {
+        pCommandList->SetComputeRootDescriptorTable(4, PayloadSrcInfo.resourceGPUHandle);      // ScrPayload
+        pCommandList->SetComputeRootDescriptorTable(8, PayloadDstInfo.resourceGPUHandle);      // DstPayload
+    }
+
+    pCommandList->SetPipelineState(bHasPayload ? m_FPSSelectCompactPayloadPipeline.get() : m_FPSSelectCompactPipeline.get());
+    pCommandList->Dispatch(NumThreadgroupsToRun, 1, 1);
+
+    CD3DX12_RESOURCE_BARRIER barriers[2];
+    int numBarriers = 0;
+    barriers[numBarriers++] = CD3DX12_RESOURCE_BARRIER::UAV(KeyDstInfo.pResource);
+    if (bHasPayload)
+        barriers[numBarriers++] = CD3DX12_RESOURCE_BARRIER::UAV(PayloadDstInfo.pResource);
+    pCommandList->ResourceBarrier(numBarriers, barriers);
+    StageTimeStamp(pCommandList, pStageTimer, "SelectCompact", 0);
+}
+
+// How many keys the incremental re-sort changes each frame (0 when sorting all of them)
+uint32_t FFXParallelSort::GetNumDirtyKeys() const
+{
+    if (!m_UIIncrementalSort || m_NumKeyWords > 1 || m_OutOfCoreChunkKeys || GetNumSelectKeys() || GetNumSelectQueries())
+        return 0;
+
+    return m_NumKeys[m_UIResolutionSize] / 100 * (uint32_t)std::min(std::max(m_UIDirtyKeyPercent, 1), MaxDirtyKeyPercent);
+}
+
+// Incremental re-sort. The sample changes NumDirtyKeys entries of last frame's order (new random keys at spread out positions),
+// and the payloads of those entries get pulled out so they can be sorted along with their new keys.
+void FFXParallelSort::GatherDirtyKeys(ID3D12GraphicsCommandList* pCommandList, GPUTimestamps* pStageTimer, uint32_t NumDirtyKeys, const RdxDX12ResourceInfo& PayloadSrcInfo)
+{
+    FFX_ParallelSortCB constantBufferData;
+    uint32_t NumGatherThreadgroupsToRun;
+    uint32_t NumMergeThreadgroupsToRun;
+    FFX_ParallelSort_SetMergeConstantAndDispatchData(m_NumKeys[m_UIResolutionSize], NumDirtyKeys, constantBufferData, NumGatherThreadgroupsToRun, NumMergeThreadgroupsToRun);
+
+    D3D12_GPU_VIRTUAL_ADDRESS constantBuffer = AllocConstantBuffer(sizeof(FFX_ParallelSortCB), &constantBufferData);
+    pCommandList->SetComputeRootConstantBufferView(0, constantBuffer);                      // Constant buffer
+    pCommandList->SetComputeRoot32BitConstant(2, ++m_DirtyKeySeed, 0);                      // Seed for the changed keys
+    pCommandList->SetComputeRootDescriptorTable(4, PayloadSrcInfo.resourceGPUHandle);       // ScrPayload
+    pCommandList->SetComputeRootDescriptorTable(18, m_DirtyKeyUAVTable.GetGPU(0));          // DirtyKeys
+    pCommandList->SetComputeRootDescriptorTable(19, m_DirtyPayloadUAVTable.GetGPU(0));      // DirtyPayload
+    pCommandList->SetComputeRootDescriptorTable(20, m_DirtyIndexUAV.GetGPU());              // DirtyIndices
+
+    pCommandList->SetPipelineState(m_FPSGenerateDirtyKeysPipeline.get());
+    pCommandList->Dispatch(NumGatherThreadgroupsToRun, 1, 1);
+
+    CD3DX12_RESOURCE_BARRIER barriers[2];
+    barriers[0] = CD3DX12_RESOURCE_BARRIER::UAV(m_DirtyKeyBuffers[0].GetResource());
+    barriers[1] = CD3DX12_RESOURCE_BARRIER::UAV(m_DirtyIndexBuffer.GetResource());
+    pCommandList->ResourceBarrier(2, barriers);
+
+    if (m_UISortPayload)
+    {
+        pCommandList->SetPipelineState(m_FPSGatherDirtyPayloadPipeline.get());
+        pCommandList->Dispatch(NumGatherThreadgroupsToRun, 1, 1);
+
+        barriers[0] = CD3DX12_RESOURCE_BARRIER::UAV(m_DirtyPayloadBuffers[0].GetResource());
+        pCommandList->ResourceBarrier(1, barriers);
+    }
+    StageTimeStamp(pCommandList, pStageTimer, "GatherDirty", 0);
+}
+
+// Merges the sorted changed keys (back in the first dirty buffers after an even number of passes) into last frame's order, 
+// then copies the result back over it so next frame has something to merge into again
+void FFXParallelSort::MergeDirtyKeys(ID3D12GraphicsCommandList* pCommandList, GPUTimestamps* pStageTimer, uint32_t NumDirtyKeys, const RdxDX12ResourceInfo& KeySrcInfo, const RdxDX12ResourceInfo& KeyDstInfo,
+                                     const RdxDX12ResourceInfo& PayloadSrcInfo, const RdxDX12ResourceInfo& PayloadDstInfo)
+{
+    FFX_ParallelSortCB constantBufferData;
+    uint32_t NumGatherThreadgroupsToRun;
+    uint32_t NumMergeThreadgroupsToRun;
+    uint32_t NumberOfKeys = m_NumKeys[m_UIResolutionSize];
+    FFX_ParallelSort_SetMergeConstantAndDispatchData(NumberOfKeys, NumDirtyKeys, constantBufferData, NumGatherThreadgroupsToRun, NumMergeThreadgroupsToRun);
+
+    bool bHasPayload = m_UISortPayload;
+    D3D12_GPU_VIRTUAL_ADDRESS constantBuffer = AllocConstantBuffer(sizeof(FFX_ParallelSortCB), &constantBufferData);
+    pCommandList->SetComputeRootConstantBufferView(0, constantBuffer);                      // Constant buffer
+    pCommandList->SetComputeRootDescriptorTable(3, KeySrcInfo.resourceGPUHandle);           // SrcBuffer
+    pCommandList->SetComputeRootDescriptorTable(7, KeyDstInfo.resourceGPUHandle);           // DstBuffer
+    pCommandList->SetComputeRootDescriptorTable(18, m_DirtyKeyUAVTable.GetGPU(0));          // DirtyKeys
+    pCommandList->SetComputeRootDescriptorTable(20, m_DirtyIndexUAV.GetGPU());              // DirtyIndices
+    if (bHasPayload)
+    {
+        pCommandList->SetComputeRootDescriptorTable(4, PayloadSrcInfo.resourceGPUHandle);   // ScrPayload
+        pCommandList->SetComputeRootDescriptorTable(8, PayloadDstInfo.resourceGPUHandle);   // DstPayload
+        pCommandList->SetComputeRootDescriptorTable(19, m_DirtyPayloadUAVTable.GetGPU(0));  // DirtyPayload
+    }
+
+    pCommandList->SetPipelineState(bHasPayload ? m_FPSMergePayloadPipeline.get() : m_FPSMergePipeline.get());
+    pCommandList->Dispatch(NumMergeThreadgroupsToRun, 1, 1);
+
+    // Copy the merged order back
+    CD3DX12_RESOURCE_BARRIER barriers[4];
+    int numBarriers = 0;
+    barriers[numBarriers++] = CD3DX12_RESOURCE_BARRIER::Transition(KeyDstInfo.pResource, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
+    barriers[numBarriers++] = CD3DX12_RESOURCE_BARRIER::Transition(KeySrcInfo.pResource, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_DEST);
+    if (bHasPayload)
+    {
+        barriers[numBarriers++] = CD3DX12_RESOURCE_BARRIER::Transition(PayloadDstInfo.pResource, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
+        barriers[numBarriers++] = CD3DX12_RESOURCE_BARRIER::Transition(PayloadSrcInfo.pResource, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_DEST);
+    }
+    pCommandList->ResourceBarrier(numBarriers, barriers);
+    StageTimeStamp(pCommandList, pStageTimer, "Merge", 0);
+
+    pCommandList->CopyBufferRegion(KeySrcInfo.pResource, 0, KeyDstInfo.pResource, 0, sizeof(uint32_t) * NumberOfKeys);
+    if (bHasPayload)
+        pCommandList->CopyBufferRegion(PayloadSrcInfo.pResource, 0, PayloadDstInfo.pResource, 0, sizeof(uint32_t) * NumberOfKeys);
+
+    for (int i = 0; i < numBarriers; ++i)
+        barriers[i] = CD3DX12_RESOURCE_BARRIER::Transition(barriers[i].Transition.pResource, barriers[i].Transition.StateAfter, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    pCommandList->ResourceBarrier(numBarriers, barriers);
+    StageTimeStamp(pCommandList, pStageTimer, "MergeCopy", 0);
+}
+
+// Deferred payload gather. The passes carried each key's source index along, so one pass moves the payload records into sorted
+// order (they land in the temp payload buffer). Sorts that keep going from this frame's result copy them back.
+void FFXParallelSort::GatherPayload(ID3D12GraphicsCommandList* pCommandList, GPUTimestamps* pStageTimer, SortContext& Context, bool bIndirectDispatch, uint32_t NumThreadgroupsToRun, const RdxDX12ResourceInfo& IndexInfo,
+                                    const RdxDX12ResourceInfo& PayloadSrcInfo, const RdxDX12ResourceInfo& PayloadDstInfo)
+{
+    // The sort's constant buffer is still bound, the root constant is the record stride (the sample's payloads are a uint each)
+    pCommandList->SetComputeRoot32BitConstant(2, 1, 0);
+    pCommandList->SetComputeRootDescriptorTable(3, IndexInfo.resourceGPUHandle);            // SrcBuffer (sorted source indices)
+    pCommandList->SetComputeRootDescriptorTable(4, PayloadSrcInfo.resourceGPUHandle);       // SrcPayload
+    pCommandList->SetComputeRootDescriptorTable(8, PayloadDstInfo.resourceGPUHandle);       // DstPayload
+
+    pCommandList->SetPipelineState(m_FPSGatherPayloadPipeline.get());
+    if (bIndirectDispatch)
+        pCommandList->ExecuteIndirect(m_pFPSCommandSignature, 1, Context.IndirectCountScatterArgs.GetResource(), 0, nullptr, 0);
+    else
+        pCommandList->Dispatch(NumThreadgroupsToRun, 1, 1);
+
+    CD3DX12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::UAV(PayloadDstInfo.pResource);
+    pCommandList->ResourceBarrier(1, &barrier);
+    StageTimeStamp(pCommandList, pStageTimer, "GatherPayload", 0);
+
+    if (!KeepsSortedKeys())
+        return;
+
+    CD3DX12_RESOURCE_BARRIER barriers[2] = { CD3DX12_RESOURCE_BARRIER::Transition(PayloadDstInfo.pResource, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE),
+                                             CD3DX12_RESOURCE_BARRIER::Transition(PayloadSrcInfo.pResource, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_DEST) };
+    pCommandList->ResourceBarrier(2, barriers);
+    pCommandList->CopyBufferRegion(PayloadSrcInfo.pResource, 0, PayloadDstInfo.pResource, 0, sizeof(uint32_t) * m_NumKeys[m_UIResolutionSize]);
+    barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(PayloadDstInfo.pResource, D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    barriers[1] = CD3DX12_RESOURCE_BARRIER::Transition(PayloadSrcInfo.pResource, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    pCommandList->ResourceBarrier(2, barriers);
+    StageTimeStamp(pCommandList, pStageTimer, "GatherCopy", 0);
+}
+
+// Packed key+index sorts. Puts each key above its source index in the temp key buffer before the passes (which only sort the key bits).
+void FFXParallelSort::PackKeyIndex(ID3D12GraphicsCommandList* pCommandList, GPUTimestamps* pStageTimer, SortContext& Context, bool bIndirectDispatch, uint32_t NumThreadgroupsToRun,
+                                   const FFX_ParallelSortCB& ConstantBufferData, uint32_t IndexBits, const RdxDX12ResourceInfo& KeyInfo, const RdxDX12ResourceInfo& PackedInfo)
+{
+    // Nothing has bound the sort's constants yet, the root constant is the index width
+    D3D12_GPU_VIRTUAL_ADDRESS constantBuffer;
+    if (bIndirectDispatch)
+        constantBuffer = Context.IndirectConstantBuffer.GetResource()->GetGPUVirtualAddress();
+    else
+        constantBuffer = AllocConstantBuffer(sizeof(FFX_ParallelSortCB), (void*)&ConstantBufferData);
+    pCommandList->SetComputeRootConstantBufferView(0, constantBuffer);
+    pCommandList->SetComputeRoot32BitConstant(2, IndexBits, 0);
+    pCommandList->SetComputeRootDescriptorTable(3, KeyInfo.resourceGPUHandle);             // SrcBuffer (keys)
+    pCommandList->SetComputeRootDescriptorTable(7, PackedInfo.resourceGPUHandle);          // DstBuffer (packed words)
+
+    pCommandList->SetPipelineState(m_FPSPackKeyIndexPipeline.get());
+    if (bIndirectDispatch)
+        pCommandList->ExecuteIndirect(m_pFPSCommandSignature, 1, Context.IndirectCountScatterArgs.GetResource(), 0, nullptr, 0);
+    else
+        pCommandList->Dispatch(NumThreadgroupsToRun, 1, 1);
+
+    CD3DX12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::UAV(PackedInfo.pResource);
+    pCommandList->ResourceBarrier(1, &barrier);
+    StageTimeStamp(pCommandList, pStageTimer, "PackKeyIndex", 0);
+}
+
+// And splits the sorted words back up into the sorted keys and their source indices (which take the place of the payload)
+void FFXParallelSort::UnpackKeyIndex(ID3D12GraphicsCommandList* pCommandList, GPUTimestamps* pStageTimer, SortContext& Context, bool bIndirectDispatch, uint32_t NumThreadgroupsToRun,
+                                     uint32_t IndexBits, const RdxDX12ResourceInfo& PackedInfo, const RdxDX12ResourceInfo& KeyInfo, const RdxDX12ResourceInfo& IndexInfo)
+{
+    // The sort's constant buffer is still bound, the root constant is the index width
+    pCommandList->SetComputeRoot32BitConstant(2, IndexBits, 0);
+    pCommandList->SetComputeRootDescriptorTable(3, PackedInfo.resourceGPUHandle);          // SrcBuffer (sorted packed words)
+    pCommandList->SetComputeRootDescriptorTable(7, KeyInfo.resourceGPUHandle);             // DstBuffer (keys)
+    pCommandList->SetComputeRootDescriptorTable(8, IndexInfo.resourceGPUHandle);           // DstPayload (source indices)
+
+    pCommandList->SetPipelineState(m_FPSUnpackKeyIndexPipeline.get());
+    if (bIndirectDispatch)
+        pCommandList->ExecuteIndirect(m_pFPSCommandSignature, 1, Context.IndirectCountScatterArgs.GetResource(), 0, nullptr, 0);
+    else
+        pCommandList->Dispatch(NumThreadgroupsToRun, 1, 1);
+
+    CD3DX12_RESOURCE_BARRIER barriers[2] = { CD3DX12_RESOURCE_BARRIER::UAV(KeyInfo.pResource), CD3DX12_RESOURCE_BARRIER::UAV(IndexInfo.pResource) };
+    pCommandList->ResourceBarrier(2, barriers);
+    StageTimeStamp(pCommandList, pStageTimer, "UnpackKeyIndex", 0);
+}
+
+// Key records (sample only). Spreads the current key set out into records of KeyRecordStrideOverride bytes with the key
+// KeyRecordOffsetOverride bytes in, for the first pass of key record sorts to read the keys from.
+void FFXParallelSort::WriteKeyRecords(ID3D12GraphicsCommandList* pCommandList, GPUTimestamps* pStageTimer)
+{
+    FFX_ParallelSortCB constantBufferData;
+    uint32_t NumThreadgroupsToRun, NumReducedThreadgroupsToRun;
+    FFX_ParallelSort_SetConstantAndDispatchData(m_NumKeys[m_UIResolutionSize], m_MaxNumThreadgroups, constantBufferData, NumThreadgroupsToRun, NumReducedThreadgroupsToRun);
+    FFX_ParallelSort_SetKeyLayout(constantBufferData, KeyRecordStrideOverride, KeyRecordOffsetOverride);
+
+    D3D12_GPU_VIRTUAL_ADDRESS constantBuffer = AllocConstantBuffer(sizeof(FFX_ParallelSortCB), &constantBufferData);
+    pCommandList->SetComputeRootConstantBufferView(0, constantBuffer);                      // Constant buffer
+    pCommandList->SetComputeRootDescriptorTable(3, m_DstKeyUAVTable.GetGPU(0));            // SrcBuffer (this frame's keys)
+    pCommandList->SetComputeRootDescriptorTable(7, m_KeyRecordUAV.GetGPU());               // DstBuffer (records)
+
+    pCommandList->SetPipelineState(m_FPSWriteKeyRecordsPipeline.get());
+    pCommandList->Dispatch(NumThreadgroupsToRun, 1, 1);
+
+    CD3DX12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::UAV(m_KeyRecordBuffer.GetResource());
+    pCommandList->ResourceBarrier(1, &barrier);
+    StageTimeStamp(pCommandList, pStageTimer, "WriteKeyRecords", 0);
+    m_KeyRecordSet = m_UIResolutionSize;
+}
+
+// GPU validation. Before the sort this adds up the checksums of the keys going in, after it those of the sorted keys along with
+// their order, and then resolves the result record and copies it into the next read-back slot (reading what was there first).
+void FFXParallelSort::ValidateSort(ID3D12GraphicsCommandList* pCommandList, GPUTimestamps* pStageTimer, const RdxDX12ResourceInfo& KeyInfo, const RdxDX12ResourceInfo& PayloadInfo, bool bHasPayload, bool b16BitKeys, bool bSorted)
+{
+    // Validation walks the whole key set like the presort check, so it takes the same constants
+    struct SetupIndirectCB
+    {
+        uint32_t NumKeysIndex;
+        uint32_t MaxThreadGroups;
+        uint32_t NumKeyWords;
+        uint32_t KeyStride;
+        uint32_t KeyOffset;
+    };
+    SetupIndirectCB ValidateCB;
+    ValidateCB.NumKeysIndex = m_UIResolutionSize;
+    ValidateCB.MaxThreadGroups = m_MaxNumThreadgroups;
+    ValidateCB.NumKeyWords = m_NumKeyWords;
+    ValidateCB.KeyStride = 1;
+    ValidateCB.KeyOffset = 0;
+
+    D3D12_GPU_VIRTUAL_ADDRESS constantBuffer = AllocConstantBuffer(sizeof(SetupIndirectCB), &ValidateCB);
+    pCommandList->SetComputeRootConstantBufferView(1, constantBuffer);                      // SetupIndirect Constant buffer
+    pCommandList->SetComputeRootDescriptorTable(b16BitKeys ? 25 : 3, KeyInfo.resourceGPUHandle);    // SrcKeys16 or SrcBuffer
+    if (bHasPayload)
+        pCommandList->SetComputeRootDescriptorTable(4, PayloadInfo.resourceGPUHandle);      // SrcPayload
+    pCommandList->SetComputeRootDescriptorTable(12, m_IndirectKeyCountsUAV.GetGPU());       // Key counts
+    pCommandList->SetComputeRootDescriptorTable(22, m_ValidateStateUAV.GetGPU());           // Validate state
+
+    if (bSorted && b16BitKeys)
+        pCommandList->SetPipelineState(bHasPayload ? m_FPSValidateOutput16BitPayloadPipeline.get() : m_FPSValidateOutput16BitPipeline.get());
+    else if (bSorted)
+        pCommandList->SetPipelineState(bHasPayload ? m_FPSValidateOutputPayloadPipeline.get() : m_FPSValidateOutputPipeline.get());
+    else if (b16BitKeys)
+        pCommandList->SetPipelineState(bHasPayload ? m_FPSValidateInput16BitPayloadPipeline.get() : m_FPSValidateInput16BitPipeline.get());
+    else
+        pCommandList->SetPipelineState(bHasPayload ? m_FPSValidateInputPayloadPipeline.get() : m_FPSValidateInputPipeline.get());
+    pCommandList->Dispatch(m_MaxNumThreadgroups, 1, 1);
+
+    CD3DX12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::UAV(m_ValidateStateBuffer.GetResource());
+    pCommandList->ResourceBarrier(1, &barrier);
+    if (!bSorted)
+    {
+        StageTimeStamp(pCommandList, pStageTimer, "ValidateInput", 0);
+        return;
+    }
+
+    pCommandList->SetPipelineState(m_FPSValidateResultPipeline.get());
+    pCommandList->Dispatch(1, 1, 1);
+
+    // Slots go to validated sorts rather than frames. When all of them are still waiting on their copies (too many validated
+    // sorts in the last few frames), this sort's record doesn't get read back
+    uint32_t Slot = m_GPUValidationSlot;
+    if (m_bGPUValidationPending[Slot])
+    {
+        barrier = CD3DX12_RESOURCE_BARRIER::UAV(m_ValidateStateBuffer.GetResource());
+        pCommandList->ResourceBarrier(1, &barrier);
+        StageTimeStamp(pCommandList, pStageTimer, "ValidateOutput", 0);
+        return;
+    }
+    m_GPUValidationSlot = (Slot + 1) % GPUValidationSlots;
+    m_bGPUValidationPending[Slot] = true;
+    m_GPUValidationSlotFrame[Slot] = m_FrameCount;
+
+    barrier = CD3DX12_RESOURCE_BARRIER::Transition(m_ValidateStateBuffer.GetResource(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
+    pCommandList->ResourceBarrier(1, &barrier);
+    pCommandList->CopyBufferRegion(m_pValidateReadBackBuffer, sizeof(uint32_t) * FFX_PARALLELSORT_VALIDATE_RESULT_SIZE * Slot, m_ValidateStateBuffer.GetResource(),
+                                   sizeof(uint32_t) * FFX_PARALLELSORT_VALIDATE_STATE_RESULT, sizeof(uint32_t) * FFX_PARALLELSORT_VALIDATE_RESULT_SIZE);
+    barrier = CD3DX12_RESOURCE_BARRIER::Transition(m_ValidateStateBuffer.GetResource(), D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    pCommandList->ResourceBarrier(1, &barrier);
+    StageTimeStamp(pCommandList, pStageTimer, "ValidateOutput", 0);
+}
+
+// Tallies up the GPU validation result records whose copies have landed (the frames that copied them are ReadBackLatency
+// frames old), oldest first
+void FFXParallelSort::ReadGPUValidationResults()
+{
+    for (uint32_t i = 0; i < GPUValidationSlots; ++i)
+    {
+        uint32_t Slot = (m_GPUValidationSlot + i) % GPUValidationSlots;
+        if (m_bGPUValidationPending[Slot] && m_FrameCount - m_GPUValidationSlotFrame[Slot] >= ReadBackLatency)
+        {
+            ReadGPUValidationResult(Slot);
+            m_bGPUValidationPending[Slot] = false;
+        }
+    }
+}
+
+// Tallies up a GPU validation result record (and reports failures)
+void FFXParallelSort::ReadGPUValidationResult(uint32_t Slot)
+{
+    const uint32_t* pResult = m_pValidateResults + FFX_PARALLELSORT_VALIDATE_RESULT_SIZE * Slot;
+    ++m_NumGPUValidations;
+
+    uint32_t Status = pResult[FFX_PARALLELSORT_VALIDATE_RESULT_STATUS];
+    if (!Status)
+        return;
+
+    ++m_NumGPUValidationFailures;
+    std::string message = "GPU validation failed on sort " + std::to_string(pResult[FFX_PARALLELSORT_VALIDATE_RESULT_COUNT]) + ":";
+    if (Status & FFX_PARALLELSORT_VALIDATE_FAILED_ORDER)
+        message += " " + std::to_string(pResult[FFX_PARALLELSORT_VALIDATE_RESULT_INVERSIONS]) + " entries larger than the next one (first at entry " +
+                   std::to_string(pResult[FFX_PARALLELSORT_VALIDATE_RESULT_FIRST_VIOLATION]) + ").";
+    if (Status & FFX_PARALLELSORT_VALIDATE_FAILED_KEYS)
+        message += " Sorted keys are not a permutation of the input.";
+    if (Status & FFX_PARALLELSORT_VALIDATE_FAILED_PAYLOAD)
+        message += " Payloads did not move with their keys.";
+    Trace(message);
+    m_LastGPUValidationFailure = message;
+}
+
+// Out-of-core sort of NumOutOfCoreKeys keys (more than the sort buffers hold). Chunks that fit get sorted on the GPU one at
+// a time and read back as sorted runs, then every output window gets its slice of each run merged by MergeRuns and read back.
+// More runs than MergeRuns takes are merged in groups, over as many passes as it takes to get down to a single run.
+// Everything goes through the upload heap's command list and waits on it, so this runs once at startup rather than per frame.
+void FFXParallelSort::SortOutOfCore(uint32_t NumOutOfCoreKeys)
+{
+    if (m_NumKeyWords > 1)
+    {
+        Trace("FFXParallelSort: out-of-core sorts only support single-word keys, skipping");
+        return;
+    }
+
+    const uint32_t ChunkSize = m_MaxNumKeys;
+    const uint32_t NumRuns = (NumOutOfCoreKeys + ChunkSize - 1) / ChunkSize;
+    Trace("FFXParallelSort: out-of-core sort of " + std::to_string(NumOutOfCoreKeys) + " keys in " + std::to_string(NumRuns) + " runs");
+
+    std::vector<uint32_t> Keys(NumOutOfCoreKeys);
+    GenerateKeys(Keys, KeyDistributionOverride, KeySeedOverride);
+    NarrowKeys(Keys, m_KeyBits);
+    uint64_t KeySum = std::accumulate(Keys.begin(), Keys.end(), uint64_t(0));
+
+    // Read-back buffer big enough for a chunk (or an output window)
+    ID3D12Resource* pReadBackBuffer = nullptr;
+    CD3DX12_HEAP_PROPERTIES readBackHeapProperties(D3D12_HEAP_TYPE_READBACK);
+    CD3DX12_RESOURCE_DESC bufferDesc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(uint32_t) * ChunkSize, D3D12_RESOURCE_FLAG_NONE);
+    ThrowIfFailed(m_pDevice->GetDevice()->CreateCommittedResource(&readBackHeapProperties, D3D12_HEAP_FLAG_NONE, &bufferDesc, D3D12_RESOURCE_STATE_COPY_DEST,
+                                                                  nullptr, IID_PPV_ARGS(&pReadBackBuffer)));
+    pReadBackBuffer->SetName(L"Out-of-core Read-back Buffer");
+
+    // Copies the first NumValues keys of a sort buffer into pData (waiting on everything recorded so far)
+    auto ReadBack = [&](ID3D12Resource* pBuffer, uint32_t* pData, uint32_t NumValues)
+    {
+        ID3D12GraphicsCommandList* pCommandList = m_pUploadHeap->GetCommandList();
+        pCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(pBuffer, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE));
+        pCommandList->CopyBufferRegion(pReadBackBuffer, 0, pBuffer, 0, sizeof(uint32_t) * NumValues);
+        pCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(pBuffer, D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
+        m_pUploadHeap->FlushAndFinish();
+
+        D3D12_RANGE range = { 0, sizeof(uint32_t) * NumValues };
+        void* pMappedData;
+        pReadBackBuffer->Map(0, &range, &pMappedData);
+        memcpy(pData, pMappedData, sizeof(uint32_t) * NumValues);
+        pReadBackBuffer->Unmap(0, nullptr);
+    };
+
+    // Uploads NumValues values to the start of a buffer the sort uses as a UAV
+    auto Upload = [&](ID3D12Resource* pBuffer, const uint32_t* pData, uint32_t NumValues)
+    {
+        m_pUploadHeap->GetCommandList()->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(pBuffer, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_DEST));
+        UploadBufferData(pBuffer, pData, NumValues);
+        m_pUploadHeap->GetCommandList()->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(pBuffer, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
+    };
+
+    auto StartTime = std::chrono::high_resolution_clock::now();
+
+    // Sort every chunk into a run (in place, chunk sorts run an even number of passes so the result is back in the first sort buffer)
+    std::vector<const uint32_t*> Runs(NumRuns);
+    std::vector<uint32_t> RunLengths(NumRuns);
+    for (uint32_t Run = 0; Run < NumRuns; ++Run)
+    {
+        uint32_t* pRun = Keys.data() + size_t(Run) * ChunkSize;
+        Runs[Run] = pRun;
+        RunLengths[Run] = std::min(NumOutOfCoreKeys - Run * ChunkSize, ChunkSize);
+
+        Upload(m_DstKeyBuffers[0].GetResource(), pRun, RunLengths[Run]);
+        m_OutOfCoreChunkKeys = RunLengths[Run];
+        Sort(m_pUploadHeap->GetCommandList(), true, 0.f);
+        m_OutOfCoreChunkKeys = 0;
+        ReadBack(m_DstKeyBuffers[0].GetResource(), pRun, RunLengths[Run]);
+    }
+
+    auto RunsTime = std::chrono::high_resolution_clock::now();
+
+    // Merge the runs in groups of at most FFX_PARALLELSORT_MAX_MERGE_RUNS, one output window at a time, and repeat until a single
+    // run is left. The runs sit back to back, so each merged group lands where its runs were (in the other key array)
+    std::vector<uint32_t> MergedKeys(NumOutOfCoreKeys);
+    uint32_t* pSrcKeys = Keys.data();
+    uint32_t* pDstKeys = MergedKeys.data();
+    std::vector<uint32_t> WindowKeys(ChunkSize);
+    std::vector<uint32_t> WindowStart(FFX_PARALLELSORT_MAX_MERGE_RUNS), WindowEnd(FFX_PARALLELSORT_MAX_MERGE_RUNS), RunOffsets(FFX_PARALLELSORT_MAX_MERGE_RUNS + 1);
+    uint32_t NumMergePasses = 0;
+    while (Runs.size() > 1)
+    {
+        std::vector<const uint32_t*> MergedRuns;
+        std::vector<uint32_t> MergedRunLengths;
+        for (size_t FirstRun = 0; FirstRun < Runs.size(); FirstRun += FFX_PARALLELSORT_MAX_MERGE_RUNS)
+        {
+            const uint32_t NumGroupRuns = uint32_t(std::min<size_t>(Runs.size() - FirstRun, FFX_PARALLELSORT_MAX_MERGE_RUNS));
+            const uint32_t* const* ppGroupRuns = Runs.data() + FirstRun;
+            const uint32_t* pGroupRunLengths = RunLengths.data() + FirstRun;
+            const uint32_t GroupKeys = std::accumulate(pGroupRunLengths, pGroupRunLengths + NumGroupRuns, 0u);
+            uint32_t* pMerged = pDstKeys + (ppGroupRuns[0] - pSrcKeys);
+            MergedRuns.push_back(pMerged);
+            MergedRunLengths.push_back(GroupKeys);
+
+            // A run left on its own only needs to move along
+            if (NumGroupRuns == 1)
+            {
+                std::copy(ppGroupRuns[0], ppGroupRuns[0] + GroupKeys, pMerged);
+                continue;
+            }
+
+            FFX_ParallelSort_SplitSortedRuns(ppGroupRuns, pGroupRunLengths, NumGroupRuns, 0, WindowStart.data());
+            for (uint32_t OutputOffset = 0; OutputOffset < GroupKeys; )
+            {
+                uint32_t WindowSize = std::min(GroupKeys - OutputOffset, ChunkSize);
+                FFX_ParallelSort_SplitSortedRuns(ppGroupRuns, pGroupRunLengths, NumGroupRuns, OutputOffset + WindowSize, WindowEnd.data());
+
+                // Slices of every run back to back
+                RunOffsets[0] = 0;
+                for (uint32_t Run = 0; Run < NumGroupRuns; ++Run)
+                {
+                    std::copy(ppGroupRuns[Run] + WindowStart[Run], ppGroupRuns[Run] + WindowEnd[Run], WindowKeys.begin() + RunOffsets[Run]);
+                    RunOffsets[Run + 1] = RunOffsets[Run] + WindowEnd[Run] - WindowStart[Run];
+                }
+                assert(RunOffsets[NumGroupRuns] == WindowSize);
+
+                Upload(m_DstKeyBuffers[0].GetResource(), WindowKeys.data(), WindowSize);
+                Upload(m_RunOffsetBuffer.GetResource(), RunOffsets.data(), NumGroupRuns + 1);
+                ID3D12GraphicsCommandList* pCommandList = m_pUploadHeap->GetCommandList();
+
+                FFX_ParallelSortCB constantBufferData;
+                uint32_t NumThreadgroupsToRun;
+                FFX_ParallelSort_SetMergeRunsConstantAndDispatchData(WindowSize, NumGroupRuns, constantBufferData, NumThreadgroupsToRun);
+
+                ID3D12DescriptorHeap* pDescriptorHeap = m_pResourceViewHeaps->GetCBV_SRV_UAVHeap();
+                pCommandList->SetDescriptorHeaps(1, &pDescriptorHeap);
+                pCommandList->SetComputeRootSignature(m_pFPSRootSignature);
+
+                D3D12_GPU_VIRTUAL_ADDRESS constantBuffer = AllocConstantBuffer(sizeof(FFX_ParallelSortCB), &constantBufferData);
+                pCommandList->SetComputeRootConstantBufferView(0, constantBuffer);              // Constant buffer
+                pCommandList->SetComputeRootDescriptorTable(3, m_DstKeyUAVTable.GetGPU(0));     // SrcBuffer
+                pCommandList->SetComputeRootDescriptorTable(7, m_DstKeyUAVTable.GetGPU(1));     // DstBuffer
+                pCommandList->SetComputeRootDescriptorTable(21, m_RunOffsetUAV.GetGPU());       // RunOffsets
+                pCommandList->SetPipelineState(m_FPSMergeRunsPipeline.get());
+                pCommandList->Dispatch(NumThreadgroupsToRun, 1, 1);
+
+                ReadBack(m_DstKeyBuffers[1].GetResource(), pMerged + OutputOffset, WindowSize);
+
+                std::swap(WindowStart, WindowEnd);
+                OutputOffset += WindowSize;
+            }
+        }
+
+        Runs.swap(MergedRuns);
+        RunLengths.swap(MergedRunLengths);
+        std::swap(pSrcKeys, pDstKeys);
+        ++NumMergePasses;
+    }
+
+    auto EndTime = std::chrono::high_resolution_clock::now();
+    pReadBackBuffer->Release();
+
+    // The sort buffers no longer hold the frame's keys
+    m_TemporalKeySet = -1;
+    m_bSortedKeysInPlace = false;
+
+    // The last merge pass wrote to what is now the source array
+    const uint32_t* pSortedKeys = pSrcKeys;
+    bool bValid = std::is_sorted(pSortedKeys, pSortedKeys + NumOutOfCoreKeys) && std::accumulate(pSortedKeys, pSortedKeys + NumOutOfCoreKeys, uint64_t(0)) == KeySum;
+    Trace(std::string("FFXParallelSort: out-of-core sort ") + (bValid ? "valid" : "invalid") +
+          ", runs " + std::to_string(std::chrono::duration<double, std::milli>(RunsTime - StartTime).count()) + " ms" +
+          ", " + std::to_string(NumMergePasses) + " merge passes " + std::to_string(std::chrono::duration<double, std::milli>(EndTime - RunsTime).count()) + " ms");
+}
+
+// Insert a GPU timestamp after a sort stage (no-op when per-stage timings are off)
+void FFXParallelSort::StageTimeStamp(ID3D12GraphicsCommandList* pCommandList, GPUTimestamps* pGPUTimer, const char* stage, uint32_t shift)
+{
+    if (!pGPUTimer || !m_StageTimings.ReserveTimeStamp())
+        return;
+
+    std::string label = "FPS ";
+    label += stage;
+    label += " ";
+    label += std::to_string(shift);
+    pGPUTimer->GetTimeStamp(pCommandList, label.c_str());
+}
+
+// Pull our stage stamps out of the frame's timings and fold them into the rolling history
+void FFXParallelSort::UpdateStageTimings(std::vector<TimeStamp>& timeStamps, const char* sortLabel)
+{
+    if (!m_UIStageTimings)
+    {
+        m_StageTimings.Clear();
+        return;
+    }
+
+    m_StageTimings.Update(timeStamps, sortLabel);
+}
+
 // Render Parallel Sort related GUI
 void FFXParallelSort::DrawGui()
 {
     if (ImGui::CollapsingHeader("FFX Parallel Sort", ImGuiTreeNodeFlags_DefaultOpen))
     {
-        static const char* ResolutionSizeStrings[] = { "1920x1080", "2560x1440", "3840x2160" };
+        std::string CustomKeySetString = std::to_string(m_NumKeys[CustomKeySet]) + " keys";
+        const char* ResolutionSizeStrings[] = { "1920x1080", "2560x1440", "3840x2160", CustomKeySetString.c_str() };
 
         ImVec2 textSize = ImGui::CalcTextSize("3840x2160");
         if (KeySetOverride < 0)
         {
             ImGui::PushItemWidth(textSize.x * 2);
-            ImGui::Combo("Sort Buffer Resolution", &m_UIResolutionSize, ResolutionSizeStrings, _countof(ResolutionSizeStrings));
+            ImGui::Combo("Sort Buffer Resolution", &m_UIResolutionSize, ResolutionSizeStrings, m_NumKeySets);
             ImGui::PopItemWidth();
         }
 
+        ImGui::Text("Key Distribution: %s (seed %u)", KeyDistributionNames[KeyDistributionOverride], KeySeedOverride);
+        if (m_WaveSize)
+            ImGui::Text("Kernels: wave%u%s", m_WaveSize, m_bPinWaveSize ? " (pinned)" : "");
+        else
+            ImGui::Text("Kernels: any wave size");
+        ImGui::Text("Scatter Ranking: %s", m_bTileScatter ? "full tile" : m_bMatchScatter ? (m_bWaveMatch ? "wave match" : "ballot match") : "per row");
+        ImGui::Text("Digit Counting: %s", m_bRegisterCount ? "registers" : "LDS atomics");
+
         ImGui::Checkbox("Sort Payload", &m_UISortPayload);
+        if (m_UISortPayload)
+            ImGui::Checkbox("Deferred Payload Gather", &m_UIDeferredPayload);
+        if (m_NumKeyWords == 1)
+        {
+            ImGui::Checkbox("Key Load/Store Hooks", &m_UIKeyHooks);
+            if (KeyRecordStrideOverride)
+            {
+                std::string KeyRecordsLabel = "Sort Key Records (" + std::to_string(KeyRecordStrideOverride) + " byte stride)";
+                ImGui::Checkbox(KeyRecordsLabel.c_str(), &m_UIKeyRecords);
+            }
+        }
+        ImGui::Checkbox("Read-Only Vector Input", &m_UIReadOnlyInput);
+        if (m_KeyBits < 32)
+        {
+            ImGui::Text("Key Width: %u bits (%u passes)", m_KeyBits, m_KeyBits / FFX_PARALLELSORT_SORT_BITS_PER_PASS);
+            if (m_b16BitKeyStorage)
+                ImGui::Checkbox("16-Bit Key Storage", &m_UI16BitKeys);
+
+            // Indirect sorts leave room for the indices of the biggest key set
+            uint32_t PackedNumKeys = m_UIIndirectSort ? m_MaxNumKeys : m_NumKeys[m_UIResolutionSize];
+            if (FFX_ParallelSort_CanPackKeyIndex(m_KeyBits, PackedNumKeys))
+                ImGui::Checkbox("Packed Key+Index", &m_UIPackedKeyIndex);
+            else
+                ImGui::Text("Packed key+index needs keys of %u bits or less", 32 - FFX_ParallelSort_PackedIndexBits(PackedNumKeys));
+        }
         ImGui::Checkbox("Use Indirect Execution", &m_UIIndirectSort);
+        ImGui::Checkbox("Skip Sort When Presorted", &m_UIPresortCheck);
+        if (m_UIPresortCheck)
+        {
+            ImGui::Text("Presort check always uses indirect execution");
+            if (m_NumPresortChecks > ReadBackLatency)
+                ImGui::Text("Last Check: %u neighbours out of order (%s)", m_LastPresortInversions, m_LastPresortInversions ? "sorted" : "sort skipped");
+        }
+        ImGui::Checkbox("Temporal Coherence", &m_UITemporalCoherence);
+        if (m_NumKeyWords == 1)
+        {
+            // Start over from the source keys when toggled, the incremental re-sort changes the keys it sorts
+            if (ImGui::Checkbox("Incremental Re-sort", &m_UIIncrementalSort))
+                m_TemporalKeySet = -1;
+            if (m_UIIncrementalSort)
+                ImGui::SliderInt("Changed Keys (%)", &m_UIDirtyKeyPercent, 1, MaxDirtyKeyPercent);
+        }
+        else
+            ImGui::Text("Incremental re-sort requires single word keys");
+        if (m_NumKeyWords == 1)
+        {
+            ImGui::Checkbox("Top-K Selection", &m_UISelectTopK);
+            if (m_UISelectTopK)
+            {
+                ImGui::InputInt("Keys To Keep", &m_UISelectNumKeys, 1024, 65536);
+                m_UISelectNumKeys = std::max(m_UISelectNumKeys, 1);
+            }
+            if ((m_UITemporalCoherence || m_UIIncrementalSort) && GetNumSelectKeys())
+                ImGui::Text("Top-K selection starts from the source keys every frame");
+        }
+        else
+            ImGui::Text("Top-K selection requires single word keys");
+        if (m_NumKeyWords == 1)
+        {
+            ImGui::Checkbox("Percentile Queries", &m_UISelectPercentiles);
+            if (m_UISelectPercentiles)
+            {
+                for (size_t i = 0; i < m_SelectPercentiles.size(); ++i)
+                {
+                    // Keys read back from the GPU, with what the CPU found next to any that don't match
+                    if (i >= m_PercentileKeys.size())
+                        ImGui::BulletText("p%g", m_SelectPercentiles[i] * 100.f);
+                    else if (m_PercentileKeySet >= 0 && i < m_ExpectedPercentileKeys[m_PercentileKeySet].size() && m_PercentileKeys[i] != m_ExpectedPercentileKeys[m_PercentileKeySet][i])
+                        ImGui::BulletText("p%g: %u (CPU reference %u)", m_SelectPercentiles[i] * 100.f, m_PercentileKeys[i], m_ExpectedPercentileKeys[m_PercentileKeySet][i]);
+                    else
+                        ImGui::BulletText("p%g: %u", m_SelectPercentiles[i] * 100.f, m_PercentileKeys[i]);
+                }
+            }
+        }
+        else
+            ImGui::Text("Percentile queries require single word keys");
+        ImGui::Checkbox("Per-Stage GPU Timings", &m_UIStageTimings);
+        if (m_UIStageTimings)
+        {
+            std::vector<StageTiming> stageTimings;
+            GetStageTimings(stageTimings);
+            for (const StageTiming& timing : stageTimings)
+                ImGui::Text("%-12s p50 %8.2f us  p99 %8.2f us", timing.Label.c_str(), timing.P50, timing.P99);
+
+            if (ImGui::TreeNode("Per Pass Timings"))
+            {
+                GetStageTimings(stageTimings, true);
+                for (const StageTiming& timing : stageTimings)
+                    ImGui::Text("%-22s p50 %8.2f us  p99 %8.2f us", timing.Label.c_str() + 4, timing.P50, timing.P99);
+                ImGui::TreePop();
+            }
+            if (m_StageTimings.IsTruncated())
+                ImGui::Text("Out of GPU timestamps, later stages are counted in Tail");
+        }
+        ImGui::Checkbox("GPU Validation", &m_UIGPUValidation);
+        if (m_UIGPUValidation || m_NumGPUValidations)
+        {
+            ImGui::Text("Validated %u sorts, %u failed", m_NumGPUValidations, m_NumGPUValidationFailures);
+            if (!m_LastGPUValidationFailure.empty())
+                ImGui::TextWrapped("%s", m_LastGPUValidationFailure.c_str());
+        }
 #ifdef DEVELOPERMODE
         if (ImGui::Button("Validate Sort Results"))
             m_UIValidateSortResults = true;
 #endif // DEVELOPERMODE
 
-        ImGui::RadioButton("Render Unsorted Keys", &m_UIVisualOutput, 0);
-        ImGui::RadioButton("Render Sorted Keys", &m_UIVisualOutput, 1);
+        if (m_UIResolutionSize == CustomKeySet)
+            ImGui::Text("Visualization requires a resolution key set");
+        else if (m_NumKeyWords > 1)
+            ImGui::Text("Visualization requires single word keys");
+        else if (m_KeyBits < 32)
+            ImGui::Text("Visualization requires 32-bit keys");
+        else if (GetNumSelectKeys() || GetNumSelectQueries())
+            ImGui::Text("Visualization requires sorting all the keys");
+        else if (GetNumDirtyKeys())
+            ImGui::Text("Visualization requires the source keys (incremental re-sort changes them)");
+        else if (KeysArePermutation(KeyDistributionOverride))
+        {
+            ImGui::RadioButton("Render Unsorted Keys", &m_UIVisualOutput, 0);
+            ImGui::RadioButton("Render Sorted Keys", &m_UIVisualOutput, 1);
+        }
+        else
+            ImGui::Text("Visualization requires a permutation key distribution");
     }
 }
 
 // Renders the image with the sorted/unsorted indicies for visual representation
 void FFXParallelSort::DrawVisualization(ID3D12GraphicsCommandList* pCommandList, uint32_t RTWidth, uint32_t RTHeight)
 {
+    // Keys are used as pixel indices, so there is nothing sensible to show unless they are a permutation of 0..N-1 covering the whole image
+    if (!KeysArePermutation(KeyDistributionOverride) || m_UIResolutionSize == CustomKeySet || m_NumKeyWords > 1 || m_KeyBits < 32 || GetNumSelectKeys() || GetNumSelectQueries() || GetNumDirtyKeys())
+        return;
+
     // Setup the constant buffer
     ParallelSortRenderCB ConstantBuffer;
     ConstantBuffer.Width = RTWidth;
@@ -843,7 +3290,7 @@ void FFXParallelSort::DrawVisualization(ID3D12GraphicsCommandList* pCommandList,
     pCommandList->SetGraphicsRootSignature(m_pRenderRootSignature);
 
     // Bind constant buffer
-    D3D12_GPU_VIRTUAL_ADDRESS GPUCB = m_pConstantBufferRing->AllocConstantBuffer(sizeof(ParallelSortRenderCB), &ConstantBuffer);
+    D3D12_GPU_VIRTUAL_ADDRESS GPUCB = AllocConstantBuffer(sizeof(ParallelSortRenderCB), &ConstantBuffer);
     pCommandList->SetGraphicsRootConstantBufferView(0, GPUCB);
 
     // If we are showing unsorted values, need to transition the source data buffer from copy source to UAV and back
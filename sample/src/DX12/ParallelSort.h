@@ -19,6 +19,12 @@
 
 #pragma once
 #include <d3d12.h>
+#include <future>
+#include <memory>
+#include <mutex>
+
+#include "../Common/StageTimings.h"
+#include "../Common/WorkerPool.h"
 
 using namespace CAULDRON_DX12;
 
@@ -38,6 +44,7 @@ typedef struct RdxDX12ResourceInfo
 {
     ID3D12Resource* pResource;          ///< Pointer to the resource -- used for barriers and syncs (must NOT be nullptr)
     D3D12_GPU_DESCRIPTOR_HANDLE resourceGPUHandle;  ///< The GPU Descriptor Handle to use for binding the resource
+    D3D12_GPU_DESCRIPTOR_HANDLE readOnlyGPUHandle;  ///< The GPU Descriptor Handle of a raw SRV of the resource (only for buffers read with read-only input)
 } RdxDX12ResourceInfo;
 
 namespace CAULDRON_DX12
@@ -54,7 +61,39 @@ public:
     void OnCreate(Device* pDevice, ResourceViewHeaps* pResourceViewHeaps, DynamicBufferRing* pConstantBufferRing, UploadHeap* pUploadHeap, SwapChain* pSwapChain);
     void OnDestroy();
 
-    void Sort(ID3D12GraphicsCommandList* pCommandList, bool isBenchmarking, float benchmarkTime);
+    // The scratch and indirect buffers a sort writes to while it runs. Sorts recorded with an acquired context are plain direct
+    // sorts of the keys (and payload) handed to the context with SetSortContextBuffers(), none of the sample's modes, read-backs
+    // or timings apply to them. They only write the context's resources, so they can be recorded from several threads at once
+    // and run concurrently on the GPU (with each other and with the default context's sort).
+    struct SortContext
+    {
+        Texture         ScratchBuffer;              // Sort scratch buffer
+        CBV_SRV_UAV     ScratchUAV;                 // UAV needed for sort scratch buffer
+        Texture         ReducedScratchBuffer;       // Sort reduced scratch buffer
+        CBV_SRV_UAV     ReducedScratchUAV;          // UAV needed for sort reduced scratch buffer
+        Texture         ScanBlockBuffer;            // Partial sums for reduced tables too big to scan in one thread group
+        CBV_SRV_UAV     ScanBlockUAV;               // UAV needed for scan block buffer
+        Texture         IndirectConstantBuffer;     // Buffer to hold radix sort constant buffer data for indirect dispatch
+        CBV_SRV_UAV     IndirectConstantBufferUAV;  // UAV needed for indirect constant buffer
+        Texture         IndirectCountScatterArgs;   // Buffer to hold dispatch arguments used for Count/Scatter parts of the algorithm
+        CBV_SRV_UAV     IndirectCountScatterArgsUAV; // UAV needed for count/scatter args buffer
+        Texture         IndirectReduceScanArgs;     // Buffer to hold dispatch arguments used for Reduce/Scan parts of the algorithm
+        CBV_SRV_UAV     IndirectReduceScanArgsUAV;  // UAV needed for reduce/scan args buffer
+        RdxDX12ResourceInfo KeyInfo[2] = {};        // Keys to sort (in UAV state) and a temp buffer as big, the sorted keys end up in [0]
+        RdxDX12ResourceInfo PayloadInfo[2] = {};    // Payload moved along with the keys (none when [0] has no resource)
+        uint32_t        NumKeys = 0;                // Keys to sort, at most as many as the sample's biggest key set
+        bool            bInUse = false;
+    };
+    // Thread safe. Hands out an unused context, creating a new one when they are all in use. Release it once the GPU is done
+    // with the sorts recorded with it.
+    SortContext* AcquireSortContext();
+    void ReleaseSortContext(SortContext* pContext);
+    // Points an acquired context's sorts at the keys (and payload) to sort. Not while the GPU is still using the context.
+    void SetSortContextBuffers(SortContext* pContext, uint32_t NumKeys, const RdxDX12ResourceInfo KeyInfo[2], const RdxDX12ResourceInfo* pPayloadInfo = nullptr);
+
+    // Sorts the sample's keys with the default context when none is given (one thread at a time, it updates the sample's state),
+    // or the context's keys. Thread safe for different acquired contexts (see SortContext).
+    void Sort(ID3D12GraphicsCommandList* pCommandList, bool isBenchmarking, float benchmarkTime, GPUTimestamps* pGPUTimer = nullptr, SortContext* pContext = nullptr);
 #ifdef DEVELOPERMODE
     void WaitForValidationResults();
 #endif // DEVELOPERMODE
@@ -62,68 +101,276 @@ public:
     void DrawGui();
     void DrawVisualization(ID3D12GraphicsCommandList* pCommandList, uint32_t RTWidth, uint32_t RTHeight);
 
+    // Per-stage GPU timings. Stamps are only recorded when enabled and a GPUTimestamps is handed to Sort(), 
+    // they are named "FPS <Stage> <Shift>" and show up in the profiler and benchmark output like any other stamp.
+    // UpdateStageTimings() adds them back into sortLabel (the stamp closing the sort) so that one stays the whole sort
+    typedef StageTimings::Timing StageTiming;
+    void EnableStageTimings(bool enable) { m_UIStageTimings = enable; }
+    void UpdateStageTimings(std::vector<TimeStamp>& timeStamps, const char* sortLabel);
+    void GetStageTimings(std::vector<StageTiming>& stageTimings, bool perPass = false) const { m_StageTimings.Get(stageTimings, perPass); }
+
+    // Key distributions the sample can generate (all seeded so runs can be reproduced)
+    enum KeyDistribution
+    {
+        KeyDistribution_Permutation = 0,    // Shuffled 0..N-1 (what the visualization expects)
+        KeyDistribution_Uniform,            // Uniform random 32-bit keys
+        KeyDistribution_Sorted,             // 0..N-1 in order
+        KeyDistribution_ReverseSorted,      // N-1..0
+        KeyDistribution_NearlySorted,       // 0..N-1 with 1% of the keys swapped at random
+        KeyDistribution_FewUnique,          // 16 distinct random 32-bit values
+        KeyDistribution_Zipf,               // Zipf (s = 1) skewed draws from 64K distinct random 32-bit values
+        KeyDistribution_ConstantHighBits,   // Floats in [1, 2), sign and exponent bits never change
+
+        KeyDistribution_Count
+    };
+    static const char* GetKeyDistributionName(int Distribution);
+    static int GetKeyDistributionFromName(const std::string& Name);
+    static std::string GetKeyDataSuffix();
+
     // Temp -- For command line overrides
     static void OverrideKeySet(int ResolutionOverride);
     static void OverridePayload();
+    static void OverrideAsyncPipelineCreation();
+    static void OverrideStageTimings();
+    static void OverrideKeyDistribution(int Distribution);
+    static void OverrideKeySeed(uint32_t Seed);
+    static void OverrideNumKeys(uint32_t NumKeys);
+    static void OverrideMaxThreadGroups(uint32_t MaxThreadGroups);
+    static void OverrideKeyWords(uint32_t NumKeyWords);
+    static void OverrideTopK(uint32_t NumSelectKeys);
+    static void OverridePercentiles(const std::vector<float>& Percentiles);
+    static void OverridePresortCheck();
+    static void OverrideTemporalCoherence();
+    static void OverrideIncrementalSort(uint32_t DirtyKeyPercent);
+    static void OverrideOutOfCore(uint32_t NumKeys);
+    static void OverrideGPUValidation();
+    static void OverrideDeferredPayload();
+    static void OverrideKeyHooks();
+    static void OverrideKeyRecords(uint32_t StrideInBytes, uint32_t OffsetInBytes);
+    static void OverrideReadOnlyInput();
+    static void OverrideKeyBits(uint32_t KeyBits);
+    static void OverridePackedKeyIndex();
+    static void OverrideWaveSize(uint32_t WaveSize);
+    static void OverrideTileScatter();
+    static void OverrideRegisterCount();
+    static void OverrideMatchScatter();
     // Temp -- For command line overrides
 
 private:
+    // Pipelines are built on worker threads, so we hold on to the pending result until something needs it
+    typedef std::shared_future<ID3D12PipelineState*> FPSPipeline;
+
     void CreateKeyPayloadBuffers();
-    void CompileRadixPipeline(const char* shaderFile, const DefineList* defines, const char* entryPoint, ID3D12PipelineState*& pPipeline);
+    SortContext* CreateSortContext();
+    void DestroySortContext(SortContext& Context);
+    D3D12_GPU_VIRTUAL_ADDRESS AllocConstantBuffer(uint32_t Size, void* pData);
+    void UploadBufferData(ID3D12Resource* pBuffer, const uint32_t* pData, uint32_t NumValues);
+    void CreateReadOnlyView(Texture& Buffer, uint32_t Index, CBV_SRV_UAV* pSRV);
+    FPSPipeline CompileRadixPipeline(const char* shaderFile, const DefineList* defines, const char* entryPoint);
+    void WaitForPipelines();
+    void StageTimeStamp(ID3D12GraphicsCommandList* pCommandList, GPUTimestamps* pGPUTimer, const char* stage, uint32_t shift);
+    uint32_t GetNumSelectKeys() const;
+    uint32_t GetNumSelectQueries() const;
+    void ReadBackPresortInversions(ID3D12GraphicsCommandList* pCommandList);
+    void ReadBackPercentiles(ID3D12GraphicsCommandList* pCommandList);
+    bool KeepsSortedKeys() const;
+    void SelectDigits(ID3D12GraphicsCommandList* pCommandList, GPUTimestamps* pStageTimer, SortContext& Context, const FFX_ParallelSortCB& ConstantBufferData, uint32_t NumThreadgroupsToRun, uint32_t NumReducedThreadgroupsToRun,
+                      const RdxDX12ResourceInfo& KeySrcInfo);
+    void SelectPercentiles(ID3D12GraphicsCommandList* pCommandList, GPUTimestamps* pStageTimer, SortContext& Context, const RdxDX12ResourceInfo& KeySrcInfo);
+    void SelectTopK(ID3D12GraphicsCommandList* pCommandList, GPUTimestamps* pStageTimer, SortContext& Context, uint32_t NumSelectKeys, const RdxDX12ResourceInfo& KeySrcInfo, const RdxDX12ResourceInfo& KeyDstInfo,
+                    const RdxDX12ResourceInfo& PayloadSrcInfo, const RdxDX12ResourceInfo& PayloadDstInfo);
+    uint32_t GetNumDirtyKeys() const;
+    void GatherDirtyKeys(ID3D12GraphicsCommandList* pCommandList, GPUTimestamps* pStageTimer, uint32_t NumDirtyKeys, const RdxDX12ResourceInfo& PayloadSrcInfo);
+    void MergeDirtyKeys(ID3D12GraphicsCommandList* pCommandList, GPUTimestamps* pStageTimer, uint32_t NumDirtyKeys, const RdxDX12ResourceInfo& KeySrcInfo, const RdxDX12ResourceInfo& KeyDstInfo,
+                        const RdxDX12ResourceInfo& PayloadSrcInfo, const RdxDX12ResourceInfo& PayloadDstInfo);
+    void SortOutOfCore(uint32_t NumOutOfCoreKeys);
+    void ValidateSort(ID3D12GraphicsCommandList* pCommandList, GPUTimestamps* pStageTimer, const RdxDX12ResourceInfo& KeyInfo, const RdxDX12ResourceInfo& PayloadInfo, bool bHasPayload, bool b16BitKeys, bool bSorted);
+    void ReadGPUValidationResults();
+    void ReadGPUValidationResult(uint32_t Slot);
+    void GatherPayload(ID3D12GraphicsCommandList* pCommandList, GPUTimestamps* pStageTimer, SortContext& Context, bool bIndirectDispatch, uint32_t NumThreadgroupsToRun, const RdxDX12ResourceInfo& IndexInfo,
+                       const RdxDX12ResourceInfo& PayloadSrcInfo, const RdxDX12ResourceInfo& PayloadDstInfo);
+    void PackKeyIndex(ID3D12GraphicsCommandList* pCommandList, GPUTimestamps* pStageTimer, SortContext& Context, bool bIndirectDispatch, uint32_t NumThreadgroupsToRun,
+                      const FFX_ParallelSortCB& ConstantBufferData, uint32_t IndexBits, const RdxDX12ResourceInfo& KeyInfo, const RdxDX12ResourceInfo& PackedInfo);
+    void UnpackKeyIndex(ID3D12GraphicsCommandList* pCommandList, GPUTimestamps* pStageTimer, SortContext& Context, bool bIndirectDispatch, uint32_t NumThreadgroupsToRun,
+                        uint32_t IndexBits, const RdxDX12ResourceInfo& PackedInfo, const RdxDX12ResourceInfo& KeyInfo, const RdxDX12ResourceInfo& IndexInfo);
+    void WriteKeyRecords(ID3D12GraphicsCommandList* pCommandList, GPUTimestamps* pStageTimer);
 #ifdef DEVELOPERMODE
-    void CreateValidationResources(ID3D12GraphicsCommandList* pCommandList, RdxDX12ResourceInfo* pKeyDstInfo);
+    void CreateValidationResources(uint32_t NumValidationKeys, bool bHasInput, bool bHasPayload, bool b16BitKeys);
+    void CopyValidationData(ID3D12GraphicsCommandList* pCommandList, const RdxDX12ResourceInfo& KeyInfo, const RdxDX12ResourceInfo& PayloadInfo, bool bSorted);
 #endif // DEVELOPERMODE
 
     // Temp -- For command line overrides
     static int KeySetOverride;
     static bool PayloadOverride;
+    static bool AsyncPipelineOverride;
+    static bool StageTimingsOverride;
+    static int KeyDistributionOverride;
+    static uint32_t KeySeedOverride;
+    static uint32_t NumKeysOverride;
+    static uint32_t MaxThreadGroupsOverride;
+    static uint32_t KeyWordsOverride;
+    static uint32_t TopKOverride;
+    static std::vector<float> PercentilesOverride;
+    static bool PresortCheckOverride;
+    static bool TemporalCoherenceOverride;
+    static uint32_t IncrementalSortOverride;
+    static uint32_t OutOfCoreOverride;
+    static bool GPUValidationOverride;
+    static bool DeferredPayloadOverride;
+    static bool KeyHooksOverride;
+    static uint32_t KeyRecordStrideOverride;
+    static uint32_t KeyRecordOffsetOverride;
+    static bool ReadOnlyInputOverride;
+    static uint32_t KeyBitsOverride;
+    static bool PackedKeyIndexOverride;
+    static int WaveSizeOverride;
+    static bool TileScatterOverride;
+    static bool RegisterCountOverride;
+    static bool MatchScatterOverride;
     // Temp -- For command line overrides
 
+    // Key set holding the custom key count (after the 1080p, 2K and 4K ones)
+    static const uint32_t CustomKeySet = 3;
+
+    // Rolling history of per-stage timings
+    StageTimings m_StageTimings;
+
+    // Workers the pipeline permutations are compiled on
+    WorkerPool m_CompilePool;
+
     Device*             m_pDevice = nullptr;
     UploadHeap*         m_pUploadHeap = nullptr;
     ResourceViewHeaps*  m_pResourceViewHeaps = nullptr;
     DynamicBufferRing*  m_pConstantBufferRing = nullptr;
     uint32_t            m_MaxNumThreadgroups = 320; // Use a generic thread group size when not on AMD hardware (taken from experiments to determine best performance threshold)
+    uint32_t            m_NumKeys[4] = { 1920 * 1080, 2560 * 1440, 3840 * 2160, 0 }; // Keys in each key set (the custom one is only filled in when a key count is requested)
+    uint32_t            m_NumKeySets = 3;       // 1080, 2K, 4K, and optionally a custom key count
+    uint32_t            m_MaxNumKeys = 0;       // Biggest key set (what the sort buffers are sized for)
+    uint32_t            m_NumKeyWords = 1;      // 32-bit words per key (stored as planes of words, least significant first)
+    uint32_t            m_KeyBits = 32;         // Bits used by single-word keys (a sort pass per 4 bits)
+    bool                m_b16BitKeyStorage = false; // Whether keys of up to 16 bits can also be sorted as 16-bit values (needs 16-bit shader ops)
+    uint32_t            m_WaveSize = 0;         // Wave size the sort kernels are specialized for (0 when they look it up at run time)
+    bool                m_bPinWaveSize = false; // Whether the kernels have to pin that wave size (the device runs more than one, needs shader model 6.6)
+    bool                m_bTileScatter = false; // Whether Scatter ranks a whole block at once instead of a row at a time
+    bool                m_bMatchScatter = false; // Whether Scatter ranks keys by matching digits within each wave instead of sorting them in LDS
+    bool                m_bWaveMatch = false;  // Whether the digit matching can use WaveMatch (shader model 6.5) instead of ballots
+    bool                m_bRegisterCount = false; // Whether Count counts digits in registers instead of with LDS atomics
+    std::vector<float>  m_SelectPercentiles;    // Percentiles looked up by the percentile queries (one select query each)
     
     // Sample resources
-    Texture             m_SrcKeyBuffers[3];     // 32 bit source key buffers (for 1080, 2K, 4K resolution)
-    CBV_SRV_UAV         m_SrcKeyUAVTable;       // 32 bit source key UAVs (for 1080, 2K, 4K resolution)
+    Texture             m_SrcKeyBuffers[4];     // 32 bit source key buffers (for 1080, 2K, 4K resolution, and custom key count)
+    CBV_SRV_UAV         m_SrcKeyUAVTable;       // 32 bit source key UAVs (for 1080, 2K, 4K resolution, and custom key count)
 
     Texture             m_SrcPayloadBuffers;    // 32 bit source payload buffers
     CBV_SRV_UAV         m_SrcPayloadUAV;        // 32 bit source payload UAVs
 
     Texture             m_DstKeyBuffers[2];     // 32 bit destination key buffers (when not doing in place writes)
     CBV_SRV_UAV         m_DstKeyUAVTable;       // 32 bit destination key UAVs
+    CBV_SRV_UAV         m_DstKeySRVTable;       // 32 bit destination key raw SRVs (read-only input)
+
+    Texture             m_SrcKey16Buffers[4];   // 16 bit source key buffers (only with 16-bit key storage)
+    Texture             m_DstKey16Buffers[2];   // 16 bit destination key buffers (only with 16-bit key storage)
+    CBV_SRV_UAV         m_DstKey16UAVTable;     // 16 bit destination key UAVs
 
     Texture             m_DstPayloadBuffers[2]; // 32 bit destination payload buffers (when not doing in place writes)
     CBV_SRV_UAV         m_DstPayloadUAVTable;   // 32 bit destination payload UAVs
+    CBV_SRV_UAV         m_DstPayloadSRVTable;   // 32 bit destination payload raw SRVs (read-only input)
+
+    Texture             m_DirtyKeyBuffers[2];   // Keys changed since last frame (incremental re-sort, sorted in place)
+    CBV_SRV_UAV         m_DirtyKeyUAVTable;     // Dirty key UAVs
+    CBV_SRV_UAV         m_DirtyKeySRVTable;     // Dirty key raw SRVs (read-only input)
+    Texture             m_DirtyPayloadBuffers[2];   // Payloads of the keys changed since last frame
+    CBV_SRV_UAV         m_DirtyPayloadUAVTable;     // Dirty payload UAVs
+    CBV_SRV_UAV         m_DirtyPayloadSRVTable;     // Dirty payload raw SRVs (read-only input)
+    Texture             m_DirtyIndexBuffer;     // Where the changed keys were in last frame's order
+    CBV_SRV_UAV         m_DirtyIndexUAV;        // Dirty index UAV
+    Texture             m_PayloadIndexBuffer;   // Source indices carried through the passes by deferred payload gathers
+    CBV_SRV_UAV         m_PayloadIndexUAV;      // Payload index UAV
+    CBV_SRV_UAV         m_PayloadIndexSRV;      // Payload index raw SRV (read-only input)
+    Texture             m_KeyRecordBuffer;      // Keys spread out into records (sorting a key field of an array of structs)
+    CBV_SRV_UAV         m_KeyRecordUAV;         // Key record UAV
+    Texture             m_RunOffsetBuffer;      // Where each sorted run starts in an out-of-core merge window
+    CBV_SRV_UAV         m_RunOffsetUAV;         // Run offsets UAV
 
     // Resources         for parallel sort algorithm
-    Texture             m_FPSScratchBuffer;             // Sort scratch buffer
-    CBV_SRV_UAV         m_FPSScratchUAV;                // UAV needed for sort scratch buffer
-    Texture             m_FPSReducedScratchBuffer;      // Sort reduced scratch buffer
-    CBV_SRV_UAV         m_FPSReducedScratchUAV;         // UAV needed for sort reduced scratch buffer
+    std::vector<std::unique_ptr<SortContext>> m_SortContexts;   // Pool of per-sort scratch and indirect resources
+    SortContext*        m_pDefaultSortContext = nullptr;        // Context Sort() uses when it isn't handed one
+    std::mutex          m_SortContextMutex;
+    std::mutex          m_ConstantBufferMutex;          // The constant buffer ring is shared by all contexts
+    uint32_t            m_ScratchBufferSize = 0;
+    uint32_t            m_ReducedScratchBufferSize = 0;
+    uint32_t            m_ScanBlockBufferSize = 0;
+    Texture             m_FPSSelectStateBuffer;         // Selection thresholds, compaction counters and percentiles (selected keys come first)
+    CBV_SRV_UAV         m_FPSSelectStateUAV;            // UAV needed for select state buffer
         
     ID3D12RootSignature* m_pFPSRootSignature            = nullptr;
-    ID3D12PipelineState* m_pFPSCountPipeline            = nullptr;
-    ID3D12PipelineState* m_pFPSCountReducePipeline      = nullptr;
-    ID3D12PipelineState* m_pFPSScanPipeline             = nullptr;
-    ID3D12PipelineState* m_pFPSScanAddPipeline          = nullptr;
-    ID3D12PipelineState* m_pFPSScatterPipeline          = nullptr;
-    ID3D12PipelineState* m_pFPSScatterPayloadPipeline   = nullptr;
+    FPSPipeline          m_FPSCountPipeline;
+    FPSPipeline          m_FPSCountReducePipeline;
+    FPSPipeline          m_FPSScanPipeline;
+    FPSPipeline          m_FPSScanAddPipeline;
+    FPSPipeline          m_FPSReduceScanAddPipeline;
+    FPSPipeline          m_FPSScanBlockReducePipeline;
+    FPSPipeline          m_FPSScanBlockSumsPipeline;
+    FPSPipeline          m_FPSScanBlockAddPipeline;
+    FPSPipeline          m_FPSScatterPipeline;
+    FPSPipeline          m_FPSScatterPayloadPipeline;
+    FPSPipeline          m_FPSScatterIndexPipeline;
+    FPSPipeline          m_FPSGatherPayloadPipeline;
+    FPSPipeline          m_FPSPackKeyIndexPipeline;
+    FPSPipeline          m_FPSUnpackKeyIndexPipeline;
+    FPSPipeline          m_FPSCountLoadKeyPipeline;
+    FPSPipeline          m_FPSScatterLoadKeyPipeline;
+    FPSPipeline          m_FPSScatterLoadKeyPayloadPipeline;
+    FPSPipeline          m_FPSScatterStoreKeyPipeline;
+    FPSPipeline          m_FPSScatterStoreKeyPayloadPipeline;
+    FPSPipeline          m_FPSWriteKeyRecordsPipeline;
+    FPSPipeline          m_FPSCountKeyRecordsPipeline;
+    FPSPipeline          m_FPSScatterKeyRecordsPipeline;
+    FPSPipeline          m_FPSScatterKeyRecordsPayloadPipeline;
+    FPSPipeline          m_FPSCountReadOnlyPipeline;
+    FPSPipeline          m_FPSScatterReadOnlyPipeline;
+    FPSPipeline          m_FPSScatterReadOnlyPayloadPipeline;
+    FPSPipeline          m_FPSCount16BitPipeline;
+    FPSPipeline          m_FPSScatter16BitPipeline;
+    FPSPipeline          m_FPSScatter16BitPayloadPipeline;
+    FPSPipeline          m_FPSSelectCountPipeline;
+    FPSPipeline          m_FPSSelectReducePipeline;
+    FPSPipeline          m_FPSSelectDigitPipeline;
+    FPSPipeline          m_FPSSelectCompactPipeline;
+    FPSPipeline          m_FPSSelectCompactPayloadPipeline;
+    FPSPipeline          m_FPSGenerateDirtyKeysPipeline;
+    FPSPipeline          m_FPSGatherDirtyPayloadPipeline;
+    FPSPipeline          m_FPSMergePipeline;
+    FPSPipeline          m_FPSMergePayloadPipeline;
+    FPSPipeline          m_FPSMergeRunsPipeline;
         
     // Resources for indirect execution of algorithm
     Texture             m_IndirectKeyCounts;            // Buffer to hold num keys for indirect dispatch
     CBV_SRV_UAV         m_IndirectKeyCountsUAV;         // UAV needed for num keys buffer
-    Texture             m_IndirectConstantBuffer;       // Buffer to hold radix sort constant buffer data for indirect dispatch
-    CBV_SRV_UAV         m_IndirectConstantBufferUAV;    // UAV needed for indirect constant buffer
-    Texture             m_IndirectCountScatterArgs;     // Buffer to hold dispatch arguments used for Count/Scatter parts of the algorithm
-    CBV_SRV_UAV         m_IndirectCountScatterArgsUAV;  // UAV needed for count/scatter args buffer
-    Texture             m_IndirectReduceScanArgs;       // Buffer to hold dispatch arguments used for Reduce/Scan parts of the algorithm
-    CBV_SRV_UAV         m_IndirectReduceScanArgsUAV;    // UAV needed for reduce/scan args buffer
+    Texture             m_PresortStateBuffer;           // Inversion counts for skipping sorts of keys that are already in order
+    CBV_SRV_UAV         m_PresortStateUAV;              // UAV needed for presort state buffer
+    ID3D12Resource*     m_pPresortReadBackBuffer = nullptr;     // Ring of inversion counts found by the presort checks (persistently mapped)
+    uint32_t*           m_pPresortInversions = nullptr;
+    Texture             m_ValidateStateBuffer;          // GPU validation checksums and result record
+    CBV_SRV_UAV         m_ValidateStateUAV;             // UAV needed for validate state buffer
+    ID3D12Resource*     m_pValidateReadBackBuffer = nullptr;    // Ring of GPU validation result records (persistently mapped)
+    uint32_t*           m_pValidateResults = nullptr;
+    ID3D12Resource*     m_pPercentileReadBackBuffer = nullptr;  // Ring of keys found by the percentile queries (persistently mapped)
+    uint32_t*           m_pPercentileResults = nullptr;
         
     ID3D12CommandSignature* m_pFPSCommandSignature;
-    ID3D12PipelineState*    m_pFPSIndirectSetupParametersPipeline = nullptr;
+    FPSPipeline             m_FPSIndirectSetupParametersPipeline;
+    FPSPipeline             m_FPSIndirectSetupPresortPipeline;
+    FPSPipeline             m_FPSCountInversionsPipeline;
+    FPSPipeline             m_FPSValidateInputPipeline;
+    FPSPipeline             m_FPSValidateInputPayloadPipeline;
+    FPSPipeline             m_FPSValidateOutputPipeline;
+    FPSPipeline             m_FPSValidateOutputPayloadPipeline;
+    FPSPipeline             m_FPSValidateResultPipeline;
+    FPSPipeline             m_FPSValidateInput16BitPipeline;
+    FPSPipeline             m_FPSValidateInput16BitPayloadPipeline;
+    FPSPipeline             m_FPSValidateOutput16BitPipeline;
+    FPSPipeline             m_FPSValidateOutput16BitPayloadPipeline;
         
     // Resources for verification render
     ID3D12RootSignature* m_pRenderRootSignature = nullptr;
@@ -139,11 +386,53 @@ private:
     HANDLE                  m_ReadBackFenceEvent;
 #ifdef DEVELOPERMODE
     bool                    m_UIValidateSortResults = false;    // Validate the results
+    uint32_t                m_NumValidationKeys = 0;            // How many sorted keys were read back
+    bool                    m_bValidationHasInput = false;      // Whether the keys going in were read back too (full sorts only)
+    bool                    m_bValidationHasPayload = false;    // Whether payloads were read back along with the keys
+    bool                    m_bValidation16BitKeys = false;     // Whether the keys were read back as 16-bit values
 #endif // DEVELOPERMODE
 
     // Options for UI and test to run
     int m_UIResolutionSize = 0;
     bool m_UISortPayload = false;
+    bool m_UIDeferredPayload = false;
+    bool m_UIKeyHooks = false;
+    bool m_UIKeyRecords = false;
+    bool m_UIReadOnlyInput = false;
+    bool m_UI16BitKeys = false;
+    bool m_UIPackedKeyIndex = false;
     bool m_UIIndirectSort = false;
     int m_UIVisualOutput = 0;
+    bool m_UIStageTimings = false;
+    bool m_UISelectTopK = false;
+    int m_UISelectNumKeys = 4096;
+    bool m_UISelectPercentiles = false;
+    static const uint32_t ReadBackLatency = 3;          // Frames before a result copied back from the GPU is looked at (the frames in flight)
+    bool m_UIPresortCheck = false;
+    uint32_t m_NumPresortChecks = 0;        // Presort checks recorded so far (picks their read-back slot)
+    uint32_t m_PresortCheckFrame[ReadBackLatency] = {};   // Frame each read-back slot's inversion count was copied in
+    uint32_t m_LastPresortInversions = 0;   // Out of order neighbours found by the latest presort check that was read back
+    uint32_t m_NumPercentileReadBacks = 0;  // Percentile selections recorded so far (picks their read-back slot)
+    uint32_t m_PercentileReadBackFrame[ReadBackLatency] = {};   // Frame each read-back slot's keys were copied in
+    int m_PercentileReadBackKeySet[ReadBackLatency] = {};       // Key set each read-back slot's keys were selected from (-1 if the keys were changed)
+    std::vector<uint32_t> m_PercentileKeys;   // Keys found by the latest percentile selection that was read back
+    int m_PercentileKeySet = -1;              // Key set they were selected from
+    std::vector<uint32_t> m_ExpectedPercentileKeys[4];  // What the CPU finds for each percentile of each key set (single word keys only)
+    bool m_UITemporalCoherence = false;
+    int m_TemporalKeySet = -1;          // Key set last frame's sorted keys came from (re-sorted in place with temporal coherence)
+    int m_KeyRecordSet = -1;            // Key set the key records were written for
+    bool m_UIIncrementalSort = false;
+    int m_UIDirtyKeyPercent = 2;
+    bool m_bSortedKeysInPlace = false;  // Whether the sort buffers hold last frame's sorted keys (what the incremental re-sort merges into)
+    uint32_t m_DirtyKeySeed = 0;        // Changes every frame so different keys get changed
+    uint32_t m_OutOfCoreChunkKeys = 0;  // Keys in the out-of-core chunk being sorted (0 outside of out-of-core sorts)
+    bool m_UIGPUValidation = false;
+    static const uint32_t GPUValidationSlots = 8;       // Read-back slots for GPU validation result records (room for a few validated sorts a frame)
+    uint32_t m_FrameCount = 0;                          // Frames started so far (tells when a read-back slot's copy has landed)
+    uint32_t m_GPUValidationSlot = 0;                   // Slot the next validated sort copies its result record into
+    bool m_bGPUValidationPending[GPUValidationSlots] = {};
+    uint32_t m_GPUValidationSlotFrame[GPUValidationSlots] = {};  // Frame each pending record was copied in
+    uint32_t m_NumGPUValidations = 0;
+    uint32_t m_NumGPUValidationFailures = 0;
+    std::string m_LastGPUValidationFailure;
 };
\ No newline at end of file
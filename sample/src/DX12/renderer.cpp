@@ -134,6 +134,7 @@ void Renderer::OnRender(const UIState* pState, SwapChain* pSwapChain, float Time
     m_CommandListRing.OnBeginFrame();
     m_ConstantBufferRing.OnBeginFrame();
     m_GPUTimer.OnBeginFrame(gpuTicksPerSecond, &m_TimeStamps);
+    m_ParallelSort.UpdateStageTimings(m_TimeStamps, "FFX Parallel Sort");
 
     // command buffer calls
     ID3D12GraphicsCommandList* pCmdLst1 = m_CommandListRing.GetNewCommandList();
@@ -144,7 +145,7 @@ void Renderer::OnRender(const UIState* pState, SwapChain* pSwapChain, float Time
     m_GPUTimer.GetTimeStamp(pCmdLst1, "Begin Frame");
 
     // Do sort tests -----------------------------------------------------------------------
-    m_ParallelSort.Sort(pCmdLst1, bIsBenchmarking, Time);
+    m_ParallelSort.Sort(pCmdLst1, bIsBenchmarking, Time, &m_GPUTimer);
     m_GPUTimer.GetTimeStamp(pCmdLst1, "FFX Parallel Sort");
 
     // submit command buffer #1
@@ -20,11 +20,14 @@
 #include "stdafx.h"
 #include "../../../FFX-ParallelSort/FFX_ParallelSort.h"
 
+#include <algorithm>
+#include <chrono>
 #include <numeric>
 #include <random>
 #include <vector>
 
-static const uint32_t NumKeys[] = { 1920 * 1080, 2560 * 1440, 3840 * 2160 };
+static const uint32_t MaxDispatchThreadGroups = 65535; // Most thread groups a dispatch can have along X (what every device supports)
+static const int MaxDirtyKeyPercent = 10;   // Most keys the incremental re-sort can change per frame (what the dirty buffers are sized for)
 
 
 //////////////////////////////////////////////////////////////////////////
@@ -39,13 +42,304 @@ void FFXParallelSort::OverridePayload()
 {
     PayloadOverride = true;
 }
+bool FFXParallelSort::AsyncPipelineOverride = false;
+void FFXParallelSort::OverrideAsyncPipelineCreation()
+{
+    AsyncPipelineOverride = true;
+}
+bool FFXParallelSort::StageTimingsOverride = false;
+void FFXParallelSort::OverrideStageTimings()
+{
+    StageTimingsOverride = true;
+}
+int FFXParallelSort::KeyDistributionOverride = FFXParallelSort::KeyDistribution_Permutation;
+void FFXParallelSort::OverrideKeyDistribution(int Distribution)
+{
+    KeyDistributionOverride = Distribution;
+}
+uint32_t FFXParallelSort::KeySeedOverride = 0x5eed;
+void FFXParallelSort::OverrideKeySeed(uint32_t Seed)
+{
+    KeySeedOverride = Seed;
+}
+uint32_t FFXParallelSort::NumKeysOverride = 0;
+void FFXParallelSort::OverrideNumKeys(uint32_t NumKeys)
+{
+    NumKeysOverride = NumKeys;
+}
+uint32_t FFXParallelSort::MaxThreadGroupsOverride = 0;
+void FFXParallelSort::OverrideMaxThreadGroups(uint32_t MaxThreadGroups)
+{
+    MaxThreadGroupsOverride = MaxThreadGroups;
+}
+uint32_t FFXParallelSort::KeyWordsOverride = 0;
+void FFXParallelSort::OverrideKeyWords(uint32_t NumKeyWords)
+{
+    KeyWordsOverride = NumKeyWords;
+}
+uint32_t FFXParallelSort::TopKOverride = 0;
+void FFXParallelSort::OverrideTopK(uint32_t NumSelectKeys)
+{
+    TopKOverride = NumSelectKeys;
+}
+std::vector<float> FFXParallelSort::PercentilesOverride;
+void FFXParallelSort::OverridePercentiles(const std::vector<float>& Percentiles)
+{
+    PercentilesOverride = Percentiles;
+}
+bool FFXParallelSort::PresortCheckOverride = false;
+void FFXParallelSort::OverridePresortCheck()
+{
+    PresortCheckOverride = true;
+}
+bool FFXParallelSort::TemporalCoherenceOverride = false;
+void FFXParallelSort::OverrideTemporalCoherence()
+{
+    TemporalCoherenceOverride = true;
+}
+uint32_t FFXParallelSort::IncrementalSortOverride = 0;
+void FFXParallelSort::OverrideIncrementalSort(uint32_t DirtyKeyPercent)
+{
+    IncrementalSortOverride = DirtyKeyPercent;
+}
+uint32_t FFXParallelSort::OutOfCoreOverride = 0;
+void FFXParallelSort::OverrideOutOfCore(uint32_t NumKeys)
+{
+    OutOfCoreOverride = NumKeys;
+}
+bool FFXParallelSort::GPUValidationOverride = false;
+void FFXParallelSort::OverrideGPUValidation()
+{
+    GPUValidationOverride = true;
+}
+bool FFXParallelSort::DeferredPayloadOverride = false;
+void FFXParallelSort::OverrideDeferredPayload()
+{
+    DeferredPayloadOverride = true;
+}
+bool FFXParallelSort::KeyHooksOverride = false;
+void FFXParallelSort::OverrideKeyHooks()
+{
+    KeyHooksOverride = true;
+}
+uint32_t FFXParallelSort::KeyRecordStrideOverride = 0;
+uint32_t FFXParallelSort::KeyRecordOffsetOverride = 0;
+void FFXParallelSort::OverrideKeyRecords(uint32_t StrideInBytes, uint32_t OffsetInBytes)
+{
+    // Records are read as uints, so the key has to be a whole uint of a record made of whole uints
+    KeyRecordStrideOverride = std::max(StrideInBytes & ~3u, (uint32_t)sizeof(uint32_t));
+    KeyRecordOffsetOverride = std::min(OffsetInBytes & ~3u, KeyRecordStrideOverride - (uint32_t)sizeof(uint32_t));
+}
+bool FFXParallelSort::ReadOnlyInputOverride = false;
+void FFXParallelSort::OverrideReadOnlyInput()
+{
+    ReadOnlyInputOverride = true;
+}
+bool FFXParallelSort::PackedKeyIndexOverride = false;
+void FFXParallelSort::OverridePackedKeyIndex()
+{
+    PackedKeyIndexOverride = true;
+}
+int FFXParallelSort::WaveSizeOverride = -1;
+void FFXParallelSort::OverrideWaveSize(uint32_t WaveSize)
+{
+    WaveSizeOverride = (int)WaveSize;
+}
+bool FFXParallelSort::TileScatterOverride = false;
+void FFXParallelSort::OverrideTileScatter()
+{
+    TileScatterOverride = true;
+}
+bool FFXParallelSort::RegisterCountOverride = false;
+void FFXParallelSort::OverrideRegisterCount()
+{
+    RegisterCountOverride = true;
+}
+bool FFXParallelSort::MatchScatterOverride = false;
+void FFXParallelSort::OverrideMatchScatter()
+{
+    MatchScatterOverride = true;
+}
+uint32_t FFXParallelSort::KeyBitsOverride = 0;
+void FFXParallelSort::OverrideKeyBits(uint32_t KeyBits)
+{
+    // Keys are sorted a digit at a time, so the width goes up to the next whole digit
+    KeyBitsOverride = std::min(std::max((KeyBits + FFX_PARALLELSORT_SORT_BITS_PER_PASS - 1) & ~(FFX_PARALLELSORT_SORT_BITS_PER_PASS - 1), (uint32_t)FFX_PARALLELSORT_SORT_BITS_PER_PASS), 32u);
+}
+//////////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////////
+// Key data generation
+
+static const char* KeyDistributionNames[] = { "permutation", "uniform", "sorted", "reverse", "nearlysorted", "fewunique", "zipf", "constanthighbits" };
+static_assert(_countof(KeyDistributionNames) == FFXParallelSort::KeyDistribution_Count, "Missing key distribution name");
+
+const char* FFXParallelSort::GetKeyDistributionName(int Distribution)
+{
+    return KeyDistributionNames[Distribution];
+}
+
+int FFXParallelSort::GetKeyDistributionFromName(const std::string& Name)
+{
+    for (int i = 0; i < KeyDistribution_Count; ++i)
+    {
+        if (!Name.compare(KeyDistributionNames[i]))
+            return i;
+    }
+    return -1;
+}
+
+// Used to tag benchmark results with the data that was sorted
+std::string FFXParallelSort::GetKeyDataSuffix()
+{
+    std::string Suffix = std::string("_") + KeyDistributionNames[KeyDistributionOverride] + "_seed" + std::to_string(KeySeedOverride);
+    if (NumKeysOverride)
+        Suffix += "_keys" + std::to_string(NumKeysOverride);
+    if (KeyWordsOverride > 1)
+        Suffix += "_words" + std::to_string(KeyWordsOverride);
+    if (TopKOverride)
+        Suffix += "_topk" + std::to_string(TopKOverride);
+    if (!PercentilesOverride.empty())
+        Suffix += "_percentiles" + std::to_string(PercentilesOverride.size());
+    if (PresortCheckOverride)
+        Suffix += "_presort";
+    if (TemporalCoherenceOverride)
+        Suffix += "_temporal";
+    if (IncrementalSortOverride)
+        Suffix += "_incremental" + std::to_string(IncrementalSortOverride);
+    if (OutOfCoreOverride)
+        Suffix += "_outofcore" + std::to_string(OutOfCoreOverride);
+    if (GPUValidationOverride)
+        Suffix += "_gpuvalidate";
+    if (DeferredPayloadOverride)
+        Suffix += "_deferredpayload";
+    if (KeyHooksOverride)
+        Suffix += "_keyhooks";
+    if (KeyRecordStrideOverride)
+        Suffix += "_keyrecords" + std::to_string(KeyRecordStrideOverride) + "_" + std::to_string(KeyRecordOffsetOverride);
+    if (ReadOnlyInputOverride)
+        Suffix += "_readonly";
+    if (KeyBitsOverride && KeyBitsOverride < 32)
+        Suffix += "_keybits" + std::to_string(KeyBitsOverride);
+    if (PackedKeyIndexOverride)
+        Suffix += "_packedkeyindex";
+    if (WaveSizeOverride >= 0)
+        Suffix += "_wave" + std::to_string(WaveSizeOverride);
+    if (TileScatterOverride)
+        Suffix += "_tilescatter";
+    if (RegisterCountOverride)
+        Suffix += "_registercount";
+    if (MatchScatterOverride)
+        Suffix += "_matchscatter";
+    return Suffix;
+}
+
+// Whether the generated keys are a permutation of 0..N-1
+static bool KeysArePermutation(int Distribution)
+{
+    return Distribution == FFXParallelSort::KeyDistribution_Permutation || Distribution == FFXParallelSort::KeyDistribution_Sorted ||
+           Distribution == FFXParallelSort::KeyDistribution_ReverseSorted || Distribution == FFXParallelSort::KeyDistribution_NearlySorted;
+}
+
+// Fill the key buffer following the requested distribution (everything is driven by the seed)
+static void GenerateKeys(std::vector<uint32_t>& Keys, int Distribution, uint32_t Seed)
+{
+    std::mt19937 Generator(Seed);
+    switch (Distribution)
+    {
+    case FFXParallelSort::KeyDistribution_Permutation:
+        std::iota(Keys.begin(), Keys.end(), 0);
+        std::shuffle(Keys.begin(), Keys.end(), Generator);
+        break;
+
+    case FFXParallelSort::KeyDistribution_Uniform:
+        for (uint32_t& Key : Keys)
+            Key = Generator();
+        break;
+
+    case FFXParallelSort::KeyDistribution_Sorted:
+        std::iota(Keys.begin(), Keys.end(), 0);
+        break;
+
+    case FFXParallelSort::KeyDistribution_ReverseSorted:
+        std::iota(Keys.rbegin(), Keys.rend(), 0);
+        break;
+
+    case FFXParallelSort::KeyDistribution_NearlySorted:
+    {
+        std::iota(Keys.begin(), Keys.end(), 0);
+        std::uniform_int_distribution<size_t> Index(0, Keys.size() - 1);
+        for (size_t i = 0; i < Keys.size() / 100; ++i)
+        {
+            // Draw the indices in a fixed order (argument evaluation order is unspecified), so a seed gives the same keys everywhere
+            size_t First = Index(Generator);
+            size_t Second = Index(Generator);
+            std::swap(Keys[First], Keys[Second]);
+        }
+        break;
+    }
+
+    case FFXParallelSort::KeyDistribution_FewUnique:
+    {
+        uint32_t Values[16];
+        for (uint32_t& Value : Values)
+            Value = Generator();
+        for (uint32_t& Key : Keys)
+            Key = Values[Generator() % _countof(Values)];
+        break;
+    }
+
+    case FFXParallelSort::KeyDistribution_Zipf:
+    {
+        // Build the CDF for ranks 1..NumValues and give each rank a random 32-bit value so all digits get exercised
+        const size_t NumValues = 64 * 1024;
+        std::vector<double> CDF(NumValues);
+        std::vector<uint32_t> Values(NumValues);
+        double Sum = 0.0;
+        for (size_t i = 0; i < NumValues; ++i)
+        {
+            Sum += 1.0 / double(i + 1);
+            CDF[i] = Sum;
+            Values[i] = Generator();
+        }
+
+        std::uniform_real_distribution<double> Draw(0.0, Sum);
+        for (uint32_t& Key : Keys)
+        {
+            size_t Rank = std::upper_bound(CDF.begin(), CDF.end(), Draw(Generator)) - CDF.begin();
+            Key = Values[std::min(Rank, NumValues - 1)];
+        }
+        break;
+    }
+
+    case FFXParallelSort::KeyDistribution_ConstantHighBits:
+        for (uint32_t& Key : Keys)
+            Key = 0x3F800000 | (Generator() & 0x007FFFFF);
+        break;
+
+    default:
+        assert(false && "Unknown key distribution");
+        break;
+    }
+}
+
+// Shift a key set down until its biggest key fits in KeyBits bits (keeps the order of the keys, and leaves key sets that already fit alone)
+static void NarrowKeys(std::vector<uint32_t>& Keys, uint32_t KeyBits)
+{
+    uint32_t MaxKey = Keys.empty() ? 0 : *std::max_element(Keys.begin(), Keys.end());
+    uint32_t Shift = 0;
+    while (KeyBits < 32 && (MaxKey >> Shift) >> KeyBits)
+        ++Shift;
+    for (uint32_t& Key : Keys)
+        Key >>= Shift;
+}
 //////////////////////////////////////////////////////////////////////////
 
 //////////////////////////////////////////////////////////////////////////
 // Helper functions for Vulkan
 
 // Transition barrier
-VkBufferMemoryBarrier BufferTransition(VkBuffer buffer, VkAccessFlags before, VkAccessFlags after, uint32_t size)
+VkBufferMemoryBarrier BufferTransition(VkBuffer buffer, VkAccessFlags before, VkAccessFlags after, VkDeviceSize size)
 {
     VkBufferMemoryBarrier bufferBarrier = {};
     bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
@@ -101,29 +395,17 @@ void FFXParallelSort::BindUAVBuffer(VkBuffer* pBuffer, VkDescriptorSet& Descript
 
     vkUpdateDescriptorSets(m_pDevice->GetDevice(), 1, &write_set, 0, nullptr);
 }
-//////////////////////////////////////////////////////////////////////////
 
-// Create all of the sort data for the sample
-void FFXParallelSort::CreateKeyPayloadBuffers()
+// Allocate the scratch and indirect buffers one sort needs while it runs, and the descriptor sets they (and its constants) are
+// bound through (called with m_SortContextMutex held)
+FFXParallelSort::SortContext* FFXParallelSort::CreateSortContext()
 {
-    std::vector<uint32_t> KeyData1080(NumKeys[0]);
-    std::vector<uint32_t> KeyData2K(NumKeys[1]);
-    std::vector<uint32_t> KeyData4K(NumKeys[2]);
-                
-    // Populate the buffers with linear access index
-    std::iota(KeyData1080.begin(), KeyData1080.end(), 0);
-    std::iota(KeyData2K.begin(), KeyData2K.end(), 0);
-    std::iota(KeyData4K.begin(), KeyData4K.end(), 0);
-
-    // Shuffle the data
-    std::shuffle(KeyData1080.begin(), KeyData1080.end(), std::mt19937{ std::random_device{}() });
-    std::shuffle(KeyData2K.begin(), KeyData2K.end(), std::mt19937{ std::random_device{}() });
-    std::shuffle(KeyData4K.begin(), KeyData4K.end(), std::mt19937{ std::random_device{}() });
+    std::unique_ptr<SortContext> Context(new SortContext);
 
     VkBufferCreateInfo bufferCreateInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
     bufferCreateInfo.pNext = nullptr;
     bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    bufferCreateInfo.usage = VK_BUFFER_USAGE_STORAGE_TEXEL_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    bufferCreateInfo.usage = VK_BUFFER_USAGE_STORAGE_TEXEL_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
 
     VmaAllocationCreateInfo allocCreateInfo = {};
     allocCreateInfo.memoryTypeBits = 0;
@@ -131,40 +413,304 @@ void FFXParallelSort::CreateKeyPayloadBuffers()
     allocCreateInfo.preferredFlags = 0;
     allocCreateInfo.requiredFlags = 0;
     allocCreateInfo.usage = VMA_MEMORY_USAGE_UNKNOWN;
-        
-    // 1080p
-    bufferCreateInfo.size = sizeof(uint32_t) * NumKeys[0];
-    allocCreateInfo.pUserData = "SrcKeys1080";
-    if (VK_SUCCESS != vmaCreateBuffer(m_pDevice->GetAllocator(), &bufferCreateInfo, &allocCreateInfo, &m_SrcKeyBuffers[0], &m_SrcKeyBufferAllocations[0], nullptr))
+
+    bufferCreateInfo.size = m_ScratchBufferSize;
+    allocCreateInfo.pUserData = "Scratch";
+    if (VK_SUCCESS != vmaCreateBuffer(m_pDevice->GetAllocator(), &bufferCreateInfo, &allocCreateInfo, &Context->ScratchBuffer, &Context->ScratchBufferAllocation, nullptr))
+    {
+        Trace("Failed to create buffer for Scratch");
+    }
+
+    bufferCreateInfo.size = m_ReducedScratchBufferSize;
+    allocCreateInfo.pUserData = "ReducedScratch";
+    if (VK_SUCCESS != vmaCreateBuffer(m_pDevice->GetAllocator(), &bufferCreateInfo, &allocCreateInfo, &Context->ReducedScratchBuffer, &Context->ReducedScratchBufferAllocation, nullptr))
+    {
+        Trace("Failed to create buffer for ReducedScratch");
+    }
+
+    bufferCreateInfo.size = m_ScanBlockBufferSize;
+    allocCreateInfo.pUserData = "ScanBlockScratch";
+    if (VK_SUCCESS != vmaCreateBuffer(m_pDevice->GetAllocator(), &bufferCreateInfo, &allocCreateInfo, &Context->ScanBlockBuffer, &Context->ScanBlockBufferAllocation, nullptr))
+    {
+        Trace("Failed to create buffer for ScanBlockScratch");
+    }
+
+    // Buffers for indirect execution of the algorithm
+    bufferCreateInfo.size = sizeof(uint32_t) * 3;
+    bufferCreateInfo.usage = VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_TEXEL_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    allocCreateInfo.pUserData = "IndirectCount_Scatter_DispatchArgs";
+    if (VK_SUCCESS != vmaCreateBuffer(m_pDevice->GetAllocator(), &bufferCreateInfo, &allocCreateInfo, &Context->IndirectCountScatterArgs, &Context->IndirectCountScatterArgsAllocation, nullptr))
+    {
+        Trace("Failed to create buffer for IndirectCount_Scatter_DispatchArgs");
+    }
+
+    bufferCreateInfo.size = sizeof(uint32_t) * 6;    // Reduce/scan args followed by scan block args
+    allocCreateInfo.pUserData = "IndirectReduceScanArgs";
+    if (VK_SUCCESS != vmaCreateBuffer(m_pDevice->GetAllocator(), &bufferCreateInfo, &allocCreateInfo, &Context->IndirectReduceScanArgs, &Context->IndirectReduceScanArgsAllocation, nullptr))
+    {
+        Trace("Failed to create buffer for IndirectReduceScanArgs");
+    }
+
+    bufferCreateInfo.size = sizeof(FFX_ParallelSortCB);
+    bufferCreateInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_TEXEL_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    allocCreateInfo.pUserData = "IndirectConstantBuffer";
+    if (VK_SUCCESS != vmaCreateBuffer(m_pDevice->GetAllocator(), &bufferCreateInfo, &allocCreateInfo, &Context->IndirectConstantBuffer, &Context->IndirectConstantBufferAllocation, nullptr))
+    {
+        Trace("Failed to create buffer for IndirectConstantBuffer");
+    }
+
+    // Descriptor sets
+    bool bDescriptorAlloc = true;
+    for (int i = 0; i < 3; ++i)
+    {
+        bDescriptorAlloc &= m_pResourceViewHeaps->AllocDescriptor(m_SortDescriptorSetLayoutConstants, &Context->DescriptorSetConstants[i]);
+        bDescriptorAlloc &= m_pResourceViewHeaps->AllocDescriptor(m_SortDescriptorSetLayoutConstants, &Context->DescriptorSetConstantsSelect[i]);
+        bDescriptorAlloc &= m_pResourceViewHeaps->AllocDescriptor(m_SortDescriptorSetLayoutConstants, &Context->DescriptorSetConstantsMerge[i]);
+        bDescriptorAlloc &= m_pResourceViewHeaps->AllocDescriptor(m_SortDescriptorSetLayoutConstants, &Context->DescriptorSetConstantsKeyRecords[i]);
+        bDescriptorAlloc &= m_pResourceViewHeaps->AllocDescriptor(m_SortDescriptorSetLayoutConstantsIndirect, &Context->DescriptorSetConstantsIndirect[i]);
+        bDescriptorAlloc &= m_pResourceViewHeaps->AllocDescriptor(m_SortDescriptorSetLayoutConstantsIndirect, &Context->DescriptorSetConstantsValidate[i]);
+    }
+    for (int i = 0; i < 5; ++i)
+        bDescriptorAlloc &= m_pResourceViewHeaps->AllocDescriptor(m_SortDescriptorSetLayoutScan, &Context->DescriptorSetScanSets[i]);
+    bDescriptorAlloc &= m_pResourceViewHeaps->AllocDescriptor(m_SortDescriptorSetLayoutScratch, &Context->DescriptorSetScratch);
+    bDescriptorAlloc &= m_pResourceViewHeaps->AllocDescriptor(m_SortDescriptorSetLayoutIndirect, &Context->DescriptorSetIndirect);
+    bDescriptorAlloc &= m_pResourceViewHeaps->AllocDescriptor(m_SortDescriptorSetLayoutInputOutputs, &Context->DescriptorSetInputOutput[0]);
+    bDescriptorAlloc &= m_pResourceViewHeaps->AllocDescriptor(m_SortDescriptorSetLayoutInputOutputs, &Context->DescriptorSetInputOutput[1]);
+    assert(bDescriptorAlloc == true);
+
+    // Map scan sets (reduced, scratch)
+    VkBuffer BufferMaps[6];
+    BufferMaps[0] = BufferMaps[1] = Context->ReducedScratchBuffer;
+    BindUAVBuffer(BufferMaps, Context->DescriptorSetScanSets[0], 0, 2);
+
+    BufferMaps[0] = BufferMaps[1] = Context->ScratchBuffer;
+    BufferMaps[2] = Context->ReducedScratchBuffer;
+    BindUAVBuffer(BufferMaps, Context->DescriptorSetScanSets[1], 0, 3);
+
+    // Map scan block sets (reduced -> partial sums, partial sums, reduced + partial sums)
+    BufferMaps[0] = Context->ReducedScratchBuffer;
+    BufferMaps[1] = BufferMaps[2] = Context->ScanBlockBuffer;
+    BindUAVBuffer(BufferMaps, Context->DescriptorSetScanSets[2], 0, 3);
+
+    BufferMaps[0] = BufferMaps[1] = BufferMaps[2] = Context->ScanBlockBuffer;
+    BindUAVBuffer(BufferMaps, Context->DescriptorSetScanSets[3], 0, 3);
+
+    BufferMaps[0] = BufferMaps[1] = Context->ReducedScratchBuffer;
+    BufferMaps[2] = Context->ScanBlockBuffer;
+    BindUAVBuffer(BufferMaps, Context->DescriptorSetScanSets[4], 0, 3);
+
+    // Map Scratch areas (fixed)
+    BufferMaps[0] = Context->ScratchBuffer;
+    BufferMaps[1] = Context->ReducedScratchBuffer;
+    BufferMaps[2] = m_FPSSelectStateBuffer;
+    BindUAVBuffer(BufferMaps, Context->DescriptorSetScratch, 0, 3);
+
+    // Map indirect buffers
+    BufferMaps[0] = m_IndirectKeyCounts;
+    BufferMaps[1] = Context->IndirectConstantBuffer;
+    BufferMaps[2] = Context->IndirectCountScatterArgs;
+    BufferMaps[3] = Context->IndirectReduceScanArgs;
+    BufferMaps[4] = m_PresortStateBuffer;
+    BufferMaps[5] = m_ValidateStateBuffer;
+    BindUAVBuffer(BufferMaps, Context->DescriptorSetIndirect, 0, 6);
+
+    m_SortContexts.push_back(std::move(Context));
+    return m_SortContexts.back().get();
+}
+
+void FFXParallelSort::DestroySortContext(SortContext& Context)
+{
+    vmaDestroyBuffer(m_pDevice->GetAllocator(), Context.ScratchBuffer, Context.ScratchBufferAllocation);
+    vmaDestroyBuffer(m_pDevice->GetAllocator(), Context.ReducedScratchBuffer, Context.ReducedScratchBufferAllocation);
+    vmaDestroyBuffer(m_pDevice->GetAllocator(), Context.ScanBlockBuffer, Context.ScanBlockBufferAllocation);
+    vmaDestroyBuffer(m_pDevice->GetAllocator(), Context.IndirectConstantBuffer, Context.IndirectConstantBufferAllocation);
+    vmaDestroyBuffer(m_pDevice->GetAllocator(), Context.IndirectCountScatterArgs, Context.IndirectCountScatterArgsAllocation);
+    vmaDestroyBuffer(m_pDevice->GetAllocator(), Context.IndirectReduceScanArgs, Context.IndirectReduceScanArgsAllocation);
+
+    for (int i = 0; i < 3; ++i)
+    {
+        m_pResourceViewHeaps->FreeDescriptor(Context.DescriptorSetConstants[i]);
+        m_pResourceViewHeaps->FreeDescriptor(Context.DescriptorSetConstantsSelect[i]);
+        m_pResourceViewHeaps->FreeDescriptor(Context.DescriptorSetConstantsMerge[i]);
+        m_pResourceViewHeaps->FreeDescriptor(Context.DescriptorSetConstantsKeyRecords[i]);
+        m_pResourceViewHeaps->FreeDescriptor(Context.DescriptorSetConstantsIndirect[i]);
+        m_pResourceViewHeaps->FreeDescriptor(Context.DescriptorSetConstantsValidate[i]);
+    }
+    for (int i = 0; i < 5; ++i)
+        m_pResourceViewHeaps->FreeDescriptor(Context.DescriptorSetScanSets[i]);
+    m_pResourceViewHeaps->FreeDescriptor(Context.DescriptorSetScratch);
+    m_pResourceViewHeaps->FreeDescriptor(Context.DescriptorSetIndirect);
+    m_pResourceViewHeaps->FreeDescriptor(Context.DescriptorSetInputOutput[0]);
+    m_pResourceViewHeaps->FreeDescriptor(Context.DescriptorSetInputOutput[1]);
+}
+
+FFXParallelSort::SortContext* FFXParallelSort::AcquireSortContext()
+{
+    std::lock_guard<std::mutex> lock(m_SortContextMutex);
+    for (std::unique_ptr<SortContext>& Context : m_SortContexts)
+    {
+        if (!Context->bInUse)
+        {
+            Context->bInUse = true;
+            return Context.get();
+        }
+    }
+
+    SortContext* pContext = CreateSortContext();
+    pContext->bInUse = true;
+    return pContext;
+}
+
+void FFXParallelSort::ReleaseSortContext(SortContext* pContext)
+{
+    std::lock_guard<std::mutex> lock(m_SortContextMutex);
+    assert(pContext->bInUse && pContext != m_pDefaultSortContext);
+    pContext->bInUse = false;
+}
+
+void FFXParallelSort::SetSortContextBuffers(SortContext* pContext, uint32_t NumKeys, const VkBuffer KeyBuffers[2], const VkBuffer* pPayloadBuffers/*=nullptr*/)
+{
+    assert(pContext->bInUse && pContext != m_pDefaultSortContext);
+    pContext->NumKeys = NumKeys;
+    for (int i = 0; i < 2; ++i)
     {
-        Trace("Failed to create buffer for SrcKeys1080");
+        pContext->KeyBuffers[i] = KeyBuffers[i];
+        pContext->PayloadBuffers[i] = pPayloadBuffers ? pPayloadBuffers[i] : VK_NULL_HANDLE;
     }
-    // 2K
-    bufferCreateInfo.size = sizeof(uint32_t) * NumKeys[1];
-    allocCreateInfo.pUserData = "SrcKeys2K";
-    if (VK_SUCCESS != vmaCreateBuffer(m_pDevice->GetAllocator(), &bufferCreateInfo, &allocCreateInfo, &m_SrcKeyBuffers[1], &m_SrcKeyBufferAllocations[1], nullptr))
+
+    // Map inputs/outputs (sorts without a payload never touch the payload bindings, they just need something valid there)
+    VkBuffer BufferMaps[4];
+    for (int i = 0; i < 2; ++i)
     {
-        Trace("Failed to create buffer for SrcKeys2K");
+        BufferMaps[0] = pContext->KeyBuffers[i];
+        BufferMaps[1] = pContext->KeyBuffers[!i];
+        BufferMaps[2] = pPayloadBuffers ? pContext->PayloadBuffers[i] : m_DstPayloadBuffers[i];
+        BufferMaps[3] = pPayloadBuffers ? pContext->PayloadBuffers[!i] : m_DstPayloadBuffers[!i];
+        BindUAVBuffer(BufferMaps, pContext->DescriptorSetInputOutput[i], 0, 4);
     }
-    // 4K
-    bufferCreateInfo.size = sizeof(uint32_t) * NumKeys[2];
-    allocCreateInfo.pUserData = "SrcKeys4K";
-    if (VK_SUCCESS != vmaCreateBuffer(m_pDevice->GetAllocator(), &bufferCreateInfo, &allocCreateInfo, &m_SrcKeyBuffers[2], &m_SrcKeyBufferAllocations[2], nullptr))
+}
+
+// Constant buffer ring allocations (the ring is shared by all contexts)
+VkDescriptorBufferInfo FFXParallelSort::AllocConstantBuffer(uint32_t Size, void* pData)
+{
+    std::lock_guard<std::mutex> lock(m_ConstantBufferMutex);
+    return m_pConstantBufferRing->AllocConstantBuffer(Size, pData);
+}
+//////////////////////////////////////////////////////////////////////////
+
+// Copy data into a buffer through the upload heap. Big buffers are copied in chunks, flushing the upload heap whenever it fills up.
+void FFXParallelSort::UploadBufferData(VkBuffer Buffer, const uint32_t* pData, uint32_t NumValues)
+{
+    const uint32_t MaxValuesPerCopy = 4 * 1024 * 1024;
+    for (uint32_t Offset = 0; Offset < NumValues; )
     {
-        Trace("Failed to create buffer for SrcKeys4K");
+        uint32_t NumValuesToCopy = std::min(NumValues - Offset, MaxValuesPerCopy);
+        uint8_t* pDataBuffer = m_pUploadHeap->Suballocate(NumValuesToCopy * sizeof(uint32_t), sizeof(uint32_t));
+        if (!pDataBuffer)
+        {
+            m_pUploadHeap->FlushAndFinish();
+            pDataBuffer = m_pUploadHeap->Suballocate(NumValuesToCopy * sizeof(uint32_t), sizeof(uint32_t));
+        }
+
+        memcpy(pDataBuffer, pData + Offset, sizeof(uint32_t) * NumValuesToCopy);
+        VkBufferCopy copyInfo = { 0 };
+        copyInfo.srcOffset = pDataBuffer - m_pUploadHeap->BasePtr();
+        copyInfo.dstOffset = sizeof(uint32_t) * Offset;
+        copyInfo.size = sizeof(uint32_t) * NumValuesToCopy;
+        vkCmdCopyBuffer(m_pUploadHeap->GetCommandList(), m_pUploadHeap->GetResource(), Buffer, 1, &copyInfo);
+        Offset += NumValuesToCopy;
     }
+}
+
+// Create all of the sort data for the sample
+void FFXParallelSort::CreateKeyPayloadBuffers()
+{
+    static const char* SrcKeyBufferNames[] = { "SrcKeys1080", "SrcKeys2K", "SrcKeys4K", "SrcKeysCustom" };
+    static const char* SrcKey16BufferNames[] = { "SrcKeys16Bit1080", "SrcKeys16Bit2K", "SrcKeys16Bit4K", "SrcKeys16BitCustom" };
+
+    VkBufferCreateInfo bufferCreateInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+    bufferCreateInfo.pNext = nullptr;
+    bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    bufferCreateInfo.usage = VK_BUFFER_USAGE_STORAGE_TEXEL_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+    VmaAllocationCreateInfo allocCreateInfo = {};
+    allocCreateInfo.memoryTypeBits = 0;
+    allocCreateInfo.pool = VK_NULL_HANDLE;
+    allocCreateInfo.preferredFlags = 0;
+    allocCreateInfo.requiredFlags = 0;
+    allocCreateInfo.usage = VMA_MEMORY_USAGE_UNKNOWN;
+
+    // The payload needs to fit the biggest key set
+    bufferCreateInfo.size = sizeof(uint32_t) * m_MaxNumKeys;
     allocCreateInfo.pUserData = "SrcPayloadBuffer";
     if (VK_SUCCESS != vmaCreateBuffer(m_pDevice->GetAllocator(), &bufferCreateInfo, &allocCreateInfo, &m_SrcPayloadBuffers, &m_SrcPayloadBufferAllocation, nullptr))
     {
         Trace("Failed to create buffer for SrcPayloadBuffer");
     }
 
-    // Clear out transfer bit on remaining buffers
-    bufferCreateInfo.usage &= ~VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    // Populate the buffers with the requested key distribution (one key set at a time so we only ever hold one on the CPU)
+    Trace(std::string("FFXParallelSort: generating ") + KeyDistributionNames[KeyDistributionOverride] + " keys with seed " + std::to_string(KeySeedOverride));
+    bool bPayloadUploaded = false;
+    std::vector<uint32_t> KeyData, KeyPlane;
+    for (uint32_t i = 0; i < m_NumKeySets; ++i)
+    {
+        // Multi-word keys get one plane per word, each following the distribution with its own seed
+        KeyData.resize(m_NumKeys[i] * m_NumKeyWords);
+        KeyPlane.resize(m_NumKeys[i]);
+        for (uint32_t Word = 0; Word < m_NumKeyWords; ++Word)
+        {
+            GenerateKeys(KeyPlane, KeyDistributionOverride, KeySeedOverride + Word);
+            NarrowKeys(KeyPlane, m_KeyBits);
+            std::copy(KeyPlane.begin(), KeyPlane.end(), KeyData.begin() + m_NumKeys[i] * Word);
+        }
+
+        bufferCreateInfo.size = sizeof(uint32_t) * m_NumKeys[i] * m_NumKeyWords;
+        allocCreateInfo.pUserData = (void*)SrcKeyBufferNames[i];
+        if (VK_SUCCESS != vmaCreateBuffer(m_pDevice->GetAllocator(), &bufferCreateInfo, &allocCreateInfo, &m_SrcKeyBuffers[i], &m_SrcKeyBufferAllocations[i], nullptr))
+        {
+            Trace(std::string("Failed to create buffer for ") + SrcKeyBufferNames[i]);
+        }
+        UploadBufferData(m_SrcKeyBuffers[i], KeyData.data(), m_NumKeys[i] * m_NumKeyWords);
+
+        // Keys of up to 16 bits also get a copy stored as 16-bit values (two to a uint, padded out to whole uints)
+        if (m_b16BitKeyStorage)
+        {
+            KeyPlane.assign((m_NumKeys[i] + 1) / 2, 0);
+            for (uint32_t Key = 0; Key < m_NumKeys[i]; ++Key)
+                KeyPlane[Key / 2] |= KeyData[Key] << (16 * (Key % 2));
+
+            bufferCreateInfo.size = sizeof(uint32_t) * KeyPlane.size();
+            allocCreateInfo.pUserData = (void*)SrcKey16BufferNames[i];
+            if (VK_SUCCESS != vmaCreateBuffer(m_pDevice->GetAllocator(), &bufferCreateInfo, &allocCreateInfo, &m_SrcKey16Buffers[i], &m_SrcKey16BufferAllocations[i], nullptr))
+            {
+                Trace(std::string("Failed to create buffer for ") + SrcKey16BufferNames[i]);
+            }
+            UploadBufferData(m_SrcKey16Buffers[i], KeyPlane.data(), (uint32_t)KeyPlane.size());
+        }
+
+        // Copy the biggest key set for payload (it doesn't matter what the payload is as we really only want it to measure cost of copying/sorting)
+        if (m_NumKeys[i] == m_MaxNumKeys && !bPayloadUploaded)
+        {
+            UploadBufferData(m_SrcPayloadBuffers, KeyData.data(), m_NumKeys[i]);
+            bPayloadUploaded = true;
+        }
+
+        // Work out what the percentile queries should find in this key set, the same rank the GPU picks (keys get reordered, so this goes last)
+        m_ExpectedPercentileKeys[i].clear();
+        if (m_NumKeyWords == 1)
+        {
+            for (float Percentile : m_SelectPercentiles)
+            {
+                uint32_t Rank = std::min((uint32_t)(std::min(std::max(Percentile, 0.f), 1.f) * (float)(m_NumKeys[i] - 1)), m_NumKeys[i] - 1);
+                std::nth_element(KeyData.begin(), KeyData.begin() + Rank, KeyData.end());
+                m_ExpectedPercentileKeys[i].push_back(KeyData[Rank]);
+            }
+        }
+    }
 
     // The DstKey and DstPayload buffers will be used as src/dst when sorting. A copy of the 
     // source key/payload will be copied into them before hand so we can keep our original values
-    bufferCreateInfo.size = sizeof(uint32_t) * NumKeys[2];
+    bufferCreateInfo.size = sizeof(uint32_t) * m_MaxNumKeys * m_NumKeyWords;
     allocCreateInfo.pUserData = "DstKeyBuf0";
     if (VK_SUCCESS != vmaCreateBuffer(m_pDevice->GetAllocator(), &bufferCreateInfo, &allocCreateInfo, &m_DstKeyBuffers[0], &m_DstKeyBufferAllocations[0], nullptr))
     {
@@ -177,6 +723,23 @@ void FFXParallelSort::CreateKeyPayloadBuffers()
         Trace("Failed to create buffer for DstKeyBuf1");
     }
 
+    if (m_b16BitKeyStorage)
+    {
+        bufferCreateInfo.size = sizeof(uint32_t) * ((m_MaxNumKeys + 1) / 2);
+        allocCreateInfo.pUserData = "DstKey16BitBuf0";
+        if (VK_SUCCESS != vmaCreateBuffer(m_pDevice->GetAllocator(), &bufferCreateInfo, &allocCreateInfo, &m_DstKey16Buffers[0], &m_DstKey16BufferAllocations[0], nullptr))
+        {
+            Trace("Failed to create buffer for DstKey16BitBuf0");
+        }
+
+        allocCreateInfo.pUserData = "DstKey16BitBuf1";
+        if (VK_SUCCESS != vmaCreateBuffer(m_pDevice->GetAllocator(), &bufferCreateInfo, &allocCreateInfo, &m_DstKey16Buffers[1], &m_DstKey16BufferAllocations[1], nullptr))
+        {
+            Trace("Failed to create buffer for DstKey16BitBuf1");
+        }
+    }
+
+    bufferCreateInfo.size = sizeof(uint32_t) * m_MaxNumKeys;
     allocCreateInfo.pUserData = "DstPayloadBuf0";
     if (VK_SUCCESS != vmaCreateBuffer(m_pDevice->GetAllocator(), &bufferCreateInfo, &allocCreateInfo, &m_DstPayloadBuffers[0], &m_DstPayloadBufferAllocations[0], nullptr))
     {
@@ -189,82 +752,157 @@ void FFXParallelSort::CreateKeyPayloadBuffers()
         Trace("Failed to create buffer for DstPayloadBuf1");
     }
 
-    // Copy data in
-    VkBufferCopy copyInfo = { 0 };
-    // 1080
-    uint8_t* pKeyDataBuffer = m_pUploadHeap->Suballocate(NumKeys[0] * sizeof(uint32_t), sizeof(uint32_t));
-    memcpy(pKeyDataBuffer, KeyData1080.data() , sizeof(uint32_t) * NumKeys[0]);
-    copyInfo.srcOffset = pKeyDataBuffer - m_pUploadHeap->BasePtr();
-    copyInfo.size = sizeof(uint32_t) * NumKeys[0];
-    vkCmdCopyBuffer(m_pUploadHeap->GetCommandList(), m_pUploadHeap->GetResource(), m_SrcKeyBuffers[0], 1, &copyInfo);
-        
-    // 2K
-    pKeyDataBuffer = m_pUploadHeap->Suballocate(NumKeys[1] * sizeof(uint32_t), sizeof(uint32_t));
-    memcpy(pKeyDataBuffer, KeyData2K.data(), sizeof(uint32_t) * NumKeys[1]);
-    copyInfo.srcOffset = pKeyDataBuffer - m_pUploadHeap->BasePtr();
-    copyInfo.size = sizeof(uint32_t) * NumKeys[1];
-    vkCmdCopyBuffer(m_pUploadHeap->GetCommandList(), m_pUploadHeap->GetResource(), m_SrcKeyBuffers[1], 1, &copyInfo);
-        
-    // 4K
-    pKeyDataBuffer = m_pUploadHeap->Suballocate(NumKeys[2] * sizeof(uint32_t), sizeof(uint32_t));
-    memcpy(pKeyDataBuffer, KeyData4K.data(), sizeof(uint32_t) * NumKeys[2]);
-    copyInfo.srcOffset = pKeyDataBuffer - m_pUploadHeap->BasePtr();
-    copyInfo.size = sizeof(uint32_t) * NumKeys[2];
-    vkCmdCopyBuffer(m_pUploadHeap->GetCommandList(), m_pUploadHeap->GetResource(), m_SrcKeyBuffers[2], 1, &copyInfo);
-
-    uint8_t* pPayloadDataBuffer = m_pUploadHeap->Suballocate(NumKeys[2] * sizeof(uint32_t), sizeof(uint32_t));
-    memcpy(pPayloadDataBuffer, KeyData4K.data(), sizeof(uint32_t) * NumKeys[2]);    // Copy the 4k source data for payload (it doesn't matter what the payload is as we really only want it to measure cost of copying/sorting)
-    copyInfo.srcOffset = pPayloadDataBuffer - m_pUploadHeap->BasePtr();
-    copyInfo.size = sizeof(uint32_t) * NumKeys[2];
-    vkCmdCopyBuffer(m_pUploadHeap->GetCommandList(), m_pUploadHeap->GetResource(), m_SrcPayloadBuffers, 1, &copyInfo);      
-
     // Once we are done copying the data, put in barriers to transition the source resources to 
     // copy source (which is what they will stay for the duration of app runtime)
-    VkBufferMemoryBarrier Barriers[6] = { BufferTransition(m_SrcKeyBuffers[2], VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT, sizeof(uint32_t) * NumKeys[2]),
-                                            BufferTransition(m_SrcPayloadBuffers, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT, sizeof(uint32_t) * NumKeys[2]),
-                                            BufferTransition(m_SrcKeyBuffers[1], VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT, sizeof(uint32_t) * NumKeys[1]), 
-                                            BufferTransition(m_SrcKeyBuffers[0], VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT, sizeof(uint32_t) * NumKeys[0]), 
-        
-                                        // Copy the data into the dst[0] buffers for use on first frame
-                                            BufferTransition(m_DstKeyBuffers[0], VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, sizeof(uint32_t) * NumKeys[2]) ,
-                                            BufferTransition(m_DstPayloadBuffers[0], VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, sizeof(uint32_t) * NumKeys[2]) };
+    VkBufferMemoryBarrier Barriers[_countof(m_SrcKeyBuffers) + _countof(m_SrcKey16Buffers) + 3];
+    uint32_t NumBarriers = 0;
+    for (uint32_t i = 0; i < m_NumKeySets; ++i)
+        Barriers[NumBarriers++] = BufferTransition(m_SrcKeyBuffers[i], VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT, sizeof(uint32_t) * m_NumKeys[i] * m_NumKeyWords);
+    if (m_b16BitKeyStorage)
+    {
+        for (uint32_t i = 0; i < m_NumKeySets; ++i)
+            Barriers[NumBarriers++] = BufferTransition(m_SrcKey16Buffers[i], VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_WHOLE_SIZE);
+    }
+    Barriers[NumBarriers++] = BufferTransition(m_SrcPayloadBuffers, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT, sizeof(uint32_t) * m_MaxNumKeys);
 
-    vkCmdPipelineBarrier(m_pUploadHeap->GetCommandList(), VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 6, Barriers, 0, nullptr);
+    // Copy the data into the dst[0] buffers for use on first frame
+    Barriers[NumBarriers++] = BufferTransition(m_DstKeyBuffers[0], VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, sizeof(uint32_t) * m_MaxNumKeys * m_NumKeyWords);
+    Barriers[NumBarriers++] = BufferTransition(m_DstPayloadBuffers[0], VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, sizeof(uint32_t) * m_MaxNumKeys);
+    vkCmdPipelineBarrier(m_pUploadHeap->GetCommandList(), VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, NumBarriers, Barriers, 0, nullptr);
 
+    VkBufferCopy copyInfo = { 0 };
     copyInfo.srcOffset = 0;
-    copyInfo.size = sizeof(uint32_t) * NumKeys[m_UIResolutionSize];
+    copyInfo.size = sizeof(uint32_t) * m_NumKeys[m_UIResolutionSize] * m_NumKeyWords;
     vkCmdCopyBuffer(m_pUploadHeap->GetCommandList(), m_SrcKeyBuffers[m_UIResolutionSize], m_DstKeyBuffers[0], 1, &copyInfo);
+    copyInfo.size = sizeof(uint32_t) * m_NumKeys[m_UIResolutionSize];
     vkCmdCopyBuffer(m_pUploadHeap->GetCommandList(), m_SrcPayloadBuffers, m_DstPayloadBuffers[0], 1, &copyInfo);
 
     // Put the dst buffers back to UAVs for sort usage
-    Barriers[0] = BufferTransition(m_DstKeyBuffers[0], VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, sizeof(uint32_t) * NumKeys[m_UIResolutionSize]);
-    Barriers[1] = BufferTransition(m_DstPayloadBuffers[0], VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, sizeof(uint32_t) * NumKeys[m_UIResolutionSize]);
+    Barriers[0] = BufferTransition(m_DstKeyBuffers[0], VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, sizeof(uint32_t) * m_NumKeys[m_UIResolutionSize] * m_NumKeyWords);
+    Barriers[1] = BufferTransition(m_DstPayloadBuffers[0], VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, sizeof(uint32_t) * m_NumKeys[m_UIResolutionSize]);
     vkCmdPipelineBarrier(m_pUploadHeap->GetCommandList(), VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 2, Barriers, 0, nullptr);
 }
 
 // Compile specified radix sort shader and create pipeline
-void FFXParallelSort::CompileRadixPipeline(const char* shaderFile, const DefineList* defines, const char* entryPoint, VkPipeline& pPipeline)
+// Compilation is queued on the compile pool (one worker per hardware thread), so permutations build concurrently without a thread
+// each. Calling get() on the returned pipeline blocks until that specific permutation is ready.
+FFXParallelSort::FPSPipeline FFXParallelSort::CompileRadixPipeline(const char* shaderFile, const DefineList* defines, const char* entryPoint)
 {
-    std::string CompileFlags("-T cs_6_0");
+    // Take copies of everything as the task will outlive the caller's arguments
+    std::string ShaderFile(shaderFile);
+    std::string EntryPoint(entryPoint);
+    DefineList Defines;
+    if (defines)
+        Defines = *defines;
+
+    // Every permutation is built for the subgroup size and scatter ranking and digit counting picked at creation
+    if (m_WaveSize)
+        Defines["kRS_WaveSize"] = std::to_string(m_WaveSize);
+    if (m_bTileScatter)
+        Defines["kRS_TileScatter"] = std::to_string(1);
+    if (m_bRegisterCount)
+        Defines["kRS_RegisterCount"] = std::to_string(1);
+    if (m_bMatchScatter)
+        Defines["kRS_MatchScatter"] = std::to_string(1);
+
+    return m_CompilePool.Submit([this, ShaderFile, EntryPoint, Defines]()
+    {
+        std::string CompileFlags("-T cs_6_0");
 #ifdef _DEBUG
-    CompileFlags += " -Zi -Od";
+        CompileFlags += " -Zi -Od";
 #endif // _DEBUG
 
-    VkPipelineShaderStageCreateInfo stage_create_info = { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO };
+        // 16-bit key storage needs native 16-bit types
+        const char* ShaderModel = Defines.count("kRS_16BitKeys") ? "-T cs_6_2 -enable-16bit-types" : "-T cs_6_0";
 
-    VkResult vkResult = VKCompileFromFile(m_pDevice->GetDevice(), VK_SHADER_STAGE_COMPUTE_BIT, shaderFile, entryPoint, "-T cs_6_0", defines, &stage_create_info);
-    stage_create_info.flags = 0;
-    assert(vkResult == VK_SUCCESS);
+        VkPipelineShaderStageCreateInfo stage_create_info = { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO };
 
-    VkComputePipelineCreateInfo create_info = { VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO };
-    create_info.pNext = nullptr;
-    create_info.basePipelineHandle = VK_NULL_HANDLE;
-    create_info.basePipelineIndex = 0;
-    create_info.flags = 0;
-    create_info.layout = m_SortPipelineLayout;
-    create_info.stage = stage_create_info;
-    vkResult = vkCreateComputePipelines(m_pDevice->GetDevice(), VK_NULL_HANDLE, 1, &create_info, nullptr, &pPipeline);
-    assert(vkResult == VK_SUCCESS);
+        VkResult vkResult = VKCompileFromFile(m_pDevice->GetDevice(), VK_SHADER_STAGE_COMPUTE_BIT, ShaderFile.c_str(), EntryPoint.c_str(), ShaderModel, &Defines, &stage_create_info);
+        stage_create_info.flags = 0;
+        assert(vkResult == VK_SUCCESS);
+
+        // Specialized kernels run at the subgroup size they were built for, in full subgroups (the single thread kernels
+        // have nothing to fill a subgroup with, and don't use the subgroup size)
+        VkPipelineShaderStageRequiredSubgroupSizeCreateInfoEXT RequiredSubgroupSize = { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_REQUIRED_SUBGROUP_SIZE_CREATE_INFO_EXT };
+        if (Defines.count("kRS_WaveSize") && EntryPoint != "FPS_SetupIndirectParameters" && EntryPoint != "FPS_ValidateResult")
+        {
+            RequiredSubgroupSize.requiredSubgroupSize = m_WaveSize;
+            stage_create_info.pNext = &RequiredSubgroupSize;
+            stage_create_info.flags = VK_PIPELINE_SHADER_STAGE_CREATE_REQUIRE_FULL_SUBGROUPS_BIT_EXT;
+        }
+
+        VkComputePipelineCreateInfo create_info = { VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO };
+        create_info.pNext = nullptr;
+        create_info.basePipelineHandle = VK_NULL_HANDLE;
+        create_info.basePipelineIndex = 0;
+        create_info.flags = 0;
+        create_info.layout = m_SortPipelineLayout;
+        create_info.stage = stage_create_info;
+
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        vkResult = vkCreateComputePipelines(m_pDevice->GetDevice(), VK_NULL_HANDLE, 1, &create_info, nullptr, &pipeline);
+        assert(vkResult == VK_SUCCESS);
+        return pipeline;
+    });
+}
+
+// Block until every radix sort pipeline has finished building
+void FFXParallelSort::WaitForPipelines()
+{
+    m_FPSIndirectSetupParametersPipeline.wait();
+    m_FPSIndirectSetupPresortPipeline.wait();
+    m_FPSCountInversionsPipeline.wait();
+    m_FPSValidateInputPipeline.wait();
+    m_FPSValidateInputPayloadPipeline.wait();
+    m_FPSValidateOutputPipeline.wait();
+    m_FPSValidateOutputPayloadPipeline.wait();
+    m_FPSValidateResultPipeline.wait();
+    m_FPSCountPipeline.wait();
+    m_FPSCountReducePipeline.wait();
+    m_FPSScanPipeline.wait();
+    m_FPSScanAddPipeline.wait();
+    m_FPSReduceScanAddPipeline.wait();
+    m_FPSScanBlockReducePipeline.wait();
+    m_FPSScanBlockSumsPipeline.wait();
+    m_FPSScanBlockAddPipeline.wait();
+    m_FPSScatterPipeline.wait();
+    m_FPSScatterPayloadPipeline.wait();
+    m_FPSScatterIndexPipeline.wait();
+    m_FPSGatherPayloadPipeline.wait();
+    m_FPSPackKeyIndexPipeline.wait();
+    m_FPSUnpackKeyIndexPipeline.wait();
+    m_FPSCountLoadKeyPipeline.wait();
+    m_FPSScatterLoadKeyPipeline.wait();
+    m_FPSScatterLoadKeyPayloadPipeline.wait();
+    m_FPSScatterStoreKeyPipeline.wait();
+    m_FPSScatterStoreKeyPayloadPipeline.wait();
+    m_FPSWriteKeyRecordsPipeline.wait();
+    m_FPSCountKeyRecordsPipeline.wait();
+    m_FPSScatterKeyRecordsPipeline.wait();
+    m_FPSScatterKeyRecordsPayloadPipeline.wait();
+    m_FPSCountReadOnlyPipeline.wait();
+    m_FPSScatterReadOnlyPipeline.wait();
+    m_FPSScatterReadOnlyPayloadPipeline.wait();
+    if (m_b16BitKeyStorage)
+    {
+        m_FPSCount16BitPipeline.wait();
+        m_FPSScatter16BitPipeline.wait();
+        m_FPSScatter16BitPayloadPipeline.wait();
+        m_FPSValidateInput16BitPipeline.wait();
+        m_FPSValidateInput16BitPayloadPipeline.wait();
+        m_FPSValidateOutput16BitPipeline.wait();
+        m_FPSValidateOutput16BitPayloadPipeline.wait();
+    }
+    m_FPSSelectCountPipeline.wait();
+    m_FPSSelectReducePipeline.wait();
+    m_FPSSelectDigitPipeline.wait();
+    m_FPSSelectCompactPipeline.wait();
+    m_FPSSelectCompactPayloadPipeline.wait();
+    m_FPSGenerateDirtyKeysPipeline.wait();
+    m_FPSGatherDirtyPayloadPipeline.wait();
+    m_FPSMergePipeline.wait();
+    m_FPSMergePayloadPipeline.wait();
+    m_FPSMergeRunsPipeline.wait();
 }
 
 // Parallel Sort initialization
@@ -277,13 +915,116 @@ void FFXParallelSort::OnCreate(Device* pDevice, ResourceViewHeaps* pResourceView
     m_MaxNumThreadgroups = 800;
 
     // Overrides for testing
-    if (KeySetOverride >= 0)
+    if (MaxThreadGroupsOverride)
+        m_MaxNumThreadgroups = std::min(MaxThreadGroupsOverride, MaxDispatchThreadGroups);
+    if (KeyWordsOverride)
+        m_NumKeyWords = KeyWordsOverride;
+    if (KeyBitsOverride && m_NumKeyWords == 1)
+        m_KeyBits = KeyBitsOverride;
+    if (NumKeysOverride)
+    {
+        m_NumKeys[CustomKeySet] = NumKeysOverride;
+        m_NumKeySets = CustomKeySet + 1;
+        m_UIResolutionSize = CustomKeySet;
+    }
+    m_MaxNumKeys = *std::max_element(m_NumKeys, m_NumKeys + m_NumKeySets);
+    if (KeySetOverride >= 0 && KeySetOverride < (int)m_NumKeySets)
         m_UIResolutionSize = KeySetOverride;
     if (PayloadOverride)
         m_UISortPayload = true;
+    if (DeferredPayloadOverride)
+    {
+        m_UISortPayload = true;
+        m_UIDeferredPayload = true;
+    }
+    if (KeyHooksOverride)
+        m_UIKeyHooks = true;
+    if (KeyRecordStrideOverride)
+    {
+        // The records of the biggest key set have to fit in a single storage buffer binding
+        VkPhysicalDeviceProperties DeviceProperties;
+        vkGetPhysicalDeviceProperties(m_pDevice->GetPhysicalDevice(), &DeviceProperties);
+        uint64_t KeyRecordBufferSize = (uint64_t)KeyRecordStrideOverride * m_MaxNumKeys;
+        if (KeyRecordBufferSize <= DeviceProperties.limits.maxStorageBufferRange)
+            m_UIKeyRecords = true;
+        else
+        {
+            Trace("FFXParallelSort: key records of " + std::to_string(KeyRecordStrideOverride) + " bytes don't fit in a buffer for " + std::to_string(m_MaxNumKeys) + " keys, not sorting key records");
+            KeyRecordStrideOverride = 0;
+        }
+    }
+    if (ReadOnlyInputOverride)
+        m_UIReadOnlyInput = true;
+    if (PackedKeyIndexOverride)
+        m_UIPackedKeyIndex = true;
+    if (TileScatterOverride)
+        m_bTileScatter = true;
+    if (RegisterCountOverride)
+        m_bRegisterCount = true;
+    // Match ranking always uses ballots here (no kRS_WaveMatch), as WaveMatch needs VK_NV_shader_subgroup_partitioned
+    if (MatchScatterOverride && !m_bTileScatter)
+        m_bMatchScatter = true;
+    if (StageTimingsOverride)
+        m_UIStageTimings = true;
+    if (TopKOverride)
+    {
+        m_UISelectTopK = true;
+        m_UISelectNumKeys = (int)TopKOverride;
+    }
+    if (PresortCheckOverride)
+        m_UIPresortCheck = true;
+    if (TemporalCoherenceOverride)
+        m_UITemporalCoherence = true;
+    if (GPUValidationOverride)
+        m_UIGPUValidation = true;
+    if (IncrementalSortOverride)
+    {
+        m_UIIncrementalSort = true;
+        m_UIDirtyKeyPercent = std::min((int)IncrementalSortOverride, MaxDirtyKeyPercent);
+    }
+    m_SelectPercentiles = { 0.01f, 0.25f, 0.5f, 0.75f, 0.99f };
+    if (!PercentilesOverride.empty())
+    {
+        m_SelectPercentiles = PercentilesOverride;
+        m_UISelectPercentiles = true;
+    }
 
-    // Create resources to test with. Sorts will be done for 1080p, 2K, and 4K resolution data sets
-    CreateKeyPayloadBuffers();
+    // Keys of up to 16 bits can be sorted as 16-bit values when the device has 16-bit storage buffer access and 16-bit ints. Cauldron only
+    // turns on VK_KHR_16bit_storage (with the features the device has) along with FP16, so that has to be on as well
+    if (m_KeyBits <= 16 && m_pDevice->IsFp16Supported())
+    {
+        VkPhysicalDevice16BitStorageFeatures Storage16BitFeatures = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_16BIT_STORAGE_FEATURES };
+        VkPhysicalDeviceFeatures2 Features = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+        Features.pNext = &Storage16BitFeatures;
+        vkGetPhysicalDeviceFeatures2(m_pDevice->GetPhysicalDevice(), &Features);
+        m_b16BitKeyStorage = Storage16BitFeatures.storageBuffer16BitAccess && Features.features.shaderInt16;
+        m_UI16BitKeys = m_b16BitKeyStorage;
+    }
+
+    // Specialize the sort kernels for a subgroup size when VK_EXT_subgroup_size_control lets the pipelines require it along with full
+    // subgroups (subgroupSizeControl and computeFullSubgroups). Where there is a choice go with the widest the sort has kernels for, as
+    // it leaves the fewest subgroup totals to combine. Without those features the kernels look the subgroup size up at run time
+    {
+        VkPhysicalDeviceSubgroupSizeControlFeaturesEXT SubgroupSizeControlFeatures = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_SIZE_CONTROL_FEATURES_EXT };
+        VkPhysicalDeviceFeatures2 Features = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+        Features.pNext = &SubgroupSizeControlFeatures;
+        vkGetPhysicalDeviceFeatures2(m_pDevice->GetPhysicalDevice(), &Features);
+
+        VkPhysicalDeviceSubgroupSizeControlPropertiesEXT SubgroupSizeControlProperties = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_SIZE_CONTROL_PROPERTIES_EXT };
+        VkPhysicalDeviceProperties2 Properties = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2 };
+        Properties.pNext = &SubgroupSizeControlProperties;
+        vkGetPhysicalDeviceProperties2(m_pDevice->GetPhysicalDevice(), &Properties);
+
+        uint32_t WaveSize = WaveSizeOverride >= 0 ? (uint32_t)WaveSizeOverride : (SubgroupSizeControlProperties.maxSubgroupSize >= 64 ? 64 : 32);
+        if ((WaveSize == 32 || WaveSize == 64) && SubgroupSizeControlFeatures.subgroupSizeControl && SubgroupSizeControlFeatures.computeFullSubgroups &&
+            (SubgroupSizeControlProperties.requiredSubgroupSizeStages & VK_SHADER_STAGE_COMPUTE_BIT) &&
+            WaveSize >= SubgroupSizeControlProperties.minSubgroupSize && WaveSize <= SubgroupSizeControlProperties.maxSubgroupSize &&
+            FFX_PARALLELSORT_THREADGROUP_SIZE <= WaveSize * SubgroupSizeControlProperties.maxComputeWorkgroupSubgroups)
+            m_WaveSize = WaveSize;
+    }
+
+    // Create resources to test with. Sorts will be done for 1080p, 2K, and 4K resolution data sets (and the custom key count if there is one)
+    CreateKeyPayloadBuffers();
 
     VkBufferCreateInfo bufferCreateInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
     bufferCreateInfo.pNext = nullptr;
@@ -298,22 +1039,108 @@ void FFXParallelSort::OnCreate(Device* pDevice, ResourceViewHeaps* pResourceView
     allocCreateInfo.usage = VMA_MEMORY_USAGE_UNKNOWN;
 
     // We are just going to fudge the indirect execution parameters for each resolution
-    bufferCreateInfo.size = sizeof(uint32_t) * 3;
+    bufferCreateInfo.size = sizeof(m_NumKeys);
     allocCreateInfo.pUserData = "IndirectKeyCounts";
     if (VK_SUCCESS != vmaCreateBuffer(m_pDevice->GetAllocator(), &bufferCreateInfo, &allocCreateInfo, &m_IndirectKeyCounts, &m_IndirectKeyCountsAllocation, nullptr))
     {
         Trace("Failed to create buffer for IndirectKeyCounts");
     }
 
-    VkBufferCopy copyInfo = { 0 };
-    uint8_t* pNumKeysBuffer = m_pUploadHeap->Suballocate(sizeof(uint32_t) * 3, sizeof(uint32_t));
-    memcpy(pNumKeysBuffer, NumKeys, sizeof(uint32_t) * 3);
-    copyInfo.srcOffset = pNumKeysBuffer - m_pUploadHeap->BasePtr();
-    copyInfo.size = sizeof(uint32_t) * 3;
-    vkCmdCopyBuffer(m_pUploadHeap->GetCommandList(), m_pUploadHeap->GetResource(), m_IndirectKeyCounts, 1, &copyInfo);
+    UploadBufferData(m_IndirectKeyCounts, m_NumKeys, _countof(m_NumKeys));
+
+    VkBufferMemoryBarrier barrier = BufferTransition(m_IndirectKeyCounts, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, sizeof(m_NumKeys));
+    vkCmdPipelineBarrier(m_pUploadHeap->GetCommandList(), VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+    // Selection state is a plane per field with one entry per query, the percentile plane is filled in once up front
+    uint32_t NumSelectQueries = (uint32_t)m_SelectPercentiles.size();
+    std::vector<uint32_t> SelectState(FFX_PARALLELSORT_SELECT_STATE_SIZE * NumSelectQueries, 0);
+    for (uint32_t i = 0; i < NumSelectQueries; ++i)
+        memcpy(&SelectState[FFX_PARALLELSORT_SELECT_STATE_PERCENTILE * NumSelectQueries + i], &m_SelectPercentiles[i], sizeof(float));
+
+    m_SelectStateBufferSize = (uint32_t)(sizeof(uint32_t) * SelectState.size());
+    bufferCreateInfo.size = m_SelectStateBufferSize;
+    bufferCreateInfo.usage = VK_BUFFER_USAGE_STORAGE_TEXEL_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    allocCreateInfo.pUserData = "SelectState";
+    if (VK_SUCCESS != vmaCreateBuffer(m_pDevice->GetAllocator(), &bufferCreateInfo, &allocCreateInfo, &m_FPSSelectStateBuffer, &m_FPSSelectStateBufferAllocation, nullptr))
+    {
+        Trace("Failed to create buffer for SelectState");
+    }
+
+    UploadBufferData(m_FPSSelectStateBuffer, SelectState.data(), (uint32_t)SelectState.size());
+
+    barrier = BufferTransition(m_FPSSelectStateBuffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, m_SelectStateBufferSize);
+    vkCmdPipelineBarrier(m_pUploadHeap->GetCommandList(), VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+    // The presort check accumulates into its inversion counter, so it needs to start out cleared
+    uint32_t PresortState[FFX_PARALLELSORT_PRESORT_STATE_SIZE] = { 0 };
+    bufferCreateInfo.size = sizeof(PresortState);
+    bufferCreateInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    allocCreateInfo.pUserData = "PresortState";
+    if (VK_SUCCESS != vmaCreateBuffer(m_pDevice->GetAllocator(), &bufferCreateInfo, &allocCreateInfo, &m_PresortStateBuffer, &m_PresortStateBufferAllocation, nullptr))
+    {
+        Trace("Failed to create buffer for PresortState");
+    }
+
+    UploadBufferData(m_PresortStateBuffer, PresortState, FFX_PARALLELSORT_PRESORT_STATE_SIZE);
 
-    VkBufferMemoryBarrier barrier = BufferTransition(m_IndirectKeyCounts, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, sizeof(uint32_t) * 3);
+    barrier = BufferTransition(m_PresortStateBuffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, sizeof(PresortState));
     vkCmdPipelineBarrier(m_pUploadHeap->GetCommandList(), VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+    // GPU validation accumulates checksums, so it needs to start out cleared too (and its result record gets copied out)
+    uint32_t ValidateState[FFX_PARALLELSORT_VALIDATE_STATE_SIZE];
+    FFX_ParallelSort_InitValidateState(ValidateState);
+    bufferCreateInfo.size = sizeof(ValidateState);
+    bufferCreateInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    allocCreateInfo.pUserData = "ValidateState";
+    if (VK_SUCCESS != vmaCreateBuffer(m_pDevice->GetAllocator(), &bufferCreateInfo, &allocCreateInfo, &m_ValidateStateBuffer, &m_ValidateStateBufferAllocation, nullptr))
+    {
+        Trace("Failed to create buffer for ValidateState");
+    }
+
+    UploadBufferData(m_ValidateStateBuffer, ValidateState, FFX_PARALLELSORT_VALIDATE_STATE_SIZE);
+
+    barrier = BufferTransition(m_ValidateStateBuffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, sizeof(ValidateState));
+    vkCmdPipelineBarrier(m_pUploadHeap->GetCommandList(), VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+    // Result records get copied into a ring of read-back slots and looked at once the slot comes around again
+    bufferCreateInfo.size = sizeof(uint32_t) * FFX_PARALLELSORT_VALIDATE_RESULT_SIZE * GPUValidationSlots;
+    bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    allocCreateInfo.usage = VMA_MEMORY_USAGE_GPU_TO_CPU;
+    allocCreateInfo.pUserData = "GPU Validation Read-back Buffer";
+    if (VK_SUCCESS != vmaCreateBuffer(m_pDevice->GetAllocator(), &bufferCreateInfo, &allocCreateInfo, &m_ValidateReadBackBuffer, &m_ValidateReadBackBufferAllocation, nullptr))
+    {
+        Trace("Failed to create buffer for GPU validation read-back");
+    }
+    if (VK_SUCCESS != vmaMapMemory(m_pDevice->GetAllocator(), m_ValidateReadBackBufferAllocation, (void**)&m_pValidateResults))
+    {
+        Trace("Failed to map GPU validation read-back buffer");
+    }
+
+    // What each presort check found gets copied into a ring of read-back slots too (so the GUI can show whether sorts get skipped)
+    bufferCreateInfo.size = sizeof(uint32_t) * ReadBackLatency;
+    allocCreateInfo.pUserData = "Presort Read-back Buffer";
+    if (VK_SUCCESS != vmaCreateBuffer(m_pDevice->GetAllocator(), &bufferCreateInfo, &allocCreateInfo, &m_PresortReadBackBuffer, &m_PresortReadBackBufferAllocation, nullptr))
+    {
+        Trace("Failed to create buffer for presort read-back");
+    }
+    if (VK_SUCCESS != vmaMapMemory(m_pDevice->GetAllocator(), m_PresortReadBackBufferAllocation, (void**)&m_pPresortInversions))
+    {
+        Trace("Failed to map presort read-back buffer");
+    }
+
+    // The keys the percentile queries find get copied into a ring of read-back slots (so they can be shown and checked against the CPU)
+    bufferCreateInfo.size = sizeof(uint32_t) * ReadBackLatency * std::max(NumSelectQueries, 1u);
+    allocCreateInfo.pUserData = "Percentile Read-back Buffer";
+    if (VK_SUCCESS != vmaCreateBuffer(m_pDevice->GetAllocator(), &bufferCreateInfo, &allocCreateInfo, &m_PercentileReadBackBuffer, &m_PercentileReadBackBufferAllocation, nullptr))
+    {
+        Trace("Failed to create buffer for percentile read-back");
+    }
+    if (VK_SUCCESS != vmaMapMemory(m_pDevice->GetAllocator(), m_PercentileReadBackBufferAllocation, (void**)&m_pPercentileResults))
+    {
+        Trace("Failed to map percentile read-back buffer");
+    }
+    bufferCreateInfo.usage = VK_BUFFER_USAGE_STORAGE_TEXEL_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    allocCreateInfo.usage = VMA_MEMORY_USAGE_UNKNOWN;
         
     // Create resources for sort validation (image that goes from shuffled to sorted)
     m_Validate1080pTexture.InitFromFile(m_pDevice, m_pUploadHeap, "Validate1080p.png", false,VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
@@ -326,45 +1153,62 @@ void FFXParallelSort::OnCreate(Device* pDevice, ResourceViewHeaps* pResourceView
     // Finish up
     m_pUploadHeap->FlushAndFinish();
 
-    // Allocate the scratch buffers needed for radix sort
-    FFX_ParallelSort_CalculateScratchResourceSize(NumKeys[2], m_ScratchBufferSize, m_ReducedScratchBufferSize);
-        
-    bufferCreateInfo.size = m_ScratchBufferSize;
-    allocCreateInfo.pUserData = "Scratch";
-    if (VK_SUCCESS != vmaCreateBuffer(m_pDevice->GetAllocator(), &bufferCreateInfo, &allocCreateInfo, &m_FPSScratchBuffer, &m_FPSScratchBufferAllocation, nullptr))
+    // Size the scratch buffers needed for radix sort (big enough for the batched percentile queries too), every sort context gets its own
+    uint32_t selectScratchBufferSize;
+    uint32_t selectReducedScratchBufferSize;
+    FFX_ParallelSort_CalculateScratchResourceSize(m_MaxNumKeys, m_ScratchBufferSize, m_ReducedScratchBufferSize);
+    FFX_ParallelSort_CalculateSelectScratchResourceSize(m_MaxNumKeys, m_MaxNumThreadgroups, NumSelectQueries, selectScratchBufferSize, selectReducedScratchBufferSize);
+    m_ScratchBufferSize = std::max(m_ScratchBufferSize, selectScratchBufferSize);
+    m_ReducedScratchBufferSize = std::max(m_ReducedScratchBufferSize, selectReducedScratchBufferSize);
+    FFX_ParallelSort_CalculateScanBlockResourceSize(m_MaxNumKeys, m_ScanBlockBufferSize);
+
+    // Allocate the buffers the incremental re-sort sorts the changed keys in (ping-pong, like the sort buffers)
+    uint32_t MaxNumDirtyKeys = std::max(m_MaxNumKeys / 100 * MaxDirtyKeyPercent, 1u);
+    bufferCreateInfo.size = sizeof(uint32_t) * MaxNumDirtyKeys;
+    const char* DirtyBufferNames[] = { "DirtyKeyBuf0", "DirtyKeyBuf1", "DirtyPayloadBuf0", "DirtyPayloadBuf1" };
+    for (uint32_t i = 0; i < 2; ++i)
     {
-        Trace("Failed to create buffer for Scratch");
+        allocCreateInfo.pUserData = (void*)DirtyBufferNames[i];
+        if (VK_SUCCESS != vmaCreateBuffer(m_pDevice->GetAllocator(), &bufferCreateInfo, &allocCreateInfo, &m_DirtyKeyBuffers[i], &m_DirtyKeyBufferAllocations[i], nullptr))
+        {
+            Trace(std::string("Failed to create buffer for ") + DirtyBufferNames[i]);
+        }
+        allocCreateInfo.pUserData = (void*)DirtyBufferNames[2 + i];
+        if (VK_SUCCESS != vmaCreateBuffer(m_pDevice->GetAllocator(), &bufferCreateInfo, &allocCreateInfo, &m_DirtyPayloadBuffers[i], &m_DirtyPayloadBufferAllocations[i], nullptr))
+        {
+            Trace(std::string("Failed to create buffer for ") + DirtyBufferNames[2 + i]);
+        }
     }
-        
-    bufferCreateInfo.size = m_ReducedScratchBufferSize;
-    allocCreateInfo.pUserData = "ReducedScratch";
-    if (VK_SUCCESS != vmaCreateBuffer(m_pDevice->GetAllocator(), &bufferCreateInfo, &allocCreateInfo, &m_FPSReducedScratchBuffer, &m_FPSReducedScratchBufferAllocation, nullptr))
+
+    allocCreateInfo.pUserData = "DirtyIndices";
+    if (VK_SUCCESS != vmaCreateBuffer(m_pDevice->GetAllocator(), &bufferCreateInfo, &allocCreateInfo, &m_DirtyIndexBuffer, &m_DirtyIndexBufferAllocation, nullptr))
     {
-        Trace("Failed to create buffer for ReducedScratch");
+        Trace("Failed to create buffer for DirtyIndices");
     }
-        
-    // Allocate the buffers for indirect execution of the algorithm
-        
-    bufferCreateInfo.size = sizeof(uint32_t) * 3;
-    bufferCreateInfo.usage = VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_TEXEL_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
-    allocCreateInfo.pUserData = "IndirectCount_Scatter_DispatchArgs";
-    if (VK_SUCCESS != vmaCreateBuffer(m_pDevice->GetAllocator(), &bufferCreateInfo, &allocCreateInfo, &m_IndirectCountScatterArgs, &m_IndirectCountScatterArgsAllocation, nullptr))
+
+    // Allocate the buffer deferred payload gathers carry source indices in (the temp payload buffer is the other half of the ping-pong)
+    bufferCreateInfo.size = sizeof(uint32_t) * m_MaxNumKeys;
+    allocCreateInfo.pUserData = "PayloadIndices";
+    if (VK_SUCCESS != vmaCreateBuffer(m_pDevice->GetAllocator(), &bufferCreateInfo, &allocCreateInfo, &m_PayloadIndexBuffer, &m_PayloadIndexBufferAllocation, nullptr))
     {
-        Trace("Failed to create buffer for IndirectCount_Scatter_DispatchArgs");
+        Trace("Failed to create buffer for PayloadIndices");
     }
-        
-    allocCreateInfo.pUserData = "IndirectReduceScanArgs";
-    if (VK_SUCCESS != vmaCreateBuffer(m_pDevice->GetAllocator(), &bufferCreateInfo, &allocCreateInfo, &m_IndirectReduceScanArgs, &m_IndirectReduceScanArgsAllocation, nullptr))
+
+    // Allocate the key records (only sized for the biggest key set when sorting key records)
+    bufferCreateInfo.size = KeyRecordStrideOverride ? (VkDeviceSize)KeyRecordStrideOverride * m_MaxNumKeys : sizeof(uint32_t);
+    allocCreateInfo.pUserData = "KeyRecords";
+    if (VK_SUCCESS != vmaCreateBuffer(m_pDevice->GetAllocator(), &bufferCreateInfo, &allocCreateInfo, &m_KeyRecordBuffer, &m_KeyRecordBufferAllocation, nullptr))
     {
-        Trace("Failed to create buffer for IndirectCount_Scatter_DispatchArgs");
+        Trace("Failed to create buffer for KeyRecords");
     }
-        
-    bufferCreateInfo.size = sizeof(FFX_ParallelSortCB);
-    bufferCreateInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_TEXEL_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
-    allocCreateInfo.pUserData = "IndirectConstantBuffer";
-    if (VK_SUCCESS != vmaCreateBuffer(m_pDevice->GetAllocator(), &bufferCreateInfo, &allocCreateInfo, &m_IndirectConstantBuffer, &m_IndirectConstantBufferAllocation, nullptr))
+
+    // Allocate the run offsets for out-of-core merges (one sorted run per chunk of keys that fits in the sort buffers, plus the end)
+    uint32_t MaxNumRuns = std::max((OutOfCoreOverride + m_MaxNumKeys - 1) / m_MaxNumKeys, 1u);
+    bufferCreateInfo.size = sizeof(uint32_t) * (MaxNumRuns + 1);
+    allocCreateInfo.pUserData = "RunOffsets";
+    if (VK_SUCCESS != vmaCreateBuffer(m_pDevice->GetAllocator(), &bufferCreateInfo, &allocCreateInfo, &m_RunOffsetBuffer, &m_RunOffsetBufferAllocation, nullptr))
     {
-        Trace("Failed to create buffer for IndirectConstantBuffer");
+        Trace("Failed to create buffer for RunOffsets");
     }
 
     // Create Pipeline layout for Sort pass
@@ -383,6 +1227,8 @@ void FFXParallelSort::OnCreate(Device* pDevice, ResourceViewHeaps* pResourceView
             { 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_ALL, nullptr },  // DstBuffer (sort)
             { 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_ALL, nullptr },  // ScrPayload (sort only)
             { 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_ALL, nullptr },  // DstPayload (sort only)
+            { 4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_ALL, nullptr },  // SrcKeys16 (16-bit key storage only)
+            { 5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_ALL, nullptr },  // DstKeys16 (16-bit key storage only)
         };
 
         VkDescriptorSetLayoutBinding layout_bindings_set_Scan[] = {
@@ -394,13 +1240,26 @@ void FFXParallelSort::OnCreate(Device* pDevice, ResourceViewHeaps* pResourceView
         VkDescriptorSetLayoutBinding layout_bindings_set_Scratch[] = {
             { 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_ALL, nullptr },  // Scratch (sort only)
             { 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_ALL, nullptr },  // Scratch (reduced)
+            { 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_ALL, nullptr },  // SelectState (top-K only)
         };
 
         VkDescriptorSetLayoutBinding layout_bindings_set_Indirect[] = {
             { 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_ALL, nullptr },  // NumKeys (indirect)
             { 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_ALL, nullptr },  // CBufferUAV (indirect)
             { 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_ALL, nullptr },  // CountScatterArgs (indirect)
-            { 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_ALL, nullptr }   // ReduceScanArgs (indirect)
+            { 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_ALL, nullptr },  // ReduceScanArgs (indirect)
+            { 4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_ALL, nullptr },  // PresortState (indirect presort check only)
+            { 5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_ALL, nullptr }   // ValidateState (GPU validation only)
+        };
+
+        VkDescriptorSetLayoutBinding layout_bindings_set_Dirty[] = {
+            { 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_ALL, nullptr },  // DirtyKeys (incremental re-sort)
+            { 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_ALL, nullptr },  // DirtyPayload (incremental re-sort)
+            { 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_ALL, nullptr }   // DirtyIndices (incremental re-sort)
+        };
+
+        VkDescriptorSetLayoutBinding layout_bindings_set_RunOffsets[] = {
+            { 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_ALL, nullptr }   // RunOffsets (out-of-core merge)
         };
 
         VkDescriptorSetLayoutCreateInfo descriptor_set_layout_create_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
@@ -410,51 +1269,61 @@ void FFXParallelSort::OnCreate(Device* pDevice, ResourceViewHeaps* pResourceView
         descriptor_set_layout_create_info.bindingCount = 1;
         VkResult vkResult = vkCreateDescriptorSetLayout(m_pDevice->GetDevice(), &descriptor_set_layout_create_info, nullptr, &m_SortDescriptorSetLayoutConstants);
         assert(vkResult == VK_SUCCESS);
-        bool bDescriptorAlloc = true;
-        bDescriptorAlloc &= m_pResourceViewHeaps->AllocDescriptor(m_SortDescriptorSetLayoutConstants, &m_SortDescriptorSetConstants[0]);
-        bDescriptorAlloc &= m_pResourceViewHeaps->AllocDescriptor(m_SortDescriptorSetLayoutConstants, &m_SortDescriptorSetConstants[1]);
-        bDescriptorAlloc &= m_pResourceViewHeaps->AllocDescriptor(m_SortDescriptorSetLayoutConstants, &m_SortDescriptorSetConstants[2]);
-        assert(bDescriptorAlloc == true);
 
         descriptor_set_layout_create_info.pBindings = layout_bindings_set_1;
         descriptor_set_layout_create_info.bindingCount = 1;
         vkResult = vkCreateDescriptorSetLayout(m_pDevice->GetDevice(), &descriptor_set_layout_create_info, nullptr, &m_SortDescriptorSetLayoutConstantsIndirect);
         assert(vkResult == VK_SUCCESS);
-        bDescriptorAlloc &= m_pResourceViewHeaps->AllocDescriptor(m_SortDescriptorSetLayoutConstantsIndirect, &m_SortDescriptorSetConstantsIndirect[0]);
-        bDescriptorAlloc &= m_pResourceViewHeaps->AllocDescriptor(m_SortDescriptorSetLayoutConstantsIndirect, &m_SortDescriptorSetConstantsIndirect[1]);
-        bDescriptorAlloc &= m_pResourceViewHeaps->AllocDescriptor(m_SortDescriptorSetLayoutConstantsIndirect, &m_SortDescriptorSetConstantsIndirect[2]);
-        assert(bDescriptorAlloc == true);
 
         descriptor_set_layout_create_info.pBindings = layout_bindings_set_InputOutputs;
-        descriptor_set_layout_create_info.bindingCount = 4;
+        descriptor_set_layout_create_info.bindingCount = 6;
         vkResult = vkCreateDescriptorSetLayout(m_pDevice->GetDevice(), &descriptor_set_layout_create_info, nullptr, &m_SortDescriptorSetLayoutInputOutputs);
         assert(vkResult == VK_SUCCESS);
-        bDescriptorAlloc = m_pResourceViewHeaps->AllocDescriptor(m_SortDescriptorSetLayoutInputOutputs, &m_SortDescriptorSetInputOutput[0]);
+        bool bDescriptorAlloc = m_pResourceViewHeaps->AllocDescriptor(m_SortDescriptorSetLayoutInputOutputs, &m_SortDescriptorSetInputOutput[0]);
         assert(bDescriptorAlloc == true);
         bDescriptorAlloc = m_pResourceViewHeaps->AllocDescriptor(m_SortDescriptorSetLayoutInputOutputs, &m_SortDescriptorSetInputOutput[1]);
         assert(bDescriptorAlloc == true);
+        bDescriptorAlloc &= m_pResourceViewHeaps->AllocDescriptor(m_SortDescriptorSetLayoutInputOutputs, &m_SortDescriptorSetDirtyInputOutput[0]);
+        bDescriptorAlloc &= m_pResourceViewHeaps->AllocDescriptor(m_SortDescriptorSetLayoutInputOutputs, &m_SortDescriptorSetDirtyInputOutput[1]);
+        bDescriptorAlloc &= m_pResourceViewHeaps->AllocDescriptor(m_SortDescriptorSetLayoutInputOutputs, &m_SortDescriptorSetPayloadIndexInputOutput[0]);
+        bDescriptorAlloc &= m_pResourceViewHeaps->AllocDescriptor(m_SortDescriptorSetLayoutInputOutputs, &m_SortDescriptorSetPayloadIndexInputOutput[1]);
+        bDescriptorAlloc &= m_pResourceViewHeaps->AllocDescriptor(m_SortDescriptorSetLayoutInputOutputs, &m_SortDescriptorSetGatherPayload);
+        bDescriptorAlloc &= m_pResourceViewHeaps->AllocDescriptor(m_SortDescriptorSetLayoutInputOutputs, &m_SortDescriptorSetKeyRecordsInputOutput);
+        bDescriptorAlloc &= m_pResourceViewHeaps->AllocDescriptor(m_SortDescriptorSetLayoutInputOutputs, &m_SortDescriptorSetWriteKeyRecords);
+        if (m_b16BitKeyStorage)
+        {
+            bDescriptorAlloc &= m_pResourceViewHeaps->AllocDescriptor(m_SortDescriptorSetLayoutInputOutputs, &m_SortDescriptorSet16BitInputOutput[0]);
+            bDescriptorAlloc &= m_pResourceViewHeaps->AllocDescriptor(m_SortDescriptorSetLayoutInputOutputs, &m_SortDescriptorSet16BitInputOutput[1]);
+        }
+        assert(bDescriptorAlloc == true);
 
         descriptor_set_layout_create_info.pBindings = layout_bindings_set_Scan;
         descriptor_set_layout_create_info.bindingCount = 3;
         vkResult = vkCreateDescriptorSetLayout(m_pDevice->GetDevice(), &descriptor_set_layout_create_info, nullptr, &m_SortDescriptorSetLayoutScan);
         assert(vkResult == VK_SUCCESS);
-        bDescriptorAlloc = m_pResourceViewHeaps->AllocDescriptor(m_SortDescriptorSetLayoutScan, &m_SortDescriptorSetScanSets[0]);
-        assert(bDescriptorAlloc == true);
-        bDescriptorAlloc = m_pResourceViewHeaps->AllocDescriptor(m_SortDescriptorSetLayoutScan, &m_SortDescriptorSetScanSets[1]);
-        assert(bDescriptorAlloc == true);
 
         descriptor_set_layout_create_info.pBindings = layout_bindings_set_Scratch;
-        descriptor_set_layout_create_info.bindingCount = 2;
+        descriptor_set_layout_create_info.bindingCount = 3;
         vkResult = vkCreateDescriptorSetLayout(m_pDevice->GetDevice(), &descriptor_set_layout_create_info, nullptr, &m_SortDescriptorSetLayoutScratch);
         assert(vkResult == VK_SUCCESS);
-        bDescriptorAlloc = m_pResourceViewHeaps->AllocDescriptor(m_SortDescriptorSetLayoutScratch, &m_SortDescriptorSetScratch);
-        assert(bDescriptorAlloc == true);
 
         descriptor_set_layout_create_info.pBindings = layout_bindings_set_Indirect;
-        descriptor_set_layout_create_info.bindingCount = 4;
+        descriptor_set_layout_create_info.bindingCount = 6;
         vkResult = vkCreateDescriptorSetLayout(m_pDevice->GetDevice(), &descriptor_set_layout_create_info, nullptr, &m_SortDescriptorSetLayoutIndirect);
         assert(vkResult == VK_SUCCESS);
-        bDescriptorAlloc = m_pResourceViewHeaps->AllocDescriptor(m_SortDescriptorSetLayoutIndirect, &m_SortDescriptorSetIndirect);
+
+        descriptor_set_layout_create_info.pBindings = layout_bindings_set_Dirty;
+        descriptor_set_layout_create_info.bindingCount = 3;
+        vkResult = vkCreateDescriptorSetLayout(m_pDevice->GetDevice(), &descriptor_set_layout_create_info, nullptr, &m_SortDescriptorSetLayoutDirty);
+        assert(vkResult == VK_SUCCESS);
+        bDescriptorAlloc = m_pResourceViewHeaps->AllocDescriptor(m_SortDescriptorSetLayoutDirty, &m_SortDescriptorSetDirty);
+        assert(bDescriptorAlloc == true);
+
+        descriptor_set_layout_create_info.pBindings = layout_bindings_set_RunOffsets;
+        descriptor_set_layout_create_info.bindingCount = 1;
+        vkResult = vkCreateDescriptorSetLayout(m_pDevice->GetDevice(), &descriptor_set_layout_create_info, nullptr, &m_SortDescriptorSetLayoutRunOffsets);
+        assert(vkResult == VK_SUCCESS);
+        bDescriptorAlloc = m_pResourceViewHeaps->AllocDescriptor(m_SortDescriptorSetLayoutRunOffsets, &m_SortDescriptorSetRunOffsets);
         assert(bDescriptorAlloc == true);
 
         // Create constant range representing our static constant
@@ -467,9 +1336,10 @@ void FFXParallelSort::OnCreate(Device* pDevice, ResourceViewHeaps* pResourceView
         VkPipelineLayoutCreateInfo layout_create_info = { VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
         layout_create_info.pNext = nullptr;
         layout_create_info.flags = 0;
-        layout_create_info.setLayoutCount = 6;
+        layout_create_info.setLayoutCount = 8;
         VkDescriptorSetLayout layouts[] = { m_SortDescriptorSetLayoutConstants, m_SortDescriptorSetLayoutConstantsIndirect, m_SortDescriptorSetLayoutInputOutputs, 
-                                            m_SortDescriptorSetLayoutScan, m_SortDescriptorSetLayoutScratch, m_SortDescriptorSetLayoutIndirect };
+                                            m_SortDescriptorSetLayoutScan, m_SortDescriptorSetLayoutScratch, m_SortDescriptorSetLayoutIndirect, m_SortDescriptorSetLayoutDirty,
+                                            m_SortDescriptorSetLayoutRunOffsets };
         layout_create_info.pSetLayouts = layouts;
         layout_create_info.pushConstantRangeCount = 1;
         layout_create_info.pPushConstantRanges = &constant_range;
@@ -534,27 +1404,140 @@ void FFXParallelSort::OnCreate(Device* pDevice, ResourceViewHeaps* pResourceView
     //////////////////////////////////////////////////////////////////////////
     // Create pipelines for radix sort
     {
-        // Create all of the necessary pipelines for Sort and Scan
+        // Create all of the necessary pipelines for Sort and Scan (these all build in parallel)
 
         // SetupIndirectParams (indirect only)
         DefineList defines;
         defines["VK_Const"] = std::to_string(1);
-        CompileRadixPipeline("ParallelSortCS.hlsl", &defines, "FPS_SetupIndirectParameters", m_FPSIndirectSetupParametersPipeline);
+        m_FPSIndirectSetupParametersPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &defines, "FPS_SetupIndirectParameters");
+
+        // Presort check (inversion count, and setup that skips the sort when there were none)
+        DefineList presortDefines = defines;
+        presortDefines["kRS_PresortCheck"] = std::to_string(1);
+        m_FPSIndirectSetupPresortPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &presortDefines, "FPS_SetupIndirectParameters");
+        m_FPSCountInversionsPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &defines, "FPS_CountInversions");
+
+        // GPU validation (checksums of the keys going in, checksums and order of the keys coming out, and the result record)
+        DefineList validatePayloadDefines = defines;
+        validatePayloadDefines["kRS_ValueCopy"] = std::to_string(1);
+        m_FPSValidateInputPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &defines, "FPS_ValidateInput");
+        m_FPSValidateInputPayloadPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &validatePayloadDefines, "FPS_ValidateInput");
+        m_FPSValidateOutputPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &defines, "FPS_ValidateOutput");
+        m_FPSValidateOutputPayloadPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &validatePayloadDefines, "FPS_ValidateOutput");
+        m_FPSValidateResultPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &defines, "FPS_ValidateResult");
+
+        // Multi-word keys need the count and scatter passes to walk the key's word planes
+        if (m_NumKeyWords > 1)
+            defines["kRS_MultiWordKeys"] = std::to_string(1);
 
         // Radix count (sum table generation)
-        CompileRadixPipeline("ParallelSortCS.hlsl", &defines, "FPS_Count", m_FPSCountPipeline);
+        m_FPSCountPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &defines, "FPS_Count");
         // Radix count reduce (sum table reduction for offset prescan)
-        CompileRadixPipeline("ParallelSortCS.hlsl", &defines, "FPS_CountReduce", m_FPSCountReducePipeline);
+        m_FPSCountReducePipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &defines, "FPS_CountReduce");
         // Radix scan (prefix scan)
-        CompileRadixPipeline("ParallelSortCS.hlsl", &defines, "FPS_Scan", m_FPSScanPipeline);
+        m_FPSScanPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &defines, "FPS_Scan");
         // Radix scan add (prefix scan + reduced prefix scan addition)
-        CompileRadixPipeline("ParallelSortCS.hlsl", &defines, "FPS_ScanAdd", m_FPSScanAddPipeline);
+        m_FPSScanAddPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &defines, "FPS_ScanAdd");
+        // Radix reduce + scan + scan add in a single thread group (for small thread group counts)
+        m_FPSReduceScanAddPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &defines, "FPS_ReduceScanAdd");
+        // Radix scan for reduced tables that don't fit in one thread group (block reduce, block sum scan, block scan + add)
+        m_FPSScanBlockReducePipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &defines, "FPS_ScanBlockReduce");
+        m_FPSScanBlockSumsPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &defines, "FPS_ScanBlockSums");
+        m_FPSScanBlockAddPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &defines, "FPS_ScanBlockAdd");
         // Radix scatter (key redistribution)
-        CompileRadixPipeline("ParallelSortCS.hlsl", &defines, "FPS_Scatter", m_FPSScatterPipeline);
+        m_FPSScatterPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &defines, "FPS_Scatter");
         
         // Radix scatter with payload (key and payload redistribution)
         defines["kRS_ValueCopy"] = std::to_string(1);
-        CompileRadixPipeline("ParallelSortCS.hlsl", &defines, "FPS_Scatter", m_FPSScatterPayloadPipeline);
+        m_FPSScatterPayloadPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &defines, "FPS_Scatter");
+
+        // Deferred payload gather (first scatter makes up the source indices, the payload moves once at the end)
+        DefineList indexDefines = defines;
+        indexDefines["kRS_IndexPayload"] = std::to_string(1);
+        m_FPSScatterIndexPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &indexDefines, "FPS_Scatter");
+        DefineList gatherDefines;
+        gatherDefines["VK_Const"] = std::to_string(1);
+        m_FPSGatherPayloadPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &gatherDefines, "FPS_GatherPayload");
+
+        // Packed key+index sorts (the passes in between are keys only)
+        m_FPSPackKeyIndexPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &gatherDefines, "FPS_PackKeyIndex");
+        m_FPSUnpackKeyIndexPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &gatherDefines, "FPS_UnpackKeyIndex");
+
+        // Key hooks (first pass' count and scatter load the keys through a hook, last pass' scatter stores them through one)
+        DefineList loadKeyDefines;
+        loadKeyDefines["VK_Const"] = std::to_string(1);
+        loadKeyDefines["kRS_LoadKeyHook"] = std::to_string(1);
+        m_FPSCountLoadKeyPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &loadKeyDefines, "FPS_Count");
+        m_FPSScatterLoadKeyPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &loadKeyDefines, "FPS_Scatter");
+        loadKeyDefines["kRS_ValueCopy"] = std::to_string(1);
+        m_FPSScatterLoadKeyPayloadPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &loadKeyDefines, "FPS_Scatter");
+        DefineList storeKeyDefines;
+        storeKeyDefines["VK_Const"] = std::to_string(1);
+        storeKeyDefines["kRS_StoreKeyHook"] = std::to_string(1);
+        m_FPSScatterStoreKeyPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &storeKeyDefines, "FPS_Scatter");
+        storeKeyDefines["kRS_ValueCopy"] = std::to_string(1);
+        m_FPSScatterStoreKeyPayloadPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &storeKeyDefines, "FPS_Scatter");
+
+        // Key records (first pass' count and scatter read the keys out of the records)
+        m_FPSWriteKeyRecordsPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &gatherDefines, "FPS_WriteKeyRecords");
+        DefineList keyRecordDefines;
+        keyRecordDefines["VK_Const"] = std::to_string(1);
+        keyRecordDefines["kRS_StridedKeys"] = std::to_string(1);
+        m_FPSCountKeyRecordsPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &keyRecordDefines, "FPS_Count");
+        m_FPSScatterKeyRecordsPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &keyRecordDefines, "FPS_Scatter");
+        keyRecordDefines["kRS_ValueCopy"] = std::to_string(1);
+        m_FPSScatterKeyRecordsPayloadPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &keyRecordDefines, "FPS_Scatter");
+
+        // Read-only input (count and scatter read the keys and payload through read-only views, count with 128-bit loads)
+        DefineList readOnlyDefines = defines;
+        readOnlyDefines.erase("kRS_ValueCopy");
+        readOnlyDefines["kRS_ReadOnlyInput"] = std::to_string(1);
+        m_FPSCountReadOnlyPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &readOnlyDefines, "FPS_Count");
+        m_FPSScatterReadOnlyPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &readOnlyDefines, "FPS_Scatter");
+        readOnlyDefines["kRS_ValueCopy"] = std::to_string(1);
+        m_FPSScatterReadOnlyPayloadPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &readOnlyDefines, "FPS_Scatter");
+
+        // 16-bit key storage (count and scatter read and write the keys as 16-bit values, only built when the device can run them)
+        if (m_b16BitKeyStorage)
+        {
+            DefineList key16Defines;
+            key16Defines["VK_Const"] = std::to_string(1);
+            key16Defines["kRS_16BitKeys"] = std::to_string(1);
+            m_FPSCount16BitPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &key16Defines, "FPS_Count");
+            m_FPSScatter16BitPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &key16Defines, "FPS_Scatter");
+            key16Defines["kRS_ValueCopy"] = std::to_string(1);
+            m_FPSScatter16BitPayloadPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &key16Defines, "FPS_Scatter");
+            m_FPSValidateInput16BitPayloadPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &key16Defines, "FPS_ValidateInput");
+            m_FPSValidateOutput16BitPayloadPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &key16Defines, "FPS_ValidateOutput");
+            key16Defines.erase("kRS_ValueCopy");
+            m_FPSValidateInput16BitPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &key16Defines, "FPS_ValidateInput");
+            m_FPSValidateOutput16BitPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &key16Defines, "FPS_ValidateOutput");
+        }
+
+        // Selection (threshold digit select, compaction, prefix filtered count, per query reduce, and compaction with payload)
+        DefineList selectDefines;
+        selectDefines["VK_Const"] = std::to_string(1);
+        m_FPSSelectDigitPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &selectDefines, "FPS_SelectDigit");
+        m_FPSSelectCompactPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &selectDefines, "FPS_SelectCompact");
+        selectDefines["kRS_SelectPrefix"] = std::to_string(1);
+        m_FPSSelectCountPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &selectDefines, "FPS_Count");
+        m_FPSSelectReducePipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &selectDefines, "FPS_CountReduce");
+        selectDefines["kRS_ValueCopy"] = std::to_string(1);
+        m_FPSSelectCompactPayloadPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &selectDefines, "FPS_SelectCompact");
+
+        // Incremental re-sort (sample's changed key generation, dirty payload gather, merge with and without payload)
+        DefineList mergeDefines;
+        mergeDefines["VK_Const"] = std::to_string(1);
+        m_FPSGenerateDirtyKeysPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &mergeDefines, "FPS_GenerateDirtyKeys");
+        m_FPSGatherDirtyPayloadPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &mergeDefines, "FPS_GatherDirtyPayload");
+        m_FPSMergePipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &mergeDefines, "FPS_Merge");
+        mergeDefines["kRS_ValueCopy"] = std::to_string(1);
+        m_FPSMergePayloadPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &mergeDefines, "FPS_Merge");
+
+        // Out-of-core merge of sorted runs (keys only)
+        DefineList mergeRunsDefines;
+        mergeRunsDefines["VK_Const"] = std::to_string(1);
+        m_FPSMergeRunsPipeline = CompileRadixPipeline("ParallelSortCS.hlsl", &mergeRunsDefines, "FPS_MergeRuns");
     }
         
     //////////////////////////////////////////////////////////////////////////
@@ -714,7 +1697,7 @@ void FFXParallelSort::OnCreate(Device* pDevice, ResourceViewHeaps* pResourceView
 
     // Do binding setups
     {
-        VkBuffer BufferMaps[4];
+        VkBuffer BufferMaps[6];
 
         // Map inputs/outputs
         BufferMaps[0] = m_DstKeyBuffers[0];
@@ -729,25 +1712,79 @@ void FFXParallelSort::OnCreate(Device* pDevice, ResourceViewHeaps* pResourceView
         BufferMaps[3] = m_DstPayloadBuffers[0];
         BindUAVBuffer(BufferMaps, m_SortDescriptorSetInputOutput[1], 0, 4);
 
-        // Map scan sets (reduced, scratch)
-        BufferMaps[0] = BufferMaps[1] = m_FPSReducedScratchBuffer;
-        BindUAVBuffer(BufferMaps, m_SortDescriptorSetScanSets[0], 0, 2);
+        // Map the incremental re-sort's inputs/outputs (same ping-pong over the dirty buffers) and its dirty set
+        BufferMaps[0] = m_DirtyKeyBuffers[0];
+        BufferMaps[1] = m_DirtyKeyBuffers[1];
+        BufferMaps[2] = m_DirtyPayloadBuffers[0];
+        BufferMaps[3] = m_DirtyPayloadBuffers[1];
+        BindUAVBuffer(BufferMaps, m_SortDescriptorSetDirtyInputOutput[0], 0, 4);
 
-        BufferMaps[0] = BufferMaps[1] = m_FPSScratchBuffer;
-        BufferMaps[2] = m_FPSReducedScratchBuffer;
-        BindUAVBuffer(BufferMaps, m_SortDescriptorSetScanSets[1], 0, 3);
+        BufferMaps[0] = m_DirtyKeyBuffers[1];
+        BufferMaps[1] = m_DirtyKeyBuffers[0];
+        BufferMaps[2] = m_DirtyPayloadBuffers[1];
+        BufferMaps[3] = m_DirtyPayloadBuffers[0];
+        BindUAVBuffer(BufferMaps, m_SortDescriptorSetDirtyInputOutput[1], 0, 4);
 
-        // Map Scratch areas (fixed)
-        BufferMaps[0] = m_FPSScratchBuffer;
-        BufferMaps[1] = m_FPSReducedScratchBuffer;
-        BindUAVBuffer(BufferMaps, m_SortDescriptorSetScratch, 0, 2);
+        // Map the deferred payload gather's inputs/outputs (source indices ping-pong with the temp payload buffer) and the gather itself
+        BufferMaps[0] = m_DstKeyBuffers[0];
+        BufferMaps[1] = m_DstKeyBuffers[1];
+        BufferMaps[2] = m_PayloadIndexBuffer;
+        BufferMaps[3] = m_DstPayloadBuffers[1];
+        BindUAVBuffer(BufferMaps, m_SortDescriptorSetPayloadIndexInputOutput[0], 0, 4);
 
-        // Map indirect buffers
-        BufferMaps[0] = m_IndirectKeyCounts;
-        BufferMaps[1] = m_IndirectConstantBuffer;
-        BufferMaps[2] = m_IndirectCountScatterArgs;
-        BufferMaps[3] = m_IndirectReduceScanArgs;
-        BindUAVBuffer(BufferMaps, m_SortDescriptorSetIndirect, 0, 4);
+        BufferMaps[0] = m_DstKeyBuffers[1];
+        BufferMaps[1] = m_DstKeyBuffers[0];
+        BufferMaps[2] = m_DstPayloadBuffers[1];
+        BufferMaps[3] = m_PayloadIndexBuffer;
+        BindUAVBuffer(BufferMaps, m_SortDescriptorSetPayloadIndexInputOutput[1], 0, 4);
+
+        BufferMaps[0] = m_PayloadIndexBuffer;
+        BufferMaps[1] = m_DstKeyBuffers[1];
+        BufferMaps[2] = m_DstPayloadBuffers[0];
+        BufferMaps[3] = m_DstPayloadBuffers[1];
+        BindUAVBuffer(BufferMaps, m_SortDescriptorSetGatherPayload, 0, 4);
+
+        // Map the key records (read by the first pass of key record sorts, written from the sort buffers)
+        BufferMaps[0] = m_KeyRecordBuffer;
+        BufferMaps[1] = m_DstKeyBuffers[1];
+        BufferMaps[2] = m_DstPayloadBuffers[0];
+        BufferMaps[3] = m_DstPayloadBuffers[1];
+        BindUAVBuffer(BufferMaps, m_SortDescriptorSetKeyRecordsInputOutput, 0, 4);
+
+        BufferMaps[0] = m_DstKeyBuffers[0];
+        BufferMaps[1] = m_KeyRecordBuffer;
+        BindUAVBuffer(BufferMaps, m_SortDescriptorSetWriteKeyRecords, 0, 4);
+
+        // Map the 16-bit keys (to their own bindings, with the same key and payload buffers as the 32-bit sorts in the others)
+        if (m_b16BitKeyStorage)
+        {
+            BufferMaps[0] = m_DstKeyBuffers[0];
+            BufferMaps[1] = m_DstKeyBuffers[1];
+            BufferMaps[2] = m_DstPayloadBuffers[0];
+            BufferMaps[3] = m_DstPayloadBuffers[1];
+            BufferMaps[4] = m_DstKey16Buffers[0];
+            BufferMaps[5] = m_DstKey16Buffers[1];
+            BindUAVBuffer(BufferMaps, m_SortDescriptorSet16BitInputOutput[0], 0, 6);
+
+            BufferMaps[0] = m_DstKeyBuffers[1];
+            BufferMaps[1] = m_DstKeyBuffers[0];
+            BufferMaps[2] = m_DstPayloadBuffers[1];
+            BufferMaps[3] = m_DstPayloadBuffers[0];
+            BufferMaps[4] = m_DstKey16Buffers[1];
+            BufferMaps[5] = m_DstKey16Buffers[0];
+            BindUAVBuffer(BufferMaps, m_SortDescriptorSet16BitInputOutput[1], 0, 6);
+        }
+
+        BufferMaps[0] = m_DirtyKeyBuffers[0];
+        BufferMaps[1] = m_DirtyPayloadBuffers[0];
+        BufferMaps[2] = m_DirtyIndexBuffer;
+        BindUAVBuffer(BufferMaps, m_SortDescriptorSetDirty, 0, 3);
+
+        // Map the out-of-core merge's run offsets
+        BindUAVBuffer(&m_RunOffsetBuffer, m_SortDescriptorSetRunOffsets);
+
+        // Create the default sort context (scratch, indirect and constant state for sorts that aren't handed a context of their own)
+        m_pDefaultSortContext = AcquireSortContext();
 
         // Bind validation textures
         for (int i = 0; i < 3; ++i)
@@ -777,6 +1814,15 @@ void FFXParallelSort::OnCreate(Device* pDevice, ResourceViewHeaps* pResourceView
         BindUAVBuffer(&m_SrcKeyBuffers[2], m_RenderDescriptorSet1[2]);
         BindUAVBuffer(&m_DstKeyBuffers[0], m_RenderDescriptorSet1[3]);
     }
+
+    // Unless asked not to, wait for the sort pipelines here. In async mode the first Sort() will only 
+    // wait on the permutations it actually binds.
+    if (!AsyncPipelineOverride)
+        WaitForPipelines();
+
+    // Out-of-core sorts run once up front (they stream everything through the upload heap)
+    if (OutOfCoreOverride)
+        SortOutOfCore(OutOfCoreOverride);
 }
 
 // Parallel Sort termination
@@ -807,108 +1853,311 @@ void FFXParallelSort::OnDestroy()
 
     // Release radix sort indirect resources
     vmaDestroyBuffer(m_pDevice->GetAllocator(), m_IndirectKeyCounts, m_IndirectKeyCountsAllocation);
-    vmaDestroyBuffer(m_pDevice->GetAllocator(), m_IndirectConstantBuffer, m_IndirectConstantBufferAllocation);
-    vmaDestroyBuffer(m_pDevice->GetAllocator(), m_IndirectCountScatterArgs, m_IndirectCountScatterArgsAllocation);
-    vmaDestroyBuffer(m_pDevice->GetAllocator(), m_IndirectReduceScanArgs, m_IndirectReduceScanArgsAllocation);
-    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSIndirectSetupParametersPipeline, nullptr);
+    vmaDestroyBuffer(m_pDevice->GetAllocator(), m_PresortStateBuffer, m_PresortStateBufferAllocation);
+    vmaUnmapMemory(m_pDevice->GetAllocator(), m_PresortReadBackBufferAllocation);
+    vmaDestroyBuffer(m_pDevice->GetAllocator(), m_PresortReadBackBuffer, m_PresortReadBackBufferAllocation);
+    vmaUnmapMemory(m_pDevice->GetAllocator(), m_PercentileReadBackBufferAllocation);
+    vmaDestroyBuffer(m_pDevice->GetAllocator(), m_PercentileReadBackBuffer, m_PercentileReadBackBufferAllocation);
+    vmaDestroyBuffer(m_pDevice->GetAllocator(), m_ValidateStateBuffer, m_ValidateStateBufferAllocation);
+    vmaUnmapMemory(m_pDevice->GetAllocator(), m_ValidateReadBackBufferAllocation);
+    vmaDestroyBuffer(m_pDevice->GetAllocator(), m_ValidateReadBackBuffer, m_ValidateReadBackBufferAllocation);
+
+    // Pipelines may still be building if we never sorted, get() waits for them
+    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSIndirectSetupParametersPipeline.get(), nullptr);
+    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSIndirectSetupPresortPipeline.get(), nullptr);
+    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSCountInversionsPipeline.get(), nullptr);
+    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSValidateInputPipeline.get(), nullptr);
+    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSValidateInputPayloadPipeline.get(), nullptr);
+    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSValidateOutputPipeline.get(), nullptr);
+    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSValidateOutputPayloadPipeline.get(), nullptr);
+    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSValidateResultPipeline.get(), nullptr);
 
     // Release radix sort algorithm resources
-    vmaDestroyBuffer(m_pDevice->GetAllocator(), m_FPSScratchBuffer, m_FPSScratchBufferAllocation);
-    vmaDestroyBuffer(m_pDevice->GetAllocator(), m_FPSReducedScratchBuffer, m_FPSReducedScratchBufferAllocation);
+    for (std::unique_ptr<SortContext>& Context : m_SortContexts)
+        DestroySortContext(*Context);
+    m_SortContexts.clear();
+    m_pDefaultSortContext = nullptr;
+    vmaDestroyBuffer(m_pDevice->GetAllocator(), m_FPSSelectStateBuffer, m_FPSSelectStateBufferAllocation);
 
     vkDestroyPipelineLayout(m_pDevice->GetDevice(), m_SortPipelineLayout, nullptr);
     vkDestroyDescriptorSetLayout(m_pDevice->GetDevice(), m_SortDescriptorSetLayoutConstants, nullptr);
-    m_pResourceViewHeaps->FreeDescriptor(m_SortDescriptorSetConstants[0]);
-    m_pResourceViewHeaps->FreeDescriptor(m_SortDescriptorSetConstants[1]);
-    m_pResourceViewHeaps->FreeDescriptor(m_SortDescriptorSetConstants[2]);
     vkDestroyDescriptorSetLayout(m_pDevice->GetDevice(), m_SortDescriptorSetLayoutConstantsIndirect, nullptr);
-    m_pResourceViewHeaps->FreeDescriptor(m_SortDescriptorSetConstantsIndirect[0]);
-    m_pResourceViewHeaps->FreeDescriptor(m_SortDescriptorSetConstantsIndirect[1]);
-    m_pResourceViewHeaps->FreeDescriptor(m_SortDescriptorSetConstantsIndirect[2]);
     vkDestroyDescriptorSetLayout(m_pDevice->GetDevice(), m_SortDescriptorSetLayoutInputOutputs, nullptr);
     m_pResourceViewHeaps->FreeDescriptor(m_SortDescriptorSetInputOutput[0]);
     m_pResourceViewHeaps->FreeDescriptor(m_SortDescriptorSetInputOutput[1]);
+    m_pResourceViewHeaps->FreeDescriptor(m_SortDescriptorSetDirtyInputOutput[0]);
+    m_pResourceViewHeaps->FreeDescriptor(m_SortDescriptorSetDirtyInputOutput[1]);
+    m_pResourceViewHeaps->FreeDescriptor(m_SortDescriptorSetPayloadIndexInputOutput[0]);
+    m_pResourceViewHeaps->FreeDescriptor(m_SortDescriptorSetPayloadIndexInputOutput[1]);
+    m_pResourceViewHeaps->FreeDescriptor(m_SortDescriptorSetGatherPayload);
+    m_pResourceViewHeaps->FreeDescriptor(m_SortDescriptorSetKeyRecordsInputOutput);
+    m_pResourceViewHeaps->FreeDescriptor(m_SortDescriptorSetWriteKeyRecords);
+    if (m_b16BitKeyStorage)
+    {
+        m_pResourceViewHeaps->FreeDescriptor(m_SortDescriptorSet16BitInputOutput[0]);
+        m_pResourceViewHeaps->FreeDescriptor(m_SortDescriptorSet16BitInputOutput[1]);
+    }
 
     vkDestroyDescriptorSetLayout(m_pDevice->GetDevice(), m_SortDescriptorSetLayoutScan, nullptr);
-    m_pResourceViewHeaps->FreeDescriptor(m_SortDescriptorSetScanSets[0]);
-    m_pResourceViewHeaps->FreeDescriptor(m_SortDescriptorSetScanSets[1]);
-
     vkDestroyDescriptorSetLayout(m_pDevice->GetDevice(), m_SortDescriptorSetLayoutScratch, nullptr);
-    m_pResourceViewHeaps->FreeDescriptor(m_SortDescriptorSetScratch);
-
     vkDestroyDescriptorSetLayout(m_pDevice->GetDevice(), m_SortDescriptorSetLayoutIndirect, nullptr);
-    m_pResourceViewHeaps->FreeDescriptor(m_SortDescriptorSetIndirect);
 
-    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSCountPipeline, nullptr);
-    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSCountReducePipeline, nullptr);
-    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSScanPipeline, nullptr);
-    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSScanAddPipeline, nullptr);
-    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSScatterPipeline, nullptr);
-    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSScatterPayloadPipeline, nullptr);
+    vkDestroyDescriptorSetLayout(m_pDevice->GetDevice(), m_SortDescriptorSetLayoutDirty, nullptr);
+    m_pResourceViewHeaps->FreeDescriptor(m_SortDescriptorSetDirty);
+
+    vkDestroyDescriptorSetLayout(m_pDevice->GetDevice(), m_SortDescriptorSetLayoutRunOffsets, nullptr);
+    m_pResourceViewHeaps->FreeDescriptor(m_SortDescriptorSetRunOffsets);
+
+    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSCountPipeline.get(), nullptr);
+    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSCountReducePipeline.get(), nullptr);
+    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSScanPipeline.get(), nullptr);
+    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSScanAddPipeline.get(), nullptr);
+    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSReduceScanAddPipeline.get(), nullptr);
+    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSScanBlockReducePipeline.get(), nullptr);
+    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSScanBlockSumsPipeline.get(), nullptr);
+    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSScanBlockAddPipeline.get(), nullptr);
+    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSScatterPipeline.get(), nullptr);
+    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSScatterPayloadPipeline.get(), nullptr);
+    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSScatterIndexPipeline.get(), nullptr);
+    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSGatherPayloadPipeline.get(), nullptr);
+    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSPackKeyIndexPipeline.get(), nullptr);
+    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSUnpackKeyIndexPipeline.get(), nullptr);
+    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSCountLoadKeyPipeline.get(), nullptr);
+    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSScatterLoadKeyPipeline.get(), nullptr);
+    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSScatterLoadKeyPayloadPipeline.get(), nullptr);
+    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSScatterStoreKeyPipeline.get(), nullptr);
+    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSScatterStoreKeyPayloadPipeline.get(), nullptr);
+    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSWriteKeyRecordsPipeline.get(), nullptr);
+    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSCountKeyRecordsPipeline.get(), nullptr);
+    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSScatterKeyRecordsPipeline.get(), nullptr);
+    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSScatterKeyRecordsPayloadPipeline.get(), nullptr);
+    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSCountReadOnlyPipeline.get(), nullptr);
+    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSScatterReadOnlyPipeline.get(), nullptr);
+    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSScatterReadOnlyPayloadPipeline.get(), nullptr);
+    if (m_b16BitKeyStorage)
+    {
+        vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSCount16BitPipeline.get(), nullptr);
+        vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSScatter16BitPipeline.get(), nullptr);
+        vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSScatter16BitPayloadPipeline.get(), nullptr);
+        vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSValidateInput16BitPipeline.get(), nullptr);
+        vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSValidateInput16BitPayloadPipeline.get(), nullptr);
+        vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSValidateOutput16BitPipeline.get(), nullptr);
+        vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSValidateOutput16BitPayloadPipeline.get(), nullptr);
+    }
+    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSSelectCountPipeline.get(), nullptr);
+    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSSelectReducePipeline.get(), nullptr);
+    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSSelectDigitPipeline.get(), nullptr);
+    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSSelectCompactPipeline.get(), nullptr);
+    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSSelectCompactPayloadPipeline.get(), nullptr);
+    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSGenerateDirtyKeysPipeline.get(), nullptr);
+    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSGatherDirtyPayloadPipeline.get(), nullptr);
+    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSMergePipeline.get(), nullptr);
+    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSMergePayloadPipeline.get(), nullptr);
+    vkDestroyPipeline(m_pDevice->GetDevice(), m_FPSMergeRunsPipeline.get(), nullptr);
+    m_CompilePool.Stop();
 
     // Release all of our resources
-    vmaDestroyBuffer(m_pDevice->GetAllocator(), m_SrcKeyBuffers[0], m_SrcKeyBufferAllocations[0]);
-    vmaDestroyBuffer(m_pDevice->GetAllocator(), m_SrcKeyBuffers[1], m_SrcKeyBufferAllocations[1]);
-    vmaDestroyBuffer(m_pDevice->GetAllocator(), m_SrcKeyBuffers[2], m_SrcKeyBufferAllocations[2]);
+    for (uint32_t i = 0; i < m_NumKeySets; ++i)
+        vmaDestroyBuffer(m_pDevice->GetAllocator(), m_SrcKeyBuffers[i], m_SrcKeyBufferAllocations[i]);
+    if (m_b16BitKeyStorage)
+    {
+        for (uint32_t i = 0; i < m_NumKeySets; ++i)
+            vmaDestroyBuffer(m_pDevice->GetAllocator(), m_SrcKey16Buffers[i], m_SrcKey16BufferAllocations[i]);
+        vmaDestroyBuffer(m_pDevice->GetAllocator(), m_DstKey16Buffers[0], m_DstKey16BufferAllocations[0]);
+        vmaDestroyBuffer(m_pDevice->GetAllocator(), m_DstKey16Buffers[1], m_DstKey16BufferAllocations[1]);
+    }
     vmaDestroyBuffer(m_pDevice->GetAllocator(), m_SrcPayloadBuffers, m_SrcPayloadBufferAllocation);
     vmaDestroyBuffer(m_pDevice->GetAllocator(), m_DstKeyBuffers[0], m_DstKeyBufferAllocations[0]);
     vmaDestroyBuffer(m_pDevice->GetAllocator(), m_DstKeyBuffers[1], m_DstKeyBufferAllocations[1]);
     vmaDestroyBuffer(m_pDevice->GetAllocator(), m_DstPayloadBuffers[0], m_DstPayloadBufferAllocations[0]);
     vmaDestroyBuffer(m_pDevice->GetAllocator(), m_DstPayloadBuffers[1], m_DstPayloadBufferAllocations[1]);
+    vmaDestroyBuffer(m_pDevice->GetAllocator(), m_DirtyKeyBuffers[0], m_DirtyKeyBufferAllocations[0]);
+    vmaDestroyBuffer(m_pDevice->GetAllocator(), m_DirtyKeyBuffers[1], m_DirtyKeyBufferAllocations[1]);
+    vmaDestroyBuffer(m_pDevice->GetAllocator(), m_DirtyPayloadBuffers[0], m_DirtyPayloadBufferAllocations[0]);
+    vmaDestroyBuffer(m_pDevice->GetAllocator(), m_DirtyPayloadBuffers[1], m_DirtyPayloadBufferAllocations[1]);
+    vmaDestroyBuffer(m_pDevice->GetAllocator(), m_DirtyIndexBuffer, m_DirtyIndexBufferAllocation);
+    vmaDestroyBuffer(m_pDevice->GetAllocator(), m_PayloadIndexBuffer, m_PayloadIndexBufferAllocation);
+    vmaDestroyBuffer(m_pDevice->GetAllocator(), m_KeyRecordBuffer, m_KeyRecordBufferAllocation);
+    vmaDestroyBuffer(m_pDevice->GetAllocator(), m_RunOffsetBuffer, m_RunOffsetBufferAllocation);
 }
 
 // Because we are sorting the data every frame, need to reset to unsorted version of data before running sort
 void FFXParallelSort::CopySourceDataForFrame(VkCommandBuffer commandList)
 {
+    // A new frame, so pick up the GPU validation results that have landed since the last one
+    ++m_FrameCount;
+    ReadGPUValidationResults();
+
     // Copy the contents the source buffer to the dstBuffer[0] each frame in order to not 
     // lose our original data
+
+    // With temporal coherence (or incremental re-sorts) we keep sorting last frame's result instead (only resetting when the key set changes)
+    bool bKeepKeys = KeepsSortedKeys();
+    if (bKeepKeys && m_TemporalKeySet == m_UIResolutionSize)
+        return;
+    m_TemporalKeySet = bKeepKeys ? m_UIResolutionSize : -1;
+    m_bSortedKeysInPlace = false;
+
     VkBufferMemoryBarrier Barriers[2] = { 
-        BufferTransition(m_DstKeyBuffers[0], VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, sizeof(uint32_t) * NumKeys[m_UIResolutionSize]) ,
-        BufferTransition(m_DstPayloadBuffers[0], VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, sizeof(uint32_t) * NumKeys[m_UIResolutionSize])
+        BufferTransition(m_DstKeyBuffers[0], VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, sizeof(uint32_t) * m_NumKeys[m_UIResolutionSize] * m_NumKeyWords) ,
+        BufferTransition(m_DstPayloadBuffers[0], VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, sizeof(uint32_t) * m_NumKeys[m_UIResolutionSize])
     };
     vkCmdPipelineBarrier(commandList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 2, Barriers, 0, nullptr);
 
     VkBufferCopy copyInfo = { 0 };
     copyInfo.srcOffset = 0;
-    copyInfo.size = sizeof(uint32_t) * NumKeys[m_UIResolutionSize];
+    copyInfo.size = sizeof(uint32_t) * m_NumKeys[m_UIResolutionSize] * m_NumKeyWords;
     vkCmdCopyBuffer(commandList, m_SrcKeyBuffers[m_UIResolutionSize], m_DstKeyBuffers[0], 1, &copyInfo);
+    copyInfo.size = sizeof(uint32_t) * m_NumKeys[m_UIResolutionSize];
     vkCmdCopyBuffer(commandList, m_SrcPayloadBuffers, m_DstPayloadBuffers[0], 1, &copyInfo);
 
     // Put the dst buffers back to UAVs for sort usage
-    Barriers[0] = BufferTransition(m_DstKeyBuffers[0], VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, sizeof(uint32_t) * NumKeys[m_UIResolutionSize]);
-    Barriers[1] = BufferTransition(m_DstPayloadBuffers[0], VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, sizeof(uint32_t) * NumKeys[m_UIResolutionSize]);
+    Barriers[0] = BufferTransition(m_DstKeyBuffers[0], VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, sizeof(uint32_t) * m_NumKeys[m_UIResolutionSize] * m_NumKeyWords);
+    Barriers[1] = BufferTransition(m_DstPayloadBuffers[0], VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, sizeof(uint32_t) * m_NumKeys[m_UIResolutionSize]);
     vkCmdPipelineBarrier(commandList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 2, Barriers, 0, nullptr);
+
+    // And the 16-bit copy of the keys when sorting with 16-bit key storage
+    if (m_b16BitKeyStorage && m_UI16BitKeys)
+    {
+        copyInfo.size = sizeof(uint32_t) * ((m_NumKeys[m_UIResolutionSize] + 1) / 2);
+        Barriers[0] = BufferTransition(m_DstKey16Buffers[0], VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, copyInfo.size);
+        vkCmdPipelineBarrier(commandList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 1, Barriers, 0, nullptr);
+        vkCmdCopyBuffer(commandList, m_SrcKey16Buffers[m_UIResolutionSize], m_DstKey16Buffers[0], 1, &copyInfo);
+        Barriers[0] = BufferTransition(m_DstKey16Buffers[0], VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, copyInfo.size);
+        vkCmdPipelineBarrier(commandList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 1, Barriers, 0, nullptr);
+    }
 }
 
 // Perform Parallel Sort (radix-based sort)
-void FFXParallelSort::Sort(VkCommandBuffer commandList, bool isBenchmarking, float benchmarkTime)
+void FFXParallelSort::Sort(VkCommandBuffer commandList, bool isBenchmarking, float benchmarkTime, GPUTimestamps* pGPUTimer/*=nullptr*/, SortContext* pContext/*=nullptr*/)
 {
-    bool bIndirectDispatch = m_UIIndirectSort;
+    SortContext& Context = pContext ? *pContext : *m_pDefaultSortContext;
+
+    // Sorts on an acquired context are plain direct sorts of the context's keys, and so are out-of-core chunks of the chunk's keys.
+    // None of the other modes apply to them, and context sorts don't look at or update any of the sample's state, so they can be
+    // recorded on other threads.
+    bool bContextSort = &Context != m_pDefaultSortContext;
+    if (bContextSort && !Context.NumKeys)
+        return;
+    assert(!bContextSort || Context.NumKeys <= m_MaxNumKeys);
+    uint32_t NumPlainSortKeys = bContextSort ? Context.NumKeys : m_OutOfCoreChunkKeys;
+    bool bIndirectDispatch = !NumPlainSortKeys && m_UIIndirectSort;
+    GPUTimestamps* pStageTimer = !bContextSort && m_UIStageTimings ? pGPUTimer : nullptr;
+    if (!bContextSort)
+        m_StageTimings.BeginSort();
+
+    // Selection needs to know how many keys it is selecting from, so it always runs with direct dispatches
+    uint32_t NumSelectKeys = NumPlainSortKeys ? 0 : GetNumSelectKeys();
+    uint32_t NumSelectQueries = NumPlainSortKeys ? 0 : GetNumSelectQueries();
+    if (NumSelectKeys || NumSelectQueries)
+        bIndirectDispatch = false;
+
+    // Incremental re-sorts only sort the keys that changed (so they need to know how many), once there is a sorted order to merge them into
+    uint32_t NumDirtyKeys = !NumPlainSortKeys && m_bSortedKeysInPlace ? GetNumDirtyKeys() : 0;
+    if (NumDirtyKeys)
+        bIndirectDispatch = false;
+
+    // The presort check decides whether to sort on the GPU, so it always runs with indirect dispatches
+    bool bPresortCheck = !NumPlainSortKeys && m_UIPresortCheck && !NumSelectKeys && !NumSelectQueries && !NumDirtyKeys;
+    if (bPresortCheck)
+        bIndirectDispatch = true;
+
+    // GPU validation checks full sorts (the other modes don't leave a sorted permutation of the input keys behind)
+    bool bGPUValidate = !NumPlainSortKeys && m_UIGPUValidation && !NumSelectKeys && !NumSelectQueries && !NumDirtyKeys;
+
+    // Key records have the first pass read the keys straight out of the records (full sorts of single-word keys that start over
+    // from the source keys every frame, so the records always hold the keys being sorted)
+    bool bKeyRecords = !NumPlainSortKeys && m_UIKeyRecords && m_NumKeyWords == 1 && !bPresortCheck && !NumSelectKeys && !NumSelectQueries && !NumDirtyKeys &&
+                       !m_UITemporalCoherence && !m_UIIncrementalSort;
+
+    // Keys the passes go over
+    uint32_t NumberOfKeys = NumPlainSortKeys ? NumPlainSortKeys : (NumSelectKeys ? NumSelectKeys : (NumDirtyKeys ? NumDirtyKeys : m_NumKeys[m_UIResolutionSize]));
 
     // To control which descriptor set to use for updating data
-    static uint32_t frameCount = 0;
-    uint32_t frameConstants = (++frameCount) % 3;
+    Context.FrameConstants = (Context.FrameConstants + 1) % 3;
 
     std::string markerText = "FFXParallelSort";
     if (bIndirectDispatch) markerText += " Indirect";
+    if (bPresortCheck) markerText += " Presort";
+    if (NumSelectKeys) markerText += " TopK";
+    if (NumSelectQueries) markerText += " Percentiles";
+    if (NumDirtyKeys) markerText += " Incremental";
     SetPerfMarkerBegin(commandList, markerText.c_str());
 
+    // Percentile queries only refine digits, nothing gets sorted (the selected keys stay on the GPU in the select state buffer)
+    if (NumSelectQueries)
+    {
+        SelectPercentiles(commandList, pStageTimer, Context);
+        ReadBackPercentiles(commandList);
+        SetPerfMarkerEnd(commandList);
+        return;
+    }
+
     // Buffers to ping-pong between when writing out sorted values
     VkBuffer* ReadBufferInfo(&m_DstKeyBuffers[0]), * WriteBufferInfo(&m_DstKeyBuffers[1]);
     VkBuffer* ReadPayloadBufferInfo(&m_DstPayloadBuffers[0]), * WritePayloadBufferInfo(&m_DstPayloadBuffers[1]);
-    bool bHasPayload = m_UISortPayload;
+    bool bHasPayload = bContextSort ? Context.PayloadBuffers[0] != VK_NULL_HANDLE : (m_UISortPayload && !m_OutOfCoreChunkKeys);
+    if (bContextSort)
+    {
+        ReadBufferInfo = &Context.KeyBuffers[0];
+        WriteBufferInfo = &Context.KeyBuffers[1];
+        ReadPayloadBufferInfo = &Context.PayloadBuffers[0];
+        WritePayloadBufferInfo = &Context.PayloadBuffers[1];
+    }
+
+    // Deferred payload gathers carry source indices through the passes instead of the payload, then move the payload once at the end.
+    // Skipped sorts wouldn't write any indices to gather with, and the other modes move payloads around themselves.
+    bool bDeferredPayload = bHasPayload && !bContextSort && m_UIDeferredPayload && !bPresortCheck && !NumSelectKeys && !NumSelectQueries && !NumDirtyKeys && !bKeyRecords;
+
+    // Key hooks load the keys in the first pass and store them in the last one (full sorts of single-word keys, and not with
+    // a deferred payload gather, its first scatter makes up indices instead, or key records, those load the keys themselves)
+    bool bKeyHooks = !NumPlainSortKeys && m_UIKeyHooks && m_NumKeyWords == 1 && !bPresortCheck && !NumSelectKeys && !NumSelectQueries && !NumDirtyKeys && !bDeferredPayload &&
+                     !bKeyRecords;
+
+    // Read-only input has count and scatter read the sort buffers through read-only views (not for the passes that read keys from
+    // elsewhere, or the first pass of a deferred payload gather, its scatter doesn't read a payload)
+    bool bReadOnlyInput = !bContextSort && m_UIReadOnlyInput && !bKeyRecords && !bKeyHooks;
+
+    // Packed key+index sorts carry the source indices in the low bits of the keys, and hand them out in place of the payload (plain
+    // full sorts of keys narrow enough to leave room for the indices of every key that could be sorted)
+    uint32_t PackedIndexBits = FFX_ParallelSort_PackedIndexBits(bIndirectDispatch ? m_MaxNumKeys : NumberOfKeys);
+    bool bPackedKeyIndex = !NumPlainSortKeys && m_UIPackedKeyIndex && m_NumKeyWords == 1 && FFX_ParallelSort_CanPackKeyIndex(m_KeyBits, bIndirectDispatch ? m_MaxNumKeys : NumberOfKeys) &&
+                           !bPresortCheck && !NumSelectKeys && !NumSelectQueries && !NumDirtyKeys && !m_UITemporalCoherence &&
+                           !m_UIIncrementalSort && !bGPUValidate && !bKeyRecords && !bDeferredPayload && !bKeyHooks;
+    if (bPackedKeyIndex)
+        bHasPayload = false;
+
+    // 16-bit key storage sorts the 16-bit copy of the keys (plain full sorts, GPU validated or not, the other modes read and write the keys
+    // as uints, so they sort the same narrow keys in the 32-bit buffers, with the same number of passes)
+    bool b16BitKeys = !NumPlainSortKeys && m_b16BitKeyStorage && m_UI16BitKeys && !bPresortCheck && !NumSelectKeys && !NumSelectQueries && !NumDirtyKeys &&
+                      !m_UITemporalCoherence && !m_UIIncrementalSort && !bKeyRecords && !bDeferredPayload && !bKeyHooks && !bReadOnlyInput && !bPackedKeyIndex;
+    if (b16BitKeys)
+    {
+        ReadBufferInfo = &m_DstKey16Buffers[0];
+        WriteBufferInfo = &m_DstKey16Buffers[1];
+    }
+
+    // Checksums of the keys going in (validation reads the first set of sort buffers)
+    VkDescriptorSet& ValidateInputOutputSet = b16BitKeys ? m_SortDescriptorSet16BitInputOutput[0] : m_SortDescriptorSetInputOutput[0];
+    if (bGPUValidate)
+        ValidateSort(commandList, pStageTimer, ValidateInputOutputSet, bHasPayload, b16BitKeys, false, Context);
 
     // Setup barriers for the run
     VkBufferMemoryBarrier Barriers[3];
     FFX_ParallelSortCB  constantBufferData = { 0 };
 
+    // Spread the keys out into records when the key set changes
+    if (bKeyRecords && m_KeyRecordSet != m_UIResolutionSize)
+        WriteKeyRecords(commandList, pStageTimer, Context);
+
     // Fill in the constant buffer data structure (this will be done by a shader in the indirect version)
     uint32_t NumThreadgroupsToRun;
     uint32_t NumReducedThreadgroupsToRun;
     if (!bIndirectDispatch)
     {
-        uint32_t NumberOfKeys = NumKeys[m_UIResolutionSize];
-        FFX_ParallelSort_SetConstantAndDispatchData(NumberOfKeys, m_MaxNumThreadgroups, constantBufferData, NumThreadgroupsToRun, NumReducedThreadgroupsToRun);
+        FFX_ParallelSort_SetConstantAndDispatchData(NumberOfKeys, m_MaxNumThreadgroups, constantBufferData, NumThreadgroupsToRun, NumReducedThreadgroupsToRun, m_NumKeyWords);
+        if (bKeyRecords)
+            FFX_ParallelSort_SetKeyLayout(constantBufferData, KeyRecordStrideOverride, KeyRecordOffsetOverride);
     }
     else
     {
@@ -916,184 +2165,1180 @@ void FFXParallelSort::Sort(VkCommandBuffer commandList, bool isBenchmarking, flo
         {
             uint32_t NumKeysIndex;
             uint32_t MaxThreadGroups;
+            uint32_t NumKeyWords;
+            uint32_t KeyStride;
+            uint32_t KeyOffset;
         };
         SetupIndirectCB IndirectSetupCB;
         IndirectSetupCB.NumKeysIndex = m_UIResolutionSize;
         IndirectSetupCB.MaxThreadGroups = m_MaxNumThreadgroups;
+        IndirectSetupCB.NumKeyWords = m_NumKeyWords;
+        IndirectSetupCB.KeyStride = bKeyRecords ? KeyRecordStrideOverride / sizeof(uint32_t) : 1;
+        IndirectSetupCB.KeyOffset = bKeyRecords ? KeyRecordOffsetOverride / sizeof(uint32_t) : 0;
             
         // Copy the data into the constant buffer
-        VkDescriptorBufferInfo constantBuffer = m_pConstantBufferRing->AllocConstantBuffer(sizeof(SetupIndirectCB), (void*)&IndirectSetupCB);
-        BindConstantBuffer(constantBuffer, m_SortDescriptorSetConstantsIndirect[frameConstants]);
+        VkDescriptorBufferInfo constantBuffer = AllocConstantBuffer(sizeof(SetupIndirectCB), (void*)&IndirectSetupCB);
+        BindConstantBuffer(constantBuffer, Context.DescriptorSetConstantsIndirect[Context.FrameConstants]);
             
         // Dispatch
-        vkCmdBindDescriptorSets(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_SortPipelineLayout, 1, 1, &m_SortDescriptorSetConstantsIndirect[frameConstants], 0, nullptr);
-        vkCmdBindDescriptorSets(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_SortPipelineLayout, 5, 1, &m_SortDescriptorSetIndirect, 0, nullptr);
-        vkCmdBindPipeline(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_FPSIndirectSetupParametersPipeline);
+        vkCmdBindDescriptorSets(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_SortPipelineLayout, 1, 1, &Context.DescriptorSetConstantsIndirect[Context.FrameConstants], 0, nullptr);
+        vkCmdBindDescriptorSets(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_SortPipelineLayout, 5, 1, &Context.DescriptorSetIndirect, 0, nullptr);
+
+        // Count the keys that are out of order so setup can skip the sort when there are none
+        if (bPresortCheck)
+        {
+            vkCmdBindDescriptorSets(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_SortPipelineLayout, 2, 1, &m_SortDescriptorSetInputOutput[0], 0, nullptr);
+            vkCmdBindPipeline(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_FPSCountInversionsPipeline.get());
+            vkCmdDispatch(commandList, m_MaxNumThreadgroups, 1, 1);
+
+            VkBufferMemoryBarrier barrier = BufferTransition(m_PresortStateBuffer, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, sizeof(uint32_t) * FFX_PARALLELSORT_PRESORT_STATE_SIZE);
+            vkCmdPipelineBarrier(commandList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+            StageTimeStamp(commandList, pStageTimer, "CountInversions", 0);
+        }
+
+        vkCmdBindPipeline(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, bPresortCheck ? m_FPSIndirectSetupPresortPipeline.get() : m_FPSIndirectSetupParametersPipeline.get());
         vkCmdDispatch(commandList, 1, 1, 1);
             
         // When done, transition the args buffers to INDIRECT_ARGUMENT, and the constant buffer UAV to Constant buffer
         VkBufferMemoryBarrier barriers[5];
-        barriers[0] = BufferTransition(m_IndirectCountScatterArgs, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, sizeof(uint32_t) * 3);
-        barriers[1] = BufferTransition(m_IndirectReduceScanArgs, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, sizeof(uint32_t) * 3);
-        barriers[2] = BufferTransition(m_IndirectConstantBuffer, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, sizeof(FFX_ParallelSortCB));
-        barriers[3] = BufferTransition(m_IndirectCountScatterArgs, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, sizeof(uint32_t) * 3);
-        barriers[4] = BufferTransition(m_IndirectReduceScanArgs, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, sizeof(uint32_t) * 3);
+        barriers[0] = BufferTransition(Context.IndirectCountScatterArgs, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, sizeof(uint32_t) * 3);
+        barriers[1] = BufferTransition(Context.IndirectReduceScanArgs, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, sizeof(uint32_t) * 6);
+        barriers[2] = BufferTransition(Context.IndirectConstantBuffer, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, sizeof(FFX_ParallelSortCB));
+        barriers[3] = BufferTransition(Context.IndirectCountScatterArgs, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, sizeof(uint32_t) * 3);
+        barriers[4] = BufferTransition(Context.IndirectReduceScanArgs, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, sizeof(uint32_t) * 6);
         vkCmdPipelineBarrier(commandList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 5, barriers, 0, nullptr);
+        StageTimeStamp(commandList, pStageTimer, "SetupIndirect", 0);
+
+        if (bPresortCheck)
+            ReadBackPresortInversions(commandList);
+    }
+
+    // Reduced tables that don't fit in a single scan block go through the scan hierarchy. The key count isn't known on the 
+    // CPU with indirect execution, so there we go by the biggest key count that could be sorted.
+    bool bScanHierarchy = FFX_ParallelSort_RequiresScanHierarchy(bIndirectDispatch ? m_MaxNumKeys : NumberOfKeys, m_MaxNumThreadgroups);
+    uint32_t NumScanBlocks = FFX_ParallelSort_NumScanBlocks(constantBufferData.NumScanValues);
+
+    // Few enough thread groups for one thread group to do the reduce, scan and scan add on its own
+    bool bFusedScan = FFX_ParallelSort_UseFusedScan(bIndirectDispatch ? m_MaxNumThreadgroups : NumThreadgroupsToRun);
+
+    // With top-K selection only the selected keys get sorted (they are compacted into the second set of buffers)
+    VkDescriptorSet* pInputOutputSets = bContextSort ? Context.DescriptorSetInputOutput : m_SortDescriptorSetInputOutput;
+    uint32_t inputSet = 0;
+    if (NumSelectKeys)
+    {
+        SelectTopK(commandList, pStageTimer, NumSelectKeys, Context);
+        std::swap(ReadBufferInfo, WriteBufferInfo);
+        std::swap(ReadPayloadBufferInfo, WritePayloadBufferInfo);
+        inputSet = 1;
+    }
+
+    // With incremental re-sorts only the changed keys get sorted (they are pulled out into the dirty buffers)
+    if (NumDirtyKeys)
+    {
+        GatherDirtyKeys(commandList, pStageTimer, NumDirtyKeys, Context);
+        ReadBufferInfo = &m_DirtyKeyBuffers[0];
+        WriteBufferInfo = &m_DirtyKeyBuffers[1];
+        ReadPayloadBufferInfo = &m_DirtyPayloadBuffers[0];
+        WritePayloadBufferInfo = &m_DirtyPayloadBuffers[1];
+        pInputOutputSets = m_SortDescriptorSetDirtyInputOutput;
     }
 
+    // Source indices ping-pong between the index buffer and the temp payload buffer (ending up in the index buffer)
+    if (bDeferredPayload)
+    {
+        ReadPayloadBufferInfo = &m_PayloadIndexBuffer;
+        pInputOutputSets = m_SortDescriptorSetPayloadIndexInputOutput;
+    }
+
+    // 16-bit keys ping-pong between the 16-bit key buffers (with the usual payload buffers)
+    if (b16BitKeys)
+        pInputOutputSets = m_SortDescriptorSet16BitInputOutput;
+
     // Bind the scratch descriptor sets
-    vkCmdBindDescriptorSets(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_SortPipelineLayout, 4, 1, &m_SortDescriptorSetScratch, 0, nullptr);
+    vkCmdBindDescriptorSets(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_SortPipelineLayout, 4, 1, &Context.DescriptorSetScratch, 0, nullptr);
 
     // Copy the data into the constant buffer and bind
     if (bIndirectDispatch)
     {
-        //constantBuffer = m_IndirectConstantBuffer.GetResource()->GetGPUVirtualAddress();
+        //constantBuffer = Context.IndirectConstantBuffer.GetResource()->GetGPUVirtualAddress();
         VkDescriptorBufferInfo constantBuffer;
-        constantBuffer.buffer = m_IndirectConstantBuffer;
+        constantBuffer.buffer = Context.IndirectConstantBuffer;
         constantBuffer.offset = 0;
         constantBuffer.range = VK_WHOLE_SIZE;
-        BindConstantBuffer(constantBuffer, m_SortDescriptorSetConstants[frameConstants]);
+        BindConstantBuffer(constantBuffer, Context.DescriptorSetConstants[Context.FrameConstants]);
     }
     else
     {
-        VkDescriptorBufferInfo constantBuffer = m_pConstantBufferRing->AllocConstantBuffer(sizeof(FFX_ParallelSortCB), (void*)&constantBufferData);
-        BindConstantBuffer(constantBuffer, m_SortDescriptorSetConstants[frameConstants]);
+        VkDescriptorBufferInfo constantBuffer = AllocConstantBuffer(sizeof(FFX_ParallelSortCB), (void*)&constantBufferData);
+        BindConstantBuffer(constantBuffer, Context.DescriptorSetConstants[Context.FrameConstants]);
     }
     // Bind constants
-    vkCmdBindDescriptorSets(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_SortPipelineLayout, 0, 1, &m_SortDescriptorSetConstants[frameConstants], 0, nullptr);
+    vkCmdBindDescriptorSets(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_SortPipelineLayout, 0, 1, &Context.DescriptorSetConstants[Context.FrameConstants], 0, nullptr);
         
-    // Perform Radix Sort (currently only support 32-bit key/payload sorting
-    uint32_t inputSet = 0;
-    for (uint32_t Shift = 0; Shift < 32u; Shift += FFX_PARALLELSORT_SORT_BITS_PER_PASS)
+    // Packed key+index sorts start out with the packed words in the second set of buffers, and only sort the key bits above the indices
+    uint32_t FirstShift = 0;
+    if (bPackedKeyIndex)
+    {
+        PackKeyIndex(commandList, pStageTimer, bIndirectDispatch, NumThreadgroupsToRun, PackedIndexBits, Context);
+        std::swap(ReadBufferInfo, WriteBufferInfo);
+        std::swap(ReadPayloadBufferInfo, WritePayloadBufferInfo);
+        inputSet = 1;
+        FirstShift = PackedIndexBits;
+    }
+
+    // Perform Radix Sort (32 bits per key word or the narrower key width, payload is always 32-bit). An odd number of passes leaves
+    // the keys in the second set of buffers, so the modes that pick them up from the first set (kept keys, the merge of the changed
+    // keys, GPU validation, context sorts and out-of-core chunks, presort checks that can skip the whole sort) run one more pass
+    // over bits that are all 0, which only moves the keys back (the sort is stable)
+    uint32_t NumKeyBits = FirstShift + (m_NumKeyWords > 1 ? 32u * m_NumKeyWords : m_KeyBits);
+    if ((NumPlainSortKeys || KeepsSortedKeys() || NumDirtyKeys || bGPUValidate || bPresortCheck) && (NumKeyBits - FirstShift) / FFX_PARALLELSORT_SORT_BITS_PER_PASS % 2)
+        NumKeyBits += FFX_PARALLELSORT_SORT_BITS_PER_PASS;
+    for (uint32_t Shift = FirstShift; Shift < NumKeyBits; Shift += FFX_PARALLELSORT_SORT_BITS_PER_PASS)
     {
         // Update the bit shift
         vkCmdPushConstants(commandList, m_SortPipelineLayout, VK_SHADER_STAGE_ALL, 0, 4, &Shift);
+        bool bReadOnlyPass = bReadOnlyInput && !(bDeferredPayload && !Shift);
 
-        // Bind input/output for this pass
-        vkCmdBindDescriptorSets(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_SortPipelineLayout, 2, 1, &m_SortDescriptorSetInputOutput[inputSet], 0, nullptr);
+        // Bind input/output for this pass (the first pass of a key record sort reads the records)
+        VkDescriptorSet* pInputOutputSet = (bKeyRecords && !Shift) ? &m_SortDescriptorSetKeyRecordsInputOutput : &pInputOutputSets[inputSet];
+        vkCmdBindDescriptorSets(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_SortPipelineLayout, 2, 1, pInputOutputSet, 0, nullptr);
 
         // Sort Count
         {
-            vkCmdBindPipeline(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_FPSCountPipeline);
+            if (bKeyRecords && !Shift)
+                vkCmdBindPipeline(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_FPSCountKeyRecordsPipeline.get());
+            else if (bReadOnlyPass)
+                vkCmdBindPipeline(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_FPSCountReadOnlyPipeline.get());
+            else if (b16BitKeys)
+                vkCmdBindPipeline(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_FPSCount16BitPipeline.get());
+            else
+                vkCmdBindPipeline(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, (bKeyHooks && !Shift) ? m_FPSCountLoadKeyPipeline.get() : m_FPSCountPipeline.get());
 
             if (bIndirectDispatch)
-                vkCmdDispatchIndirect(commandList, m_IndirectCountScatterArgs, 0);                  
+                vkCmdDispatchIndirect(commandList, Context.IndirectCountScatterArgs, 0);                  
             else
                 vkCmdDispatch(commandList, NumThreadgroupsToRun, 1, 1);
         }
 
         // UAV barrier on the sum table
-        Barriers[0] = BufferTransition(m_FPSScratchBuffer, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, m_ScratchBufferSize);
+        Barriers[0] = BufferTransition(Context.ScratchBuffer, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, m_ScratchBufferSize);
         vkCmdPipelineBarrier(commandList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 1, Barriers, 0, nullptr);
+        StageTimeStamp(commandList, pStageTimer, "Count", Shift);
             
-        // Sort Reduce
+        if (bFusedScan)
         {
-            vkCmdBindPipeline(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_FPSCountReducePipeline);
-                
+            // Sort ReduceScanAdd (the scan block args are a single thread group here, and skipped along with the rest by the presort check)
+            vkCmdBindPipeline(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_FPSReduceScanAddPipeline.get());
             if (bIndirectDispatch)
-                vkCmdDispatchIndirect(commandList, m_IndirectReduceScanArgs, 0);
+                vkCmdDispatchIndirect(commandList, Context.IndirectReduceScanArgs, sizeof(uint32_t) * 3);
             else
-                vkCmdDispatch(commandList, NumReducedThreadgroupsToRun, 1, 1);
-                    
-            // UAV barrier on the reduced sum table
-            Barriers[0] = BufferTransition(m_FPSReducedScratchBuffer, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, m_ReducedScratchBufferSize);
+                vkCmdDispatch(commandList, 1, 1, 1);
+
+            // UAV barrier on the sum table
+            Barriers[0] = BufferTransition(Context.ScratchBuffer, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, m_ScratchBufferSize);
             vkCmdPipelineBarrier(commandList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 1, Barriers, 0, nullptr);
+            StageTimeStamp(commandList, pStageTimer, "ReduceScanAdd", Shift);
         }
-
-        // Sort Scan
+        else
         {
-            // First do scan prefix of reduced values
-            vkCmdBindDescriptorSets(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_SortPipelineLayout, 3, 1, &m_SortDescriptorSetScanSets[0], 0, nullptr);
-            vkCmdBindPipeline(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_FPSScanPipeline);
-
-            if (!bIndirectDispatch)
+            // Sort Reduce
             {
-                assert(NumReducedThreadgroupsToRun < FFX_PARALLELSORT_ELEMENTS_PER_THREAD * FFX_PARALLELSORT_THREADGROUP_SIZE && "Need to account for bigger reduced histogram scan");
+                vkCmdBindPipeline(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_FPSCountReducePipeline.get());
+                
+                if (bIndirectDispatch)
+                    vkCmdDispatchIndirect(commandList, Context.IndirectReduceScanArgs, 0);
+                else
+                    vkCmdDispatch(commandList, NumReducedThreadgroupsToRun, 1, 1);
+                    
+                // UAV barrier on the reduced sum table
+                Barriers[0] = BufferTransition(Context.ReducedScratchBuffer, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, m_ReducedScratchBufferSize);
+                vkCmdPipelineBarrier(commandList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 1, Barriers, 0, nullptr);
+                StageTimeStamp(commandList, pStageTimer, "CountReduce", Shift);
             }
-            vkCmdDispatch(commandList, 1, 1, 1);
 
-            // UAV barrier on the reduced sum table
-            Barriers[0] = BufferTransition(m_FPSReducedScratchBuffer, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, m_ReducedScratchBufferSize);
-            vkCmdPipelineBarrier(commandList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 1, Barriers, 0, nullptr);
+            // Sort Scan
+            {
+                if (!bScanHierarchy)
+                {
+                    // First do scan prefix of reduced values
+                    vkCmdBindDescriptorSets(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_SortPipelineLayout, 3, 1, &Context.DescriptorSetScanSets[0], 0, nullptr);
+                    vkCmdBindPipeline(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_FPSScanPipeline.get());
+                    vkCmdDispatch(commandList, 1, 1, 1);
+                }
+                else
+                {
+                    // Reduce each block of reduced values to a partial sum
+                    vkCmdBindDescriptorSets(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_SortPipelineLayout, 3, 1, &Context.DescriptorSetScanSets[2], 0, nullptr);
+                    vkCmdBindPipeline(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_FPSScanBlockReducePipeline.get());
+                    if (bIndirectDispatch)
+                        vkCmdDispatchIndirect(commandList, Context.IndirectReduceScanArgs, sizeof(uint32_t) * 3);
+                    else
+                        vkCmdDispatch(commandList, NumScanBlocks, 1, 1);
+
+                    // UAV barrier on the partial sums
+                    Barriers[0] = BufferTransition(Context.ScanBlockBuffer, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, m_ScanBlockBufferSize);
+                    vkCmdPipelineBarrier(commandList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 1, Barriers, 0, nullptr);
+                    StageTimeStamp(commandList, pStageTimer, "ScanBlockReduce", Shift);
+
+                    // Scan prefix the partial sums
+                    vkCmdBindDescriptorSets(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_SortPipelineLayout, 3, 1, &Context.DescriptorSetScanSets[3], 0, nullptr);
+                    vkCmdBindPipeline(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_FPSScanBlockSumsPipeline.get());
+                    vkCmdDispatch(commandList, 1, 1, 1);
+
+                    // UAV barrier on the partial sums
+                    Barriers[0] = BufferTransition(Context.ScanBlockBuffer, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, m_ScanBlockBufferSize);
+                    vkCmdPipelineBarrier(commandList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 1, Barriers, 0, nullptr);
+
+                    // Scan prefix each block of reduced values and add in the block's partial sum
+                    vkCmdBindDescriptorSets(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_SortPipelineLayout, 3, 1, &Context.DescriptorSetScanSets[4], 0, nullptr);
+                    vkCmdBindPipeline(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_FPSScanBlockAddPipeline.get());
+                    if (bIndirectDispatch)
+                        vkCmdDispatchIndirect(commandList, Context.IndirectReduceScanArgs, sizeof(uint32_t) * 3);
+                    else
+                        vkCmdDispatch(commandList, NumScanBlocks, 1, 1);
+                }
+
+                // UAV barrier on the reduced sum table
+                Barriers[0] = BufferTransition(Context.ReducedScratchBuffer, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, m_ReducedScratchBufferSize);
+                vkCmdPipelineBarrier(commandList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 1, Barriers, 0, nullptr);
+                StageTimeStamp(commandList, pStageTimer, "Scan", Shift);
                 
-            // Next do scan prefix on the histogram with partial sums that we just did
-            vkCmdBindDescriptorSets(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_SortPipelineLayout, 3, 1, &m_SortDescriptorSetScanSets[1], 0, nullptr);
+                // Next do scan prefix on the histogram with partial sums that we just did
+                vkCmdBindDescriptorSets(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_SortPipelineLayout, 3, 1, &Context.DescriptorSetScanSets[1], 0, nullptr);
                 
-            vkCmdBindPipeline(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_FPSScanAddPipeline);
-            if (bIndirectDispatch)
-                vkCmdDispatchIndirect(commandList, m_IndirectReduceScanArgs, 0);
-            else
-                vkCmdDispatch(commandList, NumReducedThreadgroupsToRun, 1, 1);
-        }
+                vkCmdBindPipeline(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_FPSScanAddPipeline.get());
+                if (bIndirectDispatch)
+                    vkCmdDispatchIndirect(commandList, Context.IndirectReduceScanArgs, 0);
+                else
+                    vkCmdDispatch(commandList, NumReducedThreadgroupsToRun, 1, 1);
+            }
 
-        // UAV barrier on the sum table
-        Barriers[0] = BufferTransition(m_FPSScratchBuffer, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, m_ScratchBufferSize);
-        vkCmdPipelineBarrier(commandList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 1, Barriers, 0, nullptr);
+            // UAV barrier on the sum table
+            Barriers[0] = BufferTransition(Context.ScratchBuffer, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, m_ScratchBufferSize);
+            vkCmdPipelineBarrier(commandList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 1, Barriers, 0, nullptr);
+            StageTimeStamp(commandList, pStageTimer, "ScanAdd", Shift);
+        }
             
         // Sort Scatter
         {
-            vkCmdBindPipeline(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, bHasPayload ? m_FPSScatterPayloadPipeline : m_FPSScatterPipeline);
+            if (bDeferredPayload && !Shift)
+                vkCmdBindPipeline(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_FPSScatterIndexPipeline.get());
+            else if (bKeyRecords && !Shift)
+                vkCmdBindPipeline(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, bHasPayload ? m_FPSScatterKeyRecordsPayloadPipeline.get() : m_FPSScatterKeyRecordsPipeline.get());
+            else if (bKeyHooks && !Shift)
+                vkCmdBindPipeline(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, bHasPayload ? m_FPSScatterLoadKeyPayloadPipeline.get() : m_FPSScatterLoadKeyPipeline.get());
+            else if (bKeyHooks && Shift + FFX_PARALLELSORT_SORT_BITS_PER_PASS == NumKeyBits)
+                vkCmdBindPipeline(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, bHasPayload ? m_FPSScatterStoreKeyPayloadPipeline.get() : m_FPSScatterStoreKeyPipeline.get());
+            else if (bReadOnlyPass)
+                vkCmdBindPipeline(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, bHasPayload ? m_FPSScatterReadOnlyPayloadPipeline.get() : m_FPSScatterReadOnlyPipeline.get());
+            else if (b16BitKeys)
+                vkCmdBindPipeline(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, bHasPayload ? m_FPSScatter16BitPayloadPipeline.get() : m_FPSScatter16BitPipeline.get());
+            else
+                vkCmdBindPipeline(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, bHasPayload ? m_FPSScatterPayloadPipeline.get() : m_FPSScatterPipeline.get());
 
             if (bIndirectDispatch)
-                vkCmdDispatchIndirect(commandList, m_IndirectCountScatterArgs, 0);
+                vkCmdDispatchIndirect(commandList, Context.IndirectCountScatterArgs, 0);
             else
                 vkCmdDispatch(commandList, NumThreadgroupsToRun, 1, 1);
         }
             
-        // Finish doing everything and barrier for the next pass
+        // Finish doing everything and barrier for the next pass (whole buffer, the dirty buffers are smaller than the sort buffers)
         int numBarriers = 0;
-        Barriers[numBarriers++] = BufferTransition(*WriteBufferInfo, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, sizeof(uint32_t) * NumKeys[2]);
+        Barriers[numBarriers++] = BufferTransition(*WriteBufferInfo, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_WHOLE_SIZE);
         if (bHasPayload)
-            Barriers[numBarriers++] = BufferTransition(*WritePayloadBufferInfo, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, sizeof(uint32_t) * NumKeys[2]);
+            Barriers[numBarriers++] = BufferTransition(*WritePayloadBufferInfo, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_WHOLE_SIZE);
         vkCmdPipelineBarrier(commandList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, numBarriers, Barriers, 0, nullptr);
+        StageTimeStamp(commandList, pStageTimer, "Scatter", Shift);
             
         // Swap read/write sources
         std::swap(ReadBufferInfo, WriteBufferInfo);
-        if (bHasPayload)
+        if (bHasPayload || bPackedKeyIndex)
             std::swap(ReadPayloadBufferInfo, WritePayloadBufferInfo);
         inputSet = !inputSet;
     }
 
+    // Split the sorted words back up into the keys and their source indices (into the buffer pair the next pass would have written)
+    if (bPackedKeyIndex)
+    {
+        UnpackKeyIndex(commandList, pStageTimer, bIndirectDispatch, NumThreadgroupsToRun, PackedIndexBits, pInputOutputSets[inputSet], *WriteBufferInfo, *WritePayloadBufferInfo, Context);
+        std::swap(ReadBufferInfo, WriteBufferInfo);
+        std::swap(ReadPayloadBufferInfo, WritePayloadBufferInfo);
+        inputSet = !inputSet;
+    }
+
+    // Move the payload into sorted order (with the sort's constants and dispatch, so before the indirect buffers go back to UAVs).
+    // Validation reads the sorted payload from the first set of sort buffers, so it needs the copy back as well.
+    if (bDeferredPayload)
+        GatherPayload(commandList, pStageTimer, bIndirectDispatch, NumThreadgroupsToRun, KeepsSortedKeys() || bGPUValidate, Context);
+
     // When we are all done, transition indirect buffers back to UAV for the next frame (if doing indirect dispatch)
     if (bIndirectDispatch)
     {
         VkBufferMemoryBarrier barriers[3];
-        barriers[0] = BufferTransition(m_IndirectConstantBuffer, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, sizeof(FFX_ParallelSortCB));
-        barriers[1] = BufferTransition(m_IndirectCountScatterArgs, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, sizeof(uint32_t) * 3);
-        barriers[2] = BufferTransition(m_IndirectReduceScanArgs, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, sizeof(uint32_t) * 3);
+        barriers[0] = BufferTransition(Context.IndirectConstantBuffer, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, sizeof(FFX_ParallelSortCB));
+        barriers[1] = BufferTransition(Context.IndirectCountScatterArgs, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, sizeof(uint32_t) * 3);
+        barriers[2] = BufferTransition(Context.IndirectReduceScanArgs, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, sizeof(uint32_t) * 6);
         vkCmdPipelineBarrier(commandList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 3, barriers, 0, nullptr);
     }
 
+    // Merge the sorted changed keys into last frame's order (which puts the result back where a full sort leaves it)
+    if (NumDirtyKeys)
+        MergeDirtyKeys(commandList, pStageTimer, NumDirtyKeys, Context);
+    if (!NumSelectKeys && !bContextSort)
+        m_bSortedKeysInPlace = true;
+
+    // Checksums and order of the keys coming out
+    if (bGPUValidate)
+        ValidateSort(commandList, pStageTimer, ValidateInputOutputSet, bHasPayload, b16BitKeys, true, Context);
+
     // Close out the perf capture
     SetPerfMarkerEnd(commandList);
 }
 
+// How many keys top-K selection keeps this frame (0 when all keys get sorted)
+uint32_t FFXParallelSort::GetNumSelectKeys() const
+{
+    if (!m_UISelectTopK || m_NumKeyWords > 1 || m_OutOfCoreChunkKeys || GetNumSelectQueries())
+        return 0;
+
+    uint32_t NumSelectKeys = (uint32_t)std::max(m_UISelectNumKeys, 1);
+    return NumSelectKeys < m_NumKeys[m_UIResolutionSize] ? NumSelectKeys : 0;
+}
+
+// Whether each frame sorts last frame's result instead of a fresh copy of the source keys (temporal coherence and incremental
+// re-sorts). Not with top-K selection, as its passes ping-pong through the kept key buffers and only leave the selected keys sorted
+bool FFXParallelSort::KeepsSortedKeys() const
+{
+    return (m_UITemporalCoherence || m_UIIncrementalSort) && !GetNumSelectKeys();
+}
+
+// How many percentile queries run this frame (0 when sorting)
+uint32_t FFXParallelSort::GetNumSelectQueries() const
+{
+    if (!m_UISelectPercentiles || m_NumKeyWords > 1 || m_OutOfCoreChunkKeys)
+        return 0;
+
+    return (uint32_t)m_SelectPercentiles.size();
+}
+
+// Copies out how many out of order neighbours the presort check found (what decided whether setup skipped the sort), and picks
+// up what the slot's previous check found once its copy has landed (the frame that copied it is ReadBackLatency frames old)
+void FFXParallelSort::ReadBackPresortInversions(VkCommandBuffer commandList)
+{
+    uint32_t Slot = m_NumPresortChecks++ % ReadBackLatency;
+    if (m_NumPresortChecks > ReadBackLatency && m_FrameCount - m_PresortCheckFrame[Slot] >= ReadBackLatency)
+    {
+        vmaInvalidateAllocation(m_pDevice->GetAllocator(), m_PresortReadBackBufferAllocation, sizeof(uint32_t) * Slot, sizeof(uint32_t));
+        m_LastPresortInversions = m_pPresortInversions[Slot];
+    }
+    m_PresortCheckFrame[Slot] = m_FrameCount;
+
+    VkBufferMemoryBarrier barrier = BufferTransition(m_PresortStateBuffer, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT, sizeof(uint32_t) * FFX_PARALLELSORT_PRESORT_STATE_SIZE);
+    vkCmdPipelineBarrier(commandList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+    VkBufferCopy copyInfo;
+    copyInfo.srcOffset = sizeof(uint32_t) * FFX_PARALLELSORT_PRESORT_STATE_LAST_INVERSIONS;
+    copyInfo.dstOffset = sizeof(uint32_t) * Slot;
+    copyInfo.size = sizeof(uint32_t);
+    vkCmdCopyBuffer(commandList, m_PresortStateBuffer, m_PresortReadBackBuffer, 1, &copyInfo);
+
+    barrier = BufferTransition(m_PresortStateBuffer, VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, sizeof(uint32_t) * FFX_PARALLELSORT_PRESORT_STATE_SIZE);
+    vkCmdPipelineBarrier(commandList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+// Copies out the keys the percentile queries found (the prefix plane at the start of the select state), and picks up
+// what the slot's previous selection found once its copy has landed (the frame that copied it is ReadBackLatency frames old)
+void FFXParallelSort::ReadBackPercentiles(VkCommandBuffer commandList)
+{
+    uint32_t NumSelectQueries = GetNumSelectQueries();
+    uint32_t Slot = m_NumPercentileReadBacks++ % ReadBackLatency;
+    if (m_NumPercentileReadBacks > ReadBackLatency && m_FrameCount - m_PercentileReadBackFrame[Slot] >= ReadBackLatency)
+    {
+        vmaInvalidateAllocation(m_pDevice->GetAllocator(), m_PercentileReadBackBufferAllocation, sizeof(uint32_t) * NumSelectQueries * Slot, sizeof(uint32_t) * NumSelectQueries);
+        m_PercentileKeys.assign(m_pPercentileResults + NumSelectQueries * Slot, m_pPercentileResults + NumSelectQueries * (Slot + 1));
+        m_PercentileKeySet = m_PercentileReadBackKeySet[Slot];
+    }
+    m_PercentileReadBackFrame[Slot] = m_FrameCount;
+    m_PercentileReadBackKeySet[Slot] = m_UIIncrementalSort ? -1 : m_UIResolutionSize;
+
+    VkBufferMemoryBarrier barrier = BufferTransition(m_FPSSelectStateBuffer, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT, m_SelectStateBufferSize);
+    vkCmdPipelineBarrier(commandList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+    VkBufferCopy copyInfo;
+    copyInfo.srcOffset = sizeof(uint32_t) * FFX_PARALLELSORT_SELECT_STATE_PREFIX * NumSelectQueries;
+    copyInfo.dstOffset = sizeof(uint32_t) * NumSelectQueries * Slot;
+    copyInfo.size = sizeof(uint32_t) * NumSelectQueries;
+    vkCmdCopyBuffer(commandList, m_FPSSelectStateBuffer, m_PercentileReadBackBuffer, 1, &copyInfo);
+
+    barrier = BufferTransition(m_FPSSelectStateBuffer, VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, m_SelectStateBufferSize);
+    vkCmdPipelineBarrier(commandList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+// Radix select. Finds each query's key one digit at a time (most significant first) using the count/reduce histograms
+// of the keys still in the running. All the queries go through each step together, one Y group per query.
+void FFXParallelSort::SelectDigits(VkCommandBuffer commandList, GPUTimestamps* pStageTimer, const FFX_ParallelSortCB& ConstantBufferData, uint32_t NumThreadgroupsToRun, uint32_t NumReducedThreadgroupsToRun, SortContext& Context)
+{
+    VkDescriptorBufferInfo constantBuffer = AllocConstantBuffer(sizeof(FFX_ParallelSortCB), (void*)&ConstantBufferData);
+    BindConstantBuffer(constantBuffer, Context.DescriptorSetConstantsSelect[Context.FrameConstants]);
+
+    // Bind constants, input/output (dst 0 -> dst 1) and scratch
+    vkCmdBindDescriptorSets(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_SortPipelineLayout, 0, 1, &Context.DescriptorSetConstantsSelect[Context.FrameConstants], 0, nullptr);
+    vkCmdBindDescriptorSets(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_SortPipelineLayout, 2, 1, &m_SortDescriptorSetInputOutput[0], 0, nullptr);
+    vkCmdBindDescriptorSets(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_SortPipelineLayout, 4, 1, &Context.DescriptorSetScratch, 0, nullptr);
+
+    uint32_t NumSelectQueries = ConstantBufferData.NumSelectQueries;
+    VkBufferMemoryBarrier Barrier;
+    for (int32_t Shift = FFX_PARALLELSORT_SELECT_FIRST_SHIFT; Shift >= 0; Shift -= FFX_PARALLELSORT_SORT_BITS_PER_PASS)
+    {
+        // Update the bit shift
+        vkCmdPushConstants(commandList, m_SortPipelineLayout, VK_SHADER_STAGE_ALL, 0, 4, &Shift);
+
+        // Count the digit over the keys that still share each query's prefix
+        vkCmdBindPipeline(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_FPSSelectCountPipeline.get());
+        vkCmdDispatch(commandList, NumThreadgroupsToRun, NumSelectQueries, 1);
+
+        Barrier = BufferTransition(Context.ScratchBuffer, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, m_ScratchBufferSize);
+        vkCmdPipelineBarrier(commandList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 1, &Barrier, 0, nullptr);
+        StageTimeStamp(commandList, pStageTimer, "SelectCount", Shift);
+
+        vkCmdBindPipeline(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_FPSSelectReducePipeline.get());
+        vkCmdDispatch(commandList, NumReducedThreadgroupsToRun, NumSelectQueries, 1);
+
+        Barrier = BufferTransition(Context.ReducedScratchBuffer, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, m_ReducedScratchBufferSize);
+        vkCmdPipelineBarrier(commandList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 1, &Barrier, 0, nullptr);
+        StageTimeStamp(commandList, pStageTimer, "SelectReduce", Shift);
+
+        // Pick the bin each query's key falls in
+        vkCmdBindPipeline(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_FPSSelectDigitPipeline.get());
+        vkCmdDispatch(commandList, NumSelectQueries, 1, 1);
+
+        Barrier = BufferTransition(m_FPSSelectStateBuffer, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, m_SelectStateBufferSize);
+        vkCmdPipelineBarrier(commandList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 1, &Barrier, 0, nullptr);
+        StageTimeStamp(commandList, pStageTimer, "SelectDigit", Shift);
+    }
+}
+
+// Percentile queries. Leaves the key at each of m_SelectPercentiles at the start of the select state buffer, in query order.
+void FFXParallelSort::SelectPercentiles(VkCommandBuffer commandList, GPUTimestamps* pStageTimer, SortContext& Context)
+{
+    FFX_ParallelSortCB constantBufferData = { 0 };
+    uint32_t NumThreadgroupsToRun;
+    uint32_t NumReducedThreadgroupsToRun;
+    FFX_ParallelSort_SetConstantAndDispatchData(m_NumKeys[m_UIResolutionSize], m_MaxNumThreadgroups, constantBufferData, NumThreadgroupsToRun, NumReducedThreadgroupsToRun);
+    constantBufferData.NumSelectQueries = GetNumSelectQueries();
+
+    SelectDigits(commandList, pStageTimer, constantBufferData, NumThreadgroupsToRun, NumReducedThreadgroupsToRun, Context);
+}
+
+// Top-K selection. Finds the NumSelectKeys-th smallest key with a single select query, then compacts every key up to it
+// into the second set of dst buffers.
+void FFXParallelSort::SelectTopK(VkCommandBuffer commandList, GPUTimestamps* pStageTimer, uint32_t NumSelectKeys, SortContext& Context)
+{
+    SetPerfMarkerBegin(commandList, "FFXParallelSort Select");
+
+    // Selection runs over all of the keys
+    FFX_ParallelSortCB constantBufferData = { 0 };
+    uint32_t NumThreadgroupsToRun;
+    uint32_t NumReducedThreadgroupsToRun;
+    FFX_ParallelSort_SetConstantAndDispatchData(m_NumKeys[m_UIResolutionSize], m_MaxNumThreadgroups, constantBufferData, NumThreadgroupsToRun, NumReducedThreadgroupsToRun);
+    constantBufferData.NumSelectKeys = NumSelectKeys;
+
+    SelectDigits(commandList, pStageTimer, constantBufferData, NumThreadgroupsToRun, NumReducedThreadgroupsToRun, Context);
+
+    // Compact the keys (and payloads) that made the cut
+    bool bHasPayload = m_UISortPayload;
+    vkCmdBindPipeline(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, bHasPayload ? m_FPSSelectCompactPayloadPipeline.get() : m_FPSSelectCompactPipeline.get());
+    vkCmdDispatch(commandList, NumThreadgroupsToRun, 1, 1);
+
+    VkBufferMemoryBarrier Barriers[2];
+    int numBarriers = 0;
+    Barriers[numBarriers++] = BufferTransition(m_DstKeyBuffers[1], VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, sizeof(uint32_t) * m_MaxNumKeys);
+    if (bHasPayload)
+        Barriers[numBarriers++] = BufferTransition(m_DstPayloadBuffers[1], VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, sizeof(uint32_t) * m_MaxNumKeys);
+    vkCmdPipelineBarrier(commandList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, numBarriers, Barriers, 0, nullptr);
+    StageTimeStamp(commandList, pStageTimer, "SelectCompact", 0);
+
+    SetPerfMarkerEnd(commandList);
+}
+
+// How many keys the incremental re-sort changes each frame (0 when sorting all of them)
+uint32_t FFXParallelSort::GetNumDirtyKeys() const
+{
+    if (!m_UIIncrementalSort || m_NumKeyWords > 1 || m_OutOfCoreChunkKeys || GetNumSelectKeys() || GetNumSelectQueries())
+        return 0;
+
+    return m_NumKeys[m_UIResolutionSize] / 100 * (uint32_t)std::min(std::max(m_UIDirtyKeyPercent, 1), MaxDirtyKeyPercent);
+}
+
+// Incremental re-sort. The sample changes NumDirtyKeys entries of last frame's order (new random keys at spread out positions),
+// and the payloads of those entries get pulled out so they can be sorted along with their new keys.
+void FFXParallelSort::GatherDirtyKeys(VkCommandBuffer commandList, GPUTimestamps* pStageTimer, uint32_t NumDirtyKeys, SortContext& Context)
+{
+    FFX_ParallelSortCB constantBufferData;
+    uint32_t NumGatherThreadgroupsToRun;
+    uint32_t NumMergeThreadgroupsToRun;
+    FFX_ParallelSort_SetMergeConstantAndDispatchData(m_NumKeys[m_UIResolutionSize], NumDirtyKeys, constantBufferData, NumGatherThreadgroupsToRun, NumMergeThreadgroupsToRun);
+
+    // The merge reuses these constants, so they get their own descriptor set (can't update one that's already bound)
+    VkDescriptorBufferInfo constantBuffer = AllocConstantBuffer(sizeof(FFX_ParallelSortCB), (void*)&constantBufferData);
+    BindConstantBuffer(constantBuffer, Context.DescriptorSetConstantsMerge[Context.FrameConstants]);
+
+    // Bind constants, input/output (for the payload source) and the dirty buffers
+    vkCmdBindDescriptorSets(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_SortPipelineLayout, 0, 1, &Context.DescriptorSetConstantsMerge[Context.FrameConstants], 0, nullptr);
+    vkCmdBindDescriptorSets(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_SortPipelineLayout, 2, 1, &m_SortDescriptorSetInputOutput[0], 0, nullptr);
+    vkCmdBindDescriptorSets(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_SortPipelineLayout, 6, 1, &m_SortDescriptorSetDirty, 0, nullptr);
+
+    // Seed for the changed keys
+    uint32_t Seed = ++m_DirtyKeySeed;
+    vkCmdPushConstants(commandList, m_SortPipelineLayout, VK_SHADER_STAGE_ALL, 0, 4, &Seed);
+
+    vkCmdBindPipeline(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_FPSGenerateDirtyKeysPipeline.get());
+    vkCmdDispatch(commandList, NumGatherThreadgroupsToRun, 1, 1);
+
+    VkBufferMemoryBarrier Barriers[2];
+    Barriers[0] = BufferTransition(m_DirtyKeyBuffers[0], VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_WHOLE_SIZE);
+    Barriers[1] = BufferTransition(m_DirtyIndexBuffer, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_WHOLE_SIZE);
+    vkCmdPipelineBarrier(commandList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 2, Barriers, 0, nullptr);
+
+    if (m_UISortPayload)
+    {
+        vkCmdBindPipeline(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_FPSGatherDirtyPayloadPipeline.get());
+        vkCmdDispatch(commandList, NumGatherThreadgroupsToRun, 1, 1);
+
+        Barriers[0] = BufferTransition(m_DirtyPayloadBuffers[0], VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_WHOLE_SIZE);
+        vkCmdPipelineBarrier(commandList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 1, Barriers, 0, nullptr);
+    }
+    StageTimeStamp(commandList, pStageTimer, "GatherDirty", 0);
+}
+
+// Merges the sorted changed keys (back in the first dirty buffers after an even number of passes) into last frame's order (dst 0 -> dst 1), 
+// then copies the result back over it so next frame has something to merge into again
+void FFXParallelSort::MergeDirtyKeys(VkCommandBuffer commandList, GPUTimestamps* pStageTimer, uint32_t NumDirtyKeys, SortContext& Context)
+{
+    FFX_ParallelSortCB constantBufferData;
+    uint32_t NumGatherThreadgroupsToRun;
+    uint32_t NumMergeThreadgroupsToRun;
+    uint32_t NumberOfKeys = m_NumKeys[m_UIResolutionSize];
+    FFX_ParallelSort_SetMergeConstantAndDispatchData(NumberOfKeys, NumDirtyKeys, constantBufferData, NumGatherThreadgroupsToRun, NumMergeThreadgroupsToRun);
+
+    // Constants were filled in by GatherDirtyKeys
+    bool bHasPayload = m_UISortPayload;
+    vkCmdBindDescriptorSets(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_SortPipelineLayout, 0, 1, &Context.DescriptorSetConstantsMerge[Context.FrameConstants], 0, nullptr);
+    vkCmdBindDescriptorSets(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_SortPipelineLayout, 2, 1, &m_SortDescriptorSetInputOutput[0], 0, nullptr);
+    vkCmdBindDescriptorSets(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_SortPipelineLayout, 6, 1, &m_SortDescriptorSetDirty, 0, nullptr);
+
+    vkCmdBindPipeline(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, bHasPayload ? m_FPSMergePayloadPipeline.get() : m_FPSMergePipeline.get());
+    vkCmdDispatch(commandList, NumMergeThreadgroupsToRun, 1, 1);
+
+    // Copy the merged order back
+    VkBufferMemoryBarrier Barriers[4];
+    int numBarriers = 0;
+    Barriers[numBarriers++] = BufferTransition(m_DstKeyBuffers[1], VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT, sizeof(uint32_t) * NumberOfKeys);
+    Barriers[numBarriers++] = BufferTransition(m_DstKeyBuffers[0], VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, sizeof(uint32_t) * NumberOfKeys);
+    if (bHasPayload)
+    {
+        Barriers[numBarriers++] = BufferTransition(m_DstPayloadBuffers[1], VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT, sizeof(uint32_t) * NumberOfKeys);
+        Barriers[numBarriers++] = BufferTransition(m_DstPayloadBuffers[0], VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, sizeof(uint32_t) * NumberOfKeys);
+    }
+    vkCmdPipelineBarrier(commandList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, numBarriers, Barriers, 0, nullptr);
+    StageTimeStamp(commandList, pStageTimer, "Merge", 0);
+
+    VkBufferCopy copyInfo = { 0 };
+    copyInfo.size = sizeof(uint32_t) * NumberOfKeys;
+    vkCmdCopyBuffer(commandList, m_DstKeyBuffers[1], m_DstKeyBuffers[0], 1, &copyInfo);
+    if (bHasPayload)
+        vkCmdCopyBuffer(commandList, m_DstPayloadBuffers[1], m_DstPayloadBuffers[0], 1, &copyInfo);
+
+    // Put everything back to UAVs for sort usage
+    for (int i = 0; i < numBarriers; ++i)
+        Barriers[i] = BufferTransition(Barriers[i].buffer, Barriers[i].dstAccessMask, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, sizeof(uint32_t) * NumberOfKeys);
+    vkCmdPipelineBarrier(commandList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, numBarriers, Barriers, 0, nullptr);
+    StageTimeStamp(commandList, pStageTimer, "MergeCopy", 0);
+}
+
+// Deferred payload gather. The passes carried each key's source index along, so one pass moves the payload records into sorted
+// order (they land in the temp payload buffer). Sorts that keep going from this frame's result copy them back.
+void FFXParallelSort::GatherPayload(VkCommandBuffer commandList, GPUTimestamps* pStageTimer, bool bIndirectDispatch, uint32_t NumThreadgroupsToRun, bool bCopyBack, SortContext& Context)
+{
+    // The sort's constants are still bound, the push constant is the record stride (the sample's payloads are a uint each)
+    uint32_t RecordStride = 1;
+    vkCmdPushConstants(commandList, m_SortPipelineLayout, VK_SHADER_STAGE_ALL, 0, 4, &RecordStride);
+    vkCmdBindDescriptorSets(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_SortPipelineLayout, 2, 1, &m_SortDescriptorSetGatherPayload, 0, nullptr);
+
+    vkCmdBindPipeline(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_FPSGatherPayloadPipeline.get());
+    if (bIndirectDispatch)
+        vkCmdDispatchIndirect(commandList, Context.IndirectCountScatterArgs, 0);
+    else
+        vkCmdDispatch(commandList, NumThreadgroupsToRun, 1, 1);
+
+    uint32_t NumberOfKeys = m_NumKeys[m_UIResolutionSize];
+    VkBufferMemoryBarrier Barriers[2];
+    if (!bCopyBack)
+    {
+        Barriers[0] = BufferTransition(m_DstPayloadBuffers[1], VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, sizeof(uint32_t) * NumberOfKeys);
+        vkCmdPipelineBarrier(commandList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 1, Barriers, 0, nullptr);
+        StageTimeStamp(commandList, pStageTimer, "GatherPayload", 0);
+        return;
+    }
+
+    Barriers[0] = BufferTransition(m_DstPayloadBuffers[1], VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT, sizeof(uint32_t) * NumberOfKeys);
+    Barriers[1] = BufferTransition(m_DstPayloadBuffers[0], VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, sizeof(uint32_t) * NumberOfKeys);
+    vkCmdPipelineBarrier(commandList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 2, Barriers, 0, nullptr);
+    StageTimeStamp(commandList, pStageTimer, "GatherPayload", 0);
+
+    VkBufferCopy copyInfo = { 0 };
+    copyInfo.size = sizeof(uint32_t) * NumberOfKeys;
+    vkCmdCopyBuffer(commandList, m_DstPayloadBuffers[1], m_DstPayloadBuffers[0], 1, &copyInfo);
+
+    for (int i = 0; i < 2; ++i)
+        Barriers[i] = BufferTransition(Barriers[i].buffer, Barriers[i].dstAccessMask, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, sizeof(uint32_t) * NumberOfKeys);
+    vkCmdPipelineBarrier(commandList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 2, Barriers, 0, nullptr);
+    StageTimeStamp(commandList, pStageTimer, "GatherCopy", 0);
+}
+
+// Packed key+index sorts. Puts each key above its source index in the second key buffer before the passes (which only sort the key bits).
+void FFXParallelSort::PackKeyIndex(VkCommandBuffer commandList, GPUTimestamps* pStageTimer, bool bIndirectDispatch, uint32_t NumThreadgroupsToRun, uint32_t IndexBits, SortContext& Context)
+{
+    // The sort's constants are already bound, the push constant is the index width
+    vkCmdPushConstants(commandList, m_SortPipelineLayout, VK_SHADER_STAGE_ALL, 0, 4, &IndexBits);
+    vkCmdBindDescriptorSets(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_SortPipelineLayout, 2, 1, &m_SortDescriptorSetInputOutput[0], 0, nullptr);
+
+    vkCmdBindPipeline(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_FPSPackKeyIndexPipeline.get());
+    if (bIndirectDispatch)
+        vkCmdDispatchIndirect(commandList, Context.IndirectCountScatterArgs, 0);
+    else
+        vkCmdDispatch(commandList, NumThreadgroupsToRun, 1, 1);
+
+    VkBufferMemoryBarrier Barrier = BufferTransition(m_DstKeyBuffers[1], VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_WHOLE_SIZE);
+    vkCmdPipelineBarrier(commandList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 1, &Barrier, 0, nullptr);
+    StageTimeStamp(commandList, pStageTimer, "PackKeyIndex", 0);
+}
+
+// And splits the sorted words back up into the sorted keys and their source indices (which take the place of the payload). The input/output
+// set reads the sorted words and writes the keys and indices to the other buffer pair.
+void FFXParallelSort::UnpackKeyIndex(VkCommandBuffer commandList, GPUTimestamps* pStageTimer, bool bIndirectDispatch, uint32_t NumThreadgroupsToRun, uint32_t IndexBits,
+                                     VkDescriptorSet& InputOutputSet, VkBuffer KeyBuffer, VkBuffer IndexBuffer, SortContext& Context)
+{
+    // The sort's constants are still bound, the push constant is the index width
+    vkCmdPushConstants(commandList, m_SortPipelineLayout, VK_SHADER_STAGE_ALL, 0, 4, &IndexBits);
+    vkCmdBindDescriptorSets(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_SortPipelineLayout, 2, 1, &InputOutputSet, 0, nullptr);
+
+    vkCmdBindPipeline(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_FPSUnpackKeyIndexPipeline.get());
+    if (bIndirectDispatch)
+        vkCmdDispatchIndirect(commandList, Context.IndirectCountScatterArgs, 0);
+    else
+        vkCmdDispatch(commandList, NumThreadgroupsToRun, 1, 1);
+
+    VkBufferMemoryBarrier Barriers[2];
+    Barriers[0] = BufferTransition(KeyBuffer, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_WHOLE_SIZE);
+    Barriers[1] = BufferTransition(IndexBuffer, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_WHOLE_SIZE);
+    vkCmdPipelineBarrier(commandList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 2, Barriers, 0, nullptr);
+    StageTimeStamp(commandList, pStageTimer, "UnpackKeyIndex", 0);
+}
+
+// Key records (sample only). Spreads the current key set out into records of KeyRecordStrideOverride bytes with the key
+// KeyRecordOffsetOverride bytes in, for the first pass of key record sorts to read the keys from.
+void FFXParallelSort::WriteKeyRecords(VkCommandBuffer commandList, GPUTimestamps* pStageTimer, SortContext& Context)
+{
+    FFX_ParallelSortCB constantBufferData;
+    uint32_t NumThreadgroupsToRun, NumReducedThreadgroupsToRun;
+    FFX_ParallelSort_SetConstantAndDispatchData(m_NumKeys[m_UIResolutionSize], m_MaxNumThreadgroups, constantBufferData, NumThreadgroupsToRun, NumReducedThreadgroupsToRun);
+    FFX_ParallelSort_SetKeyLayout(constantBufferData, KeyRecordStrideOverride, KeyRecordOffsetOverride);
+
+    VkDescriptorBufferInfo constantBuffer = AllocConstantBuffer(sizeof(FFX_ParallelSortCB), (void*)&constantBufferData);
+    BindConstantBuffer(constantBuffer, Context.DescriptorSetConstantsKeyRecords[Context.FrameConstants]);
+
+    // Bind constants and input/output (this frame's keys -> records)
+    vkCmdBindDescriptorSets(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_SortPipelineLayout, 0, 1, &Context.DescriptorSetConstantsKeyRecords[Context.FrameConstants], 0, nullptr);
+    vkCmdBindDescriptorSets(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_SortPipelineLayout, 2, 1, &m_SortDescriptorSetWriteKeyRecords, 0, nullptr);
+
+    vkCmdBindPipeline(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_FPSWriteKeyRecordsPipeline.get());
+    vkCmdDispatch(commandList, NumThreadgroupsToRun, 1, 1);
+
+    VkBufferMemoryBarrier Barrier = BufferTransition(m_KeyRecordBuffer, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_WHOLE_SIZE);
+    vkCmdPipelineBarrier(commandList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 1, &Barrier, 0, nullptr);
+    StageTimeStamp(commandList, pStageTimer, "WriteKeyRecords", 0);
+    m_KeyRecordSet = m_UIResolutionSize;
+}
+
+// GPU validation. Before the sort this adds up the checksums of the keys going in, after it those of the sorted keys along with
+// their order, and then resolves the result record and copies it into the next read-back slot (reading what was there first).
+// Full sorts start and end in the first set of sort buffers, so both sides read the keys from there.
+void FFXParallelSort::ValidateSort(VkCommandBuffer commandList, GPUTimestamps* pStageTimer, VkDescriptorSet& InputOutputSet, bool bHasPayload, bool b16BitKeys, bool bSorted, SortContext& Context)
+{
+    // Validation walks the whole key set like the presort check, so it takes the same constants (the set can't be updated once bound, so fill it once)
+    if (!bSorted)
+    {
+        struct SetupIndirectCB
+        {
+            uint32_t NumKeysIndex;
+            uint32_t MaxThreadGroups;
+            uint32_t NumKeyWords;
+            uint32_t KeyStride;
+            uint32_t KeyOffset;
+        };
+        SetupIndirectCB ValidateCB;
+        ValidateCB.NumKeysIndex = m_UIResolutionSize;
+        ValidateCB.MaxThreadGroups = m_MaxNumThreadgroups;
+        ValidateCB.NumKeyWords = m_NumKeyWords;
+        ValidateCB.KeyStride = 1;
+        ValidateCB.KeyOffset = 0;
+
+        VkDescriptorBufferInfo constantBuffer = AllocConstantBuffer(sizeof(SetupIndirectCB), (void*)&ValidateCB);
+        BindConstantBuffer(constantBuffer, Context.DescriptorSetConstantsValidate[Context.FrameConstants]);
+    }
+
+    vkCmdBindDescriptorSets(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_SortPipelineLayout, 1, 1, &Context.DescriptorSetConstantsValidate[Context.FrameConstants], 0, nullptr);
+    vkCmdBindDescriptorSets(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_SortPipelineLayout, 2, 1, &InputOutputSet, 0, nullptr);
+    vkCmdBindDescriptorSets(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_SortPipelineLayout, 5, 1, &Context.DescriptorSetIndirect, 0, nullptr);
+
+    if (bSorted && b16BitKeys)
+        vkCmdBindPipeline(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, bHasPayload ? m_FPSValidateOutput16BitPayloadPipeline.get() : m_FPSValidateOutput16BitPipeline.get());
+    else if (bSorted)
+        vkCmdBindPipeline(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, bHasPayload ? m_FPSValidateOutputPayloadPipeline.get() : m_FPSValidateOutputPipeline.get());
+    else if (b16BitKeys)
+        vkCmdBindPipeline(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, bHasPayload ? m_FPSValidateInput16BitPayloadPipeline.get() : m_FPSValidateInput16BitPipeline.get());
+    else
+        vkCmdBindPipeline(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, bHasPayload ? m_FPSValidateInputPayloadPipeline.get() : m_FPSValidateInputPipeline.get());
+    vkCmdDispatch(commandList, m_MaxNumThreadgroups, 1, 1);
+
+    VkBufferMemoryBarrier barrier = BufferTransition(m_ValidateStateBuffer, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, sizeof(uint32_t) * FFX_PARALLELSORT_VALIDATE_STATE_SIZE);
+    vkCmdPipelineBarrier(commandList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+    if (!bSorted)
+    {
+        StageTimeStamp(commandList, pStageTimer, "ValidateInput", 0);
+        return;
+    }
+
+    vkCmdBindPipeline(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_FPSValidateResultPipeline.get());
+    vkCmdDispatch(commandList, 1, 1, 1);
+
+    // Slots go to validated sorts rather than frames. When all of them are still waiting on their copies (too many validated
+    // sorts in the last few frames), this sort's record doesn't get read back
+    uint32_t Slot = m_GPUValidationSlot;
+    if (m_bGPUValidationPending[Slot])
+    {
+        barrier = BufferTransition(m_ValidateStateBuffer, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, sizeof(uint32_t) * FFX_PARALLELSORT_VALIDATE_STATE_SIZE);
+        vkCmdPipelineBarrier(commandList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+        StageTimeStamp(commandList, pStageTimer, "ValidateOutput", 0);
+        return;
+    }
+    m_GPUValidationSlot = (Slot + 1) % GPUValidationSlots;
+    m_bGPUValidationPending[Slot] = true;
+    m_GPUValidationSlotFrame[Slot] = m_FrameCount;
+
+    barrier = BufferTransition(m_ValidateStateBuffer, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT, sizeof(uint32_t) * FFX_PARALLELSORT_VALIDATE_STATE_SIZE);
+    vkCmdPipelineBarrier(commandList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+    VkBufferCopy copyInfo;
+    copyInfo.srcOffset = sizeof(uint32_t) * FFX_PARALLELSORT_VALIDATE_STATE_RESULT;
+    copyInfo.dstOffset = sizeof(uint32_t) * FFX_PARALLELSORT_VALIDATE_RESULT_SIZE * Slot;
+    copyInfo.size = sizeof(uint32_t) * FFX_PARALLELSORT_VALIDATE_RESULT_SIZE;
+    vkCmdCopyBuffer(commandList, m_ValidateStateBuffer, m_ValidateReadBackBuffer, 1, &copyInfo);
+
+    barrier = BufferTransition(m_ValidateStateBuffer, VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, sizeof(uint32_t) * FFX_PARALLELSORT_VALIDATE_STATE_SIZE);
+    vkCmdPipelineBarrier(commandList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+    StageTimeStamp(commandList, pStageTimer, "ValidateOutput", 0);
+}
+
+// Tallies up the GPU validation result records whose copies have landed (the frames that copied them are ReadBackLatency
+// frames old), oldest first
+void FFXParallelSort::ReadGPUValidationResults()
+{
+    for (uint32_t i = 0; i < GPUValidationSlots; ++i)
+    {
+        uint32_t Slot = (m_GPUValidationSlot + i) % GPUValidationSlots;
+        if (m_bGPUValidationPending[Slot] && m_FrameCount - m_GPUValidationSlotFrame[Slot] >= ReadBackLatency)
+        {
+            ReadGPUValidationResult(Slot);
+            m_bGPUValidationPending[Slot] = false;
+        }
+    }
+}
+
+// Tallies up a GPU validation result record (and reports failures)
+void FFXParallelSort::ReadGPUValidationResult(uint32_t Slot)
+{
+    vmaInvalidateAllocation(m_pDevice->GetAllocator(), m_ValidateReadBackBufferAllocation, sizeof(uint32_t) * FFX_PARALLELSORT_VALIDATE_RESULT_SIZE * Slot, sizeof(uint32_t) * FFX_PARALLELSORT_VALIDATE_RESULT_SIZE);
+    const uint32_t* pResult = m_pValidateResults + FFX_PARALLELSORT_VALIDATE_RESULT_SIZE * Slot;
+    ++m_NumGPUValidations;
+
+    uint32_t Status = pResult[FFX_PARALLELSORT_VALIDATE_RESULT_STATUS];
+    if (!Status)
+        return;
+
+    ++m_NumGPUValidationFailures;
+    std::string message = "GPU validation failed on sort " + std::to_string(pResult[FFX_PARALLELSORT_VALIDATE_RESULT_COUNT]) + ":";
+    if (Status & FFX_PARALLELSORT_VALIDATE_FAILED_ORDER)
+        message += " " + std::to_string(pResult[FFX_PARALLELSORT_VALIDATE_RESULT_INVERSIONS]) + " entries larger than the next one (first at entry " +
+                   std::to_string(pResult[FFX_PARALLELSORT_VALIDATE_RESULT_FIRST_VIOLATION]) + ").";
+    if (Status & FFX_PARALLELSORT_VALIDATE_FAILED_KEYS)
+        message += " Sorted keys are not a permutation of the input.";
+    if (Status & FFX_PARALLELSORT_VALIDATE_FAILED_PAYLOAD)
+        message += " Payloads did not move with their keys.";
+    Trace(message);
+    m_LastGPUValidationFailure = message;
+}
+
+// Out-of-core sort of NumOutOfCoreKeys keys (more than the sort buffers hold). Chunks that fit get sorted on the GPU one at
+// a time and read back as sorted runs, then every output window gets its slice of each run merged by MergeRuns and read back.
+// More runs than MergeRuns takes are merged in groups, over as many passes as it takes to get down to a single run.
+// Everything goes through the upload heap's command list and waits on it, so this runs once at startup rather than per frame.
+void FFXParallelSort::SortOutOfCore(uint32_t NumOutOfCoreKeys)
+{
+    if (m_NumKeyWords > 1)
+    {
+        Trace("FFXParallelSort: out-of-core sorts only support single-word keys, skipping");
+        return;
+    }
+
+    const uint32_t ChunkSize = m_MaxNumKeys;
+    const uint32_t NumRuns = (NumOutOfCoreKeys + ChunkSize - 1) / ChunkSize;
+    Trace("FFXParallelSort: out-of-core sort of " + std::to_string(NumOutOfCoreKeys) + " keys in " + std::to_string(NumRuns) + " runs");
+
+    std::vector<uint32_t> Keys(NumOutOfCoreKeys);
+    GenerateKeys(Keys, KeyDistributionOverride, KeySeedOverride);
+    NarrowKeys(Keys, m_KeyBits);
+    uint64_t KeySum = std::accumulate(Keys.begin(), Keys.end(), uint64_t(0));
+
+    // Read-back buffer big enough for a chunk (or an output window)
+    VkBuffer ReadBackBuffer;
+    VmaAllocation ReadBackBufferAllocation;
+    VkBufferCreateInfo bufferCreateInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+    bufferCreateInfo.size = sizeof(uint32_t) * ChunkSize;
+    bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VmaAllocationCreateInfo allocCreateInfo = {};
+    allocCreateInfo.usage = VMA_MEMORY_USAGE_GPU_TO_CPU;
+    allocCreateInfo.pUserData = "OutOfCoreReadBack";
+    if (VK_SUCCESS != vmaCreateBuffer(m_pDevice->GetAllocator(), &bufferCreateInfo, &allocCreateInfo, &ReadBackBuffer, &ReadBackBufferAllocation, nullptr))
+    {
+        Trace("Failed to create buffer for OutOfCoreReadBack");
+        return;
+    }
+
+    // Copies the first NumValues keys of a sort buffer into pData (waiting on everything recorded so far)
+    auto ReadBack = [&](VkBuffer Buffer, uint32_t* pData, uint32_t NumValues)
+    {
+        VkCommandBuffer commandList = m_pUploadHeap->GetCommandList();
+        VkBufferMemoryBarrier Barrier = BufferTransition(Buffer, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT, sizeof(uint32_t) * NumValues);
+        vkCmdPipelineBarrier(commandList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 1, &Barrier, 0, nullptr);
+
+        VkBufferCopy copyInfo = { 0 };
+        copyInfo.size = sizeof(uint32_t) * NumValues;
+        vkCmdCopyBuffer(commandList, Buffer, ReadBackBuffer, 1, &copyInfo);
+
+        VkBufferMemoryBarrier Barriers[2] = { BufferTransition(Buffer, VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, sizeof(uint32_t) * NumValues),
+                                              BufferTransition(ReadBackBuffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT, sizeof(uint32_t) * NumValues) };
+        vkCmdPipelineBarrier(commandList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 2, Barriers, 0, nullptr);
+        m_pUploadHeap->FlushAndFinish();
+
+        void* pMappedData;
+        vmaMapMemory(m_pDevice->GetAllocator(), ReadBackBufferAllocation, &pMappedData);
+        vmaInvalidateAllocation(m_pDevice->GetAllocator(), ReadBackBufferAllocation, 0, sizeof(uint32_t) * NumValues);
+        memcpy(pData, pMappedData, sizeof(uint32_t) * NumValues);
+        vmaUnmapMemory(m_pDevice->GetAllocator(), ReadBackBufferAllocation);
+    };
+
+    // Uploads NumValues values to the start of a buffer the sort uses as a UAV
+    auto Upload = [&](VkBuffer Buffer, const uint32_t* pData, uint32_t NumValues)
+    {
+        VkBufferMemoryBarrier Barrier = BufferTransition(Buffer, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, sizeof(uint32_t) * NumValues);
+        vkCmdPipelineBarrier(m_pUploadHeap->GetCommandList(), VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 1, &Barrier, 0, nullptr);
+        UploadBufferData(Buffer, pData, NumValues);
+        Barrier = BufferTransition(Buffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, sizeof(uint32_t) * NumValues);
+        vkCmdPipelineBarrier(m_pUploadHeap->GetCommandList(), VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 1, &Barrier, 0, nullptr);
+    };
+
+    auto StartTime = std::chrono::high_resolution_clock::now();
+
+    // Sort every chunk into a run (in place, chunk sorts run an even number of passes so the result is back in the first sort buffer)
+    std::vector<const uint32_t*> Runs(NumRuns);
+    std::vector<uint32_t> RunLengths(NumRuns);
+    for (uint32_t Run = 0; Run < NumRuns; ++Run)
+    {
+        uint32_t* pRun = Keys.data() + size_t(Run) * ChunkSize;
+        Runs[Run] = pRun;
+        RunLengths[Run] = std::min(NumOutOfCoreKeys - Run * ChunkSize, ChunkSize);
+
+        Upload(m_DstKeyBuffers[0], pRun, RunLengths[Run]);
+        m_OutOfCoreChunkKeys = RunLengths[Run];
+        Sort(m_pUploadHeap->GetCommandList(), true, 0.f);
+        m_OutOfCoreChunkKeys = 0;
+        ReadBack(m_DstKeyBuffers[0], pRun, RunLengths[Run]);
+    }
+
+    auto RunsTime = std::chrono::high_resolution_clock::now();
+
+    // Merge the runs in groups of at most FFX_PARALLELSORT_MAX_MERGE_RUNS, one output window at a time, and repeat until a single
+    // run is left. The runs sit back to back, so each merged group lands where its runs were (in the other key array)
+    std::vector<uint32_t> MergedKeys(NumOutOfCoreKeys);
+    uint32_t* pSrcKeys = Keys.data();
+    uint32_t* pDstKeys = MergedKeys.data();
+    std::vector<uint32_t> WindowKeys(ChunkSize);
+    std::vector<uint32_t> WindowStart(FFX_PARALLELSORT_MAX_MERGE_RUNS), WindowEnd(FFX_PARALLELSORT_MAX_MERGE_RUNS), RunOffsets(FFX_PARALLELSORT_MAX_MERGE_RUNS + 1);
+    uint32_t NumMergePasses = 0;
+    while (Runs.size() > 1)
+    {
+        std::vector<const uint32_t*> MergedRuns;
+        std::vector<uint32_t> MergedRunLengths;
+        for (size_t FirstRun = 0; FirstRun < Runs.size(); FirstRun += FFX_PARALLELSORT_MAX_MERGE_RUNS)
+        {
+            const uint32_t NumGroupRuns = uint32_t(std::min<size_t>(Runs.size() - FirstRun, FFX_PARALLELSORT_MAX_MERGE_RUNS));
+            const uint32_t* const* ppGroupRuns = Runs.data() + FirstRun;
+            const uint32_t* pGroupRunLengths = RunLengths.data() + FirstRun;
+            const uint32_t GroupKeys = std::accumulate(pGroupRunLengths, pGroupRunLengths + NumGroupRuns, 0u);
+            uint32_t* pMerged = pDstKeys + (ppGroupRuns[0] - pSrcKeys);
+            MergedRuns.push_back(pMerged);
+            MergedRunLengths.push_back(GroupKeys);
+
+            // A run left on its own only needs to move along
+            if (NumGroupRuns == 1)
+            {
+                std::copy(ppGroupRuns[0], ppGroupRuns[0] + GroupKeys, pMerged);
+                continue;
+            }
+
+            FFX_ParallelSort_SplitSortedRuns(ppGroupRuns, pGroupRunLengths, NumGroupRuns, 0, WindowStart.data());
+            for (uint32_t OutputOffset = 0; OutputOffset < GroupKeys; )
+            {
+                uint32_t WindowSize = std::min(GroupKeys - OutputOffset, ChunkSize);
+                FFX_ParallelSort_SplitSortedRuns(ppGroupRuns, pGroupRunLengths, NumGroupRuns, OutputOffset + WindowSize, WindowEnd.data());
+
+                // Slices of every run back to back
+                RunOffsets[0] = 0;
+                for (uint32_t Run = 0; Run < NumGroupRuns; ++Run)
+                {
+                    std::copy(ppGroupRuns[Run] + WindowStart[Run], ppGroupRuns[Run] + WindowEnd[Run], WindowKeys.begin() + RunOffsets[Run]);
+                    RunOffsets[Run + 1] = RunOffsets[Run] + WindowEnd[Run] - WindowStart[Run];
+                }
+                assert(RunOffsets[NumGroupRuns] == WindowSize);
+
+                Upload(m_DstKeyBuffers[0], WindowKeys.data(), WindowSize);
+                Upload(m_RunOffsetBuffer, RunOffsets.data(), NumGroupRuns + 1);
+
+                FFX_ParallelSortCB constantBufferData;
+                uint32_t NumThreadgroupsToRun;
+                FFX_ParallelSort_SetMergeRunsConstantAndDispatchData(WindowSize, NumGroupRuns, constantBufferData, NumThreadgroupsToRun);
+
+                // The previous window's commands have completed, so the merge constants set is free to update
+                VkDescriptorBufferInfo constantBuffer = AllocConstantBuffer(sizeof(FFX_ParallelSortCB), (void*)&constantBufferData);
+                BindConstantBuffer(constantBuffer, m_pDefaultSortContext->DescriptorSetConstantsMerge[0]);
+
+                VkCommandBuffer commandList = m_pUploadHeap->GetCommandList();
+                vkCmdBindDescriptorSets(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_SortPipelineLayout, 0, 1, &m_pDefaultSortContext->DescriptorSetConstantsMerge[0], 0, nullptr);
+                vkCmdBindDescriptorSets(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_SortPipelineLayout, 2, 1, &m_SortDescriptorSetInputOutput[0], 0, nullptr);
+                vkCmdBindDescriptorSets(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_SortPipelineLayout, 7, 1, &m_SortDescriptorSetRunOffsets, 0, nullptr);
+                vkCmdBindPipeline(commandList, VK_PIPELINE_BIND_POINT_COMPUTE, m_FPSMergeRunsPipeline.get());
+                vkCmdDispatch(commandList, NumThreadgroupsToRun, 1, 1);
+
+                ReadBack(m_DstKeyBuffers[1], pMerged + OutputOffset, WindowSize);
+
+                std::swap(WindowStart, WindowEnd);
+                OutputOffset += WindowSize;
+            }
+        }
+
+        Runs.swap(MergedRuns);
+        RunLengths.swap(MergedRunLengths);
+        std::swap(pSrcKeys, pDstKeys);
+        ++NumMergePasses;
+    }
+
+    auto EndTime = std::chrono::high_resolution_clock::now();
+    vmaDestroyBuffer(m_pDevice->GetAllocator(), ReadBackBuffer, ReadBackBufferAllocation);
+
+    // The sort buffers no longer hold the frame's keys
+    m_TemporalKeySet = -1;
+    m_bSortedKeysInPlace = false;
+
+    // The last merge pass wrote to what is now the source array
+    const uint32_t* pSortedKeys = pSrcKeys;
+    bool bValid = std::is_sorted(pSortedKeys, pSortedKeys + NumOutOfCoreKeys) && std::accumulate(pSortedKeys, pSortedKeys + NumOutOfCoreKeys, uint64_t(0)) == KeySum;
+    Trace(std::string("FFXParallelSort: out-of-core sort ") + (bValid ? "valid" : "invalid") +
+          ", runs " + std::to_string(std::chrono::duration<double, std::milli>(RunsTime - StartTime).count()) + " ms" +
+          ", " + std::to_string(NumMergePasses) + " merge passes " + std::to_string(std::chrono::duration<double, std::milli>(EndTime - RunsTime).count()) + " ms");
+}
+
+// Insert a GPU timestamp after a sort stage (no-op when per-stage timings are off)
+void FFXParallelSort::StageTimeStamp(VkCommandBuffer commandList, GPUTimestamps* pGPUTimer, const char* stage, uint32_t shift)
+{
+    if (!pGPUTimer || !m_StageTimings.ReserveTimeStamp())
+        return;
+
+    std::string label = "FPS ";
+    label += stage;
+    label += " ";
+    label += std::to_string(shift);
+    pGPUTimer->GetTimeStamp(commandList, label.c_str());
+}
+
+// Pull our stage stamps out of the frame's timings and fold them into the rolling history
+void FFXParallelSort::UpdateStageTimings(std::vector<TimeStamp>& timeStamps, const char* sortLabel)
+{
+    if (!m_UIStageTimings)
+    {
+        m_StageTimings.Clear();
+        return;
+    }
+
+    m_StageTimings.Update(timeStamps, sortLabel);
+}
+
 // Render Parallel Sort related GUI
 void FFXParallelSort::DrawGui()
 {
     if (ImGui::CollapsingHeader("FFX Parallel Sort", ImGuiTreeNodeFlags_DefaultOpen))
     {
-        static const char* ResolutionSizeStrings[] = { "1920x1080", "2560x1440", "3840x2160" };
+        std::string CustomKeySetString = std::to_string(m_NumKeys[CustomKeySet]) + " keys";
+        const char* ResolutionSizeStrings[] = { "1920x1080", "2560x1440", "3840x2160", CustomKeySetString.c_str() };
 
         ImVec2 textSize = ImGui::CalcTextSize("3840x2160");
         if (KeySetOverride < 0)
         {
             ImGui::PushItemWidth(textSize.x * 2);
-            ImGui::Combo("Sort Buffer Resolution", &m_UIResolutionSize, ResolutionSizeStrings, _countof(ResolutionSizeStrings));
+            ImGui::Combo("Sort Buffer Resolution", &m_UIResolutionSize, ResolutionSizeStrings, m_NumKeySets);
             ImGui::PopItemWidth();
         }
 
+        ImGui::Text("Key Distribution: %s (seed %u)", KeyDistributionNames[KeyDistributionOverride], KeySeedOverride);
+        if (m_WaveSize)
+            ImGui::Text("Kernels: wave%u (required subgroup size)", m_WaveSize);
+        else
+            ImGui::Text("Kernels: any wave size");
+        ImGui::Text("Scatter Ranking: %s", m_bTileScatter ? "full tile" : m_bMatchScatter ? "ballot match" : "per row");
+        ImGui::Text("Digit Counting: %s", m_bRegisterCount ? "registers" : "LDS atomics");
+
         ImGui::Checkbox("Sort Payload", &m_UISortPayload);
+        if (m_UISortPayload)
+            ImGui::Checkbox("Deferred Payload Gather", &m_UIDeferredPayload);
+        if (m_NumKeyWords == 1)
+        {
+            ImGui::Checkbox("Key Load/Store Hooks", &m_UIKeyHooks);
+            if (KeyRecordStrideOverride)
+            {
+                std::string KeyRecordsLabel = "Sort Key Records (" + std::to_string(KeyRecordStrideOverride) + " byte stride)";
+                ImGui::Checkbox(KeyRecordsLabel.c_str(), &m_UIKeyRecords);
+            }
+        }
+        ImGui::Checkbox("Read-Only Vector Input", &m_UIReadOnlyInput);
+        if (m_KeyBits < 32)
+        {
+            ImGui::Text("Key Width: %u bits (%u passes)", m_KeyBits, m_KeyBits / FFX_PARALLELSORT_SORT_BITS_PER_PASS);
+            if (m_b16BitKeyStorage)
+                ImGui::Checkbox("16-Bit Key Storage", &m_UI16BitKeys);
+
+            // Indirect sorts leave room for the indices of the biggest key set
+            uint32_t PackedNumKeys = m_UIIndirectSort ? m_MaxNumKeys : m_NumKeys[m_UIResolutionSize];
+            if (FFX_ParallelSort_CanPackKeyIndex(m_KeyBits, PackedNumKeys))
+                ImGui::Checkbox("Packed Key+Index", &m_UIPackedKeyIndex);
+            else
+                ImGui::Text("Packed key+index needs keys of %u bits or less", 32 - FFX_ParallelSort_PackedIndexBits(PackedNumKeys));
+        }
         ImGui::Checkbox("Use Indirect Execution", &m_UIIndirectSort);
+        ImGui::Checkbox("Skip Sort When Presorted", &m_UIPresortCheck);
+        if (m_UIPresortCheck)
+        {
+            ImGui::Text("Presort check always uses indirect execution");
+            if (m_NumPresortChecks > ReadBackLatency)
+                ImGui::Text("Last Check: %u neighbours out of order (%s)", m_LastPresortInversions, m_LastPresortInversions ? "sorted" : "sort skipped");
+        }
+        ImGui::Checkbox("Temporal Coherence", &m_UITemporalCoherence);
+        if (m_NumKeyWords == 1)
+        {
+            // Start over from the source keys when toggled, the incremental re-sort changes the keys it sorts
+            if (ImGui::Checkbox("Incremental Re-sort", &m_UIIncrementalSort))
+                m_TemporalKeySet = -1;
+            if (m_UIIncrementalSort)
+                ImGui::SliderInt("Changed Keys (%)", &m_UIDirtyKeyPercent, 1, MaxDirtyKeyPercent);
+        }
+        else
+            ImGui::Text("Incremental re-sort requires single word keys");
+        if (m_NumKeyWords == 1)
+        {
+            ImGui::Checkbox("Top-K Selection", &m_UISelectTopK);
+            if (m_UISelectTopK)
+            {
+                ImGui::InputInt("Keys To Keep", &m_UISelectNumKeys, 1024, 65536);
+                m_UISelectNumKeys = std::max(m_UISelectNumKeys, 1);
+            }
+            if ((m_UITemporalCoherence || m_UIIncrementalSort) && GetNumSelectKeys())
+                ImGui::Text("Top-K selection starts from the source keys every frame");
+        }
+        else
+            ImGui::Text("Top-K selection requires single word keys");
+        if (m_NumKeyWords == 1)
+        {
+            ImGui::Checkbox("Percentile Queries", &m_UISelectPercentiles);
+            if (m_UISelectPercentiles)
+            {
+                for (size_t i = 0; i < m_SelectPercentiles.size(); ++i)
+                {
+                    // Keys read back from the GPU, with what the CPU found next to any that don't match
+                    if (i >= m_PercentileKeys.size())
+                        ImGui::BulletText("p%g", m_SelectPercentiles[i] * 100.f);
+                    else if (m_PercentileKeySet >= 0 && i < m_ExpectedPercentileKeys[m_PercentileKeySet].size() && m_PercentileKeys[i] != m_ExpectedPercentileKeys[m_PercentileKeySet][i])
+                        ImGui::BulletText("p%g: %u (CPU reference %u)", m_SelectPercentiles[i] * 100.f, m_PercentileKeys[i], m_ExpectedPercentileKeys[m_PercentileKeySet][i]);
+                    else
+                        ImGui::BulletText("p%g: %u", m_SelectPercentiles[i] * 100.f, m_PercentileKeys[i]);
+                }
+            }
+        }
+        else
+            ImGui::Text("Percentile queries require single word keys");
+        ImGui::Checkbox("Per-Stage GPU Timings", &m_UIStageTimings);
+        if (m_UIStageTimings)
+        {
+            std::vector<StageTiming> stageTimings;
+            GetStageTimings(stageTimings);
+            for (const StageTiming& timing : stageTimings)
+                ImGui::Text("%-12s p50 %8.2f us  p99 %8.2f us", timing.Label.c_str(), timing.P50, timing.P99);
 
-        ImGui::RadioButton("Render Unsorted Keys", &m_UIVisualOutput, 0);
-        ImGui::RadioButton("Render Sorted Keys", &m_UIVisualOutput, 1);
+            if (ImGui::TreeNode("Per Pass Timings"))
+            {
+                GetStageTimings(stageTimings, true);
+                for (const StageTiming& timing : stageTimings)
+                    ImGui::Text("%-22s p50 %8.2f us  p99 %8.2f us", timing.Label.c_str() + 4, timing.P50, timing.P99);
+                ImGui::TreePop();
+            }
+            if (m_StageTimings.IsTruncated())
+                ImGui::Text("Out of GPU timestamps, later stages are counted in Tail");
+        }
+        ImGui::Checkbox("GPU Validation", &m_UIGPUValidation);
+        if (m_UIGPUValidation || m_NumGPUValidations)
+        {
+            ImGui::Text("Validated %u sorts, %u failed", m_NumGPUValidations, m_NumGPUValidationFailures);
+            if (!m_LastGPUValidationFailure.empty())
+                ImGui::TextWrapped("%s", m_LastGPUValidationFailure.c_str());
+        }
+
+        if (m_UIResolutionSize == CustomKeySet)
+            ImGui::Text("Visualization requires a resolution key set");
+        else if (m_NumKeyWords > 1)
+            ImGui::Text("Visualization requires single word keys");
+        else if (m_KeyBits < 32)
+            ImGui::Text("Visualization requires 32-bit keys");
+        else if (GetNumSelectKeys() || GetNumSelectQueries())
+            ImGui::Text("Visualization requires sorting all the keys");
+        else if (GetNumDirtyKeys())
+            ImGui::Text("Visualization requires the source keys (incremental re-sort changes them)");
+        else if (KeysArePermutation(KeyDistributionOverride))
+        {
+            ImGui::RadioButton("Render Unsorted Keys", &m_UIVisualOutput, 0);
+            ImGui::RadioButton("Render Sorted Keys", &m_UIVisualOutput, 1);
+        }
+        else
+            ImGui::Text("Visualization requires a permutation key distribution");
     }
 }
 
 // Renders the image with the sorted/unsorted indicies for visual representation
 void FFXParallelSort::DrawVisualization(VkCommandBuffer commandList, uint32_t RTWidth, uint32_t RTHeight)
 {
+    // Keys are used as pixel indices, so there is nothing sensible to show unless they are a permutation of 0..N-1 covering the whole image
+    if (!KeysArePermutation(KeyDistributionOverride) || m_UIResolutionSize == CustomKeySet || m_NumKeyWords > 1 || m_KeyBits < 32 || GetNumSelectKeys() || GetNumSelectQueries() || GetNumDirtyKeys())
+        return;
+
     // Setup the constant buffer
     ParallelSortRenderCB ConstantBuffer;
     ConstantBuffer.Width = RTWidth;
@@ -1104,14 +3349,14 @@ void FFXParallelSort::DrawVisualization(VkCommandBuffer commandList, uint32_t RT
     ConstantBuffer.SortHeight = SortHeights[m_UIResolutionSize];
 
     // Bind constant buffer
-    VkDescriptorBufferInfo GPUCB = m_pConstantBufferRing->AllocConstantBuffer(sizeof(ParallelSortRenderCB), (void*)&ConstantBuffer);
+    VkDescriptorBufferInfo GPUCB = AllocConstantBuffer(sizeof(ParallelSortRenderCB), (void*)&ConstantBuffer);
     BindConstantBuffer(GPUCB, m_RenderDescriptorSet0);
         
     // If we are showing unsorted values, need to transition the source data buffer from copy source to UAV and back
     int descriptorIndex = 0;
     if (!m_UIVisualOutput)
     {
-        VkBufferMemoryBarrier Barrier = BufferTransition(m_SrcKeyBuffers[m_UIResolutionSize], VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, sizeof(uint32_t) * NumKeys[m_UIResolutionSize]);
+        VkBufferMemoryBarrier Barrier = BufferTransition(m_SrcKeyBuffers[m_UIResolutionSize], VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, sizeof(uint32_t) * m_NumKeys[m_UIResolutionSize]);
         vkCmdPipelineBarrier(m_pUploadHeap->GetCommandList(), VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 1, &Barrier, 0, nullptr);
         descriptorIndex = m_UIResolutionSize;
     }
@@ -1148,7 +3393,7 @@ void FFXParallelSort::DrawVisualization(VkCommandBuffer commandList, uint32_t RT
     // If we are showing unsorted values, need to transition the source data buffer from copy source to UAV and back
     if (!m_UIVisualOutput)
     {
-        VkBufferMemoryBarrier Barrier = BufferTransition(m_SrcKeyBuffers[m_UIResolutionSize], VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT, sizeof(uint32_t) * NumKeys[m_UIResolutionSize]);
+        VkBufferMemoryBarrier Barrier = BufferTransition(m_SrcKeyBuffers[m_UIResolutionSize], VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT, sizeof(uint32_t) * m_NumKeys[m_UIResolutionSize]);
         vkCmdPipelineBarrier(m_pUploadHeap->GetCommandList(), VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 1, &Barrier, 0, nullptr);
     }
 }
\ No newline at end of file
@@ -19,6 +19,12 @@
 
 #pragma once
 #include "vulkan/vulkan.h"
+#include <future>
+#include <memory>
+#include <mutex>
+
+#include "../Common/StageTimings.h"
+#include "../Common/WorkerPool.h"
 
 using namespace CAULDRON_VK;
 
@@ -44,39 +50,211 @@ public:
     void OnCreate(Device* pDevice, ResourceViewHeaps* pResourceViewHeaps, DynamicBufferRing* pConstantBufferRing, UploadHeap* pUploadHeap, SwapChain* pSwapChain);
     void OnDestroy();
 
-    void Sort(VkCommandBuffer commandList, bool isBenchmarking, float benchmarkTime);
+    // The scratch and indirect buffers a sort writes to while it runs, and the descriptor sets its constants are bound through.
+    // Sorts recorded with an acquired context are plain direct sorts of the keys (and payload) handed to the context with
+    // SetSortContextBuffers(), none of the sample's modes, read-backs or timings apply to them. They only write the context's
+    // resources, so they can be recorded from several threads at once and run concurrently on the GPU (with each other and with
+    // the default context's sort).
+    struct SortContext
+    {
+        VkBuffer        ScratchBuffer;              // Sort scratch buffer
+        VmaAllocation   ScratchBufferAllocation;
+        VkBuffer        ReducedScratchBuffer;       // Sort reduced scratch buffer
+        VmaAllocation   ReducedScratchBufferAllocation;
+        VkBuffer        ScanBlockBuffer;            // Partial sums for reduced tables too big to scan in one thread group
+        VmaAllocation   ScanBlockBufferAllocation;
+        VkBuffer        IndirectConstantBuffer;     // Buffer to hold radix sort constant buffer data for indirect dispatch
+        VmaAllocation   IndirectConstantBufferAllocation;
+        VkBuffer        IndirectCountScatterArgs;   // Buffer to hold dispatch arguments used for Count/Scatter parts of the algorithm
+        VmaAllocation   IndirectCountScatterArgsAllocation;
+        VkBuffer        IndirectReduceScanArgs;     // Buffer to hold dispatch arguments used for Reduce/Scan parts of the algorithm
+        VmaAllocation   IndirectReduceScanArgsAllocation;
+
+        // Constant sets are rewritten every sort, so each has one per frame in flight
+        VkDescriptorSet DescriptorSetConstants[3];
+        VkDescriptorSet DescriptorSetConstantsIndirect[3];
+        VkDescriptorSet DescriptorSetConstantsSelect[3];
+        VkDescriptorSet DescriptorSetConstantsMerge[3];
+        VkDescriptorSet DescriptorSetConstantsValidate[3];
+        VkDescriptorSet DescriptorSetConstantsKeyRecords[3];
+        VkDescriptorSet DescriptorSetScanSets[5];
+        VkDescriptorSet DescriptorSetScratch;
+        VkDescriptorSet DescriptorSetIndirect;
+        VkDescriptorSet DescriptorSetInputOutput[2];    // Ping-pong over the context's key and payload buffers
+        VkBuffer        KeyBuffers[2] = {};         // Keys to sort and a temp buffer as big, the sorted keys end up in [0]
+        VkBuffer        PayloadBuffers[2] = {};     // Payload moved along with the keys (none when [0] is VK_NULL_HANDLE)
+        uint32_t        NumKeys = 0;                // Keys to sort, at most as many as the sample's biggest key set
+        uint32_t        FrameConstants = 0;         // Which of the constant sets the current sort uses
+        bool            bInUse = false;
+    };
+    // Thread safe. Hands out an unused context, creating a new one when they are all in use. Release it once the GPU is done
+    // with the sorts recorded with it.
+    SortContext* AcquireSortContext();
+    void ReleaseSortContext(SortContext* pContext);
+    // Points an acquired context's sorts at the keys (and payload) to sort. Not while the GPU is still using the context.
+    void SetSortContextBuffers(SortContext* pContext, uint32_t NumKeys, const VkBuffer KeyBuffers[2], const VkBuffer* pPayloadBuffers = nullptr);
+
+    // Sorts the sample's keys with the default context when none is given (one thread at a time, it updates the sample's state),
+    // or the context's keys. Thread safe for different acquired contexts (see SortContext).
+    void Sort(VkCommandBuffer commandList, bool isBenchmarking, float benchmarkTime, GPUTimestamps* pGPUTimer = nullptr, SortContext* pContext = nullptr);
     void CopySourceDataForFrame(VkCommandBuffer commandList);
     void DrawGui();
     void DrawVisualization(VkCommandBuffer commandList, uint32_t RTWidth, uint32_t RTHeight);
 
+    // Per-stage GPU timings. Stamps are only recorded when enabled and a GPUTimestamps is handed to Sort(), 
+    // they are named "FPS <Stage> <Shift>" and show up in the profiler and benchmark output like any other stamp.
+    // UpdateStageTimings() adds them back into sortLabel (the stamp closing the sort) so that one stays the whole sort
+    typedef StageTimings::Timing StageTiming;
+    void EnableStageTimings(bool enable) { m_UIStageTimings = enable; }
+    void UpdateStageTimings(std::vector<TimeStamp>& timeStamps, const char* sortLabel);
+    void GetStageTimings(std::vector<StageTiming>& stageTimings, bool perPass = false) const { m_StageTimings.Get(stageTimings, perPass); }
+
+    // Key distributions the sample can generate (all seeded so runs can be reproduced)
+    enum KeyDistribution
+    {
+        KeyDistribution_Permutation = 0,    // Shuffled 0..N-1 (what the visualization expects)
+        KeyDistribution_Uniform,            // Uniform random 32-bit keys
+        KeyDistribution_Sorted,             // 0..N-1 in order
+        KeyDistribution_ReverseSorted,      // N-1..0
+        KeyDistribution_NearlySorted,       // 0..N-1 with 1% of the keys swapped at random
+        KeyDistribution_FewUnique,          // 16 distinct random 32-bit values
+        KeyDistribution_Zipf,               // Zipf (s = 1) skewed draws from 64K distinct random 32-bit values
+        KeyDistribution_ConstantHighBits,   // Floats in [1, 2), sign and exponent bits never change
+
+        KeyDistribution_Count
+    };
+    static const char* GetKeyDistributionName(int Distribution);
+    static int GetKeyDistributionFromName(const std::string& Name);
+    static std::string GetKeyDataSuffix();
+
     // Temp -- For command line overrides
     static void OverrideKeySet(int ResolutionOverride);
     static void OverridePayload();
+    static void OverrideAsyncPipelineCreation();
+    static void OverrideStageTimings();
+    static void OverrideKeyDistribution(int Distribution);
+    static void OverrideKeySeed(uint32_t Seed);
+    static void OverrideNumKeys(uint32_t NumKeys);
+    static void OverrideMaxThreadGroups(uint32_t MaxThreadGroups);
+    static void OverrideKeyWords(uint32_t NumKeyWords);
+    static void OverrideTopK(uint32_t NumSelectKeys);
+    static void OverridePercentiles(const std::vector<float>& Percentiles);
+    static void OverridePresortCheck();
+    static void OverrideTemporalCoherence();
+    static void OverrideIncrementalSort(uint32_t DirtyKeyPercent);
+    static void OverrideOutOfCore(uint32_t NumKeys);
+    static void OverrideGPUValidation();
+    static void OverrideDeferredPayload();
+    static void OverrideKeyHooks();
+    static void OverrideKeyRecords(uint32_t StrideInBytes, uint32_t OffsetInBytes);
+    static void OverrideReadOnlyInput();
+    static void OverrideKeyBits(uint32_t KeyBits);
+    static void OverridePackedKeyIndex();
+    static void OverrideWaveSize(uint32_t WaveSize);
+    static void OverrideTileScatter();
+    static void OverrideRegisterCount();
+    static void OverrideMatchScatter();
     // Temp -- For command line overrides
 
 private:
+    // Pipelines are built on worker threads, so we hold on to the pending result until something needs it
+    typedef std::shared_future<VkPipeline> FPSPipeline;
+
     void CreateKeyPayloadBuffers();
-    void CompileRadixPipeline(const char* shaderFile, const DefineList* defines, const char* entryPoint, VkPipeline& pPipeline);
+    SortContext* CreateSortContext();
+    void DestroySortContext(SortContext& Context);
+    VkDescriptorBufferInfo AllocConstantBuffer(uint32_t Size, void* pData);
+    void UploadBufferData(VkBuffer Buffer, const uint32_t* pData, uint32_t NumValues);
+    FPSPipeline CompileRadixPipeline(const char* shaderFile, const DefineList* defines, const char* entryPoint);
+    void WaitForPipelines();
+    void StageTimeStamp(VkCommandBuffer commandList, GPUTimestamps* pGPUTimer, const char* stage, uint32_t shift);
+    uint32_t GetNumSelectKeys() const;
+    uint32_t GetNumSelectQueries() const;
+    void ReadBackPresortInversions(VkCommandBuffer commandList);
+    void ReadBackPercentiles(VkCommandBuffer commandList);
+    bool KeepsSortedKeys() const;
+    void SelectDigits(VkCommandBuffer commandList, GPUTimestamps* pStageTimer, const FFX_ParallelSortCB& ConstantBufferData, uint32_t NumThreadgroupsToRun, uint32_t NumReducedThreadgroupsToRun, SortContext& Context);
+    void SelectPercentiles(VkCommandBuffer commandList, GPUTimestamps* pStageTimer, SortContext& Context);
+    void SelectTopK(VkCommandBuffer commandList, GPUTimestamps* pStageTimer, uint32_t NumSelectKeys, SortContext& Context);
+    uint32_t GetNumDirtyKeys() const;
+    void GatherDirtyKeys(VkCommandBuffer commandList, GPUTimestamps* pStageTimer, uint32_t NumDirtyKeys, SortContext& Context);
+    void MergeDirtyKeys(VkCommandBuffer commandList, GPUTimestamps* pStageTimer, uint32_t NumDirtyKeys, SortContext& Context);
+    void SortOutOfCore(uint32_t NumOutOfCoreKeys);
+    void ValidateSort(VkCommandBuffer commandList, GPUTimestamps* pStageTimer, VkDescriptorSet& InputOutputSet, bool bHasPayload, bool b16BitKeys, bool bSorted, SortContext& Context);
+    void GatherPayload(VkCommandBuffer commandList, GPUTimestamps* pStageTimer, bool bIndirectDispatch, uint32_t NumThreadgroupsToRun, bool bCopyBack, SortContext& Context);
+    void PackKeyIndex(VkCommandBuffer commandList, GPUTimestamps* pStageTimer, bool bIndirectDispatch, uint32_t NumThreadgroupsToRun, uint32_t IndexBits, SortContext& Context);
+    void UnpackKeyIndex(VkCommandBuffer commandList, GPUTimestamps* pStageTimer, bool bIndirectDispatch, uint32_t NumThreadgroupsToRun, uint32_t IndexBits,
+                        VkDescriptorSet& InputOutputSet, VkBuffer KeyBuffer, VkBuffer IndexBuffer, SortContext& Context);
+    void WriteKeyRecords(VkCommandBuffer commandList, GPUTimestamps* pStageTimer, SortContext& Context);
+    void ReadGPUValidationResults();
+    void ReadGPUValidationResult(uint32_t Slot);
     void BindConstantBuffer(VkDescriptorBufferInfo& GPUCB, VkDescriptorSet& DescriptorSet, uint32_t Binding = 0, uint32_t Count = 1);
     void BindUAVBuffer(VkBuffer* pBuffer, VkDescriptorSet& DescriptorSet, uint32_t Binding = 0, uint32_t Count = 1);
 
     // Temp -- For command line overrides
     static int KeySetOverride;
     static bool PayloadOverride;
+    static bool AsyncPipelineOverride;
+    static bool StageTimingsOverride;
+    static int KeyDistributionOverride;
+    static uint32_t KeySeedOverride;
+    static uint32_t NumKeysOverride;
+    static uint32_t MaxThreadGroupsOverride;
+    static uint32_t KeyWordsOverride;
+    static uint32_t TopKOverride;
+    static std::vector<float> PercentilesOverride;
+    static bool PresortCheckOverride;
+    static bool TemporalCoherenceOverride;
+    static uint32_t IncrementalSortOverride;
+    static uint32_t OutOfCoreOverride;
+    static bool GPUValidationOverride;
+    static bool DeferredPayloadOverride;
+    static bool KeyHooksOverride;
+    static uint32_t KeyRecordStrideOverride;
+    static uint32_t KeyRecordOffsetOverride;
+    static bool ReadOnlyInputOverride;
+    static uint32_t KeyBitsOverride;
+    static bool PackedKeyIndexOverride;
+    static int WaveSizeOverride;
+    static bool TileScatterOverride;
+    static bool RegisterCountOverride;
+    static bool MatchScatterOverride;
     // Temp -- For command line overrides
 
+    // Key set holding the custom key count (after the 1080p, 2K and 4K ones)
+    static const uint32_t CustomKeySet = 3;
+
+    // Rolling history of per-stage timings
+    StageTimings m_StageTimings;
+
+    // Workers the pipeline permutations are compiled on
+    WorkerPool m_CompilePool;
+
     Device*                 m_pDevice = nullptr;
     UploadHeap*             m_pUploadHeap = nullptr;
     ResourceViewHeaps*      m_pResourceViewHeaps = nullptr;
     DynamicBufferRing*      m_pConstantBufferRing = nullptr;
     uint32_t                m_MaxNumThreadgroups = 800;
+    uint32_t                m_NumKeys[4] = { 1920 * 1080, 2560 * 1440, 3840 * 2160, 0 }; // Keys in each key set (the custom one is only filled in when a key count is requested)
+    uint32_t                m_NumKeySets = 3;       // 1080, 2K, 4K, and optionally a custom key count
+    uint32_t                m_MaxNumKeys = 0;       // Biggest key set (what the sort buffers are sized for)
+    uint32_t                m_NumKeyWords = 1;      // 32-bit words per key (stored as planes of words, least significant first)
+    uint32_t                m_KeyBits = 32;         // Bits used by single-word keys (a sort pass per 4 bits)
+    bool                    m_b16BitKeyStorage = false; // Whether keys of up to 16 bits can also be sorted as 16-bit values (needs 16-bit storage)
+    uint32_t                m_WaveSize = 0;         // Subgroup size the sort kernels are specialized for and require (0 when they look it up at run time)
+    bool                    m_bTileScatter = false; // Whether Scatter ranks a whole block at once instead of a row at a time
+    bool                    m_bMatchScatter = false; // Whether Scatter ranks keys by matching digits within each wave instead of sorting them in LDS
+    bool                    m_bRegisterCount = false; // Whether Count counts digits in registers instead of with LDS atomics
+    std::vector<float>      m_SelectPercentiles;    // Percentiles looked up by the percentile queries (one select query each)
 
     uint32_t                m_ScratchBufferSize;
     uint32_t                m_ReducedScratchBufferSize;
+    uint32_t                m_ScanBlockBufferSize;
+    uint32_t                m_SelectStateBufferSize;
     
     // Sample resources
-    VkBuffer                m_SrcKeyBuffers[3];     // 32 bit source key buffers (for 1080, 2K, 4K resolution)
-    VmaAllocation           m_SrcKeyBufferAllocations[3];
+    VkBuffer                m_SrcKeyBuffers[4];     // 32 bit source key buffers (for 1080, 2K, 4K resolution, and custom key count)
+    VmaAllocation           m_SrcKeyBufferAllocations[4];
 
     VkBuffer        m_SrcPayloadBuffers;    // 32 bit source payload buffers
     VmaAllocation   m_SrcPayloadBufferAllocation;
@@ -84,49 +262,131 @@ private:
     VkBuffer        m_DstKeyBuffers[2];     // 32 bit destination key buffers (when not doing in place writes)
     VmaAllocation   m_DstKeyBufferAllocations[2];
 
+    VkBuffer        m_SrcKey16Buffers[4];   // 16 bit source key buffers (only with 16-bit key storage)
+    VmaAllocation   m_SrcKey16BufferAllocations[4];
+
+    VkBuffer        m_DstKey16Buffers[2];   // 16 bit destination key buffers (only with 16-bit key storage)
+    VmaAllocation   m_DstKey16BufferAllocations[2];
+
     VkBuffer        m_DstPayloadBuffers[2]; // 32 bit destination payload buffers (when not doing in place writes)
     VmaAllocation   m_DstPayloadBufferAllocations[2];
 
-    VkBuffer        m_FPSScratchBuffer;             // Sort scratch buffer
-    VmaAllocation   m_FPSScratchBufferAllocation;
+    VkBuffer        m_DirtyKeyBuffers[2];   // Keys changed since last frame (incremental re-sort, sorted in place)
+    VmaAllocation   m_DirtyKeyBufferAllocations[2];
+
+    VkBuffer        m_DirtyPayloadBuffers[2];   // Payloads of the keys changed since last frame
+    VmaAllocation   m_DirtyPayloadBufferAllocations[2];
+
+    VkBuffer        m_DirtyIndexBuffer;     // Where the changed keys were in last frame's order
+    VmaAllocation   m_DirtyIndexBufferAllocation;
+
+    VkBuffer        m_PayloadIndexBuffer;   // Source indices carried through the passes by deferred payload gathers
+    VmaAllocation   m_PayloadIndexBufferAllocation;
+
+    VkBuffer        m_KeyRecordBuffer;      // Keys spread out into records (sorting a key field of an array of structs)
+    VmaAllocation   m_KeyRecordBufferAllocation;
+
+    VkBuffer        m_RunOffsetBuffer;      // Where each sorted run starts in an out-of-core merge window
+    VmaAllocation   m_RunOffsetBufferAllocation;
+
+    std::vector<std::unique_ptr<SortContext>> m_SortContexts;   // Pool of per-sort scratch, indirect and constant state
+    SortContext*    m_pDefaultSortContext = nullptr;            // Context Sort() uses when it isn't handed one
+    std::mutex      m_SortContextMutex;
+    std::mutex      m_ConstantBufferMutex;          // The constant buffer ring is shared by all contexts
 
-    VkBuffer        m_FPSReducedScratchBuffer;      // Sort reduced scratch buffer
-    VmaAllocation   m_FPSReducedScratchBufferAllocation;
+    VkBuffer        m_FPSSelectStateBuffer;         // Selection thresholds, compaction counters and percentiles (selected keys come first)
+    VmaAllocation   m_FPSSelectStateBufferAllocation;
 
     VkDescriptorSetLayout   m_SortDescriptorSetLayoutConstants;
-    VkDescriptorSet         m_SortDescriptorSetConstants[3];
     VkDescriptorSetLayout   m_SortDescriptorSetLayoutConstantsIndirect;
-    VkDescriptorSet         m_SortDescriptorSetConstantsIndirect[3];
 
     VkDescriptorSetLayout   m_SortDescriptorSetLayoutInputOutputs;
     VkDescriptorSetLayout   m_SortDescriptorSetLayoutScan;
     VkDescriptorSetLayout   m_SortDescriptorSetLayoutScratch;
     VkDescriptorSetLayout   m_SortDescriptorSetLayoutIndirect;
+    VkDescriptorSetLayout   m_SortDescriptorSetLayoutDirty;
+    VkDescriptorSetLayout   m_SortDescriptorSetLayoutRunOffsets;
 
     VkDescriptorSet         m_SortDescriptorSetInputOutput[2];
-    VkDescriptorSet         m_SortDescriptorSetScanSets[2];
-    VkDescriptorSet         m_SortDescriptorSetScratch;
-    VkDescriptorSet         m_SortDescriptorSetIndirect;
+    VkDescriptorSet         m_SortDescriptorSetDirtyInputOutput[2];
+    VkDescriptorSet         m_SortDescriptorSetPayloadIndexInputOutput[2];
+    VkDescriptorSet         m_SortDescriptorSetGatherPayload;
+    VkDescriptorSet         m_SortDescriptorSetKeyRecordsInputOutput;
+    VkDescriptorSet         m_SortDescriptorSetWriteKeyRecords;
+    VkDescriptorSet         m_SortDescriptorSet16BitInputOutput[2];
+    VkDescriptorSet         m_SortDescriptorSetDirty;
+    VkDescriptorSet         m_SortDescriptorSetRunOffsets;
     VkPipelineLayout        m_SortPipelineLayout;
 
-    VkPipeline m_FPSCountPipeline;
-    VkPipeline m_FPSCountReducePipeline;
-    VkPipeline m_FPSScanPipeline;
-    VkPipeline m_FPSScanAddPipeline;
-    VkPipeline m_FPSScatterPipeline;
-    VkPipeline m_FPSScatterPayloadPipeline;
+    FPSPipeline m_FPSCountPipeline;
+    FPSPipeline m_FPSCountReducePipeline;
+    FPSPipeline m_FPSScanPipeline;
+    FPSPipeline m_FPSScanAddPipeline;
+    FPSPipeline m_FPSReduceScanAddPipeline;
+    FPSPipeline m_FPSScanBlockReducePipeline;
+    FPSPipeline m_FPSScanBlockSumsPipeline;
+    FPSPipeline m_FPSScanBlockAddPipeline;
+    FPSPipeline m_FPSScatterPipeline;
+    FPSPipeline m_FPSScatterPayloadPipeline;
+    FPSPipeline m_FPSScatterIndexPipeline;
+    FPSPipeline m_FPSGatherPayloadPipeline;
+    FPSPipeline m_FPSPackKeyIndexPipeline;
+    FPSPipeline m_FPSUnpackKeyIndexPipeline;
+    FPSPipeline m_FPSCountLoadKeyPipeline;
+    FPSPipeline m_FPSScatterLoadKeyPipeline;
+    FPSPipeline m_FPSScatterLoadKeyPayloadPipeline;
+    FPSPipeline m_FPSScatterStoreKeyPipeline;
+    FPSPipeline m_FPSScatterStoreKeyPayloadPipeline;
+    FPSPipeline m_FPSWriteKeyRecordsPipeline;
+    FPSPipeline m_FPSCountKeyRecordsPipeline;
+    FPSPipeline m_FPSScatterKeyRecordsPipeline;
+    FPSPipeline m_FPSScatterKeyRecordsPayloadPipeline;
+    FPSPipeline m_FPSCountReadOnlyPipeline;
+    FPSPipeline m_FPSScatterReadOnlyPipeline;
+    FPSPipeline m_FPSScatterReadOnlyPayloadPipeline;
+    FPSPipeline m_FPSCount16BitPipeline;
+    FPSPipeline m_FPSScatter16BitPipeline;
+    FPSPipeline m_FPSScatter16BitPayloadPipeline;
+    FPSPipeline m_FPSSelectCountPipeline;
+    FPSPipeline m_FPSSelectReducePipeline;
+    FPSPipeline m_FPSSelectDigitPipeline;
+    FPSPipeline m_FPSSelectCompactPipeline;
+    FPSPipeline m_FPSSelectCompactPayloadPipeline;
+    FPSPipeline m_FPSGenerateDirtyKeysPipeline;
+    FPSPipeline m_FPSGatherDirtyPayloadPipeline;
+    FPSPipeline m_FPSMergePipeline;
+    FPSPipeline m_FPSMergePayloadPipeline;
+    FPSPipeline m_FPSMergeRunsPipeline;
 
     // Resources for indirect execution of algorithm
     VkBuffer        m_IndirectKeyCounts;            // Buffer to hold num keys for indirect dispatch
     VmaAllocation   m_IndirectKeyCountsAllocation;
-    VkBuffer        m_IndirectConstantBuffer;       // Buffer to hold radix sort constant buffer data for indirect dispatch
-    VmaAllocation   m_IndirectConstantBufferAllocation;
-    VkBuffer        m_IndirectCountScatterArgs;     // Buffer to hold dispatch arguments used for Count/Scatter parts of the algorithm
-    VmaAllocation   m_IndirectCountScatterArgsAllocation;
-    VkBuffer        m_IndirectReduceScanArgs;       // Buffer to hold dispatch arguments used for Reduce/Scan parts of the algorithm
-    VmaAllocation   m_IndirectReduceScanArgsAllocation;
+    VkBuffer        m_PresortStateBuffer;           // Inversion counts for skipping sorts of keys that are already in order
+    VmaAllocation   m_PresortStateBufferAllocation;
+    VkBuffer        m_PresortReadBackBuffer;        // Ring of inversion counts found by the presort checks (persistently mapped)
+    VmaAllocation   m_PresortReadBackBufferAllocation;
+    uint32_t*       m_pPresortInversions = nullptr;
+    VkBuffer        m_PercentileReadBackBuffer;     // Ring of keys found by the percentile queries (persistently mapped)
+    VmaAllocation   m_PercentileReadBackBufferAllocation;
+    uint32_t*       m_pPercentileResults = nullptr;
+    VkBuffer        m_ValidateStateBuffer;          // GPU validation checksums and result record
+    VmaAllocation   m_ValidateStateBufferAllocation;
+    VkBuffer        m_ValidateReadBackBuffer;       // Ring of GPU validation result records (persistently mapped)
+    VmaAllocation   m_ValidateReadBackBufferAllocation;
+    uint32_t*       m_pValidateResults = nullptr;
         
-    VkPipeline                  m_FPSIndirectSetupParametersPipeline;
+    FPSPipeline                 m_FPSIndirectSetupParametersPipeline;
+    FPSPipeline                 m_FPSIndirectSetupPresortPipeline;
+    FPSPipeline                 m_FPSCountInversionsPipeline;
+    FPSPipeline                 m_FPSValidateInputPipeline;
+    FPSPipeline                 m_FPSValidateInputPayloadPipeline;
+    FPSPipeline                 m_FPSValidateOutputPipeline;
+    FPSPipeline                 m_FPSValidateOutputPayloadPipeline;
+    FPSPipeline                 m_FPSValidateResultPipeline;
+    FPSPipeline                 m_FPSValidateInput16BitPipeline;
+    FPSPipeline                 m_FPSValidateInput16BitPayloadPipeline;
+    FPSPipeline                 m_FPSValidateOutput16BitPipeline;
+    FPSPipeline                 m_FPSValidateOutput16BitPayloadPipeline;
 
     // Resources for verification render
     Texture                     m_Validate4KTexture;
@@ -147,6 +407,44 @@ private:
     // Options for UI and test to run
     int m_UIResolutionSize = 0;
     bool m_UISortPayload = false;
+    bool m_UIDeferredPayload = false;
+    bool m_UIKeyHooks = false;
+    bool m_UIKeyRecords = false;
+    bool m_UIReadOnlyInput = false;
+    bool m_UI16BitKeys = false;
+    bool m_UIPackedKeyIndex = false;
     bool m_UIIndirectSort = false;
     int m_UIVisualOutput = 0;
+    bool m_UIStageTimings = false;
+    bool m_UISelectTopK = false;
+    int m_UISelectNumKeys = 4096;
+    bool m_UISelectPercentiles = false;
+    static const uint32_t ReadBackLatency = 3;          // Frames before a result copied back from the GPU is looked at (the frames in flight)
+    bool m_UIPresortCheck = false;
+    uint32_t m_NumPresortChecks = 0;        // Presort checks recorded so far (picks their read-back slot)
+    uint32_t m_PresortCheckFrame[ReadBackLatency] = {};   // Frame each read-back slot's inversion count was copied in
+    uint32_t m_LastPresortInversions = 0;   // Out of order neighbours found by the latest presort check that was read back
+    uint32_t m_NumPercentileReadBacks = 0;  // Percentile selections recorded so far (picks their read-back slot)
+    uint32_t m_PercentileReadBackFrame[ReadBackLatency] = {};   // Frame each read-back slot's keys were copied in
+    int m_PercentileReadBackKeySet[ReadBackLatency] = {};       // Key set each read-back slot's keys were selected from (-1 if the keys were changed)
+    std::vector<uint32_t> m_PercentileKeys;   // Keys found by the latest percentile selection that was read back
+    int m_PercentileKeySet = -1;              // Key set they were selected from
+    std::vector<uint32_t> m_ExpectedPercentileKeys[4];  // What the CPU finds for each percentile of each key set (single word keys only)
+    bool m_UITemporalCoherence = false;
+    int m_TemporalKeySet = -1;          // Key set last frame's sorted keys came from (re-sorted in place with temporal coherence)
+    int m_KeyRecordSet = -1;            // Key set the key records were written for
+    bool m_UIIncrementalSort = false;
+    int m_UIDirtyKeyPercent = 2;
+    bool m_bSortedKeysInPlace = false;  // Whether the sort buffers hold last frame's sorted keys (what the incremental re-sort merges into)
+    uint32_t m_DirtyKeySeed = 0;        // Changes every frame so different keys get changed
+    uint32_t m_OutOfCoreChunkKeys = 0;  // Keys in the out-of-core chunk being sorted (0 outside of out-of-core sorts)
+    bool m_UIGPUValidation = false;
+    static const uint32_t GPUValidationSlots = 8;       // Read-back slots for GPU validation result records (room for a few validated sorts a frame)
+    uint32_t m_FrameCount = 0;                          // Frames started so far (tells when a read-back slot's copy has landed)
+    uint32_t m_GPUValidationSlot = 0;                   // Slot the next validated sort copies its result record into
+    bool m_bGPUValidationPending[GPUValidationSlots] = {};
+    uint32_t m_GPUValidationSlotFrame[GPUValidationSlots] = {};  // Frame each pending record was copied in
+    uint32_t m_NumGPUValidations = 0;
+    uint32_t m_NumGPUValidationFailures = 0;
+    std::string m_LastGPUValidationFailure;
 };
\ No newline at end of file
@@ -148,13 +148,14 @@ void Renderer::OnRender(const UIState* pState, SwapChain* pSwapChain, float Time
     }
 
     m_GPUTimer.OnBeginFrame(cmdBuf1, &m_TimeStamps);
+    m_ParallelSort.UpdateStageTimings(m_TimeStamps, "FFX Parallel Sort");
 
     // Copy the data to sort for the frame (don't time this -- external to process)
     m_ParallelSort.CopySourceDataForFrame(cmdBuf1);
     m_GPUTimer.GetTimeStamp(cmdBuf1, "Begin Frame");
 
     // Do sort tests -----------------------------------------------------------------------
-    m_ParallelSort.Sort(cmdBuf1, bIsBenchmarking, Time);
+    m_ParallelSort.Sort(cmdBuf1, bIsBenchmarking, Time, &m_GPUTimer);
     m_GPUTimer.GetTimeStamp(cmdBuf1, "FFX Parallel Sort");
 
     // submit command buffer #1
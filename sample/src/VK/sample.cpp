@@ -22,6 +22,7 @@
 
 #include <shellapi.h>
 #include <cassert>
+#include <sstream>
 
 //--------------------------------------------------------------------------------------
 //
@@ -77,6 +78,29 @@ void Sample::OnParseCommandLine(LPSTR lpCmdLine, uint32_t* pWidth, uint32_t* pHe
     json globals = m_jsonConfigFile["globals"];
     process(globals);
 
+    // Read the sort data settings
+    if (m_jsonConfigFile.find("ParallelSortSettings") != m_jsonConfigFile.end())
+    {
+        json sortSettings = m_jsonConfigFile["ParallelSortSettings"];
+        int keyDistribution = FFXParallelSort::GetKeyDistributionFromName(sortSettings.value("keyDistribution", std::string("permutation")));
+        assert(keyDistribution >= 0 && "Unknown keyDistribution in FFXParallelSort.json");
+        if (keyDistribution >= 0)
+            FFXParallelSort::OverrideKeyDistribution(keyDistribution);
+        FFXParallelSort::OverrideKeySeed(sortSettings.value("keySeed", 0x5eedu));
+        uint32_t numKeys = sortSettings.value("numKeys", 0u);
+        if (numKeys)
+            FFXParallelSort::OverrideNumKeys(numKeys);
+        uint32_t keyWords = sortSettings.value("keyWords", 0u);
+        if (keyWords)
+            FFXParallelSort::OverrideKeyWords(keyWords);
+        uint32_t topK = sortSettings.value("topK", 0u);
+        if (topK)
+            FFXParallelSort::OverrideTopK(topK);
+        std::vector<float> percentiles = sortSettings.value("percentiles", std::vector<float>());
+        if (!percentiles.empty())
+            FFXParallelSort::OverridePercentiles(percentiles);
+    }
+
     // Process the command line to see if we need to do anything for the sample (i.e. benchmarking, setup certain settings, etc.)
     std::string charString = lpCmdLine;
     if (!charString.compare(""))
@@ -103,14 +127,90 @@ void Sample::OnParseCommandLine(LPSTR lpCmdLine, uint32_t* pWidth, uint32_t* pHe
         // Set num keys to sort
         else if (!wideString.compare(L"-keyset"))
         {
-            assert(ArgCount > CurrentArg + 1 && "Incorrect usage of -keyset <0-2>");
+            assert(ArgCount > CurrentArg + 1 && "Incorrect usage of -keyset <0-3>");
             // Get the parameter
             int keySet = std::stoi(ArgList[CurrentArg + 1]);
-            assert(keySet >= 0 && keySet < 3 && "Incorrect usage of -keyset <0-2>");
+            assert(keySet >= 0 && keySet < 4 && "Incorrect usage of -keyset <0-3>");
             FFXParallelSort::OverrideKeySet(keySet);
             CurrentArg += 2;
         }
 
+        // Sort a custom number of keys (added as key set 3)
+        else if (!wideString.compare(L"-numkeys"))
+        {
+            assert(ArgCount > CurrentArg + 1 && "Incorrect usage of -numkeys <count>");
+            // Get the parameter
+            uint32_t numKeys = (uint32_t)std::stoul(ArgList[CurrentArg + 1]);
+            assert(numKeys > 0 && "Incorrect usage of -numkeys <count>");
+            FFXParallelSort::OverrideNumKeys(numKeys);
+            CurrentArg += 2;
+        }
+
+        // Cap on the number of thread groups used by count/scatter (big values exercise the multi-level scan, clamped to 65535)
+        else if (!wideString.compare(L"-maxthreadgroups"))
+        {
+            assert(ArgCount > CurrentArg + 1 && "Incorrect usage of -maxthreadgroups <count>");
+            uint32_t maxThreadGroups = (uint32_t)std::stoul(ArgList[CurrentArg + 1]);
+            assert(maxThreadGroups > 0 && "Incorrect usage of -maxthreadgroups <count>");
+            FFXParallelSort::OverrideMaxThreadGroups(maxThreadGroups);
+            CurrentArg += 2;
+        }
+
+        // Number of 32-bit words per key (wider keys take 8 radix passes per extra word)
+        else if (!wideString.compare(L"-keywords"))
+        {
+            assert(ArgCount > CurrentArg + 1 && "Incorrect usage of -keywords <1-4>");
+            uint32_t keyWords = (uint32_t)std::stoul(ArgList[CurrentArg + 1]);
+            assert(keyWords >= 1 && keyWords <= 4 && "Incorrect usage of -keywords <1-4>");
+            FFXParallelSort::OverrideKeyWords(keyWords);
+            CurrentArg += 2;
+        }
+
+        // Only keep (and sort) the given number of smallest keys
+        else if (!wideString.compare(L"-topk"))
+        {
+            assert(ArgCount > CurrentArg + 1 && "Incorrect usage of -topk <count>");
+            uint32_t topK = (uint32_t)std::stoul(ArgList[CurrentArg + 1]);
+            assert(topK > 0 && "Incorrect usage of -topk <count>");
+            FFXParallelSort::OverrideTopK(topK);
+            CurrentArg += 2;
+        }
+
+        // Look up the keys at the given percentiles instead of sorting (comma separated, each in [0, 1])
+        else if (!wideString.compare(L"-percentiles"))
+        {
+            assert(ArgCount > CurrentArg + 1 && "Incorrect usage of -percentiles <p0,p1,...>");
+            std::wstringstream percentileList(ArgList[CurrentArg + 1]);
+            std::wstring percentile;
+            std::vector<float> percentiles;
+            while (std::getline(percentileList, percentile, L','))
+                percentiles.push_back(std::stof(percentile));
+            assert(!percentiles.empty() && "Incorrect usage of -percentiles <p0,p1,...>");
+            FFXParallelSort::OverridePercentiles(percentiles);
+            CurrentArg += 2;
+        }
+
+        // Set the key distribution to sort
+        else if (!wideString.compare(L"-keydistribution"))
+        {
+            assert(ArgCount > CurrentArg + 1 && "Incorrect usage of -keydistribution <name>");
+            // Get the parameter
+            std::wstring distributionName = ArgList[CurrentArg + 1];
+            int keyDistribution = FFXParallelSort::GetKeyDistributionFromName(std::string(distributionName.begin(), distributionName.end()));
+            assert(keyDistribution >= 0 && "Incorrect usage of -keydistribution <name>");
+            if (keyDistribution >= 0)
+                FFXParallelSort::OverrideKeyDistribution(keyDistribution);
+            CurrentArg += 2;
+        }
+
+        // Set the seed used to generate keys
+        else if (!wideString.compare(L"-seed"))
+        {
+            assert(ArgCount > CurrentArg + 1 && "Incorrect usage of -seed <value>");
+            FFXParallelSort::OverrideKeySeed((uint32_t)std::stoul(ArgList[CurrentArg + 1]));
+            CurrentArg += 2;
+        }
+
         // Set payload sort
         else if (!wideString.compare(L"-payload"))
         {
@@ -118,6 +218,130 @@ void Sample::OnParseCommandLine(LPSTR lpCmdLine, uint32_t* pWidth, uint32_t* pHe
             ++CurrentArg;
         }
 
+        // Set payload sort with a deferred payload gather
+        else if (!wideString.compare(L"-deferredpayload"))
+        {
+            FFXParallelSort::OverrideDeferredPayload();
+            ++CurrentArg;
+        }
+
+        // Load and store the keys through the sample's key hooks
+        else if (!wideString.compare(L"-keyhooks"))
+        {
+            FFXParallelSort::OverrideKeyHooks();
+            ++CurrentArg;
+        }
+
+        // Sort keys that are a field of bigger records (record size and where the key is in each, in bytes)
+        else if (!wideString.compare(L"-keyrecords"))
+        {
+            assert(ArgCount > CurrentArg + 2 && "Incorrect usage of -keyrecords <StrideInBytes> <OffsetInBytes>");
+            FFXParallelSort::OverrideKeyRecords((uint32_t)std::stoul(ArgList[CurrentArg + 1]), (uint32_t)std::stoul(ArgList[CurrentArg + 2]));
+            CurrentArg += 3;
+        }
+
+        // Have count and scatter read the sort buffers through read-only views
+        else if (!wideString.compare(L"-readonlyinput"))
+        {
+            FFXParallelSort::OverrideReadOnlyInput();
+            ++CurrentArg;
+        }
+
+        // Sort keys narrower than 32 bits (16-bit keys are stored as 16-bit values where the device supports it)
+        else if (!wideString.compare(L"-keybits"))
+        {
+            assert(ArgCount > CurrentArg + 1 && "Incorrect usage of -keybits <NumBits>");
+            FFXParallelSort::OverrideKeyBits((uint32_t)std::stoul(ArgList[CurrentArg + 1]));
+            CurrentArg += 2;
+        }
+
+        // Carry the source indices in the low bits of narrow keys instead of sorting a payload
+        else if (!wideString.compare(L"-packedkeyindex"))
+        {
+            FFXParallelSort::OverridePackedKeyIndex();
+            ++CurrentArg;
+        }
+
+        // Build the kernels for the given wave size (32 or 64, when the device can require it), or 0 for the unspecialized ones
+        else if (!wideString.compare(L"-wavesize"))
+        {
+            assert(ArgCount > CurrentArg + 1 && "Incorrect usage of -wavesize <0|32|64>");
+            FFXParallelSort::OverrideWaveSize((uint32_t)std::stoul(ArgList[CurrentArg + 1]));
+            CurrentArg += 2;
+        }
+
+        // Have Scatter rank a whole block of keys at once instead of a row at a time
+        else if (!wideString.compare(L"-tilescatter"))
+        {
+            FFXParallelSort::OverrideTileScatter();
+            ++CurrentArg;
+        }
+
+        // Have Count count digits in registers instead of with LDS atomics
+        else if (!wideString.compare(L"-registercount"))
+        {
+            FFXParallelSort::OverrideRegisterCount();
+            ++CurrentArg;
+        }
+
+        // Have Scatter rank keys by matching digits across each wave instead of sorting them in LDS (not with -tilescatter)
+        else if (!wideString.compare(L"-matchscatter"))
+        {
+            FFXParallelSort::OverrideMatchScatter();
+            ++CurrentArg;
+        }
+
+        // Skip the sort on the GPU when the keys are already in order
+        else if (!wideString.compare(L"-presortcheck"))
+        {
+            FFXParallelSort::OverridePresortCheck();
+            ++CurrentArg;
+        }
+
+        // Keep sorting last frame's result instead of resetting the keys each frame
+        else if (!wideString.compare(L"-temporal"))
+        {
+            FFXParallelSort::OverrideTemporalCoherence();
+            ++CurrentArg;
+        }
+
+        // Change the given percentage of last frame's sorted keys each frame and merge them back in instead of sorting everything
+        else if (!wideString.compare(L"-incremental"))
+        {
+            assert(ArgCount > CurrentArg + 1 && "Incorrect usage of -incremental <percent>");
+            FFXParallelSort::OverrideIncrementalSort((uint32_t)std::stoul(ArgList[CurrentArg + 1]));
+            CurrentArg += 2;
+        }
+
+        // Sort the given number of keys out of core at startup (in chunks that fit the sort buffers, merged on the GPU)
+        else if (!wideString.compare(L"-outofcore"))
+        {
+            assert(ArgCount > CurrentArg + 1 && "Incorrect usage of -outofcore <NumKeys>");
+            FFXParallelSort::OverrideOutOfCore((uint32_t)std::stoul(ArgList[CurrentArg + 1]));
+            CurrentArg += 2;
+        }
+
+        // Check every sort on the GPU (order and checksums), reading the results back a few frames later
+        else if (!wideString.compare(L"-gpuvalidate"))
+        {
+            FFXParallelSort::OverrideGPUValidation();
+            ++CurrentArg;
+        }
+
+        // Build sort pipelines in the background instead of blocking OnCreate
+        else if (!wideString.compare(L"-asyncpipelines"))
+        {
+            FFXParallelSort::OverrideAsyncPipelineCreation();
+            ++CurrentArg;
+        }
+
+        // Time every stage of every sort pass (also adds the stages to the benchmark results)
+        else if (!wideString.compare(L"-stagetimings"))
+        {
+            FFXParallelSort::OverrideStageTimings();
+            ++CurrentArg;
+        }
+
         else
         {
             assert(false && "Unsupported command line parameter");
@@ -147,7 +371,15 @@ void Sample::OnCreate()
         std::string deviceName;
         std::string driverVersion;
         m_device.GetDeviceInfo(&deviceName, &driverVersion);
-        BenchmarkConfig(m_jsonConfigFile["BenchmarkSettings"], -1, nullptr, deviceName, driverVersion);
+
+        // Tag the results with the key distribution and seed so the run can be reproduced
+        json benchmarkSettings = m_jsonConfigFile["BenchmarkSettings"];
+        std::string resultsFilename = benchmarkSettings.value("resultsFilename", std::string("FFXParallelSort.csv"));
+        size_t extension = resultsFilename.rfind('.');
+        resultsFilename.insert(extension == std::string::npos ? resultsFilename.size() : extension, FFXParallelSort::GetKeyDataSuffix());
+        benchmarkSettings["resultsFilename"] = resultsFilename;
+
+        BenchmarkConfig(benchmarkSettings, -1, nullptr, deviceName, driverVersion);
     }
 
     // Init GUI (non gfx stuff)